@@ -0,0 +1,44 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <sdkconfig.h>
+#include "esp_app_trace.h"
+#include "esp_heap_profiler.h"
+
+#ifdef CONFIG_HEAP_PROFILER
+
+#define HEAP_PROFILE_MAGIC 0x46525048 /* "HPRF" */
+
+esp_err_t heap_profiler_dump_tohost(uint32_t tmo)
+{
+    size_t count = heap_profiler_get_site_count();
+    heap_profiler_site_t site;
+    uint32_t header[4] = {
+        HEAP_PROFILE_MAGIC, heap_profiler_get_sample_interval(), count, heap_profiler_get_dropped_count()
+    };
+
+    esp_err_t err = esp_apptrace_write(ESP_APPTRACE_DEST_TRAX, header, sizeof(header), tmo);
+    for (size_t i = 0; i < count && err == ESP_OK; i++) {
+        if (heap_profiler_get_site(i, &site) != ESP_OK) {
+            memset(&site, 0, sizeof(site)); /* sites are never removed, but keep the record count right */
+        }
+        err = esp_apptrace_write(ESP_APPTRACE_DEST_TRAX, &site, sizeof(site), tmo);
+    }
+    if (err == ESP_OK) {
+        err = esp_apptrace_flush(ESP_APPTRACE_DEST_TRAX, tmo);
+    }
+    return err;
+}
+
+#endif // CONFIG_HEAP_PROFILER
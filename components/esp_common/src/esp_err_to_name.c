@@ -212,6 +212,10 @@ static const esp_err_msg_t esp_err_msg_table[] = {
     ERR_TBL_IT(ESP_ERR_NVS_CONTENT_DIFFERS),                    /*  4376 0x1118 Internal error; never returned by nvs
                                                                                 API functions.  NVS key is different in
                                                                                 comparison */
+#   endif
+#   ifdef      ESP_ERR_NVS_BLOB_STREAM_OPEN
+    ERR_TBL_IT(ESP_ERR_NVS_BLOB_STREAM_OPEN),                   /*  4377 0x1119 The key is being written by a blob
+                                                                                stream which hasn't been closed yet */
 #   endif
     // components/ulp/include/ulp_common.h
 #   ifdef      ESP_ERR_ULP_BASE
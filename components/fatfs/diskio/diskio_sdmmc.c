@@ -12,17 +12,191 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
 #include "diskio_impl.h"
+#include "diskio_sdmmc.h"
 #include "ffconf.h"
 #include "ff.h"
 #include "sdmmc_cmd.h"
 #include "esp_log.h"
 #include "esp_compiler.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#define STREAM_BUF_COUNT    2
+
+typedef struct {
+    BYTE* data;
+    DWORD sector;               // first sector in the buffer
+    UINT count;                 // number of sectors in the buffer
+} stream_buf_t;
+
+typedef struct {
+    BYTE pdrv;
+    UINT capacity;              // size of each buffer, in sectors
+    stream_buf_t bufs[STREAM_BUF_COUNT];
+    stream_buf_t* fill;         // buffer being filled, not yet passed to the writer task
+    QueueHandle_t free_queue;   // buffers which can be filled
+    QueueHandle_t write_queue;  // buffers to be written; NULL stops the writer task
+    TaskHandle_t task;
+    SemaphoreHandle_t task_done; // given by the writer task when it exits
+    volatile esp_err_t err;     // first failed write, reported by the next operation
+    ff_sdmmc_write_cb_t on_write_done;
+    void* arg;
+} stream_t;
 
 static sdmmc_card_t* s_cards[FF_VOLUMES] = { NULL };
+static stream_t* s_streams[FF_VOLUMES] = { NULL };
 
 static const char* TAG = "diskio_sdmmc";
 
+static void stream_task(void* arg)
+{
+    stream_t* stream = (stream_t*) arg;
+    sdmmc_card_t* card = s_cards[stream->pdrv];
+    stream_buf_t* buf;
+    while (xQueueReceive(stream->write_queue, &buf, portMAX_DELAY) == pdTRUE && buf != NULL) {
+        esp_err_t err = sdmmc_write_sectors_pre_erase(card, buf->data, buf->sector, buf->count);
+        if (unlikely(err != ESP_OK)) {
+            ESP_LOGE(TAG, "sdmmc_write_blocks failed (%d)", err);
+            if (stream->err == ESP_OK) {
+                stream->err = err;
+            }
+        }
+        if (stream->on_write_done) {
+            stream->on_write_done(stream->pdrv, buf->sector, buf->count, err, stream->arg);
+        }
+        xQueueSend(stream->free_queue, &buf, portMAX_DELAY);
+    }
+    xSemaphoreGive(stream->task_done);
+    vTaskDelete(NULL);
+}
+
+static void stream_submit(stream_t* stream)
+{
+    if (stream->fill != NULL) {
+        xQueueSend(stream->write_queue, &stream->fill, portMAX_DELAY);
+        stream->fill = NULL;
+    }
+}
+
+/* Pass the partially filled buffer to the writer task and wait until all buffers are written */
+static esp_err_t stream_flush(stream_t* stream)
+{
+    stream_submit(stream);
+    stream_buf_t* bufs[STREAM_BUF_COUNT];
+    for (int i = 0; i < STREAM_BUF_COUNT; i++) {
+        xQueueReceive(stream->free_queue, &bufs[i], portMAX_DELAY);
+    }
+    for (int i = 0; i < STREAM_BUF_COUNT; i++) {
+        xQueueSend(stream->free_queue, &bufs[i], portMAX_DELAY);
+    }
+    esp_err_t err = stream->err;
+    stream->err = ESP_OK;
+    return err;
+}
+
+static DRESULT stream_write(stream_t* stream, const BYTE* buff, DWORD sector, UINT count)
+{
+    if (unlikely(stream->err != ESP_OK)) {
+        stream->err = ESP_OK;
+        return RES_ERROR;
+    }
+    const size_t sector_size = s_cards[stream->pdrv]->csd.sector_size;
+    while (count > 0) {
+        if (stream->fill != NULL && sector != stream->fill->sector + stream->fill->count) {
+            stream_submit(stream);
+        }
+        if (stream->fill == NULL) {
+            xQueueReceive(stream->free_queue, &stream->fill, portMAX_DELAY);
+            stream->fill->sector = sector;
+            stream->fill->count = 0;
+        }
+        stream_buf_t* buf = stream->fill;
+        UINT n = MIN(count, stream->capacity - buf->count);
+        memcpy(buf->data + buf->count * sector_size, buff, n * sector_size);
+        buf->count += n;
+        buff += n * sector_size;
+        sector += n;
+        count -= n;
+        if (buf->count == stream->capacity) {
+            stream_submit(stream);
+        }
+    }
+    return RES_OK;
+}
+
+static void stream_delete(stream_t* stream)
+{
+    if (stream->task != NULL) {
+        stream_buf_t* stop = NULL;
+        xQueueSend(stream->write_queue, &stop, portMAX_DELAY);
+        // not a task notification, one may already be pending for the calling task
+        xSemaphoreTake(stream->task_done, portMAX_DELAY);
+    }
+    if (stream->task_done != NULL) {
+        vSemaphoreDelete(stream->task_done);
+    }
+    if (stream->write_queue != NULL) {
+        vQueueDelete(stream->write_queue);
+    }
+    if (stream->free_queue != NULL) {
+        vQueueDelete(stream->free_queue);
+    }
+    for (int i = 0; i < STREAM_BUF_COUNT; i++) {
+        free(stream->bufs[i].data);
+    }
+    free(stream);
+}
+
+static esp_err_t stream_create(BYTE pdrv, const ff_sdmmc_streaming_config_t* config, stream_t** out_stream)
+{
+    const size_t sector_size = s_cards[pdrv]->csd.sector_size;
+    UINT capacity = config->buffer_size / sector_size;
+    if (capacity == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stream_t* stream = calloc(1, sizeof(stream_t));
+    if (stream == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    stream->pdrv = pdrv;
+    stream->capacity = capacity;
+    stream->on_write_done = config->on_write_done;
+    stream->arg = config->arg;
+    stream->free_queue = xQueueCreate(STREAM_BUF_COUNT, sizeof(stream_buf_t*));
+    // one more slot for the stop request
+    stream->write_queue = xQueueCreate(STREAM_BUF_COUNT + 1, sizeof(stream_buf_t*));
+    stream->task_done = xSemaphoreCreateBinary();
+    if (stream->free_queue == NULL || stream->write_queue == NULL || stream->task_done == NULL) {
+        goto fail;
+    }
+    for (int i = 0; i < STREAM_BUF_COUNT; i++) {
+        stream_buf_t* buf = &stream->bufs[i];
+        buf->data = heap_caps_malloc(capacity * sector_size, MALLOC_CAP_DMA);
+        if (buf->data == NULL) {
+            goto fail;
+        }
+        xQueueSend(stream->free_queue, &buf, 0);
+    }
+    if (xTaskCreate(stream_task, "sdmmc_stream", config->task_stack_size, stream,
+                    config->task_priority, &stream->task) != pdPASS) {
+        stream->task = NULL;
+        goto fail;
+    }
+    *out_stream = stream;
+    return ESP_OK;
+
+fail:
+    stream_delete(stream);
+    return ESP_ERR_NO_MEM;
+}
+
 DSTATUS ff_sdmmc_initialize (BYTE pdrv)
 {
     return 0;
@@ -37,6 +211,13 @@ DRESULT ff_sdmmc_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
 {
     sdmmc_card_t* card = s_cards[pdrv];
     assert(card);
+    stream_t* stream = s_streams[pdrv];
+    if (stream != NULL) {
+        // card can't be read while the writer task is using it
+        if (unlikely(stream_flush(stream) != ESP_OK)) {
+            return RES_ERROR;
+        }
+    }
     esp_err_t err = sdmmc_read_sectors(card, buff, sector, count);
     if (unlikely(err != ESP_OK)) {
         ESP_LOGE(TAG, "sdmmc_read_blocks failed (%d)", err);
@@ -49,6 +230,9 @@ DRESULT ff_sdmmc_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
 {
     sdmmc_card_t* card = s_cards[pdrv];
     assert(card);
+    if (s_streams[pdrv] != NULL) {
+        return stream_write(s_streams[pdrv], buff, sector, count);
+    }
     esp_err_t err = sdmmc_write_sectors(card, buff, sector, count);
     if (unlikely(err != ESP_OK)) {
         ESP_LOGE(TAG, "sdmmc_write_blocks failed (%d)", err);
@@ -63,6 +247,9 @@ DRESULT ff_sdmmc_ioctl (BYTE pdrv, BYTE cmd, void* buff)
     assert(card);
     switch(cmd) {
         case CTRL_SYNC:
+            if (s_streams[pdrv] != NULL && stream_flush(s_streams[pdrv]) != ESP_OK) {
+                return RES_ERROR;
+            }
             return RES_OK;
         case GET_SECTOR_COUNT:
             *((DWORD*) buff) = card->csd.capacity;
@@ -89,6 +276,28 @@ void ff_diskio_register_sdmmc(BYTE pdrv, sdmmc_card_t* card)
     ff_diskio_register(pdrv, &sdmmc_impl);
 }
 
+esp_err_t ff_sdmmc_set_streaming(BYTE pdrv, const ff_sdmmc_streaming_config_t* config)
+{
+    if (pdrv >= FF_VOLUMES || s_cards[pdrv] == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    stream_t* stream = s_streams[pdrv];
+    if (stream != NULL) {
+        err = stream_flush(stream);
+        s_streams[pdrv] = NULL;
+        stream_delete(stream);
+    }
+    if (config == NULL || err != ESP_OK) {
+        return err;
+    }
+    err = stream_create(pdrv, config, &stream);
+    if (err == ESP_OK) {
+        s_streams[pdrv] = stream;
+    }
+    return err;
+}
+
 BYTE ff_diskio_get_pdrv_card(const sdmmc_card_t* card)
 {
     for (int i = 0; i < FF_VOLUMES; i++) {
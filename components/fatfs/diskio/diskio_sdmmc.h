@@ -15,6 +15,7 @@
 #pragma once
 
 #include "sdmmc_cmd.h"
+#include "diskio_impl.h"
 #include "driver/sdmmc_defs.h"
 
 #ifdef __cplusplus
@@ -37,6 +38,64 @@ void ff_diskio_register_sdmmc(unsigned char pdrv, sdmmc_card_t* card);
  */
 BYTE ff_diskio_get_pdrv_card(const sdmmc_card_t* card);
 
+/**
+ * Callback invoked by the streaming writer task when a write to the card is complete
+ *
+ * @param pdrv   drive number
+ * @param sector first sector written
+ * @param count  number of sectors written
+ * @param err    result of the write, ESP_OK on success
+ * @param arg    user argument from ff_sdmmc_streaming_config_t
+ */
+typedef void (*ff_sdmmc_write_cb_t)(BYTE pdrv, DWORD sector, UINT count, esp_err_t err, void* arg);
+
+/**
+ * Configuration of the streaming write mode
+ */
+typedef struct {
+    size_t buffer_size;     /*!< size of each of the two write buffers, in bytes; rounded down to the sector size */
+    int task_priority;      /*!< priority of the writer task */
+    size_t task_stack_size; /*!< stack size of the writer task, in bytes */
+    ff_sdmmc_write_cb_t on_write_done;  /*!< optional callback, called from the writer task after each write */
+    void* arg;              /*!< argument passed to on_write_done */
+} ff_sdmmc_streaming_config_t;
+
+#define FF_SDMMC_STREAMING_CONFIG_DEFAULT() { \
+    .buffer_size = 16 * 1024, \
+    .task_priority = 5, \
+    .task_stack_size = 3072, \
+    .on_write_done = NULL, \
+    .arg = NULL, \
+}
+
+/**
+ * @brief Enable or disable streaming writes for an SD/MMC drive
+ *
+ * In the streaming mode, sectors written by FatFs are copied into one of two
+ * DMA capable buffers, and the write function returns without waiting for the
+ * card. Writes to consecutive sectors are merged, and a buffer is passed to a
+ * writer task when it is full or when a non-consecutive sector is written.
+ * The writer task writes each buffer using a single multiple block write,
+ * preceded by a pre-erase hint (ACMD23) on SD cards, while FatFs fills the
+ * other buffer.
+ *
+ * Reads and CTRL_SYNC (which FatFs issues on f_sync and f_close) wait until
+ * all buffered writes have reached the card. If a buffered write fails, the
+ * error is returned from the next write, read or sync operation.
+ *
+ * This function must not be called while the drive is being accessed.
+ *
+ * @param pdrv   drive number, registered using ff_diskio_register_sdmmc
+ * @param config streaming configuration, or NULL to write back buffered data
+ *               and disable streaming
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if pdrv is not an SD/MMC drive or buffer_size is smaller than one sector
+ *      - ESP_ERR_NO_MEM if buffers or the writer task can not be allocated
+ *      - error of a buffered write, if disabling streaming failed to write back the data
+ */
+esp_err_t ff_sdmmc_set_streaming(BYTE pdrv, const ff_sdmmc_streaming_config_t* config);
+
 #ifdef __cplusplus
 }
 #endif
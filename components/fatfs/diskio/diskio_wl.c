@@ -75,8 +75,25 @@ DRESULT ff_wl_ioctl (BYTE pdrv, BYTE cmd, void *buff)
     ESP_LOGV(TAG, "ff_wl_ioctl: cmd=%i\n", cmd);
     assert(wl_handle + 1);
     switch (cmd) {
-    case CTRL_SYNC:
+    case CTRL_SYNC: {
+        esp_err_t err = wl_sync(wl_handle);
+        if (unlikely(err != ESP_OK)) {
+            ESP_LOGE(TAG, "wl_sync failed (%d)", err);
+            return RES_ERROR;
+        }
         return RES_OK;
+    }
+    case CTRL_TRIM: {
+        // First and last sector of the range which is no longer used
+        DWORD *range = (DWORD *) buff;
+        size_t sector_size = wl_sector_size(wl_handle);
+        esp_err_t err = wl_trim(wl_handle, range[0] * sector_size, (range[1] - range[0] + 1) * sector_size);
+        if (unlikely(err != ESP_OK)) {
+            ESP_LOGE(TAG, "wl_trim failed (%d)", err);
+            return RES_ERROR;
+        }
+        return RES_OK;
+    }
     case GET_SECTOR_COUNT:
         *((DWORD *) buff) = wl_size(wl_handle) / wl_sector_size(wl_handle);
         return RES_OK;
@@ -1035,6 +1035,69 @@ static void clear_lock (	/* Clear lock entries of the volume */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT sector cache shared by all files on the volume                    */
+/*-----------------------------------------------------------------------*/
+#if FF_FAT_CACHE_SECTORS
+
+static void fat_cache_clear (
+	FATFS* fs			/* Filesystem object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_FAT_CACHE_SECTORS; i++) fs->fcsect[i] = 0xFFFFFFFF;
+}
+
+
+static int fat_cache_find (	/* Returns index of the entry holding the sector or -1 */
+	FATFS* fs,			/* Filesystem object */
+	DWORD sector		/* Sector number */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_FAT_CACHE_SECTORS; i++) {
+		if (fs->fcsect[i] == sector) {
+			fs->fcused[i] = ++fs->fcstamp;
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+
+static void fat_cache_store (
+	FATFS* fs,			/* Filesystem object (the sector to store is in the win[]) */
+	DWORD sector		/* Sector number */
+)
+{
+	int i;
+	UINT n;
+
+
+	if (fs->fs_type == 0 || sector - fs->fatbase >= fs->fsize) return;	/* Only sectors of the 1st FAT of a mounted volume */
+	i = fat_cache_find(fs, sector);
+	if (i < 0) {	/* Replace an empty or the least recently used entry */
+		i = 0;
+		for (n = 0; n < FF_FAT_CACHE_SECTORS; n++) {
+			if (fs->fcsect[n] == 0xFFFFFFFF) {
+				i = (int)n; break;
+			}
+			if (fs->fcstamp - fs->fcused[n] > fs->fcstamp - fs->fcused[i]) i = (int)n;
+		}
+		fs->fcsect[i] = sector;
+		fs->fcused[i] = ++fs->fcstamp;
+	}
+	mem_cpy(fs->fcbuf[i], fs->win, SS(fs));
+}
+
+#endif	/* FF_FAT_CACHE_SECTORS */
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Move/Flush disk access window in the filesystem object                */
 /*-----------------------------------------------------------------------*/
@@ -1051,6 +1114,9 @@ static FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 			fs->wflag = 0;	/* Clear window dirty flag */
 			if (fs->winsect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
 				if (fs->n_fats == 2) disk_write(fs->pdrv, fs->win, fs->winsect + fs->fsize, 1);	/* Reflect it to 2nd FAT if needed */
+#if FF_FAT_CACHE_SECTORS
+				fat_cache_store(fs, fs->winsect);	/* Keep the cached copy up to date */
+#endif
 			}
 		} else {
 			res = FR_DISK_ERR;
@@ -1074,10 +1140,22 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 		res = sync_window(fs);		/* Write-back changes */
 #endif
 		if (res == FR_OK) {			/* Fill sector window with new data */
+#if FF_FAT_CACHE_SECTORS
+			int i = fat_cache_find(fs, sector);
+
+			if (i >= 0) {			/* Take it from the FAT cache if available */
+				mem_cpy(fs->win, fs->fcbuf[i], SS(fs));
+			} else
+#endif
 			if (disk_read(fs->pdrv, fs->win, sector, 1) != RES_OK) {
 				sector = 0xFFFFFFFF;	/* Invalidate window if read data is not valid */
 				res = FR_DISK_ERR;
 			}
+#if FF_FAT_CACHE_SECTORS
+			else {
+				fat_cache_store(fs, sector);
+			}
+#endif
 			fs->winsect = sector;
 		}
 	}
@@ -3254,6 +3332,9 @@ static FRESULT find_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 	/* Following code attempts to mount the volume. (analyze BPB and initialize the filesystem object) */
 
 	fs->fs_type = 0;					/* Clear the filesystem object */
+#if FF_FAT_CACHE_SECTORS
+	fat_cache_clear(fs);				/* Cached FAT sectors may be stale */
+#endif
 	fs->pdrv = LD2PD(vol);				/* Bind the logical drive and a physical drive */
 	stat = disk_initialize(fs->pdrv);	/* Initialize the physical drive */
 	if (stat & STA_NOINIT) { 			/* Check if the initialization succeeded */
@@ -164,6 +164,12 @@ typedef struct {
 #endif
 	DWORD	winsect;		/* Current sector appearing in the win[] */
 	BYTE	win[FF_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
+#if FF_FAT_CACHE_SECTORS
+	DWORD	fcsect[FF_FAT_CACHE_SECTORS];	/* Sectors held in the FAT cache (0xFFFFFFFF:empty) */
+	DWORD	fcused[FF_FAT_CACHE_SECTORS];	/* Access stamps of the FAT cache entries */
+	DWORD	fcstamp;		/* Last access stamp given out */
+	BYTE	fcbuf[FF_FAT_CACHE_SECTORS][FF_MAX_SS];	/* FAT cache (shared by all files on the volume) */
+#endif
 } FATFS;
 
 
@@ -44,7 +44,11 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
+#ifdef CONFIG_FATFS_USE_FASTSEEK
+#define FF_USE_FASTSEEK	1
+#else
 #define FF_USE_FASTSEEK	0
+#endif
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
@@ -222,7 +226,11 @@
 /  GET_SECTOR_SIZE command. */
 
 
+#ifdef CONFIG_FATFS_USE_TRIM
+#define FF_USE_TRIM		1
+#else
 #define FF_USE_TRIM		0
+#endif
 /* This option switches support for ATA-TRIM. (0:Disable or 1:Enable)
 /  To enable Trim function, also CTRL_TRIM command should be implemented to the
 /  disk_ioctl() function. */
@@ -252,6 +260,17 @@
 /  buffer in the filesystem object (FATFS) is used for the file data transfer. */
 
 
+#ifdef CONFIG_FATFS_FAT_CACHE_SECTORS
+#define FF_FAT_CACHE_SECTORS	CONFIG_FATFS_FAT_CACHE_SECTORS
+#else
+#define FF_FAT_CACHE_SECTORS	0
+#endif
+/* Number of sectors of the 1st FAT which are kept in the filesystem object (FATFS)
+/  in addition to the disk access window. The cache is shared by all files of the
+/  volume and saves reading FAT sectors again when the window moves between FAT,
+/  directory and data sectors. Each sector takes FF_MAX_SS bytes. (0:Disable) */
+
+
 #define FF_FS_EXFAT		0
 /* This option switches support for exFAT filesystem. (0:Disable or 1:Enable)
 /  To enable exFAT, also LFN needs to be enabled. (FF_USE_LFN >= 1)
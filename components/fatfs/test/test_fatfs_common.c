@@ -20,6 +20,7 @@
 #include <sys/time.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <utime.h>
 #include "unity.h"
@@ -182,6 +183,35 @@ void test_fatfs_pwrite_file(const char *filename)
     test_file_content(filename, "Hello, Dolly!");
 }
 
+void test_fatfs_readv_writev_file(const char *filename)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    const struct iovec wr_iov[] = {
+        { .iov_base = "Hello", .iov_len = 5 },
+        { .iov_base = NULL, .iov_len = 0 },
+        { .iov_base = ", world!", .iov_len = 8 },
+    };
+    TEST_ASSERT_EQUAL(13, writev(fd, wr_iov, 3));
+    TEST_ASSERT_EQUAL(0, close(fd));
+    test_file_content(filename, "Hello, world!");
+
+    fd = open(filename, O_RDONLY);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    char head[7] = { 0 };
+    char tail[16] = { 0 };
+    const struct iovec rd_iov[] = {
+        { .iov_base = head, .iov_len = sizeof(head) - 1 },
+        { .iov_base = tail, .iov_len = sizeof(tail) - 1 },
+    };
+    // the second buffer is only partially filled, at the end of the file
+    TEST_ASSERT_EQUAL(13, readv(fd, rd_iov, 2));
+    TEST_ASSERT_EQUAL_STRING("Hello,", head);
+    TEST_ASSERT_EQUAL_STRING(" world!", tail);
+    TEST_ASSERT_EQUAL(0, readv(fd, rd_iov, 2));
+    TEST_ASSERT_EQUAL(0, close(fd));
+}
+
 void test_fatfs_open_max_files(const char* filename_prefix, size_t files_count)
 {
     FILE** files = calloc(files_count, sizeof(FILE*));
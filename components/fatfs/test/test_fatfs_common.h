@@ -45,6 +45,8 @@ void test_fatfs_pread_file(const char* filename);
 
 void test_fatfs_pwrite_file(const char* filename);
 
+void test_fatfs_readv_writev_file(const char* filename);
+
 void test_fatfs_open_max_files(const char* filename_prefix, size_t files_count);
 
 void test_fatfs_lseek(const char* filename);
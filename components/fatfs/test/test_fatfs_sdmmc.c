@@ -28,6 +28,7 @@
 #include "driver/sdmmc_defs.h"
 #include "sdmmc_cmd.h"
 #include "ff.h"
+#include "diskio_sdmmc.h"
 #include "test_fatfs_common.h"
 #include "soc/soc_caps.h"
 
@@ -111,6 +112,13 @@ TEST_CASE("(SD) pwrite() works well", "[fatfs][test_env=UT_T1_SDMODE]")
     test_teardown();
 }
 
+TEST_CASE("(SD) readv() and writev() work well", "[fatfs][test_env=UT_T1_SDMODE]")
+{
+    test_setup();
+    test_fatfs_readv_writev_file(test_filename);
+    test_teardown();
+}
+
 TEST_CASE("(SD) overwrite and append file", "[fatfs][sd][test_env=UT_T1_SDMODE]")
 {
     test_setup();
@@ -230,6 +238,84 @@ static void sdmmc_speed_test(void *buf, size_t buf_size, size_t file_size, bool
     TEST_ESP_OK(esp_vfs_fat_sdmmc_unmount());
 }
 
+typedef struct {
+    size_t writes;
+    size_t sectors;
+    esp_err_t err;
+} stream_stats_t;
+
+static void stream_write_done(BYTE pdrv, DWORD sector, UINT count, esp_err_t err, void* arg)
+{
+    stream_stats_t* stats = (stream_stats_t*) arg;
+    stats->writes++;
+    stats->sectors += count;
+    if (err != ESP_OK) {
+        stats->err = err;
+    }
+}
+
+TEST_CASE("(SD) streaming writes", "[fatfs][sd][test_env=UT_T1_SDMODE][timeout=60]")
+{
+    size_t heap_size;
+    HEAP_SIZE_CAPTURE(heap_size);
+
+    const size_t buf_size = 4 * 1024;
+    const size_t file_size = 1024 * 1024;
+    uint32_t* buf = (uint32_t*) calloc(1, buf_size);
+    uint32_t* read_buf = (uint32_t*) calloc(1, buf_size);
+    esp_fill_random(buf, buf_size);
+
+    sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+    sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
+    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
+        .format_if_mount_failed = true,
+        .max_files = 5,
+        .allocation_unit_size = 64 * 1024,
+        .stream_buffer_size = 16 * 1024
+    };
+    sdmmc_card_t* card;
+    TEST_ESP_OK(esp_vfs_fat_sdmmc_mount("/sdcard", &host, &slot_config, &mount_config, &card));
+    test_fatfs_rw_speed("/sdcard/stream.bin", buf, buf_size, file_size, true);
+
+    /* Enable the completion callback and check that all the data goes through the writer task */
+    stream_stats_t stats = { 0 };
+    BYTE pdrv = ff_diskio_get_pdrv_card(card);
+    ff_sdmmc_streaming_config_t stream_config = FF_SDMMC_STREAMING_CONFIG_DEFAULT();
+    stream_config.on_write_done = &stream_write_done;
+    stream_config.arg = &stats;
+    TEST_ESP_OK(ff_sdmmc_set_streaming(pdrv, &stream_config));
+
+    FILE* f = fopen("/sdcard/stream.bin", "wb");
+    TEST_ASSERT_NOT_NULL(f);
+    for (size_t n = 0; n < file_size / buf_size; ++n) {
+        buf[0] = n;
+        TEST_ASSERT_EQUAL(buf_size, write(fileno(f), buf, buf_size));
+    }
+    TEST_ASSERT_EQUAL(0, fclose(f));
+    TEST_ESP_OK(stats.err);
+    TEST_ASSERT_GREATER_OR_EQUAL(file_size / card->csd.sector_size, stats.sectors);
+    // consecutive sectors are merged into multiple block writes
+    TEST_ASSERT_LESS_THAN(file_size / buf_size, stats.writes);
+    printf("%d sectors written in %d writes\n", stats.sectors, stats.writes);
+
+    TEST_ESP_OK(ff_sdmmc_set_streaming(pdrv, NULL));
+    f = fopen("/sdcard/stream.bin", "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    for (size_t n = 0; n < file_size / buf_size; ++n) {
+        buf[0] = n;
+        TEST_ASSERT_EQUAL(buf_size, read(fileno(f), read_buf, buf_size));
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(buf, read_buf, buf_size);
+    }
+    TEST_ASSERT_EQUAL(0, fclose(f));
+
+    TEST_ESP_OK(esp_vfs_fat_sdcard_unmount("/sdcard", card));
+    free(buf);
+    free(read_buf);
+
+    HEAP_SIZE_CHECK(heap_size, 0);
+}
+
 TEST_CASE("(SD) mount two FAT partitions, SDMMC and WL, at the same time", "[fatfs][sd][test_env=UT_T1_SDMODE]")
 {
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
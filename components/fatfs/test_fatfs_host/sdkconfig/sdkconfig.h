@@ -6,3 +6,7 @@
 #define CONFIG_ESPTOOLPY_FLASHSIZE "8MB"
 //currently use the legacy implementation, since the stubs for new HAL are not done yet
 #define CONFIG_SPI_FLASH_USE_LEGACY_IMPL
+#define CONFIG_FATFS_USE_FASTSEEK 1
+#define CONFIG_FATFS_FAST_SEEK_BUFFER_SIZE 64
+#define CONFIG_FATFS_FAT_CACHE_SECTORS 2
+#define CONFIG_FATFS_USE_TRIM 1
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include <chrono>
 
 #include "ff.h"
 #include "esp_partition.h"
@@ -10,6 +11,16 @@
 #include "catch.hpp"
 
 extern "C" void _spi_flash_init(const char* chip_size, size_t block_size, size_t sector_size, size_t page_size, const char* partition_bin);
+extern "C" size_t spi_flash_get_read_ops();
+extern "C" size_t spi_flash_get_read_bytes();
+extern "C" void spi_flash_reset_stats();
+extern "C" int spi_flash_get_total_erase_cycles();
+
+extern "C" DSTATUS ff_wl_initialize(BYTE pdrv);
+extern "C" DSTATUS ff_wl_status(BYTE pdrv);
+extern "C" DRESULT ff_wl_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count);
+extern "C" DRESULT ff_wl_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count);
+extern "C" DRESULT ff_wl_ioctl(BYTE pdrv, BYTE cmd, void *buff);
 
 TEST_CASE("create volume, open file, write and read back data", "[fatfs]")
 {
@@ -91,3 +102,350 @@ TEST_CASE("create volume, open file, write and read back data", "[fatfs]")
     free(read);
     free(data);
 }
+
+// Flash time model used to compare read patterns: a fixed cost per operation plus the time to transfer the data
+static double read_time_us(size_t ops, size_t bytes)
+{
+    return ops * 20.0 + bytes / 20.0;
+}
+
+TEST_CASE("benchmark reading a large file in big and small chunks", "[fatfs][benchmark]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+
+    FATFS fs;
+    FIL file;
+    UINT bw;
+    BYTE pdrv;
+    wl_handle_t wl_handle;
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, "storage");
+    REQUIRE(wl_mount(partition, &wl_handle) == ESP_OK);
+    REQUIRE(ff_diskio_get_drive(&pdrv) == ESP_OK);
+    REQUIRE(ff_diskio_register_wl_partition(pdrv, wl_handle) == ESP_OK);
+
+    DWORD part_list[] = {100, 0, 0, 0};
+    BYTE work_area[FF_MAX_SS];
+    REQUIRE(f_fdisk(pdrv, part_list, work_area) == FR_OK);
+    // FatFs doesn't read across cluster boundaries in one disk_read call, use clusters of several sectors
+    REQUIRE(f_mkfs("", FM_ANY, 8 * CONFIG_WL_SECTOR_SIZE, work_area, sizeof(work_area)) == FR_OK);
+    REQUIRE(f_mount(&fs, "", 0) == FR_OK);
+
+    const uint32_t data_size = 512 * 1024;
+    char *data = (char*) malloc(data_size);
+    char *read = (char*) malloc(data_size);
+    for (uint32_t i = 0; i < data_size; i += sizeof(i)) {
+        *((uint32_t*)(data + i)) = i * 2654435761u;
+    }
+
+    REQUIRE(f_open(&file, "large.bin", FA_CREATE_ALWAYS | FA_READ | FA_WRITE) == FR_OK);
+    REQUIRE(f_write(&file, data, data_size, &bw) == FR_OK);
+    REQUIRE(bw == data_size);
+
+    const UINT chunks[] = {FF_MAX_SS, 8 * 1024, 32 * 1024};
+    size_t ops[sizeof(chunks) / sizeof(chunks[0])];
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        REQUIRE(f_lseek(&file, 0) == FR_OK);
+        memset(read, 0, data_size);
+        spi_flash_reset_stats();
+        for (uint32_t offset = 0; offset < data_size; offset += chunks[c]) {
+            REQUIRE(f_read(&file, read + offset, chunks[c], &bw) == FR_OK);
+            REQUIRE(bw == chunks[c]);
+        }
+        REQUIRE(memcmp(data, read, data_size) == 0);
+
+        ops[c] = spi_flash_get_read_ops();
+        size_t bytes = spi_flash_get_read_bytes();
+        double time_us = read_time_us(ops[c], bytes);
+        printf("f_read of %6u bytes: %6u flash reads, %7u bytes, %8.0f KB/s\n",
+               (unsigned) chunks[c], (unsigned) ops[c], (unsigned) bytes, data_size / 1024.0 / (time_us / 1000000.0));
+    }
+    // Reads spanning many sectors reach the flash as a few contiguous operations
+    CHECK(ops[2] * 4 <= ops[0]);
+
+    REQUIRE(f_close(&file) == FR_OK);
+    REQUIRE(f_mount(0, "", 0) == FR_OK);
+    REQUIRE(wl_unmount(wl_handle) == ESP_OK);
+    ff_diskio_unregister(pdrv);
+
+    free(read);
+    free(data);
+}
+
+// RAM disk with SD card sized sectors, large enough for a FAT spanning many sectors
+static const UINT ram_disk_sector_size = 512;
+static const DWORD ram_disk_sector_count = 32768;
+static BYTE *ram_disk;
+static size_t ram_disk_reads;
+static size_t ram_disk_fat_reads;
+static DWORD ram_disk_fat_start;
+static DWORD ram_disk_fat_end;
+
+static DSTATUS ram_disk_init(BYTE pdrv)
+{
+    return 0;
+}
+
+static DSTATUS ram_disk_status(BYTE pdrv)
+{
+    return 0;
+}
+
+static DRESULT ram_disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    ram_disk_reads++;
+    if (sector >= ram_disk_fat_start && sector < ram_disk_fat_end) {
+        ram_disk_fat_reads++;
+    }
+    memcpy(buff, ram_disk + sector * ram_disk_sector_size, count * ram_disk_sector_size);
+    return RES_OK;
+}
+
+static DRESULT ram_disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+    memcpy(ram_disk + sector * ram_disk_sector_size, buff, count * ram_disk_sector_size);
+    return RES_OK;
+}
+
+static DRESULT ram_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+    switch (cmd) {
+    case CTRL_SYNC:
+        return RES_OK;
+    case GET_SECTOR_COUNT:
+        *((DWORD *) buff) = ram_disk_sector_count;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *((WORD *) buff) = ram_disk_sector_size;
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        return RES_ERROR;
+    }
+    return RES_ERROR;
+}
+
+static const ff_diskio_impl_t ram_disk_impl = {
+    .init = &ram_disk_init,
+    .status = &ram_disk_status,
+    .read = &ram_disk_read,
+    .write = &ram_disk_write,
+    .ioctl = &ram_disk_ioctl
+};
+
+static BYTE ram_disk_mount(FATFS *fs, char *path)
+{
+    BYTE pdrv;
+    BYTE work_area[FF_MAX_SS];
+
+    ram_disk = (BYTE*) calloc(ram_disk_sector_count, ram_disk_sector_size);
+    REQUIRE(ram_disk != NULL);
+    REQUIRE(ff_diskio_get_drive(&pdrv) == ESP_OK);
+    ff_diskio_register(pdrv, &ram_disk_impl);
+    sprintf(path, "%u:", pdrv);
+
+    // Clusters of one sector give the longest cluster chains
+    REQUIRE(f_mkfs(path, FM_FAT | FM_SFD, ram_disk_sector_size, work_area, sizeof(work_area)) == FR_OK);
+    REQUIRE(f_mount(fs, path, 1) == FR_OK);
+    ram_disk_fat_start = fs->fatbase;
+    ram_disk_fat_end = fs->fatbase + fs->fsize;
+    return pdrv;
+}
+
+static void ram_disk_unmount(BYTE pdrv, const char *path)
+{
+    REQUIRE(f_mount(0, path, 0) == FR_OK);
+    ff_diskio_unregister(pdrv);
+    free(ram_disk);
+    ram_disk = NULL;
+}
+
+TEST_CASE("benchmark seeking in large files with and without fast seek", "[fatfs][benchmark]")
+{
+    FATFS fs;
+    FIL file;
+    UINT bw;
+    char path[8];
+    char name[16];
+    BYTE pdrv = ram_disk_mount(&fs, path);
+
+    const size_t chunk_size = 64 * 1024;
+    char *chunk = (char*) malloc(chunk_size);
+    const uint32_t file_sizes[] = {64 * 1024, 1024 * 1024, 4 * 1024 * 1024, 12 * 1024 * 1024};
+    const int seeks = 200;
+    DWORD link_map[64];
+
+    for (size_t f = 0; f < sizeof(file_sizes) / sizeof(file_sizes[0]); f++) {
+        uint32_t file_size = file_sizes[f];
+        sprintf(name, "%s%u.bin", path, (unsigned) f);
+        REQUIRE(f_open(&file, name, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+        for (uint32_t offset = 0; offset < file_size; offset += chunk_size) {
+            for (size_t i = 0; i < chunk_size; i += sizeof(uint32_t)) {
+                *((uint32_t*)(chunk + i)) = offset + i;
+            }
+            REQUIRE(f_write(&file, chunk, chunk_size, &bw) == FR_OK);
+            REQUIRE(bw == chunk_size);
+        }
+        REQUIRE(f_close(&file) == FR_OK);
+
+        double reads_per_seek[2];
+        for (int fast = 0; fast < 2; fast++) {
+            REQUIRE(f_open(&file, name, FA_READ) == FR_OK);
+            if (fast) {
+                link_map[0] = sizeof(link_map) / sizeof(link_map[0]);
+                file.cltbl = link_map;
+                REQUIRE(f_lseek(&file, CREATE_LINKMAP) == FR_OK);
+            }
+            uint32_t seed = 1;
+            ram_disk_reads = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < seeks; i++) {
+                seed = seed * 1103515245 + 12345;
+                uint32_t offset = (seed % (file_size / sizeof(uint32_t))) * sizeof(uint32_t);
+                uint32_t value;
+                REQUIRE(f_lseek(&file, offset) == FR_OK);
+                REQUIRE(f_read(&file, &value, sizeof(value), &bw) == FR_OK);
+                REQUIRE(bw == sizeof(value));
+                REQUIRE(value == offset);
+            }
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            reads_per_seek[fast] = (double) ram_disk_reads / seeks;
+            printf("%8u byte file, %s: %6.1f disk reads and %7.1f us per lseek+read\n", (unsigned) file_size,
+                   fast ? "fast seek  " : "normal seek", reads_per_seek[fast], us / seeks);
+            REQUIRE(f_close(&file) == FR_OK);
+        }
+        // The link map replaces walking the FAT, only the data sector is read
+        CHECK(reads_per_seek[1] <= 1.0);
+        if (file_size >= 4 * 1024 * 1024) {
+            CHECK(reads_per_seek[0] > reads_per_seek[1] * 5);
+        }
+        REQUIRE(f_unlink(name) == FR_OK);
+    }
+
+    free(chunk);
+    ram_disk_unmount(pdrv, path);
+}
+
+TEST_CASE("FAT sectors are cached when appending to several files", "[fatfs]")
+{
+    FATFS fs;
+    FIL files[2];
+    UINT bw;
+    char path[8];
+    char name[16];
+    BYTE pdrv = ram_disk_mount(&fs, path);
+
+    for (int f = 0; f < 2; f++) {
+        sprintf(name, "%slog%d.txt", path, f);
+        REQUIRE(f_open(&files[f], name, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+    }
+    char record[ram_disk_sector_size];
+    memset(record, 'x', sizeof(record));
+    const int appends = 100;
+    ram_disk_fat_reads = 0;
+    for (int i = 0; i < appends; i++) {
+        for (int f = 0; f < 2; f++) {
+            REQUIRE(f_write(&files[f], record, sizeof(record), &bw) == FR_OK);
+            REQUIRE(bw == sizeof(record));
+            REQUIRE(f_sync(&files[f]) == FR_OK);
+        }
+    }
+    printf("%d appends with f_sync: %u FAT sector reads\n", appends * 2, (unsigned) ram_disk_fat_reads);
+#if FF_FAT_CACHE_SECTORS
+    // The FAT sector stays cached while the window holds the directory entries
+    CHECK(ram_disk_fat_reads <= FF_FAT_CACHE_SECTORS);
+#endif
+    for (int f = 0; f < 2; f++) {
+        REQUIRE(f_close(&files[f]) == FR_OK);
+        REQUIRE(f_size(&files[f]) == appends * sizeof(record));
+    }
+    ram_disk_unmount(pdrv, path);
+}
+
+// Wear levelling disk driver which ignores CTRL_TRIM, as it was before trim was supported
+static DRESULT ff_wl_ioctl_no_trim(BYTE pdrv, BYTE cmd, void *buff)
+{
+    if (cmd == CTRL_TRIM) {
+        return RES_ERROR;
+    }
+    return ff_wl_ioctl(pdrv, cmd, buff);
+}
+
+static const ff_diskio_impl_t wl_no_trim_impl = {
+    .init = &ff_wl_initialize,
+    .status = &ff_wl_status,
+    .read = &ff_wl_read,
+    .write = &ff_wl_write,
+    .ioctl = &ff_wl_ioctl_no_trim
+};
+
+TEST_CASE("benchmark trim with log rotation on a wear levelled partition", "[fatfs][benchmark]")
+{
+    const int logs = 1000;
+    const int logs_kept = 8;
+    const uint32_t log_size = 32 * 1024;
+    const UINT chunk_size = 4096;
+    int erases[2];
+
+    for (int trim = 0; trim < 2; trim++) {
+        _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, "storage");
+        REQUIRE(esp_partition_erase_range(partition, 0, partition->size) == ESP_OK);
+
+        FATFS fs;
+        FIL file;
+        UINT bw;
+        BYTE pdrv;
+        char path[8];
+        char name[24];
+        wl_handle_t wl_handle;
+        REQUIRE(wl_mount(partition, &wl_handle) == ESP_OK);
+        REQUIRE(ff_diskio_get_drive(&pdrv) == ESP_OK);
+        REQUIRE(ff_diskio_register_wl_partition(pdrv, wl_handle) == ESP_OK);
+        if (!trim) {
+            ff_diskio_register(pdrv, &wl_no_trim_impl);
+        }
+        sprintf(path, "%u:", pdrv);
+        BYTE work_area[FF_MAX_SS];
+        REQUIRE(f_mkfs(path, FM_ANY | FM_SFD, 0, work_area, sizeof(work_area)) == FR_OK);
+        REQUIRE(f_mount(&fs, path, 1) == FR_OK);
+
+        char *chunk = (char*) malloc(chunk_size);
+        memset(chunk, 0x5a, chunk_size);
+        int start = spi_flash_get_total_erase_cycles();
+        for (int i = 0; i < logs; i++) {
+            sprintf(name, "%slog%d.txt", path, i);
+            REQUIRE(f_open(&file, name, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+            for (uint32_t offset = 0; offset < log_size; offset += chunk_size) {
+                REQUIRE(f_write(&file, chunk, chunk_size, &bw) == FR_OK);
+                REQUIRE(bw == chunk_size);
+            }
+            REQUIRE(f_close(&file) == FR_OK);
+            if (i >= logs_kept) {
+                sprintf(name, "%slog%d.txt", path, i - logs_kept);
+                REQUIRE(f_unlink(name) == FR_OK);
+            }
+        }
+        erases[trim] = spi_flash_get_total_erase_cycles() - start;
+
+        // The logs which were kept are intact
+        char *read = (char*) malloc(chunk_size);
+        for (int i = logs - logs_kept; i < logs; i++) {
+            sprintf(name, "%slog%d.txt", path, i);
+            REQUIRE(f_open(&file, name, FA_READ) == FR_OK);
+            for (uint32_t offset = 0; offset < log_size; offset += chunk_size) {
+                REQUIRE(f_read(&file, read, chunk_size, &bw) == FR_OK);
+                REQUIRE(bw == chunk_size);
+                REQUIRE(memcmp(read, chunk, chunk_size) == 0);
+            }
+            REQUIRE(f_close(&file) == FR_OK);
+        }
+        free(read);
+        printf("log rotation of %d files, %s: %d flash erases\n", logs, trim ? "trim   " : "no trim", erases[trim]);
+
+        free(chunk);
+        REQUIRE(f_mount(0, path, 0) == FR_OK);
+        ff_diskio_unregister(pdrv);
+        REQUIRE(wl_unmount(wl_handle) == ESP_OK);
+    }
+    CHECK(erases[1] < erases[0]);
+}
@@ -93,6 +93,17 @@ typedef struct {
      * sector size.
      */
     size_t allocation_unit_size;
+    /**
+     * SD cards only. If non-zero, enables the streaming write mode of the
+     * SD/MMC disk driver, with two write buffers of this size (in bytes).
+     * Writes return as soon as the data is copied into a buffer, and the card
+     * is written by a separate task, using pre-erase hints for multiple
+     * block writes. Data reaches the card on fsync, fclose, or any read
+     * from the card. See ff_sdmmc_set_streaming for details.
+     *
+     * Setting this field to 0 disables the streaming write mode.
+     */
+    size_t stream_buffer_size;
 } esp_vfs_fat_mount_config_t;
 
 // Compatibility definition
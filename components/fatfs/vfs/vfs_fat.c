@@ -70,6 +70,8 @@ static off_t vfs_fat_lseek(void* p, int fd, off_t size, int mode);
 static ssize_t vfs_fat_read(void* ctx, int fd, void * dst, size_t size);
 static ssize_t vfs_fat_pread(void *ctx, int fd, void *dst, size_t size, off_t offset);
 static ssize_t vfs_fat_pwrite(void *ctx, int fd, const void *src, size_t size, off_t offset);
+static ssize_t vfs_fat_readv(void *ctx, int fd, const struct iovec *iov, int iovcnt);
+static ssize_t vfs_fat_writev(void *ctx, int fd, const struct iovec *iov, int iovcnt);
 static int vfs_fat_open(void* ctx, const char * path, int flags, int mode);
 static int vfs_fat_close(void* ctx, int fd);
 static int vfs_fat_fstat(void* ctx, int fd, struct stat * st);
@@ -135,6 +137,8 @@ esp_err_t esp_vfs_fat_register(const char* base_path, const char* fat_drive, siz
         .read_p = &vfs_fat_read,
         .pread_p = &vfs_fat_pread,
         .pwrite_p = &vfs_fat_pwrite,
+        .readv_p = &vfs_fat_readv,
+        .writev_p = &vfs_fat_writev,
         .open_p = &vfs_fat_open,
         .close_p = &vfs_fat_close,
         .fstat_p = &vfs_fat_fstat,
@@ -272,9 +276,35 @@ static int fresult_to_errno(FRESULT fr)
 
 static void file_cleanup(vfs_fat_ctx_t* ctx, int fd)
 {
+#if FF_USE_FASTSEEK
+    ff_memfree(ctx->files[fd].cltbl);
+#endif
     memset(&ctx->files[fd], 0, sizeof(FIL));
 }
 
+#if FF_USE_FASTSEEK
+/**
+ * @brief Create the cluster link map table of a file, so that seeks don't follow the FAT chain
+ *
+ * Fast seek stays disabled if the table can't be allocated, or the file is too fragmented for it.
+ */
+static void prepare_fatfs_file_link_map(FIL* file)
+{
+    const size_t entries = CONFIG_FATFS_FAST_SEEK_BUFFER_SIZE;
+    file->cltbl = ff_memalloc(entries * sizeof(DWORD));
+    if (file->cltbl == NULL) {
+        return;
+    }
+    file->cltbl[0] = entries;
+    FRESULT res = f_lseek(file, CREATE_LINKMAP);
+    if (res != FR_OK) {
+        ESP_LOGD(TAG, "%s: fast seek disabled, fresult=%d", __func__, res);
+        ff_memfree(file->cltbl);
+        file->cltbl = NULL;
+    }
+}
+#endif
+
 /**
  * @brief Prepend drive letters to path names
  * This function returns new path path pointers, pointing to a temporary buffer
@@ -322,6 +352,12 @@ static int vfs_fat_open(void* ctx, const char * path, int flags, int mode)
     // therefore this flag is stored here (at this VFS level) in order to save
     // memory.
     fat_ctx->o_append[fd] = (flags & O_APPEND) == O_APPEND;
+#if FF_USE_FASTSEEK
+    // FATFS can't extend files in fast seek mode, use it for files which are only read
+    if ((flags & O_ACCMODE) == O_RDONLY) {
+        prepare_fatfs_file_link_map(&fat_ctx->files[fd]);
+    }
+#endif
     _lock_release(&fat_ctx->lock);
     return fd;
 }
@@ -444,6 +480,58 @@ pwrite_release:
     return ret;
 }
 
+static ssize_t vfs_fat_readv(void *ctx, int fd, const struct iovec *iov, int iovcnt)
+{
+    vfs_fat_ctx_t *fat_ctx = (vfs_fat_ctx_t *) ctx;
+    FIL *file = &fat_ctx->files[fd];
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        unsigned read = 0;
+        FRESULT res = f_read(file, iov[i].iov_base, iov[i].iov_len, &read);
+        total += read;
+        if (res != FR_OK) {
+            ESP_LOGD(TAG, "%s: fresult=%d", __func__, res);
+            errno = fresult_to_errno(res);
+            return (total > 0) ? total : -1;
+        }
+        if (read < iov[i].iov_len) {
+            break; // end of file
+        }
+    }
+    return total;
+}
+
+static ssize_t vfs_fat_writev(void *ctx, int fd, const struct iovec *iov, int iovcnt)
+{
+    vfs_fat_ctx_t *fat_ctx = (vfs_fat_ctx_t *) ctx;
+    FIL *file = &fat_ctx->files[fd];
+    FRESULT res;
+    // The whole vector is appended at the end of the file, like a single write
+    if (fat_ctx->o_append[fd]) {
+        if ((res = f_lseek(file, f_size(file))) != FR_OK) {
+            ESP_LOGD(TAG, "%s: fresult=%d", __func__, res);
+            errno = fresult_to_errno(res);
+            return -1;
+        }
+    }
+    // Buffers go to f_write one after the other; FatFs collects small ones in its sector buffer
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        unsigned written = 0;
+        res = f_write(file, iov[i].iov_base, iov[i].iov_len, &written);
+        total += written;
+        if (res != FR_OK) {
+            ESP_LOGD(TAG, "%s: fresult=%d", __func__, res);
+            errno = fresult_to_errno(res);
+            return (total > 0) ? total : -1;
+        }
+        if (written < iov[i].iov_len) {
+            break; // volume is full
+        }
+    }
+    return total;
+}
+
 static int vfs_fat_fsync(void* ctx, int fd)
 {
     vfs_fat_ctx_t* fat_ctx = (vfs_fat_ctx_t*) ctx;
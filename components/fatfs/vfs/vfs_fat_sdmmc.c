@@ -128,6 +128,16 @@ static esp_err_t mount_to_vfs_fat(const esp_vfs_fat_mount_config_t *mount_config
             goto fail;
         }
     }
+
+    if (mount_config->stream_buffer_size > 0) {
+        ff_sdmmc_streaming_config_t stream_config = FF_SDMMC_STREAMING_CONFIG_DEFAULT();
+        stream_config.buffer_size = mount_config->stream_buffer_size;
+        err = ff_sdmmc_set_streaming(pdrv, &stream_config);
+        if (err != ESP_OK) {
+            ESP_LOGD(TAG, "ff_sdmmc_set_streaming failed (0x%x)", err);
+            goto fail;
+        }
+    }
     return ESP_OK;
 
 fail:
@@ -369,6 +379,12 @@ static esp_err_t unmount_card_core(const char *base_path, sdmmc_card_t *card)
         return ESP_ERR_INVALID_ARG;
     }
 
+    // write back buffered data, if streaming writes are enabled
+    esp_err_t err = ff_sdmmc_set_streaming(pdrv, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "failed to write back buffered data (0x%x)", err);
+    }
+
     // unmount
     char drv[3] = {(char)('0' + pdrv), ':', 0};
     f_mount(0, drv, 0);
@@ -378,7 +394,7 @@ static esp_err_t unmount_card_core(const char *base_path, sdmmc_card_t *card)
     call_host_deinit(&card->host);
     free(card);
 
-    esp_err_t err = esp_vfs_fat_unregister_path(base_path);
+    err = esp_vfs_fat_unregister_path(base_path);
     return err;
 }
 
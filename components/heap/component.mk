@@ -2,7 +2,13 @@
 # Component Makefile
 #
 
-COMPONENT_OBJS := heap_caps_init.o heap_caps.o multi_heap.o
+COMPONENT_OBJS := heap_caps_init.o heap_caps.o heap_caps_pool.o
+
+ifdef CONFIG_HEAP_ALLOCATOR_TLSF
+COMPONENT_OBJS += multi_heap_tlsf.o
+else
+COMPONENT_OBJS += multi_heap.o
+endif
 
 ifndef CONFIG_HEAP_POISONING_DISABLED
 COMPONENT_OBJS += multi_heap_poisoning.o
@@ -12,6 +18,15 @@ COMPONENT_OBJS += heap_task_info.o
 endif
 endif
 
+ifdef CONFIG_HEAP_CACHE
+COMPONENT_OBJS += heap_caps_cache.o
+endif
+
+ifdef CONFIG_HEAP_PROFILER
+COMPONENT_OBJS += heap_profiler.o
+heap_caps.o: CFLAGS += -Wno-frame-address
+endif
+
 ifdef CONFIG_HEAP_TRACING_STANDALONE
 
 COMPONENT_OBJS += heap_trace_standalone.o
@@ -20,7 +35,7 @@ endif
 
 ifdef CONFIG_HEAP_TRACING
 
-WRAP_FUNCTIONS = calloc malloc free realloc heap_caps_malloc heap_caps_free heap_caps_realloc heap_caps_malloc_default heap_caps_realloc_default
+WRAP_FUNCTIONS = calloc malloc free realloc heap_caps_malloc heap_caps_free heap_caps_realloc heap_caps_malloc_default heap_caps_realloc_default heap_caps_pool_alloc heap_caps_pool_free
 WRAP_ARGUMENT := -Wl,--wrap=
 
 COMPONENT_ADD_LDFLAGS = -l$(COMPONENT_NAME) $(addprefix $(WRAP_ARGUMENT),$(WRAP_FUNCTIONS))
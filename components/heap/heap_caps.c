@@ -22,6 +22,31 @@
 #include "esp_log.h"
 #include "heap_private.h"
 #include "esp_system.h"
+#include "heap_caps_pool_internal.h"
+#ifdef CONFIG_HEAP_CACHE
+#include "heap_caps_cache_internal.h"
+#include "multi_heap_internal.h"
+
+/* Only blocks from heaps which have all these caps are cached, and only allocations which need none but these caps
+   are served from the cache */
+#define HEAP_CACHE_CAPS (MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT | MALLOC_CAP_32BIT)
+
+static void heap_caps_free_to_heap(void *ptr);
+#endif
+#ifdef CONFIG_HEAP_PROFILER
+#include "heap_profiler_internal.h"
+
+static void heap_caps_profile_sample(void *ptr, size_t samples);
+
+/* Called for each allocation, records the rare ones which are sampled */
+static inline __attribute__((always_inline)) void heap_caps_profile_alloc(void *ptr, size_t size)
+{
+    size_t samples = heap_profiler_sample_count(size);
+    if (samples != 0) {
+        heap_caps_profile_sample(ptr, samples);
+    }
+}
+#endif
 
 /*
 This file, combined with a region allocator that supports multiple heaps, solves the problem that the ESP32 has RAM
@@ -81,43 +106,19 @@ esp_err_t heap_caps_register_failed_alloc_callback(esp_alloc_failed_hook_t callb
 
 bool heap_caps_match(const heap_t *heap, uint32_t caps)
 {
+    caps &= ~MALLOC_CAP_LONG_LIVED;
     return heap->heap != NULL && ((get_all_caps(heap) & caps) == caps);
 }
 
 /*
-Routine to allocate a bit of memory with certain capabilities. caps is a bitfield of MALLOC_CAP_* bits.
+Find a heap with the requested caps and allocate from it.
 */
-IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
+IRAM_ATTR static void *heap_caps_malloc_from_heaps( size_t size, uint32_t caps )
 {
     void *ret = NULL;
-
-    if (size > HEAP_SIZE_MAX) {
-        // Avoids int overflow when adding small numbers to size, or
-        // calculating 'end' from start+size, by limiting 'size' to the possible range
-        heap_caps_alloc_failed(size, caps, __func__);
-
-        return NULL;
-    }
-
-    if (caps & MALLOC_CAP_EXEC) {
-        //MALLOC_CAP_EXEC forces an alloc from IRAM. There is a region which has both this as well as the following
-        //caps, but the following caps are not possible for IRAM.  Thus, the combination is impossible and we return
-        //NULL directly, even although our heap capabilities (based on soc_memory_tags & soc_memory_regions) would
-        //indicate there is a tag for this.
-        if ((caps & MALLOC_CAP_8BIT) || (caps & MALLOC_CAP_DMA)) {
-            heap_caps_alloc_failed(size, caps, __func__);
-
-            return NULL;
-        }
-        caps |= MALLOC_CAP_32BIT; // IRAM is 32-bit accessible RAM
-    }
-
-    if (caps & MALLOC_CAP_32BIT) {
-        /* 32-bit accessible RAM should allocated in 4 byte aligned sizes
-         * (Future versions of ESP-IDF should possibly fail if an invalid size is requested)
-         */
-        size = (size + 3) & (~3); // int overflow checked above
-    }
+    //MALLOC_CAP_LONG_LIVED is a hint for placement in the heap, not a capability to match
+    const bool long_lived = caps & MALLOC_CAP_LONG_LIVED;
+    caps &= ~MALLOC_CAP_LONG_LIVED;
 
     for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
         //Iterate over heaps and check capabilities at this priority
@@ -141,8 +142,12 @@ IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
                             return dram_alloc_to_iram_addr(ret, size + 4);  // int overflow checked above
                         }
                     } else {
-                        //Just try to alloc, nothing special.
-                        ret = multi_heap_malloc(heap->heap, size);
+                        //Just try to alloc, long-lived memory from the top of the heap.
+                        if (long_lived) {
+                            ret = multi_heap_malloc_high(heap->heap, size);
+                        } else {
+                            ret = multi_heap_malloc(heap->heap, size);
+                        }
                         if (ret != NULL) {
                             return ret;
                         }
@@ -152,12 +157,144 @@ IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
         }
     }
 
-    heap_caps_alloc_failed(size, caps, __func__);
+    //Nothing usable found.
+    return NULL;
+}
+
+/*
+Allocate memory with certain capabilities, without recording it in the heap profiler.
+*/
+IRAM_ATTR static void *heap_caps_malloc_base( size_t size, uint32_t caps )
+{
+    void *ret = NULL;
+
+    if (size > HEAP_SIZE_MAX) {
+        // Avoids int overflow when adding small numbers to size, or
+        // calculating 'end' from start+size, by limiting 'size' to the possible range
+        heap_caps_alloc_failed(size, caps, "heap_caps_malloc");
+
+        return NULL;
+    }
+
+    if (caps & MALLOC_CAP_EXEC) {
+        //MALLOC_CAP_EXEC forces an alloc from IRAM. There is a region which has both this as well as the following
+        //caps, but the following caps are not possible for IRAM.  Thus, the combination is impossible and we return
+        //NULL directly, even although our heap capabilities (based on soc_memory_tags & soc_memory_regions) would
+        //indicate there is a tag for this.
+        if ((caps & MALLOC_CAP_8BIT) || (caps & MALLOC_CAP_DMA)) {
+            heap_caps_alloc_failed(size, caps, "heap_caps_malloc");
+
+            return NULL;
+        }
+        caps |= MALLOC_CAP_32BIT; // IRAM is 32-bit accessible RAM
+    }
+
+    if (caps & MALLOC_CAP_32BIT) {
+        /* 32-bit accessible RAM should allocated in 4 byte aligned sizes
+         * (Future versions of ESP-IDF should possibly fail if an invalid size is requested)
+         */
+        size = (size + 3) & (~3); // int overflow checked above
+    }
+
+#ifdef CONFIG_HEAP_CACHE
+    if ((caps & ~HEAP_CACHE_CAPS) == 0) {
+        size_t block_size = heap_caps_cache_block_size(size);
+        if (block_size != 0) {
+            ret = heap_caps_cache_get(block_size);
+            if (ret != NULL) {
+#ifdef CONFIG_HEAP_TASK_TRACKING
+                //The block still belongs to the task which freed it
+                multi_heap_set_owner(ret);
+#endif
+                return ret;
+            }
+            //Allocate the whole size class, so that the block can be cached once it's freed
+            size = block_size;
+        }
+    }
+#endif
+
+    ret = heap_caps_malloc_from_heaps(size, caps);
+    if (ret != NULL) {
+        return ret;
+    }
+
+#ifdef CONFIG_HEAP_CACHE
+    //Cached blocks may be what's missing, give them back to the heaps and try again
+    if (heap_caps_cache_flush_blocks(heap_caps_free_to_heap) != 0) {
+        ret = heap_caps_malloc_from_heaps(size, caps);
+        if (ret != NULL) {
+            return ret;
+        }
+    }
+#endif
+
+    heap_caps_alloc_failed(size, caps, "heap_caps_malloc");
 
     //Nothing usable found.
     return NULL;
 }
 
+/*
+Routine to allocate a bit of memory with certain capabilities. caps is a bitfield of MALLOC_CAP_* bits.
+*/
+IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
+{
+    void *ret = heap_caps_malloc_base(size, caps);
+#ifdef CONFIG_HEAP_PROFILER
+    if (ret != NULL) {
+        heap_caps_profile_alloc(ret, size);
+    }
+#endif
+    return ret;
+}
+
+#ifdef CONFIG_HEAP_PROFILER
+/* Architecture-specific return value of __builtin_return_address which
+ * should be interpreted as an invalid address.
+ */
+#ifdef __XTENSA__
+#define HEAP_ARCH_INVALID_PC  0x40000000
+#else
+#define HEAP_ARCH_INVALID_PC  0x00000000
+#endif
+
+// The allocating function (heap_caps_malloc etc.) is 1 stack frame deeper than we care about
+#define PROFILE_STACK_OFFSET  1
+
+#define PROFILE_STACK(N) do {                                           \
+        if (CONFIG_HEAP_PROFILER_STACK_DEPTH == N) {                    \
+            goto done;                                                  \
+        }                                                               \
+        callers[N] = __builtin_return_address(N+PROFILE_STACK_OFFSET);  \
+        if (!esp_ptr_executable(callers[N])                             \
+            || callers[N] == (void*) HEAP_ARCH_INVALID_PC) {            \
+            callers[N] = 0;                                             \
+            goto done;                                                  \
+        }                                                               \
+    } while(0)
+
+/* Record a sampled allocation with the call stack of the caller of the allocating function.
+
+   Not inlined, so that the depth of the stack frames is known. Calls to __builtin_return_address are "unrolled" via
+   the PROFILE_STACK macro as gcc requires the argument to be a compile-time constant.
+*/
+static IRAM_ATTR __attribute__((noinline)) void heap_caps_profile_sample(void *ptr, size_t samples)
+{
+    void *callers[CONFIG_HEAP_PROFILER_STACK_DEPTH] = { 0 };
+    PROFILE_STACK(0);
+    PROFILE_STACK(1);
+    PROFILE_STACK(2);
+    PROFILE_STACK(3);
+    PROFILE_STACK(4);
+    PROFILE_STACK(5);
+    PROFILE_STACK(6);
+    PROFILE_STACK(7);
+ done:
+    heap_profiler_record_sample(ptr, samples, callers);
+}
+#endif
+
 
 #define MALLOC_DISABLE_EXTERNAL_ALLOCS -1
 //Dual-use: -1 (=MALLOC_DISABLE_EXTERNAL_ALLOCS) disables allocations in external memory, >=0 sets the limit for allocations preferring internal memory.
@@ -292,6 +429,10 @@ IRAM_ATTR void heap_caps_free( void *ptr)
         return;
     }
 
+#ifdef CONFIG_HEAP_PROFILER
+    heap_profiler_record_free(ptr);
+#endif
+
     if (esp_ptr_in_diram_iram(ptr)) {
         //Memory allocated here is actually allocated in the DRAM alias region and
         //cannot be de-allocated as usual. dram_alloc_to_iram_addr stores a pointer to
@@ -302,9 +443,57 @@ IRAM_ATTR void heap_caps_free( void *ptr)
 
     heap_t *heap = find_containing_heap(ptr);
     assert(heap != NULL && "free() target pointer is outside heap areas");
+#ifdef CONFIG_HEAP_CACHE
+    if ((get_all_caps(heap) & HEAP_CACHE_CAPS) == HEAP_CACHE_CAPS
+        && heap_caps_cache_put(ptr, multi_heap_get_allocated_size(heap->heap, ptr))) {
+        return;
+    }
+#endif
+    multi_heap_free(heap->heap, ptr);
+}
+
+#ifdef CONFIG_HEAP_CACHE
+/* Free a block bypassing the cache, used to flush it */
+IRAM_ATTR static void heap_caps_free_to_heap(void *ptr)
+{
+    heap_t *heap = find_containing_heap(ptr);
+    assert(heap != NULL && "cached block is outside heap areas");
     multi_heap_free(heap->heap, ptr);
 }
 
+void heap_caps_cache_flush(void)
+{
+    heap_caps_cache_flush_blocks(heap_caps_free_to_heap);
+}
+#endif
+
+heap_caps_pool_handle_t heap_caps_pool_create(size_t object_size, size_t num_objects, uint32_t caps)
+{
+    size_t storage_size = heap_caps_pool_storage_size(object_size, num_objects);
+    if (storage_size == 0) {
+        return NULL;
+    }
+
+    //The free list head is updated with compare-and-set, which only works in internal memory
+    void *control = heap_caps_malloc(heap_caps_pool_control_size(), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    void *storage = heap_caps_malloc(storage_size, caps);
+    if (control == NULL || storage == NULL) {
+        heap_caps_free(control);
+        heap_caps_free(storage);
+        return NULL;
+    }
+    return heap_caps_pool_init(control, storage, object_size, num_objects);
+}
+
+void heap_caps_pool_delete(heap_caps_pool_handle_t pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    heap_caps_free(heap_caps_pool_get_storage(pool));
+    heap_caps_free(pool);
+}
+
 IRAM_ATTR void *heap_caps_realloc( void *ptr, size_t size, int caps)
 {
     bool ptr_in_diram_case = false;
@@ -347,13 +536,19 @@ IRAM_ATTR void *heap_caps_realloc( void *ptr, size_t size, int caps)
 
     // are the existing heap's capabilities compatible with the
     // requested ones?
-    bool compatible_caps = (caps & get_all_caps(heap)) == caps;
+    uint32_t match_caps = caps & ~MALLOC_CAP_LONG_LIVED;
+    bool compatible_caps = (match_caps & get_all_caps(heap)) == match_caps;
 
     if (compatible_caps && !ptr_in_diram_case) {
         // try to reallocate this memory within the same heap
         // (which will resize the block if it can)
         void *r = multi_heap_realloc(heap->heap, ptr, size);
         if (r != NULL) {
+#ifdef CONFIG_HEAP_PROFILER
+            //The block is recorded again, as if it was freed and allocated
+            heap_profiler_record_free(ptr);
+            heap_caps_profile_alloc(r, size);
+#endif
             return r;
         }
     }
@@ -464,6 +659,31 @@ void heap_caps_get_info( multi_heap_info_t *info, uint32_t caps )
     }
 }
 
+void heap_caps_get_frag_info( multi_heap_frag_info_t *info, uint32_t caps )
+{
+    bzero(info, sizeof(multi_heap_frag_info_t));
+
+    heap_t *heap;
+    SLIST_FOREACH(heap, &registered_heaps, next) {
+        if (heap_caps_match(heap, caps)) {
+            multi_heap_frag_info_t hinfo;
+            multi_heap_get_frag_info(heap->heap, &hinfo);
+
+            for (int i = 0; i < MULTI_HEAP_FRAG_SIZE_CLASSES; i++) {
+                info->free_blocks[i] += hinfo.free_blocks[i];
+                info->free_bytes[i] += hinfo.free_bytes[i];
+            }
+            info->total_free_bytes += hinfo.total_free_bytes;
+            info->largest_free_block = MAX(info->largest_free_block,
+                                           hinfo.largest_free_block);
+        }
+    }
+    if (info->total_free_bytes > 0) {
+        info->fragmentation = (uint64_t)(info->total_free_bytes - info->largest_free_block) * 100
+                              / info->total_free_bytes;
+    }
+}
+
 void heap_caps_print_heap_info( uint32_t caps )
 {
     multi_heap_info_t info;
@@ -585,6 +805,9 @@ IRAM_ATTR void *heap_caps_aligned_alloc(size_t alignment, size_t size, int caps)
                     //Just try to alloc, nothing special.
                     ret = multi_heap_aligned_alloc(heap->heap, size, alignment); 
                     if (ret != NULL) {
+#ifdef CONFIG_HEAP_PROFILER
+                        heap_caps_profile_alloc(ret, size);
+#endif
                         return ret;
                     }
                 }
@@ -619,6 +842,10 @@ IRAM_ATTR void heap_caps_aligned_free(void *ptr)
         return;
     }
 
+#ifdef CONFIG_HEAP_PROFILER
+    heap_profiler_record_free(ptr);
+#endif
+
     heap_t *heap = find_containing_heap(ptr);
     assert(heap != NULL && "free() target pointer is outside heap areas");
     multi_heap_aligned_free(heap->heap, ptr);
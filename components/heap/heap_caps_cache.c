@@ -0,0 +1,187 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "heap_caps_cache_internal.h"
+
+/* Note: Keep platform-specific parts in this header, this source
+   file should depend on libc only */
+#include "multi_heap_platform.h"
+
+#ifndef CONFIG_HEAP_CACHE_DEPTH
+#define CONFIG_HEAP_CACHE_DEPTH 8 /* host tests */
+#endif
+
+/* Size classes are powers of two from 16 to 256 bytes */
+#define NUM_CLASSES         5
+#define MIN_CLASS_SIZE_LOG2 4
+#define MAX_CLASS_SIZE      (1 << (MIN_CLASS_SIZE_LOG2 + NUM_CLASSES - 1))
+
+/* The heap may give a bit more than the requested size, if the rest of the free block was too small to split. Blocks
+   up to this much bigger than the class size are still cached in it. */
+#define CLASS_SIZE_SLACK    16
+
+typedef struct {
+    multi_heap_lock_t lock;
+    uint8_t count[NUM_CLASSES];
+    void *blocks[NUM_CLASSES][CONFIG_HEAP_CACHE_DEPTH];
+    size_t hits;
+    size_t misses;
+    size_t cached_frees;
+    size_t overflows;
+} heap_cache_t;
+
+static heap_cache_t s_cache[MULTI_HEAP_NUM_CORES] = {
+    [0 ... MULTI_HEAP_NUM_CORES - 1] = { .lock = MULTI_HEAP_LOCK_STATIC_INITIALIZER }
+};
+
+static size_t s_flushes; /* protected by the lock of the first core */
+
+#ifndef MULTI_HEAP_FREERTOS
+int multi_heap_host_core_id(void)
+{
+    static __thread int core_id = -1;
+    static int next_core_id;
+    if (core_id < 0) {
+        core_id = __atomic_fetch_add(&next_core_id, 1, __ATOMIC_RELAXED) % MULTI_HEAP_NUM_CORES;
+    }
+    return core_id;
+}
+#endif
+
+static inline size_t class_size(int cls)
+{
+    return (size_t)1 << (MIN_CLASS_SIZE_LOG2 + cls);
+}
+
+/* Smallest class which holds 'size' bytes, or -1 */
+static inline int class_for_alloc(size_t size)
+{
+    if (size == 0 || size > MAX_CLASS_SIZE) {
+        return -1;
+    }
+    if (size <= class_size(0)) {
+        return 0;
+    }
+    return (31 - __builtin_clz(size - 1)) + 1 - MIN_CLASS_SIZE_LOG2;
+}
+
+/* Class of a block which is being freed, or -1 */
+static inline int class_for_block(size_t block_size)
+{
+    if (block_size < class_size(0) || block_size >= MAX_CLASS_SIZE + CLASS_SIZE_SLACK) {
+        return -1;
+    }
+    int cls = (31 - __builtin_clz(block_size)) - MIN_CLASS_SIZE_LOG2;
+    if (cls >= NUM_CLASSES) {
+        cls = NUM_CLASSES - 1;
+    }
+    return (block_size < class_size(cls) + CLASS_SIZE_SLACK) ? cls : -1;
+}
+
+size_t heap_caps_cache_block_size(size_t size)
+{
+    int cls = class_for_alloc(size);
+    return (cls < 0) ? 0 : class_size(cls);
+}
+
+void *heap_caps_cache_get(size_t block_size)
+{
+    int cls = class_for_alloc(block_size);
+    if (cls < 0) {
+        return NULL;
+    }
+    void *ptr = NULL;
+    heap_cache_t *cache = &s_cache[MULTI_HEAP_CORE_ID()];
+    MULTI_HEAP_LOCK(&cache->lock);
+    if (cache->count[cls] > 0) {
+        ptr = cache->blocks[cls][--cache->count[cls]];
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    MULTI_HEAP_UNLOCK(&cache->lock);
+    return ptr;
+}
+
+bool heap_caps_cache_put(void *ptr, size_t block_size)
+{
+    int cls = class_for_block(block_size);
+    if (cls < 0) {
+        return false;
+    }
+    bool cached = false;
+    heap_cache_t *cache = &s_cache[MULTI_HEAP_CORE_ID()];
+    MULTI_HEAP_LOCK(&cache->lock);
+    if (cache->count[cls] < CONFIG_HEAP_CACHE_DEPTH) {
+        cache->blocks[cls][cache->count[cls]++] = ptr;
+        cache->cached_frees++;
+        cached = true;
+    } else {
+        cache->overflows++;
+    }
+    MULTI_HEAP_UNLOCK(&cache->lock);
+    return cached;
+}
+
+size_t heap_caps_cache_flush_blocks(void (*release)(void *ptr))
+{
+    size_t released = 0;
+    MULTI_HEAP_LOCK(&s_cache[0].lock);
+    s_flushes++;
+    MULTI_HEAP_UNLOCK(&s_cache[0].lock);
+    for (int core = 0; core < MULTI_HEAP_NUM_CORES; core++) {
+        heap_cache_t *cache = &s_cache[core];
+        for (int cls = 0; cls < NUM_CLASSES; cls++) {
+            /* one block at a time, so that the cache isn't locked while the heap is */
+            while (true) {
+                void *ptr = NULL;
+                MULTI_HEAP_LOCK(&cache->lock);
+                if (cache->count[cls] > 0) {
+                    ptr = cache->blocks[cls][--cache->count[cls]];
+                }
+                MULTI_HEAP_UNLOCK(&cache->lock);
+                if (ptr == NULL) {
+                    break;
+                }
+                release(ptr);
+                released++;
+            }
+        }
+    }
+    return released;
+}
+
+void heap_caps_cache_get_stats(heap_caps_cache_stats_t *stats)
+{
+    memset(stats, 0, sizeof(heap_caps_cache_stats_t));
+    for (int core = 0; core < MULTI_HEAP_NUM_CORES; core++) {
+        heap_cache_t *cache = &s_cache[core];
+        MULTI_HEAP_LOCK(&cache->lock);
+        stats->hits += cache->hits;
+        stats->misses += cache->misses;
+        stats->cached_frees += cache->cached_frees;
+        stats->overflows += cache->overflows;
+        for (int cls = 0; cls < NUM_CLASSES; cls++) {
+            stats->cached_blocks += cache->count[cls];
+            stats->cached_bytes += cache->count[cls] * class_size(cls);
+        }
+        if (core == 0) {
+            stats->flushes = s_flushes;
+        }
+        MULTI_HEAP_UNLOCK(&cache->lock);
+    }
+}
@@ -0,0 +1,53 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_heap_caps_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per-core cache of small heap blocks, used by heap_caps.c.
+
+   Blocks freed with heap_caps_free() are kept in a small stack ("magazine") per size class and core, and handed out
+   again by heap_caps_malloc() without taking the heap lock or searching the heaps. The cache only knows about block
+   pointers and sizes, heap_caps.c decides which allocations can use it. It doesn't depend on the rest of heap_caps,
+   so that it can also be tested on the host.
+*/
+
+/* Return the size of the block to allocate for a request of 'size' bytes, so that the block can be cached when it is
+   freed. Returns 0 if blocks of this size are not cached. */
+size_t heap_caps_cache_block_size(size_t size);
+
+/* Take a block from the cache of this core. 'block_size' is the result of heap_caps_cache_block_size().
+
+   Returns NULL if the cache has no block of this size. */
+void *heap_caps_cache_get(size_t block_size);
+
+/* Keep a block which is being freed in the cache of this core. 'block_size' is the allocated size of the block.
+
+   Returns false if the block can't be cached, then the caller has to free it. */
+bool heap_caps_cache_put(void *ptr, size_t block_size);
+
+/* Remove all blocks from the caches of all cores, calling 'release' to free each of them.
+
+   Returns the number of blocks released. */
+size_t heap_caps_cache_flush_blocks(void (*release)(void *ptr));
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,178 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include "heap_caps_pool_internal.h"
+
+/* Note: Keep platform-specific parts in this header, this source
+   file should depend on libc only */
+#include "multi_heap_platform.h"
+
+/* The free list is a singly linked list of object indexes, the index of the next free object is stored in the first
+   word of each free object.
+
+   The head of the list is updated with compare-and-set only, so that no lock is needed. It holds the index of the
+   first free object in the low 16 bits, and a tag in the high 16 bits which changes on every update. Otherwise an
+   allocation could read the next index of the first free object, then another core could allocate that object and
+   free other objects, and the first allocation would still see the same head and set it to the stale next index.
+*/
+#define INDEX_MASK   0xFFFF
+#define INDEX_END    INDEX_MASK
+#define TAG_ONE      (INDEX_MASK + 1)
+
+struct heap_caps_pool {
+    volatile uint32_t head;
+    volatile uint32_t num_free;
+    volatile uint32_t min_free;
+    uint8_t *storage;
+    size_t object_size;
+    size_t num_objects;
+};
+
+static inline size_t round_object_size(size_t object_size)
+{
+    return (object_size + 3) & ~3;
+}
+
+static inline uint32_t *object_at(heap_caps_pool_handle_t pool, uint32_t index)
+{
+    return (uint32_t *)(pool->storage + index * pool->object_size);
+}
+
+/* Atomically add 'delta' to *addr, returns the new value */
+static inline uint32_t atomic_add(volatile uint32_t *addr, int32_t delta)
+{
+    uint32_t old, set;
+    do {
+        old = *addr;
+        set = old + delta;
+        MULTI_HEAP_COMPARE_SET(addr, old, &set);
+    } while (set != old);
+    return old + delta;
+}
+
+static inline void update_min_free(heap_caps_pool_handle_t pool, uint32_t num_free)
+{
+    uint32_t old, set;
+    do {
+        old = pool->min_free;
+        if (num_free >= old) {
+            return;
+        }
+        set = num_free;
+        MULTI_HEAP_COMPARE_SET(&pool->min_free, old, &set);
+    } while (set != old);
+}
+
+size_t heap_caps_pool_control_size(void)
+{
+    return sizeof(struct heap_caps_pool);
+}
+
+size_t heap_caps_pool_storage_size(size_t object_size, size_t num_objects)
+{
+    if (object_size == 0 || num_objects == 0 || num_objects > HEAP_CAPS_POOL_MAX_OBJECTS
+        || object_size > SIZE_MAX / num_objects - 3) {
+        return 0;
+    }
+    return round_object_size(object_size) * num_objects;
+}
+
+heap_caps_pool_handle_t heap_caps_pool_init(void *control, void *storage, size_t object_size, size_t num_objects)
+{
+    assert(heap_caps_pool_storage_size(object_size, num_objects) != 0);
+    heap_caps_pool_handle_t pool = (heap_caps_pool_handle_t)control;
+
+    pool->storage = (uint8_t *)storage;
+    pool->object_size = round_object_size(object_size);
+    pool->num_objects = num_objects;
+    for (uint32_t i = 0; i < num_objects; i++) {
+        *object_at(pool, i) = (i + 1 < num_objects) ? i + 1 : INDEX_END;
+    }
+    pool->head = 0;
+    pool->num_free = num_objects;
+    pool->min_free = num_objects;
+    return pool;
+}
+
+void *heap_caps_pool_get_storage(heap_caps_pool_handle_t pool)
+{
+    return pool->storage;
+}
+
+void *heap_caps_pool_alloc(heap_caps_pool_handle_t pool)
+{
+    uint32_t head, set, index;
+    do {
+        head = pool->head;
+        index = head & INDEX_MASK;
+        if (index == INDEX_END) {
+            return NULL;
+        }
+        /* If the object is allocated by someone else meanwhile, this reads garbage but the head has changed */
+        uint32_t next = *object_at(pool, index) & INDEX_MASK;
+        set = ((head & ~INDEX_MASK) + TAG_ONE) | next;
+        MULTI_HEAP_COMPARE_SET(&pool->head, head, &set);
+    } while (set != head);
+
+    update_min_free(pool, atomic_add(&pool->num_free, -1));
+    return object_at(pool, index);
+}
+
+void heap_caps_pool_free(heap_caps_pool_handle_t pool, void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    size_t offset = (uint8_t *)ptr - pool->storage;
+    assert((uint8_t *)ptr >= pool->storage && offset < pool->object_size * pool->num_objects
+           && offset % pool->object_size == 0 && "heap_caps_pool_free() pointer is not an object of this pool");
+    uint32_t index = offset / pool->object_size;
+
+    /* Count the object before it can be allocated again, so that num_free never goes below zero */
+    atomic_add(&pool->num_free, 1);
+
+    uint32_t head, set;
+    do {
+        head = pool->head;
+        *(uint32_t *)ptr = head & INDEX_MASK;
+        set = ((head & ~INDEX_MASK) + TAG_ONE) | index;
+        MULTI_HEAP_COMPARE_SET(&pool->head, head, &set);
+    } while (set != head);
+}
+
+size_t heap_caps_pool_get_object_size(heap_caps_pool_handle_t pool)
+{
+    return pool->object_size;
+}
+
+void heap_caps_pool_get_info(heap_caps_pool_handle_t pool, multi_heap_info_t *info)
+{
+    size_t num_free = pool->num_free;
+    if (num_free > pool->num_objects) {
+        num_free = pool->num_objects; /* an object was freed while another one was being allocated */
+    }
+
+    memset(info, 0, sizeof(multi_heap_info_t));
+    info->total_free_bytes = num_free * pool->object_size;
+    info->total_allocated_bytes = (pool->num_objects - num_free) * pool->object_size;
+    info->largest_free_block = (num_free > 0) ? pool->object_size : 0;
+    info->minimum_free_bytes = pool->min_free * pool->object_size;
+    info->allocated_blocks = pool->num_objects - num_free;
+    info->free_blocks = num_free;
+    info->total_blocks = pool->num_objects;
+}
@@ -0,0 +1,46 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stddef.h>
+#include "esp_heap_caps_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fixed-size object pools, used by heap_caps.c.
+
+   heap_caps.c allocates the memory of a pool with the requested caps and heap_caps_pool.c manages the objects in it,
+   so that the pool itself can also be tested on the host.
+*/
+
+/* Size of the memory needed for the pool structure. It must be in internal RAM, as the free list is updated with
+   compare-and-set instructions. */
+size_t heap_caps_pool_control_size(void);
+
+/* Size of the memory needed for the objects of a pool, or 0 if the arguments are invalid */
+size_t heap_caps_pool_storage_size(size_t object_size, size_t num_objects);
+
+/* Initialise a pool in memory of the sizes given by the functions above, with all objects free.
+
+   Returns the handle of the pool, which points to 'control'. */
+heap_caps_pool_handle_t heap_caps_pool_init(void *control, void *storage, size_t object_size, size_t num_objects);
+
+/* Return the 'storage' pointer given to heap_caps_pool_init() */
+void *heap_caps_pool_get_storage(heap_caps_pool_handle_t pool);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,338 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include "heap_profiler_internal.h"
+
+/* Note: Keep platform-specific parts in this header, this source
+   file should depend on libc only */
+#include "multi_heap_platform.h"
+
+/* Defaults for host tests */
+#ifndef CONFIG_HEAP_PROFILER_STACK_DEPTH
+#define CONFIG_HEAP_PROFILER_STACK_DEPTH 4
+#endif
+#ifndef CONFIG_HEAP_PROFILER_MAX_SITES
+#define CONFIG_HEAP_PROFILER_MAX_SITES 64
+#endif
+#ifndef CONFIG_HEAP_PROFILER_MAX_SAMPLES
+#define CONFIG_HEAP_PROFILER_MAX_SAMPLES 4096
+#endif
+
+_Static_assert(CONFIG_HEAP_PROFILER_STACK_DEPTH <= HEAP_PROFILER_MAX_STACK_DEPTH,
+               "CONFIG_HEAP_PROFILER_STACK_DEPTH is larger than HEAP_PROFILER_MAX_STACK_DEPTH");
+
+/* The table of sampled allocations has some free slots, so that lookups stay short */
+#define SAMPLE_SLOTS (CONFIG_HEAP_PROFILER_MAX_SAMPLES + CONFIG_HEAP_PROFILER_MAX_SAMPLES / 2)
+
+#define MAX_SAMPLE_INTERVAL (1 << 24)
+
+typedef struct {
+    uint32_t stack_hash; /* 0 if the entry is unused */
+    uint32_t live_samples;
+    uint32_t total_samples;
+    void *callers[CONFIG_HEAP_PROFILER_STACK_DEPTH];
+} site_t;
+
+/* A sampled allocation which is not freed yet. The allocated size isn't needed, each sample stands for
+   'sample_interval' bytes. */
+typedef struct {
+    void *ptr; /* NULL if the entry is unused */
+    uint16_t site;
+    uint16_t samples;
+} sample_t;
+
+static multi_heap_lock_t s_lock = MULTI_HEAP_LOCK_STATIC_INITIALIZER;
+static volatile bool s_running;
+static uint32_t s_sample_interval;
+static uint32_t s_rand;
+static size_t s_dropped;
+static size_t s_num_sites;
+static volatile size_t s_num_samples;
+static site_t s_sites[CONFIG_HEAP_PROFILER_MAX_SITES];
+static sample_t s_samples[SAMPLE_SLOTS];
+
+/* Bytes to allocate until the next sample point. Kept per core so that allocations which aren't sampled don't take
+   any lock; an interrupt which allocates memory while a task on the same core updates the counter may make it skip
+   a few bytes. */
+static volatile int32_t s_bytes_until_sample[MULTI_HEAP_NUM_CORES];
+
+static inline IRAM_ATTR uint32_t next_rand(void)
+{
+    /* xorshift32, never returns 0 */
+    uint32_t x = s_rand;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_rand = x;
+    return x;
+}
+
+/* Distance to the next sample point: exponentially distributed with a mean of s_sample_interval, so that each byte is
+   a sample point with the same probability whatever the sizes of the allocations are. This is -ln(u) * interval for
+   u uniform in (0, 1], computed in fixed point as this can run in an interrupt handler, where the FPU can't be used. */
+static IRAM_ATTR uint32_t next_interval(void)
+{
+    uint32_t u = next_rand();
+    int msb = 31 - __builtin_clz(u);
+    /* fractional part of log2(u) in 16.16 fixed point: log2(1 + m) ~= m * (1.3465 - 0.3465 * m) */
+    uint32_t m = (msb >= 16) ? (u >> (msb - 16)) & 0xFFFF : (u << (16 - msb)) & 0xFFFF;
+    uint32_t log2_frac = ((uint64_t)m * (88245 - ((22709 * m) >> 16))) >> 16;
+    uint32_t neg_log2 = ((32 - msb) << 16) - log2_frac; /* -log2(u / 2^32) */
+    /* -ln(x) = -log2(x) * ln(2), ln(2) = 45426 / 65536 */
+    uint32_t interval = ((uint64_t)neg_log2 * 45426 * s_sample_interval) >> 32;
+    return (interval > 0) ? interval : 1;
+}
+
+static inline IRAM_ATTR uint32_t stack_hash(void *const *callers)
+{
+    /* FNV-1a over the addresses */
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < CONFIG_HEAP_PROFILER_STACK_DEPTH; i++) {
+        hash = (hash ^ (uint32_t)(uintptr_t)callers[i]) * 16777619u;
+    }
+    return (hash != 0) ? hash : 1;
+}
+
+static inline IRAM_ATTR size_t sample_slot(void *ptr)
+{
+    return (((uintptr_t)ptr >> 2) * 2654435761u) % SAMPLE_SLOTS;
+}
+
+/* Find the site with this call stack, or add it. Returns -1 if the table is full. Call with the lock held. */
+static IRAM_ATTR int find_site(void *const *callers)
+{
+    uint32_t hash = stack_hash(callers);
+    size_t i = hash % CONFIG_HEAP_PROFILER_MAX_SITES;
+    for (size_t n = 0; n < CONFIG_HEAP_PROFILER_MAX_SITES; n++) {
+        site_t *site = &s_sites[i];
+        if (site->stack_hash == hash) {
+            return i;
+        }
+        if (site->stack_hash == 0) {
+            site->stack_hash = hash;
+            memcpy(site->callers, callers, sizeof(site->callers));
+            s_num_sites++;
+            return i;
+        }
+        i = (i + 1) % CONFIG_HEAP_PROFILER_MAX_SITES;
+    }
+    return -1;
+}
+
+IRAM_ATTR size_t heap_profiler_sample_count(size_t size)
+{
+    if (!s_running) {
+        return 0;
+    }
+    volatile int32_t *until = &s_bytes_until_sample[MULTI_HEAP_CORE_ID()];
+    *until -= size;
+    if (*until > 0) {
+        return 0;
+    }
+
+    size_t samples = 0;
+    MULTI_HEAP_LOCK(&s_lock);
+    while (*until <= 0) {
+        *until += next_interval();
+        samples++;
+    }
+    MULTI_HEAP_UNLOCK(&s_lock);
+    return samples;
+}
+
+IRAM_ATTR void heap_profiler_record_sample(void *ptr, size_t samples, void *const *callers)
+{
+    MULTI_HEAP_LOCK(&s_lock);
+    if (!s_running) {
+        goto done;
+    }
+    int site = find_site(callers);
+    if (site < 0 || s_num_samples == CONFIG_HEAP_PROFILER_MAX_SAMPLES) {
+        s_dropped += samples;
+        goto done;
+    }
+    if (samples > UINT16_MAX) {
+        samples = UINT16_MAX;
+    }
+
+    size_t i = sample_slot(ptr);
+    while (s_samples[i].ptr != NULL) {
+        i = (i + 1) % SAMPLE_SLOTS;
+    }
+    s_samples[i].ptr = ptr;
+    s_samples[i].site = site;
+    s_samples[i].samples = samples;
+    s_num_samples++;
+    s_sites[site].live_samples += samples;
+    s_sites[site].total_samples += samples;
+
+ done:
+    MULTI_HEAP_UNLOCK(&s_lock);
+}
+
+IRAM_ATTR void heap_profiler_record_free(void *ptr)
+{
+    if (s_num_samples == 0 || !s_running) {
+        return;
+    }
+    /* A sampled pointer is always found by probing from its home slot without crossing an unused slot, even while
+       another core removes an entry (see below). So if the home slot is unused, 'ptr' wasn't sampled and most frees
+       don't need the lock. */
+    size_t i = sample_slot(ptr);
+    if (((volatile sample_t *)s_samples)[i].ptr == NULL) {
+        return;
+    }
+
+    MULTI_HEAP_LOCK(&s_lock);
+    while (s_samples[i].ptr != NULL && s_samples[i].ptr != ptr) {
+        i = (i + 1) % SAMPLE_SLOTS;
+    }
+    if (s_samples[i].ptr == ptr) {
+        s_sites[s_samples[i].site].live_samples -= s_samples[i].samples;
+        s_num_samples--;
+
+        /* Move the following entries back, so that no lookup stops early at the freed slot. An entry is copied
+           before the slot it leaves is reused or cleared, so there is never an unused slot on its probe path. */
+        size_t j = i;
+        while (true) {
+            size_t home;
+            do {
+                j = (j + 1) % SAMPLE_SLOTS;
+                if (s_samples[j].ptr == NULL) {
+                    s_samples[i].ptr = NULL;
+                    goto done;
+                }
+                home = sample_slot(s_samples[j].ptr);
+                /* entry j can stay if its home slot is cyclically in (i, j] */
+            } while ((i <= j) ? (i < home && home <= j) : (i < home || home <= j));
+            s_samples[i] = s_samples[j];
+            i = j;
+        }
+    }
+ done:
+    MULTI_HEAP_UNLOCK(&s_lock);
+}
+
+esp_err_t heap_profiler_start(size_t sample_interval)
+{
+    if (sample_interval == 0 || sample_interval > MAX_SAMPLE_INTERVAL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    MULTI_HEAP_LOCK(&s_lock);
+    if (s_running) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        memset(s_sites, 0, sizeof(s_sites));
+        memset(s_samples, 0, sizeof(s_samples));
+        s_num_sites = 0;
+        s_num_samples = 0;
+        s_dropped = 0;
+        s_sample_interval = sample_interval;
+        if (s_rand == 0) {
+            s_rand = 0x2545F491;
+        }
+        for (int core = 0; core < MULTI_HEAP_NUM_CORES; core++) {
+            s_bytes_until_sample[core] = next_interval();
+        }
+        s_running = true;
+    }
+    MULTI_HEAP_UNLOCK(&s_lock);
+    return err;
+}
+
+esp_err_t heap_profiler_stop(void)
+{
+    esp_err_t err = ESP_OK;
+    MULTI_HEAP_LOCK(&s_lock);
+    if (!s_running) {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    s_running = false;
+    MULTI_HEAP_UNLOCK(&s_lock);
+    return err;
+}
+
+size_t heap_profiler_get_sample_interval(void)
+{
+    return s_sample_interval;
+}
+
+size_t heap_profiler_get_site_count(void)
+{
+    return s_num_sites;
+}
+
+esp_err_t heap_profiler_get_site(size_t index, heap_profiler_site_t *site)
+{
+    if (site == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    MULTI_HEAP_LOCK(&s_lock);
+    for (int i = 0; i < CONFIG_HEAP_PROFILER_MAX_SITES; i++) {
+        const site_t *s = &s_sites[i];
+        if (s->stack_hash == 0) {
+            continue;
+        }
+        if (index-- == 0) {
+            memset(site, 0, sizeof(heap_profiler_site_t));
+            site->stack_hash = s->stack_hash;
+            site->live_bytes = s->live_samples * s_sample_interval;
+            site->total_bytes = s->total_samples * s_sample_interval;
+            site->live_samples = s->live_samples;
+            memcpy(site->callers, s->callers, sizeof(s->callers));
+            err = ESP_OK;
+            break;
+        }
+    }
+    MULTI_HEAP_UNLOCK(&s_lock);
+    return err;
+}
+
+size_t heap_profiler_get_dropped_count(void)
+{
+    return s_dropped;
+}
+
+void heap_profiler_dump(void)
+{
+    size_t count = heap_profiler_get_site_count();
+    size_t live_bytes = 0;
+    heap_profiler_site_t site;
+
+    printf("Heap profile, 1 sample per %u bytes allocated:\n", (unsigned)s_sample_interval);
+    for (size_t i = 0; i < count; i++) {
+        if (heap_profiler_get_site(i, &site) != ESP_OK) {
+            break;
+        }
+        printf("%u bytes live (%u samples), %u bytes allocated, stack 0x%08x caller ",
+               (unsigned)site.live_bytes, (unsigned)site.live_samples, (unsigned)site.total_bytes,
+               (unsigned)site.stack_hash);
+        for (int j = 0; j < CONFIG_HEAP_PROFILER_STACK_DEPTH && site.callers[j] != NULL; j++) {
+            printf("%s%p", (j > 0) ? ":" : "", site.callers[j]);
+        }
+        printf("\n");
+        live_bytes += site.live_bytes;
+    }
+    printf("%u bytes live in %u call sites\n", (unsigned)live_bytes, (unsigned)count);
+    if (s_dropped > 0) {
+        printf("(NB: %u samples were dropped as the profiler tables are full, estimates are too low.)\n",
+               (unsigned)s_dropped);
+    }
+}
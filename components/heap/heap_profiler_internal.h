@@ -0,0 +1,43 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stddef.h>
+#include "esp_heap_profiler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sampling heap profiler, called by heap_caps.c.
+
+   heap_caps.c calls heap_profiler_sample_count() for each allocation, and only captures the call stack and calls
+   heap_profiler_record_sample() for the rare allocations which are sampled. The profiler doesn't depend on the rest of
+   heap_caps, so that its estimates can be checked on the host.
+*/
+
+/* Return the number of sample points in the next 'size' allocated bytes. This is 0 for most allocations, then they
+   don't need to be recorded. */
+size_t heap_profiler_sample_count(size_t size);
+
+/* Record an allocation at 'ptr' which got 'samples' sample points. The first CONFIG_HEAP_PROFILER_STACK_DEPTH entries
+   of 'callers' are the call stack, unused ones are NULL. */
+void heap_profiler_record_sample(void *ptr, size_t samples, void *const *callers);
+
+/* Record that 'ptr' is freed, if it was sampled */
+void heap_profiler_record_free(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
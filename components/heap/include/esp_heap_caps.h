@@ -40,6 +40,7 @@ extern "C" {
 #define MALLOC_CAP_INTERNAL         (1<<11) ///< Memory must be internal; specifically it should not disappear when flash/spiram cache is switched off
 #define MALLOC_CAP_DEFAULT          (1<<12) ///< Memory can be returned in a non-capability-specific memory allocation (e.g. malloc(), calloc()) call
 #define MALLOC_CAP_IRAM_8BIT        (1<<13) ///< Memory must be in IRAM and allow unaligned access
+#define MALLOC_CAP_LONG_LIVED       (1<<14) ///< Not a capability but a hint: memory stays allocated for a long time, and is placed at the top of a heap, away from short-lived allocations
 
 #define MALLOC_CAP_INVALID          (1<<31) ///< Memory can't be used / list end marker
 
@@ -65,6 +66,9 @@ esp_err_t heap_caps_register_failed_alloc_callback(esp_alloc_failed_hook_t callb
  *
  * In IDF, ``malloc(p)`` is equivalent to ``heap_caps_malloc(p, MALLOC_CAP_8BIT)``.
  *
+ * Memory which is kept for a long time, while the memory around it is freed again, can be
+ * allocated with the MALLOC_CAP_LONG_LIVED hint, so that it doesn't split the free memory.
+ *
  * @param size Size, in bytes, of the amount of memory to allocate
  * @param caps        Bitwise OR of MALLOC_CAP_* flags indicating the type
  *                    of memory to be returned
@@ -241,6 +245,20 @@ size_t heap_caps_get_largest_free_block( uint32_t caps );
  */
 void heap_caps_get_info( multi_heap_info_t *info, uint32_t caps );
 
+/**
+ * @brief Get the free block histogram for all regions with the given capabilities.
+ *
+ * Calls multi_heap_get_frag_info() on all heaps which share the given capabilities. The histogram and the totals are
+ * summed across all matching heaps, the fragmentation is computed from the sums.
+ *
+ * @param info        Pointer to a structure which will be filled with the
+ *                    histogram.
+ * @param caps        Bitwise OR of MALLOC_CAP_* flags indicating the type
+ *                    of memory
+ *
+ */
+void heap_caps_get_frag_info( multi_heap_frag_info_t *info, uint32_t caps );
+
 
 /**
  * @brief Print a summary of all memory with the given capabilities.
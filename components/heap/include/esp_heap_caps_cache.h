@@ -0,0 +1,61 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Statistics of the per-core cache of small heap blocks
+ *
+ * The counters are totals over all cores since boot.
+ */
+typedef struct {
+    size_t hits;            ///< Allocations served from the cache
+    size_t misses;          ///< Allocations of a cached size which had to use the heap
+    size_t cached_frees;    ///< Blocks kept in the cache when they were freed
+    size_t overflows;       ///< Blocks freed to the heap because the cache was full
+    size_t flushes;         ///< Number of times the cache was flushed
+    size_t cached_blocks;   ///< Number of blocks currently in the cache
+    size_t cached_bytes;    ///< Total size of the blocks currently in the cache
+} heap_caps_cache_stats_t;
+
+/**
+ * @brief Free all blocks held in the per-core caches
+ *
+ * Cached blocks are still allocated from the point of view of the heap, so
+ * they are not included in heap_caps_get_free_size() and similar functions.
+ * The caches are flushed automatically when an allocation fails; this
+ * function can be called before checking the free heap size, or before an
+ * allocation which needs a large contiguous block.
+ *
+ * @note Only available if CONFIG_HEAP_CACHE is enabled.
+ */
+void heap_caps_cache_flush(void);
+
+/**
+ * @brief Get the statistics of the per-core caches
+ *
+ * @param stats  Structure filled with the statistics
+ *
+ * @note Only available if CONFIG_HEAP_CACHE is enabled.
+ */
+void heap_caps_cache_get_stats(heap_caps_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
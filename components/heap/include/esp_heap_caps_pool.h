@@ -0,0 +1,100 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "multi_heap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Opaque handle to a pool of fixed-size objects */
+typedef struct heap_caps_pool *heap_caps_pool_handle_t;
+
+/** @brief Maximum number of objects in a pool */
+#define HEAP_CAPS_POOL_MAX_OBJECTS  65535
+
+/**
+ * @brief Create a pool of fixed-size objects
+ *
+ * The memory for all objects is allocated at once with heap_caps_malloc(), so
+ * the objects have no per-object header, and allocating or freeing an object
+ * takes a constant time.
+ *
+ * heap_caps_pool_alloc() and heap_caps_pool_free() don't take any lock, so they
+ * can be called from tasks on both cores and from interrupt handlers. To use
+ * a pool from an interrupt handler which runs while the flash cache is
+ * disabled, include MALLOC_CAP_INTERNAL in the caps.
+ *
+ * @param object_size Size of each object, in bytes. Rounded up to a multiple of 4.
+ * @param num_objects Number of objects in the pool, at most HEAP_CAPS_POOL_MAX_OBJECTS.
+ * @param caps        Bitwise OR of MALLOC_CAP_* flags for the memory of the objects.
+ *
+ * @return Handle to the pool, or NULL if the arguments are invalid or there is not enough memory.
+ */
+heap_caps_pool_handle_t heap_caps_pool_create(size_t object_size, size_t num_objects, uint32_t caps);
+
+/**
+ * @brief Delete a pool and free its memory
+ *
+ * All objects of the pool become invalid, whether they were freed or not.
+ *
+ * @param pool Pool to delete. Can be NULL.
+ */
+void heap_caps_pool_delete(heap_caps_pool_handle_t pool);
+
+/**
+ * @brief Allocate an object from a pool
+ *
+ * @param pool Pool to allocate from.
+ *
+ * @return Pointer to an object of the size given to heap_caps_pool_create(),
+ *         aligned to 4 bytes, or NULL if all objects are allocated.
+ */
+void *heap_caps_pool_alloc(heap_caps_pool_handle_t pool);
+
+/**
+ * @brief Return an object to its pool
+ *
+ * @param pool Pool which the object was allocated from.
+ * @param ptr  Object to free, as returned by heap_caps_pool_alloc(). Can be NULL.
+ */
+void heap_caps_pool_free(heap_caps_pool_handle_t pool, void *ptr);
+
+/**
+ * @brief Get the size of the objects of a pool
+ *
+ * @param pool Pool handle.
+ *
+ * @return Object size in bytes, after rounding up.
+ */
+size_t heap_caps_pool_get_object_size(heap_caps_pool_handle_t pool);
+
+/**
+ * @brief Get information about a pool
+ *
+ * Fills the same structure as heap_caps_get_info(), counting each object as a
+ * block: free_blocks is the number of free objects, minimum_free_bytes is the
+ * low watermark of free objects since the pool was created, and so on.
+ *
+ * @param pool Pool handle.
+ * @param info Pointer to a structure to fill with the information.
+ */
+void heap_caps_pool_get_info(heap_caps_pool_handle_t pool, multi_heap_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
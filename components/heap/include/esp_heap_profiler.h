@@ -0,0 +1,137 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maximum number of stack frames stored for each call site */
+#define HEAP_PROFILER_MAX_STACK_DEPTH 8
+
+/**
+ * @brief Allocations of one call site, as estimated by the sampling heap profiler
+ *
+ * This structure is also the record format of heap_profiler_dump_tohost().
+ */
+typedef struct {
+    uint32_t stack_hash;    ///< Hash of the call stack, identifies the call site
+    uint32_t live_bytes;    ///< Estimated number of bytes allocated at this call site and not freed yet
+    uint32_t total_bytes;   ///< Estimated number of bytes allocated at this call site since the profiler was started
+    uint32_t live_samples;  ///< Number of samples which live_bytes is estimated from
+    void *callers[HEAP_PROFILER_MAX_STACK_DEPTH]; ///< Call stack of the allocations, innermost first. The first entries may be heap functions, unused entries are NULL.
+} heap_profiler_site_t;
+
+/**
+ * @brief Start the sampling heap profiler
+ *
+ * The profiler picks allocations as if it picked each allocated byte with a
+ * probability of 1 / sample_interval, and records the call stack of the
+ * picked allocations until they are freed. From these samples, it estimates
+ * how much memory each call site holds. Allocations which aren't sampled
+ * cost only a counter update, so the profiler can stay enabled in
+ * production.
+ *
+ * Any previous profile is cleared.
+ *
+ * @note Only available if CONFIG_HEAP_PROFILER is enabled.
+ *
+ * @param sample_interval Average number of allocated bytes between two samples.
+ *        Smaller intervals give more accurate estimates, but need more samples.
+ *
+ * @return
+ *  - ESP_OK Profiler started
+ *  - ESP_ERR_INVALID_ARG sample_interval is 0 or too large
+ *  - ESP_ERR_INVALID_STATE Profiler is already running
+ */
+esp_err_t heap_profiler_start(size_t sample_interval);
+
+/**
+ * @brief Stop the sampling heap profiler
+ *
+ * The profile is kept as it is when the profiler is stopped, until it is
+ * started again.
+ *
+ * @return
+ *  - ESP_OK Profiler stopped
+ *  - ESP_ERR_INVALID_STATE Profiler is not running
+ */
+esp_err_t heap_profiler_stop(void);
+
+/**
+ * @brief Get the sample interval of the profile
+ *
+ * @return The sample_interval given to heap_profiler_start(), or 0 if the profiler was never started
+ */
+size_t heap_profiler_get_sample_interval(void);
+
+/**
+ * @brief Get the number of call sites in the profile
+ *
+ * @return Number of call sites, valid indexes for heap_profiler_get_site() are 0 to this number - 1.
+ */
+size_t heap_profiler_get_site_count(void);
+
+/**
+ * @brief Get the estimates for one call site
+ *
+ * @param index Index of the call site, from 0 to heap_profiler_get_site_count() - 1.
+ * @param site  Structure filled with the estimates.
+ *
+ * @return
+ *  - ESP_OK Structure filled
+ *  - ESP_ERR_INVALID_ARG index is out of range or site is NULL
+ */
+esp_err_t heap_profiler_get_site(size_t index, heap_profiler_site_t *site);
+
+/**
+ * @brief Get the number of samples which could not be recorded
+ *
+ * A sample is dropped if the table of call sites or the table of sampled
+ * allocations (CONFIG_HEAP_PROFILER_MAX_SITES, CONFIG_HEAP_PROFILER_MAX_SAMPLES)
+ * is full. If this is not 0, the estimates are too low.
+ *
+ * @return Number of dropped samples since the profiler was started
+ */
+size_t heap_profiler_get_dropped_count(void);
+
+/**
+ * @brief Print the profile to the console, one line per call site
+ */
+void heap_profiler_dump(void);
+
+/**
+ * @brief Send the profile to the host over application tracing
+ *
+ * Writes a 16 byte header ("HPRF", the sample interval, the number of call
+ * sites and the number of dropped samples, as 32-bit words) followed by one
+ * heap_profiler_site_t per call site to the TRAX destination.
+ *
+ * @note Implemented by the app_trace component.
+ *
+ * @param tmo Timeout in microseconds for writing the trace data.
+ *
+ * @return
+ *  - ESP_OK Profile sent
+ *  - Error code from esp_apptrace_write() or esp_apptrace_flush()
+ */
+esp_err_t heap_profiler_dump_tohost(uint32_t tmo);
+
+#ifdef __cplusplus
+}
+#endif
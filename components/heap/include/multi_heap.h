@@ -51,6 +51,22 @@ void *multi_heap_aligned_alloc(multi_heap_handle_t heap, size_t size, size_t ali
  */
 void *multi_heap_malloc(multi_heap_handle_t heap, size_t size);
 
+/** @brief malloc() a buffer at the high end of a given heap
+ *
+ * Same as multi_heap_malloc(), but the buffer is taken from the highest addresses of the free block which is used,
+ * rather than from the lowest ones. Allocating long-lived buffers with this function and short-lived buffers with
+ * multi_heap_malloc() keeps the two apart, so that freeing the short-lived buffers leaves larger free blocks.
+ *
+ * With the default allocator, the highest free block which is large enough is used. With the TLSF allocator, the
+ * highest of the first blocks of each free list which is large enough is used, so that the search time stays bounded.
+ *
+ * @param heap Handle to a registered heap.
+ * @param size Size of desired buffer.
+ *
+ * @return Pointer to new memory, or NULL if allocation fails.
+ */
+void *multi_heap_malloc_high(multi_heap_handle_t heap, size_t size);
+
 /** @brief free() a buffer aligned in a given heap.
  *
  * @param heap Handle to a registered heap.
@@ -185,6 +201,33 @@ typedef struct {
  */
 void multi_heap_get_info(multi_heap_handle_t heap, multi_heap_info_t *info);
 
+/** @brief Number of size classes in multi_heap_frag_info_t */
+#define MULTI_HEAP_FRAG_SIZE_CLASSES 12
+
+/** @brief Structure to access the free block histogram via multi_heap_get_frag_info
+ *
+ * Size class 0 counts the free blocks smaller than 32 bytes, size class n the blocks of (16 << n) to (32 << n) - 1
+ * bytes, and the last size class all blocks of 32 KB or more.
+ */
+typedef struct {
+    size_t free_blocks[MULTI_HEAP_FRAG_SIZE_CLASSES]; ///<  Number of free blocks in each size class.
+    size_t free_bytes[MULTI_HEAP_FRAG_SIZE_CLASSES];  ///<  Total size of the free blocks in each size class.
+    size_t total_free_bytes;      ///<  Total free bytes in the heap, as in multi_heap_info_t.
+    size_t largest_free_block;    ///<  Size of largest free block in the heap, as in multi_heap_info_t.
+    size_t fragmentation;         ///<  Part of the free bytes which are not in the largest free block, in percent. 0 if the heap has a single free block.
+} multi_heap_frag_info_t;
+
+/** @brief Return the free block histogram of a given heap
+ *
+ * Fills a multi_heap_frag_info_t structure with the number and size of free blocks in each size class. Watching the
+ * fragmentation over time shows if the free memory is getting split into blocks which are too small for the
+ * allocations of the application, before an allocation fails.
+ *
+ * @param heap Handle to a registered heap.
+ * @param info Pointer to a structure to fill with the histogram.
+ */
+void multi_heap_get_frag_info(multi_heap_handle_t heap, multi_heap_frag_info_t *info);
+
 #ifdef __cplusplus
 }
 #endif
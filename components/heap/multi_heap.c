@@ -33,6 +33,9 @@
 void *multi_heap_malloc(multi_heap_handle_t heap, size_t size)
     __attribute__((alias("multi_heap_malloc_impl")));
 
+void *multi_heap_malloc_high(multi_heap_handle_t heap, size_t size)
+    __attribute__((alias("multi_heap_malloc_high_impl")));
+
 void *multi_heap_aligned_alloc(multi_heap_handle_t heap, size_t size, size_t alignment)
     __attribute__((alias("multi_heap_aligned_alloc_impl")));
 
@@ -54,6 +57,9 @@ multi_heap_handle_t multi_heap_register(void *start, size_t size)
 void multi_heap_get_info(multi_heap_handle_t heap, multi_heap_info_t *info)
     __attribute__((alias("multi_heap_get_info_impl")));
 
+void multi_heap_get_frag_info(multi_heap_handle_t heap, multi_heap_frag_info_t *info)
+    __attribute__((alias("multi_heap_get_frag_info_impl")));
+
 size_t multi_heap_free_size(multi_heap_handle_t heap)
     __attribute__((alias("multi_heap_free_size_impl")));
 
@@ -470,6 +476,65 @@ void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size)
     return best_block->data;
 }
 
+void *multi_heap_malloc_high_impl(multi_heap_handle_t heap, size_t size)
+{
+    heap_block_t *high_block = NULL;
+    heap_block_t *prev_free = NULL;
+    heap_block_t *prev = NULL;
+    size = ALIGN_UP(size);
+
+    if (size == 0 || heap == NULL) {
+        return NULL;
+    }
+
+    multi_heap_internal_lock(heap);
+
+    if (heap->free_bytes < size) {
+        multi_heap_internal_unlock(heap);
+        return NULL;
+    }
+
+    /* Find the highest free block which is big enough */
+    prev = &heap->first_block;
+    for (heap_block_t *b = heap->first_block.next_free; b != NULL; b = b->next_free) {
+        MULTI_HEAP_ASSERT(b > prev, &prev->next_free); // free blocks should be ascending in address
+        MULTI_HEAP_ASSERT(is_free(b), b); // block should be free
+        if (block_data_size(b) >= size) {
+            high_block = b;
+            prev_free = prev;
+        }
+        prev = b;
+    }
+
+    if (high_block == NULL) {
+        multi_heap_internal_unlock(heap);
+        return NULL; /* No room in heap */
+    }
+
+    heap_block_t *block;
+    if (block_data_size(high_block) >= size + sizeof(heap_block_t)) {
+        /* Split off the end of the free block, which stays in the free list */
+        block = (heap_block_t *)((intptr_t)get_next_block(high_block) - size - sizeof(block->header));
+        block->header = high_block->header & NEXT_BLOCK_MASK;
+        high_block->header = (intptr_t)block | BLOCK_FREE_FLAG;
+        heap->free_bytes -= size + sizeof(block->header);
+    } else {
+        /* Not enough room for a free block before the allocation, use the whole block */
+        block = high_block;
+        prev_free->next_free = block->next_free;
+        block->header &= ~BLOCK_FREE_FLAG;
+        heap->free_bytes -= block_data_size(block);
+    }
+
+    if (heap->free_bytes < heap->minimum_free_bytes) {
+        heap->minimum_free_bytes = heap->free_bytes;
+    }
+
+    multi_heap_internal_unlock(heap);
+
+    return block->data;
+}
+
 void *multi_heap_aligned_alloc_impl(multi_heap_handle_t heap, size_t size, size_t alignment)
 {
     if (heap == NULL) {
@@ -809,3 +874,21 @@ void multi_heap_get_info_impl(multi_heap_handle_t heap, multi_heap_info_t *info)
     multi_heap_internal_unlock(heap);
 
 }
+
+void multi_heap_get_frag_info_impl(multi_heap_handle_t heap, multi_heap_frag_info_t *info)
+{
+    memset(info, 0, sizeof(multi_heap_frag_info_t));
+
+    if (heap == NULL) {
+        return;
+    }
+
+    multi_heap_internal_lock(heap);
+    for(heap_block_t *b = get_next_block(&heap->first_block); !is_last_block(b); b = get_next_block(b)) {
+        if (is_free(b)) {
+            multi_heap_internal_frag_add_block(info, block_data_size(b));
+        }
+    }
+    multi_heap_internal_frag_finish(info);
+    multi_heap_internal_unlock(heap);
+}
@@ -25,17 +25,46 @@ typedef const struct heap_block *multi_heap_block_handle_t;
 */
 
 void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size);
+void *multi_heap_malloc_high_impl(multi_heap_handle_t heap, size_t size);
 void *multi_heap_aligned_alloc_impl(multi_heap_handle_t heap, size_t size, size_t alignment);
 void multi_heap_free_impl(multi_heap_handle_t heap, void *p);
 void multi_heap_aligned_free_impl(multi_heap_handle_t heap, void *p);
 void *multi_heap_realloc_impl(multi_heap_handle_t heap, void *p, size_t size);
 multi_heap_handle_t multi_heap_register_impl(void *start, size_t size);
 void multi_heap_get_info_impl(multi_heap_handle_t heap, multi_heap_info_t *info);
+void multi_heap_get_frag_info_impl(multi_heap_handle_t heap, multi_heap_frag_info_t *info);
 size_t multi_heap_free_size_impl(multi_heap_handle_t heap);
 size_t multi_heap_minimum_free_size_impl(multi_heap_handle_t heap);
 size_t multi_heap_get_allocated_size_impl(multi_heap_handle_t heap, void *p);
 void *multi_heap_get_block_address_impl(multi_heap_block_handle_t block);
 
+/* Add a free block to the histogram of multi_heap_get_frag_info() */
+static inline void multi_heap_internal_frag_add_block(multi_heap_frag_info_t *info, size_t size)
+{
+    int size_class = 0;
+    if (size >= 32) {
+        size_class = (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(size) - 4;
+        if (size_class >= MULTI_HEAP_FRAG_SIZE_CLASSES) {
+            size_class = MULTI_HEAP_FRAG_SIZE_CLASSES - 1;
+        }
+    }
+    info->free_blocks[size_class]++;
+    info->free_bytes[size_class] += size;
+    info->total_free_bytes += size;
+    if (size > info->largest_free_block) {
+        info->largest_free_block = size;
+    }
+}
+
+/* Set the fragmentation of multi_heap_get_frag_info() once all free blocks are added */
+static inline void multi_heap_internal_frag_finish(multi_heap_frag_info_t *info)
+{
+    if (info->total_free_bytes > 0) {
+        info->fragmentation = (uint64_t)(info->total_free_bytes - info->largest_free_block) * 100
+                              / info->total_free_bytes;
+    }
+}
+
 /* Some internal functions for heap poisoning use */
 
 /* Check an allocated block's poison bytes are correct. Called by multi_heap_check(). */
@@ -69,3 +98,7 @@ void *multi_heap_get_block_address(multi_heap_block_handle_t block);
 
 /* Get the owner identification for a heap block */
 void *multi_heap_get_block_owner(multi_heap_block_handle_t block);
+
+/* Make the current task the owner of an allocated block, which is handed out again without the heap.
+   Only available with CONFIG_HEAP_TASK_TRACKING. */
+void multi_heap_set_owner(void *p);
@@ -17,6 +17,7 @@
 
 #include <freertos/FreeRTOS.h>
 #include "sdkconfig.h"
+#include "esp_attr.h"
 #if CONFIG_IDF_TARGET_ESP32
 #include "esp32/rom/ets_sys.h"
 #elif CONFIG_IDF_TARGET_ESP32S2
@@ -47,6 +48,13 @@ typedef portMUX_TYPE multi_heap_lock_t;
 
 #define MULTI_HEAP_LOCK_STATIC_INITIALIZER     portMUX_INITIALIZER_UNLOCKED
 
+#define MULTI_HEAP_NUM_CORES portNUM_PROCESSORS
+#define MULTI_HEAP_CORE_ID() xPortGetCoreID()
+
+/* Atomically set *ADDR to *SET if it is equal to COMPARE. *SET is always
+   replaced with the previous value of *ADDR. Only works in internal RAM. */
+#define MULTI_HEAP_COMPARE_SET(ADDR, COMPARE, SET) uxPortCompareSet((ADDR), (COMPARE), (SET))
+
 /* Not safe to use std i/o while in a portmux critical section,
    can deadlock, so we use the ROM equivalent functions. */
 
@@ -89,15 +97,44 @@ inline static void multi_heap_assert(bool condition, const char *format, int lin
 #else // MULTI_HEAP_FREERTOS
 
 #include <assert.h>
+#include <pthread.h>
+
+typedef pthread_mutex_t multi_heap_lock_t;
 
-typedef int multi_heap_lock_t;
+/* Code which has to stay in IRAM on the target is placed normally */
+#define IRAM_ATTR
 
 #define MULTI_HEAP_PRINTF printf
 #define MULTI_HEAP_STDERR_PRINTF(MSG, ...) fprintf(stderr, MSG, __VA_ARGS__)
-#define MULTI_HEAP_LOCK(PLOCK)  (void) (PLOCK)
-#define MULTI_HEAP_UNLOCK(PLOCK)  (void) (PLOCK)
-#define MULTI_HEAP_LOCK_INIT(PLOCK)  (void) (PLOCK)
-#define MULTI_HEAP_LOCK_STATIC_INITIALIZER  0
+
+/* Host builds are single threaded unless a lock is set, like on the target */
+#define MULTI_HEAP_LOCK(PLOCK) do {                         \
+        if((PLOCK) != NULL) {                               \
+            pthread_mutex_lock((multi_heap_lock_t *)(PLOCK)); \
+        }                                                   \
+    } while(0)
+
+#define MULTI_HEAP_UNLOCK(PLOCK) do {                       \
+        if ((PLOCK) != NULL) {                              \
+            pthread_mutex_unlock((multi_heap_lock_t *)(PLOCK)); \
+        }                                                   \
+    } while(0)
+
+#define MULTI_HEAP_LOCK_INIT(PLOCK)  pthread_mutex_init((PLOCK), NULL)
+#define MULTI_HEAP_LOCK_STATIC_INITIALIZER  PTHREAD_MUTEX_INITIALIZER
+
+/* Each host thread gets its own "core", so that per-core data can be tested with threads */
+#define MULTI_HEAP_NUM_CORES 4
+int multi_heap_host_core_id(void);
+#define MULTI_HEAP_CORE_ID() multi_heap_host_core_id()
+
+inline static void multi_heap_compare_set(volatile uint32_t *addr, uint32_t compare, uint32_t *set)
+{
+    __atomic_compare_exchange_n(addr, &compare, *set, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    *set = compare;
+}
+
+#define MULTI_HEAP_COMPARE_SET(ADDR, COMPARE, SET) multi_heap_compare_set((ADDR), (COMPARE), (SET))
 
 #define MULTI_HEAP_ASSERT(CONDITION, ADDRESS) assert((CONDITION) && "Heap corrupt")
 
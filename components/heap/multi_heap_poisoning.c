@@ -241,6 +241,32 @@ void *multi_heap_malloc(multi_heap_handle_t heap, size_t size)
     return data;
 }
 
+void *multi_heap_malloc_high(multi_heap_handle_t heap, size_t size)
+{
+    if (!size) {
+        return NULL;
+    }
+
+    if(size > SIZE_MAX - POISON_OVERHEAD) {
+        return NULL;
+    }
+
+    multi_heap_internal_lock(heap);
+    poison_head_t *head = multi_heap_malloc_high_impl(heap, size + POISON_OVERHEAD);
+    uint8_t *data = NULL;
+    if (head != NULL) {
+        data = poison_allocated_region(head, size);
+#ifdef SLOW
+        /* check everything we got back is FREE_FILL_PATTERN & swap for MALLOC_FILL_PATTERN */
+        bool ret = verify_fill_pattern(data, size, true, true, true);
+        assert( ret );
+#endif
+    }
+
+    multi_heap_internal_unlock(heap);
+    return data;
+}
+
 void multi_heap_aligned_free(multi_heap_handle_t heap, void *p)
 {
     multi_heap_internal_lock(heap);
@@ -343,7 +369,12 @@ size_t multi_heap_get_allocated_size(multi_heap_handle_t heap, void *p)
     assert(head != NULL);
     size_t result = multi_heap_get_allocated_size_impl(heap, head);
     if (result > 0) {
+#ifdef CONFIG_HEAP_CACHE
+        /* the block may be bigger than requested, but anything after alloc_size is the tail canary */
+        return MIN(result - POISON_OVERHEAD, head->alloc_size);
+#else
         return result - POISON_OVERHEAD;
+#endif
     }
     return 0;
 }
@@ -353,6 +384,13 @@ void *multi_heap_get_block_owner(multi_heap_block_handle_t block)
     return MULTI_HEAP_GET_BLOCK_OWNER((poison_head_t*)multi_heap_get_block_address_impl(block));
 }
 
+#ifdef CONFIG_HEAP_TASK_TRACKING
+void multi_heap_set_owner(void *p)
+{
+    MULTI_HEAP_SET_BLOCK_OWNER((poison_head_t *)((intptr_t)p - sizeof(poison_head_t)));
+}
+#endif
+
 multi_heap_handle_t multi_heap_register(void *start, size_t size)
 {
 #ifdef SLOW
@@ -384,6 +422,16 @@ void multi_heap_get_info(multi_heap_handle_t heap, multi_heap_info_t *info)
     subtract_poison_overhead(&info->minimum_free_bytes);
 }
 
+void multi_heap_get_frag_info(multi_heap_handle_t heap, multi_heap_frag_info_t *info)
+{
+    multi_heap_get_frag_info_impl(heap, info);
+    /* same as multi_heap_get_info(), the histogram keeps the block sizes */
+    subtract_poison_overhead(&info->largest_free_block);
+    subtract_poison_overhead(&info->total_free_bytes);
+    info->fragmentation = 0;
+    multi_heap_internal_frag_finish(info);
+}
+
 size_t multi_heap_free_size(multi_heap_handle_t heap)
 {
     size_t r = multi_heap_free_size_impl(heap);
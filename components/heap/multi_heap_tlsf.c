@@ -0,0 +1,1004 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <multi_heap.h>
+#include "multi_heap_internal.h"
+
+/* Note: Keep platform-specific parts in this header, this source
+   file should depend on libc only */
+#include "multi_heap_platform.h"
+
+/* Defines compile-time configuration macros */
+#include "multi_heap_config.h"
+
+/* Alternative implementation of multi_heap.c, using segregated free lists ("two-level segregated fit", TLSF).
+
+   Free blocks are kept in one list per size class, so malloc finds a free block with two bitmap lookups instead of
+   walking all free blocks. Each free block has a pointer to itself in its last word, and the block after a free block
+   has a flag set in its header, so free can find and merge the previous block without walking any list.
+
+   Used blocks have the same 4 byte header as in multi_heap.c, so the heap poisoning layer and the block walking
+   functions work the same way.
+*/
+
+#ifndef MULTI_HEAP_POISONING
+/* if no heap poisoning, public API aliases directly to these implementations */
+void *multi_heap_malloc(multi_heap_handle_t heap, size_t size)
+    __attribute__((alias("multi_heap_malloc_impl")));
+
+void *multi_heap_malloc_high(multi_heap_handle_t heap, size_t size)
+    __attribute__((alias("multi_heap_malloc_high_impl")));
+
+void *multi_heap_aligned_alloc(multi_heap_handle_t heap, size_t size, size_t alignment)
+    __attribute__((alias("multi_heap_aligned_alloc_impl")));
+
+void multi_heap_free(multi_heap_handle_t heap, void *p)
+    __attribute__((alias("multi_heap_free_impl")));
+
+void multi_heap_aligned_free(multi_heap_handle_t heap, void *p)
+    __attribute__((alias("multi_heap_aligned_free_impl")));
+
+void *multi_heap_realloc(multi_heap_handle_t heap, void *p, size_t size)
+    __attribute__((alias("multi_heap_realloc_impl")));
+
+size_t multi_heap_get_allocated_size(multi_heap_handle_t heap, void *p)
+    __attribute__((alias("multi_heap_get_allocated_size_impl")));
+
+multi_heap_handle_t multi_heap_register(void *start, size_t size)
+    __attribute__((alias("multi_heap_register_impl")));
+
+void multi_heap_get_info(multi_heap_handle_t heap, multi_heap_info_t *info)
+    __attribute__((alias("multi_heap_get_info_impl")));
+
+void multi_heap_get_frag_info(multi_heap_handle_t heap, multi_heap_frag_info_t *info)
+    __attribute__((alias("multi_heap_get_frag_info_impl")));
+
+size_t multi_heap_free_size(multi_heap_handle_t heap)
+    __attribute__((alias("multi_heap_free_size_impl")));
+
+size_t multi_heap_minimum_free_size(multi_heap_handle_t heap)
+    __attribute__((alias("multi_heap_minimum_free_size_impl")));
+
+void *multi_heap_get_block_address(multi_heap_block_handle_t block)
+    __attribute__((alias("multi_heap_get_block_address_impl")));
+
+void *multi_heap_get_block_owner(multi_heap_block_handle_t block)
+{
+    return NULL;
+}
+
+#endif
+
+#define ALIGN(X) ((X) & ~(sizeof(void *)-1))
+#define ALIGN_UP(X) ALIGN((X)+sizeof(void *)-1)
+#define ALIGN_UP_BY(num, align) (((num) + ((align) - 1)) & ~((align) - 1))
+
+/* Size classes
+
+   Sizes below SMALL_BLOCK_SIZE are split into SL_COUNT linear classes (first level 0). Each power of two above is a
+   first level class, split into SL_COUNT second level classes. Any block in a class is at least as big as the
+   smallest size of the class.
+*/
+#define SL_COUNT_LOG2       3
+#define SL_COUNT            (1 << SL_COUNT_LOG2)
+#define SMALL_BLOCK_SIZE    (SL_COUNT * sizeof(void *))
+#define FL_SHIFT            (__builtin_ctz(SMALL_BLOCK_SIZE) - 1)
+#define FL_COUNT_MAX        (32 - FL_SHIFT)
+
+struct heap_block;
+
+/* Block in the heap
+
+   'header' holds a pointer to the next block (used or free) ORed with a free flag (the LSB of the pointer) and a flag
+   which is set if the previous block is free.
+
+   'next_free' and 'prev_free' are valid if the block is free and link the blocks of the same size class. The last word
+   of a free block points to the block itself, so that the next block can find it.
+*/
+typedef struct heap_block {
+    intptr_t header;                  /* Encodes next block in heap (used or unused) and the flags */
+    union {
+        uint8_t data[1];              /* First byte of data, valid if block is used. Actual size of data is 'block_data_size(block)' */
+        struct {
+            struct heap_block *next_free; /* Next free block of the same size class, valid if block is free */
+            struct heap_block *prev_free; /* Previous free block of the same size class, valid if block is free */
+        };
+    };
+} heap_block_t;
+
+/* These masks apply to the 'header' field of heap_block_t */
+#define BLOCK_FREE_FLAG 0x1  /* If set, this block is free & next_free pointer is valid */
+#define PREV_FREE_FLAG  0x2  /* If set, the previous block is free and its last word points to it */
+#define NEXT_BLOCK_MASK (~3) /* AND header with this mask to get pointer to next block (free or used) */
+
+/* A block has to be big enough to hold the free list pointers and the pointer to itself once it is freed */
+#define MIN_BLOCK_DATA_SIZE (3 * sizeof(void *))
+
+/* Metadata header for the heap, stored at the beginning of heap space.
+
+   'first_block' is a "fake" first block, used to provide a pointer to the first used & free block in the heap. This
+   block is never allocated or merged into an adjacent block. Its data holds the free list heads.
+
+   'last_block' is a pointer to a final free block of length 0, which is added at the end of the heap when it is
+   registered. This block is also never allocated or merged into an adjacent block.
+ */
+typedef struct multi_heap_info {
+    void *lock;
+    size_t free_bytes;
+    size_t minimum_free_bytes;
+    heap_block_t *last_block;
+    uint32_t fl_count;                  /* number of first level classes, depends on the heap size */
+    uint32_t fl_bitmap;                 /* bit 'fl' is set if any list of first level class 'fl' is not empty */
+    uint8_t sl_bitmap[FL_COUNT_MAX];    /* bit 'sl' of 'sl_bitmap[fl]' is set if list 'fl', 'sl' is not empty */
+    heap_block_t first_block;           /* initial 'free block', never allocated */
+    heap_block_t *free_lists[];         /* 'fl_count' * SL_COUNT list heads, stored in the data of first_block */
+} heap_t;
+
+_Static_assert(SL_COUNT <= 8, "sl_bitmap is too small");
+
+/* Given a pointer to the 'data' field of a block (ie the previous malloc/realloc result), return a pointer to the
+   containing block.
+*/
+static inline heap_block_t *get_block(const void *data_ptr)
+{
+    return (heap_block_t *)((char *)data_ptr - offsetof(heap_block_t, data));
+}
+
+/* Return the next sequential block in the heap.
+ */
+static inline heap_block_t *get_next_block(const heap_block_t *block)
+{
+    intptr_t next = block->header & NEXT_BLOCK_MASK;
+    if (next == 0) {
+        return NULL; /* last_block */
+    }
+    assert(next > (intptr_t)block);
+    return (heap_block_t *)next;
+}
+
+/* Return true if this block is free. */
+static inline bool is_free(const heap_block_t *block)
+{
+    return block->header & BLOCK_FREE_FLAG;
+}
+
+/* Return true if the block before this one is free. */
+static inline bool is_prev_free(const heap_block_t *block)
+{
+    return block->header & PREV_FREE_FLAG;
+}
+
+/* Return true if this block is the first in the heap */
+static inline bool is_first_block(const heap_t *heap, const heap_block_t *block)
+{
+    return (block == &heap->first_block);
+}
+
+/* Return true if this block is the last_block in the heap
+   (the only block with no next pointer) */
+static inline bool is_last_block(const heap_block_t *block)
+{
+    return (block->header & NEXT_BLOCK_MASK) == 0;
+}
+
+/* Data size of the block (excludes this block's header) */
+static inline size_t block_data_size(const heap_block_t *block)
+{
+    intptr_t next = (intptr_t)block->header & NEXT_BLOCK_MASK;
+    intptr_t this = (intptr_t)block;
+    if (next == 0) {
+        return 0; /* this is the last block in the heap */
+    }
+    return next - this - sizeof(block->header);
+}
+
+/* Last word of a free block, which points to the block */
+static inline heap_block_t **get_block_footer(const heap_block_t *block)
+{
+    return (heap_block_t **)get_next_block(block) - 1;
+}
+
+/* Check a block is valid for this heap. Used to verify parameters. */
+static void assert_valid_block(const heap_t *heap, const heap_block_t *block)
+{
+    MULTI_HEAP_ASSERT(block >= &heap->first_block && block <= heap->last_block,
+                      block); // block not in heap
+    if (heap < (const heap_t *)heap->last_block) {
+        const heap_block_t *next = get_next_block(block);
+        MULTI_HEAP_ASSERT(next >= &heap->first_block && next <= heap->last_block, block); // Next block not in heap
+    }
+}
+
+/* Get the free block before 'block' in the heap, using the pointer in its last word. 'block' must have
+   PREV_FREE_FLAG set. */
+static inline heap_block_t *get_prev_free_block(const heap_block_t *block)
+{
+    heap_block_t *prev = *((heap_block_t **)block - 1);
+    MULTI_HEAP_ASSERT(is_free(prev) && get_next_block(prev) == block, block); // previous free block should be adjacent
+    return prev;
+}
+
+/* Index of the most significant bit set */
+static inline int fls(size_t size)
+{
+    return (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(size);
+}
+
+/* Find the size class of a block of the given data size */
+static inline void mapping_insert(size_t size, int *fl, int *sl)
+{
+    if (size < SMALL_BLOCK_SIZE) {
+        *fl = 0;
+        *sl = size / (SMALL_BLOCK_SIZE / SL_COUNT);
+    } else {
+        int f = fls(size);
+        *sl = (size >> (f - SL_COUNT_LOG2)) ^ SL_COUNT;
+        *fl = f - FL_SHIFT;
+    }
+}
+
+/* Find the smallest size class of which all blocks can hold the given data size */
+static inline void mapping_search(size_t size, int *fl, int *sl)
+{
+    if (size >= SMALL_BLOCK_SIZE) {
+        size += (1 << (fls(size) - SL_COUNT_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static inline heap_block_t **get_free_list(heap_t *heap, int fl, int sl)
+{
+    return &heap->free_lists[fl * SL_COUNT + sl];
+}
+
+/* Add a block to the free list of its size class and mark it free */
+static void block_set_free(heap_t *heap, heap_block_t *block)
+{
+    int fl, sl;
+    size_t size = block_data_size(block);
+    MULTI_HEAP_ASSERT(size >= MIN_BLOCK_DATA_SIZE, block); // block too small to be free
+    mapping_insert(size, &fl, &sl);
+    MULTI_HEAP_ASSERT(fl < heap->fl_count, block); // block bigger than the heap
+
+    heap_block_t **list = get_free_list(heap, fl, sl);
+    block->next_free = *list;
+    block->prev_free = NULL;
+    if (*list != NULL) {
+        (*list)->prev_free = block;
+    }
+    *list = block;
+    heap->fl_bitmap |= 1 << fl;
+    heap->sl_bitmap[fl] |= 1 << sl;
+
+    block->header |= BLOCK_FREE_FLAG;
+    *get_block_footer(block) = block;
+    get_next_block(block)->header |= PREV_FREE_FLAG;
+    heap->free_bytes += size;
+}
+
+/* Remove a free block from its free list and mark it used */
+static void block_set_used(heap_t *heap, heap_block_t *block)
+{
+    int fl, sl;
+    size_t size = block_data_size(block);
+    MULTI_HEAP_ASSERT(is_free(block), block); // block should be free
+    mapping_insert(size, &fl, &sl);
+
+    if (block->next_free != NULL) {
+        block->next_free->prev_free = block->prev_free;
+    }
+    if (block->prev_free != NULL) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        heap_block_t **list = get_free_list(heap, fl, sl);
+        MULTI_HEAP_ASSERT(*list == block, block); // first block of the list should be this one
+        *list = block->next_free;
+        if (*list == NULL) {
+            heap->sl_bitmap[fl] &= ~(1 << sl);
+            if (heap->sl_bitmap[fl] == 0) {
+                heap->fl_bitmap &= ~(1 << fl);
+            }
+        }
+    }
+
+    block->header &= ~BLOCK_FREE_FLAG;
+    get_next_block(block)->header &= ~PREV_FREE_FLAG;
+    heap->free_bytes -= size;
+#ifdef MULTI_HEAP_POISONING_SLOW
+    /* the free list pointers and the pointer in the last word become part of the data */
+    multi_heap_internal_poison_fill_region(block->data, sizeof(heap_block_t) - sizeof(block->header), true /* free */);
+    multi_heap_internal_poison_fill_region(get_block_footer(block), sizeof(heap_block_t *), true /* free */);
+#endif
+}
+
+/* Find a free block which can hold at least 'size' bytes of data.
+
+   Looks for the first non-empty list of a size class where all blocks are big enough, in constant time. If there
+   is none, the blocks of the class of 'size' itself may still be big enough: these are searched in turn, so that an
+   allocation of the largest free block size doesn't fail.
+*/
+static heap_block_t *find_free_block(heap_t *heap, size_t size)
+{
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+    if (fl < heap->fl_count) {
+        uint32_t sl_map = heap->sl_bitmap[fl] & (~0U << sl);
+        if (sl_map == 0) {
+            /* no block in this first level class, take the next class which has any */
+            uint32_t fl_map = (fl + 1 < 32) ? heap->fl_bitmap & (~0U << (fl + 1)) : 0;
+            if (fl_map != 0) {
+                fl = __builtin_ctz(fl_map);
+                sl_map = heap->sl_bitmap[fl];
+            }
+        }
+        if (sl_map != 0) {
+            return *get_free_list(heap, fl, __builtin_ctz(sl_map));
+        }
+    }
+
+    mapping_insert(size, &fl, &sl);
+    if (fl >= heap->fl_count) {
+        return NULL;
+    }
+    for (heap_block_t *b = *get_free_list(heap, fl, sl); b != NULL; b = b->next_free) {
+        if (block_data_size(b) >= size) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* Find a free block which can hold at least 'size' bytes of data, as high in the heap as possible.
+
+   Searching all free blocks for the highest one would make malloc O(n). Instead, the first block of each list
+   where all blocks are big enough is a candidate, so the search time is bounded by the number of size classes. If
+   there is none, this falls back to find_free_block().
+*/
+static heap_block_t *find_high_free_block(heap_t *heap, size_t size)
+{
+    int fl, sl;
+    heap_block_t *high_block = NULL;
+    mapping_search(size, &fl, &sl);
+    if (fl < heap->fl_count) {
+        uint32_t fl_map = heap->fl_bitmap & (~0U << fl);
+        while (fl_map != 0) {
+            int f = __builtin_ctz(fl_map);
+            uint32_t sl_map = heap->sl_bitmap[f] & ((f == fl) ? (~0U << sl) : ~0U);
+            while (sl_map != 0) {
+                heap_block_t *b = *get_free_list(heap, f, __builtin_ctz(sl_map));
+                if (b > high_block) {
+                    high_block = b;
+                }
+                sl_map &= sl_map - 1;
+            }
+            fl_map &= fl_map - 1;
+        }
+    }
+    return (high_block != NULL) ? high_block : find_free_block(heap, size);
+}
+
+/* Merge used block 'b' into the used block 'a' before it. */
+static heap_block_t *merge_adjacent(heap_t *heap, heap_block_t *a, heap_block_t *b)
+{
+    MULTI_HEAP_ASSERT(get_next_block(a) == b, a); // Blocks should be in order
+    MULTI_HEAP_ASSERT(!is_free(a) && !is_free(b), a); // Blocks should be out of the free lists
+    assert(!is_first_block(heap, a) && !is_last_block(b));
+
+    a->header = (b->header & NEXT_BLOCK_MASK) | (a->header & PREV_FREE_FLAG);
+
+#ifdef MULTI_HEAP_POISONING_SLOW
+    /* b's former block header needs to be replaced with a fill pattern */
+    multi_heap_internal_poison_fill_region(b, sizeof(heap_block_t), true /* free */);
+#endif
+
+    return a;
+}
+
+/* Split a used block so it holds at least 'size' bytes of data, making any spare space into a new free block (merged
+   with the next block if that one is free.)
+*/
+static void split_if_necessary(heap_t *heap, heap_block_t *block, size_t size)
+{
+    const size_t block_size = block_data_size(block);
+    MULTI_HEAP_ASSERT(!is_free(block), block); // split block shouldn't be free
+    MULTI_HEAP_ASSERT(size <= block_size, block); // size should be valid
+
+    /* can't split the head or tail block */
+    assert(!is_first_block(heap, block));
+    assert(!is_last_block(block));
+
+    if (size == block_size) {
+        return;
+    }
+    heap_block_t *new_block = (heap_block_t *)(block->data + size);
+    heap_block_t *next_block = get_next_block(block);
+
+    if (is_free(next_block) && !is_last_block(next_block)) {
+        /* The next block is free, extend it downwards. */
+        block_set_used(heap, next_block);
+        new_block->header = next_block->header & NEXT_BLOCK_MASK;
+#ifdef MULTI_HEAP_POISONING_SLOW
+        /* next_block header needs to be replaced with a fill pattern */
+        multi_heap_internal_poison_fill_region(next_block, sizeof(heap_block_t), true /* free */);
+#endif
+    } else {
+        /* Insert a free block between the current and the next one. */
+        if (block_size < size + sizeof(new_block->header) + MIN_BLOCK_DATA_SIZE) {
+            /* Can't split 'block' if we're not going to get a usable free block afterwards */
+            return;
+        }
+        new_block->header = (intptr_t)next_block;
+    }
+    block->header = (intptr_t)new_block | (block->header & PREV_FREE_FLAG);
+    block_set_free(heap, new_block);
+}
+
+/* Round a requested size up to the data size of a block */
+static inline size_t block_size_for(size_t size)
+{
+    size = ALIGN_UP(size);
+    return (size < MIN_BLOCK_DATA_SIZE) ? MIN_BLOCK_DATA_SIZE : size;
+}
+
+void *multi_heap_get_block_address_impl(multi_heap_block_handle_t block)
+{
+    return ((char *)block + offsetof(heap_block_t, data));
+}
+
+size_t multi_heap_get_allocated_size_impl(multi_heap_handle_t heap, void *p)
+{
+    heap_block_t *pb = get_block(p);
+
+    assert_valid_block(heap, pb);
+    MULTI_HEAP_ASSERT(!is_free(pb), pb); // block shouldn't be free
+    return block_data_size(pb);
+}
+
+multi_heap_handle_t multi_heap_register_impl(void *start_ptr, size_t size)
+{
+    uintptr_t start = ALIGN_UP((uintptr_t)start_ptr);
+    uintptr_t end = ALIGN((uintptr_t)start_ptr + size);
+    heap_t *heap = (heap_t *)start;
+    size = end - start;
+
+    if (end < start || size < sizeof(heap_t) + 2*sizeof(heap_block_t)) {
+        return NULL; /* 'size' is too small to fit a heap here */
+    }
+
+    /* the free lists are only needed up to the size class of the whole heap */
+    int fl, sl;
+    mapping_insert(size, &fl, &sl);
+    const size_t lists_size = (fl + 1) * SL_COUNT * sizeof(heap_block_t *);
+    const size_t overhead = sizeof(heap_t) + lists_size + sizeof(heap_block_t) + sizeof(heap_block_t);
+    if (size < overhead + MIN_BLOCK_DATA_SIZE) {
+        return NULL; /* no room left for a free block */
+    }
+
+    memset(heap, 0, sizeof(heap_t) + lists_size);
+    heap->lock = NULL;
+    heap->fl_count = fl + 1;
+    heap->last_block = (heap_block_t *)(end - sizeof(heap_block_t));
+
+    /* first 'real' (allocatable) free block goes after the free lists */
+    heap_block_t *first_free_block = (heap_block_t *)(start + sizeof(heap_t) + lists_size);
+    first_free_block->header = (intptr_t)heap->last_block;
+
+    /* last block is 'free' but has a NULL next pointer */
+    heap->last_block->header = BLOCK_FREE_FLAG;
+    heap->last_block->next_free = NULL;
+
+    /* first block also 'free' but is never in a free list,
+       malloc will never allocate into this block. */
+    heap->first_block.header = (intptr_t)first_free_block | BLOCK_FREE_FLAG;
+    heap->first_block.next_free = NULL;
+
+    /* free bytes is the data size of first_free_block */
+    heap->free_bytes = 0;
+    block_set_free(heap, first_free_block);
+    heap->minimum_free_bytes = heap->free_bytes;
+
+    return heap;
+}
+
+void multi_heap_set_lock(multi_heap_handle_t heap, void *lock)
+{
+    heap->lock = lock;
+}
+
+void inline multi_heap_internal_lock(multi_heap_handle_t heap)
+{
+    MULTI_HEAP_LOCK(heap->lock);
+}
+
+void inline multi_heap_internal_unlock(multi_heap_handle_t heap)
+{
+    MULTI_HEAP_UNLOCK(heap->lock);
+}
+
+multi_heap_block_handle_t multi_heap_get_first_block(multi_heap_handle_t heap)
+{
+    return &heap->first_block;
+}
+
+multi_heap_block_handle_t multi_heap_get_next_block(multi_heap_handle_t heap, multi_heap_block_handle_t block)
+{
+    heap_block_t *next = get_next_block(block);
+    /* check for valid free last block to avoid assert in assert_valid_block */
+    if (next == heap->last_block && is_last_block(next) && is_free(next)) {
+        return NULL;
+    }
+    assert_valid_block(heap, next);
+    return next;
+}
+
+bool multi_heap_is_free(multi_heap_block_handle_t block)
+{
+    return is_free(block);
+}
+
+void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size)
+{
+    if (size == 0 || size > SIZE_MAX - sizeof(void *) || heap == NULL) {
+        return NULL;
+    }
+    size = block_size_for(size);
+
+    multi_heap_internal_lock(heap);
+
+    /* also guarantees that rounding up to a size class can't overflow */
+    if (heap->free_bytes < size) {
+        multi_heap_internal_unlock(heap);
+        return NULL;
+    }
+
+    heap_block_t *block = find_free_block(heap, size);
+    if (block == NULL) {
+        multi_heap_internal_unlock(heap);
+        return NULL; /* No room in heap */
+    }
+
+    block_set_used(heap, block);
+    split_if_necessary(heap, block, size);
+
+    if (heap->free_bytes < heap->minimum_free_bytes) {
+        heap->minimum_free_bytes = heap->free_bytes;
+    }
+
+    multi_heap_internal_unlock(heap);
+
+    return block->data;
+}
+
+void *multi_heap_malloc_high_impl(multi_heap_handle_t heap, size_t size)
+{
+    if (size == 0 || size > SIZE_MAX - sizeof(void *) || heap == NULL) {
+        return NULL;
+    }
+    size = block_size_for(size);
+
+    multi_heap_internal_lock(heap);
+
+    if (heap->free_bytes < size) {
+        multi_heap_internal_unlock(heap);
+        return NULL;
+    }
+
+    heap_block_t *free_block = find_high_free_block(heap, size);
+    if (free_block == NULL) {
+        multi_heap_internal_unlock(heap);
+        return NULL; /* No room in heap */
+    }
+
+    block_set_used(heap, free_block);
+    heap_block_t *block = free_block;
+    if (block_data_size(free_block) >= size + sizeof(block->header) + MIN_BLOCK_DATA_SIZE) {
+        /* Split off the end of the free block, the start goes back to the free lists */
+        heap_block_t *next_block = get_next_block(free_block);
+        block = (heap_block_t *)((intptr_t)next_block - size - sizeof(block->header));
+        block->header = (intptr_t)next_block;
+        free_block->header = (intptr_t)block | (free_block->header & PREV_FREE_FLAG);
+        block_set_free(heap, free_block);
+    }
+
+    if (heap->free_bytes < heap->minimum_free_bytes) {
+        heap->minimum_free_bytes = heap->free_bytes;
+    }
+
+    multi_heap_internal_unlock(heap);
+
+    return block->data;
+}
+
+void *multi_heap_aligned_alloc_impl(multi_heap_handle_t heap, size_t size, size_t alignment)
+{
+    if (heap == NULL) {
+        return NULL;
+    }
+
+    if (!size) {
+        return NULL;
+    }
+
+    if (!alignment) {
+        return NULL;
+    }
+
+    //Alignment must be a power of two...
+    if ((alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+
+    uint32_t overhead = (sizeof(uint32_t) + (alignment - 1));
+
+    multi_heap_internal_lock(heap);
+    void *head = multi_heap_malloc_impl(heap, size + overhead);
+    if (head == NULL) {
+        multi_heap_internal_unlock(heap);
+        return NULL;
+    }
+
+    //Lets align our new obtained block address:
+    //and save information to recover original block pointer
+    //to allow us to deallocate the memory when needed
+    void *ptr = (void *)ALIGN_UP_BY((uintptr_t)head + sizeof(uint32_t), alignment);
+    *((uint32_t *)ptr - 1) = (uint32_t)((uintptr_t)ptr - (uintptr_t)head);
+
+    multi_heap_internal_unlock(heap);
+    return ptr;
+}
+
+void multi_heap_aligned_free_impl(multi_heap_handle_t heap, void *p)
+{
+    if (p == NULL) {
+        return;
+    }
+
+    multi_heap_internal_lock(heap);
+    uint32_t offset = *((uint32_t *)p - 1);
+    void *block_head = (void *)((uint8_t *)p - offset);
+
+#ifdef MULTI_HEAP_POISONING_SLOW
+        multi_heap_internal_poison_fill_region(block_head, multi_heap_get_allocated_size_impl(heap, block_head), true /* free */);
+#endif
+
+    multi_heap_free_impl(heap, block_head);
+    multi_heap_internal_unlock(heap);
+}
+
+void multi_heap_free_impl(multi_heap_handle_t heap, void *p)
+{
+    heap_block_t *pb = get_block(p);
+
+    if (heap == NULL || p == NULL) {
+        return;
+    }
+
+    multi_heap_internal_lock(heap);
+
+    assert_valid_block(heap, pb);
+    MULTI_HEAP_ASSERT(!is_free(pb), pb); // block should not be free
+    MULTI_HEAP_ASSERT(!is_last_block(pb), pb); // block should not be last block
+    MULTI_HEAP_ASSERT(!is_first_block(heap, pb), pb); // block should not be first block
+
+    /* Merge with the previous and the next block if they are free */
+    if (is_prev_free(pb)) {
+        heap_block_t *prev = get_prev_free_block(pb);
+        block_set_used(heap, prev);
+        pb = merge_adjacent(heap, prev, pb);
+    }
+
+    heap_block_t *next = get_next_block(pb);
+    if (is_free(next) && !is_last_block(next)) {
+        block_set_used(heap, next);
+        pb = merge_adjacent(heap, pb, next);
+    }
+
+    block_set_free(heap, pb);
+
+    multi_heap_internal_unlock(heap);
+}
+
+
+void *multi_heap_realloc_impl(multi_heap_handle_t heap, void *p, size_t size)
+{
+    heap_block_t *pb = get_block(p);
+    void *result;
+
+    assert(heap != NULL);
+
+    if (p == NULL) {
+        return multi_heap_malloc_impl(heap, size);
+    }
+
+    assert_valid_block(heap, pb);
+    // non-null realloc arg should be allocated
+    MULTI_HEAP_ASSERT(!is_free(pb), pb);
+
+    if (size == 0) {
+        /* note: calling multi_free_impl() here as we've already been
+           through any poison-unwrapping */
+        multi_heap_free_impl(heap, p);
+        return NULL;
+    }
+
+    if (heap == NULL || size > SIZE_MAX - sizeof(void *)) {
+        return NULL;
+    }
+
+    size = block_size_for(size);
+
+    multi_heap_internal_lock(heap);
+    result = NULL;
+
+    if (size <= block_data_size(pb)) {
+        // Shrinking....
+        split_if_necessary(heap, pb, size);
+        result = pb->data;
+    }
+    else if (heap->free_bytes < size - block_data_size(pb)) {
+        // Growing, but there's not enough total free space in the heap
+        multi_heap_internal_unlock(heap);
+        return NULL;
+    }
+
+    // New size is larger than existing block
+    if (result == NULL) {
+        // See if we can grow into one or both adjacent blocks
+        heap_block_t *next = get_next_block(pb);
+        heap_block_t *prev = is_prev_free(pb) ? get_prev_free_block(pb) : NULL;
+        const size_t orig_size = block_data_size(pb);
+        const size_t next_grow_size = (is_free(next) && !is_last_block(next)) ?
+                                      block_data_size(next) + sizeof(next->header) : 0;
+        const size_t prev_grow_size = (prev != NULL) ? block_data_size(prev) + sizeof(pb->header) : 0;
+
+        if (orig_size + next_grow_size + prev_grow_size >= size) {
+            if (next_grow_size > 0) {
+                block_set_used(heap, next);
+                pb = merge_adjacent(heap, pb, next);
+            }
+            // only move the data if the next block isn't enough
+            if (block_data_size(pb) < size) {
+                block_set_used(heap, prev);
+                pb = merge_adjacent(heap, prev, pb);
+                memmove(pb->data, p, orig_size);
+            }
+            split_if_necessary(heap, pb, size);
+            result = pb->data;
+        }
+    }
+
+    if (result == NULL) {
+        // Need to allocate elsewhere and copy data over
+        //
+        // (Calling _impl versions here as we've already been through any
+        // unwrapping for heap poisoning features.)
+        result = multi_heap_malloc_impl(heap, size);
+        if (result != NULL) {
+            memcpy(result, pb->data, block_data_size(pb));
+            multi_heap_free_impl(heap, pb->data);
+        }
+    }
+
+    if (heap->free_bytes < heap->minimum_free_bytes) {
+        heap->minimum_free_bytes = heap->free_bytes;
+    }
+
+    multi_heap_internal_unlock(heap);
+    return result;
+}
+
+#define FAIL_PRINT(MSG, ...) do {                                       \
+        if (print_errors) {                                             \
+            MULTI_HEAP_STDERR_PRINTF(MSG, __VA_ARGS__);                 \
+        }                                                               \
+        valid = false;                                                  \
+    }                                                                   \
+    while(0)
+
+bool multi_heap_check(multi_heap_handle_t heap, bool print_errors)
+{
+    bool valid = true;
+    size_t total_free_bytes = 0;
+    size_t total_free_blocks = 0;
+    assert(heap != NULL);
+
+    multi_heap_internal_lock(heap);
+
+    heap_block_t *prev = NULL;
+
+    /* note: not using get_next_block() in loop, so that assertions aren't checked here */
+    for(heap_block_t *b = &heap->first_block; b != NULL; b = (heap_block_t *)(b->header & NEXT_BLOCK_MASK)) {
+        if (b == prev) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p points to itself\n", b);
+            goto done;
+        }
+        if (b < prev) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p is before prev block %p\n", b, prev);
+            goto done;
+        }
+        if (b > heap->last_block || b < &heap->first_block) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p is outside heap (last valid block %p)\n", b, prev);
+            goto done;
+        }
+        const bool prev_free = prev != NULL && is_free(prev) && !is_first_block(heap, prev);
+        if (is_free(b) && prev_free && !is_last_block(b)) {
+            FAIL_PRINT("CORRUPT HEAP: Two adjacent free blocks found, %p and %p\n", prev, b);
+        }
+        if (prev != NULL && prev_free != is_prev_free(b)) {
+            FAIL_PRINT("CORRUPT HEAP: Block %p has wrong previous free flag\n", b);
+        }
+        if (is_free(b) && !is_first_block(heap, b) && !is_last_block(b)) {
+            if (*get_block_footer(b) != b) {
+                FAIL_PRINT("CORRUPT HEAP: Free block %p end points to %p\n", b, *get_block_footer(b));
+            }
+            total_free_bytes += block_data_size(b);
+            total_free_blocks++;
+        }
+        prev = b;
+
+#ifdef MULTI_HEAP_POISONING
+        if (!is_last_block(b) && !is_first_block(heap, b)) {
+            /* For slow heap poisoning, any block should contain correct poisoning patterns and/or fills */
+            bool poison_ok;
+            if (is_free(b)) {
+                uint32_t block_len = (intptr_t)get_next_block(b) - (intptr_t)b - sizeof(heap_block_t) - sizeof(heap_block_t *);
+                poison_ok = multi_heap_internal_check_block_poisoning(&b[1], block_len, true, print_errors);
+            }
+            else {
+                poison_ok = multi_heap_internal_check_block_poisoning(b->data, block_data_size(b), false, print_errors);
+            }
+            valid = poison_ok && valid;
+        }
+#endif
+
+    } /* for(heap_block_t b = ... */
+
+    if (prev != heap->last_block) {
+        FAIL_PRINT("CORRUPT HEAP: Last block %p not %p\n", prev, heap->last_block);
+    }
+    if (!is_free(heap->last_block)) {
+        FAIL_PRINT("CORRUPT HEAP: Expected prev block %p to be free\n", heap->last_block);
+    }
+
+    /* every free block should be in the list of its size class, and nothing else */
+    for (int fl = 0; fl < heap->fl_count; fl++) {
+        for (int sl = 0; sl < SL_COUNT; sl++) {
+            heap_block_t *list = *get_free_list(heap, fl, sl);
+            if ((list != NULL) != ((heap->sl_bitmap[fl] >> sl) & 1)) {
+                FAIL_PRINT("CORRUPT HEAP: Wrong bitmap for free list %d/%d\n", fl, sl);
+            }
+            heap_block_t *prev_free = NULL;
+            for (heap_block_t *b = list; b != NULL; b = b->next_free) {
+                int b_fl, b_sl;
+                if (b <= &heap->first_block || b >= heap->last_block || !is_free(b)) {
+                    FAIL_PRINT("CORRUPT HEAP: Free list %d/%d has invalid block %p\n", fl, sl, b);
+                    goto done;
+                }
+                mapping_insert(block_data_size(b), &b_fl, &b_sl);
+                if (b_fl != fl || b_sl != sl || b->prev_free != prev_free) {
+                    FAIL_PRINT("CORRUPT HEAP: Free block %p is in the wrong place in free list %d/%d\n", b, fl, sl);
+                }
+                if (total_free_blocks-- == 0) {
+                    FAIL_PRINT("CORRUPT HEAP: Free list %d/%d has more blocks than the heap\n", fl, sl);
+                    goto done;
+                }
+                prev_free = b;
+            }
+        }
+        if ((heap->sl_bitmap[fl] != 0) != ((heap->fl_bitmap >> fl) & 1)) {
+            FAIL_PRINT("CORRUPT HEAP: Wrong bitmap for free lists %d\n", fl);
+        }
+    }
+    if (total_free_blocks != 0) {
+        FAIL_PRINT("CORRUPT HEAP: %u free blocks are not in any free list\n", (unsigned)total_free_blocks);
+    }
+
+    if (heap->free_bytes != total_free_bytes) {
+        FAIL_PRINT("CORRUPT HEAP: Expected %u free bytes counted %u\n", (unsigned)heap->free_bytes, (unsigned)total_free_bytes);
+    }
+
+ done:
+    multi_heap_internal_unlock(heap);
+
+    return valid;
+}
+
+void multi_heap_dump(multi_heap_handle_t heap)
+{
+    assert(heap != NULL);
+
+    multi_heap_internal_lock(heap);
+    MULTI_HEAP_STDERR_PRINTF("Heap start %p end %p\nFree list bitmap 0x%08x\n", &heap->first_block, heap->last_block, heap->fl_bitmap);
+    for(heap_block_t *b = &heap->first_block; b != NULL; b = get_next_block(b)) {
+        MULTI_HEAP_STDERR_PRINTF("Block %p data size 0x%08x bytes next block %p", b, block_data_size(b), get_next_block(b));
+        if (is_free(b)) {
+            MULTI_HEAP_STDERR_PRINTF(" FREE. Next free %p\n", b->next_free);
+        } else {
+            MULTI_HEAP_STDERR_PRINTF("%s", "\n"); /* C macros & optional __VA_ARGS__ */
+        }
+    }
+    multi_heap_internal_unlock(heap);
+}
+
+size_t multi_heap_free_size_impl(multi_heap_handle_t heap)
+{
+    if (heap == NULL) {
+        return 0;
+    }
+    return heap->free_bytes;
+}
+
+size_t multi_heap_minimum_free_size_impl(multi_heap_handle_t heap)
+{
+    if (heap == NULL) {
+        return 0;
+    }
+    return heap->minimum_free_bytes;
+}
+
+void multi_heap_get_info_impl(multi_heap_handle_t heap, multi_heap_info_t *info)
+{
+    memset(info, 0, sizeof(multi_heap_info_t));
+
+    if (heap == NULL) {
+        return;
+    }
+
+    multi_heap_internal_lock(heap);
+    for(heap_block_t *b = get_next_block(&heap->first_block); !is_last_block(b); b = get_next_block(b)) {
+        info->total_blocks++;
+        if (is_free(b)) {
+            size_t s = block_data_size(b);
+            info->total_free_bytes += s;
+            if (s > info->largest_free_block) {
+                info->largest_free_block = s;
+            }
+            info->free_blocks++;
+        } else {
+            info->total_allocated_bytes += block_data_size(b);
+            info->allocated_blocks++;
+        }
+    }
+
+    info->minimum_free_bytes = heap->minimum_free_bytes;
+    // heap has wrong total size (address printed here is not indicative of the real error)
+    MULTI_HEAP_ASSERT(info->total_free_bytes == heap->free_bytes, heap);
+
+    multi_heap_internal_unlock(heap);
+
+}
+
+void multi_heap_get_frag_info_impl(multi_heap_handle_t heap, multi_heap_frag_info_t *info)
+{
+    memset(info, 0, sizeof(multi_heap_frag_info_t));
+
+    if (heap == NULL) {
+        return;
+    }
+
+    multi_heap_internal_lock(heap);
+    for(heap_block_t *b = get_next_block(&heap->first_block); !is_last_block(b); b = get_next_block(b)) {
+        if (is_free(b)) {
+            multi_heap_internal_frag_add_block(info, block_data_size(b));
+        }
+    }
+    multi_heap_internal_frag_finish(info);
+    multi_heap_internal_unlock(heap);
+}
@@ -0,0 +1,78 @@
+/*
+ Tests for fixed-size object pools
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_caps_pool.h"
+#include "soc/soc_memory_layout.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+TEST_CASE("heap_caps_pool uses memory with the requested caps", "[heap][pool]")
+{
+    size_t before = heap_caps_get_free_size(MALLOC_CAP_DMA);
+    heap_caps_pool_handle_t pool = heap_caps_pool_create(30, 20, MALLOC_CAP_DMA);
+    TEST_ASSERT_NOT_NULL(pool);
+    TEST_ASSERT(heap_caps_get_free_size(MALLOC_CAP_DMA) <= before - 20 * 32);
+
+    void *p = heap_caps_pool_alloc(pool);
+    TEST_ASSERT(esp_ptr_dma_capable(p));
+    heap_caps_pool_free(pool, p);
+
+    heap_caps_pool_delete(pool);
+    TEST_ASSERT_EQUAL(before, heap_caps_get_free_size(MALLOC_CAP_DMA));
+
+    TEST_ASSERT_NULL(heap_caps_pool_create(0, 20, MALLOC_CAP_DEFAULT));
+    TEST_ASSERT_NULL(heap_caps_pool_create(60000, 64, MALLOC_CAP_INTERNAL));
+}
+
+static heap_caps_pool_handle_t s_pool;
+static SemaphoreHandle_t s_done;
+static volatile bool s_corrupt;
+
+static void pool_task(void *arg)
+{
+    uint8_t id = (uint8_t)(intptr_t)arg;
+    for (int i = 0; i < 100000; i++) {
+        uint8_t *p = heap_caps_pool_alloc(s_pool);
+        if (p != NULL) {
+            memset(p, id, 16);
+            taskYIELD();
+            for (int b = 0; b < 16; b++) {
+                if (p[b] != id) {
+                    s_corrupt = true;
+                }
+            }
+            heap_caps_pool_free(s_pool, p);
+        }
+    }
+    xSemaphoreGive(s_done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("heap_caps_pool can be used from both cores at once", "[heap][pool]")
+{
+    s_pool = heap_caps_pool_create(16, 4, MALLOC_CAP_INTERNAL);
+    TEST_ASSERT_NOT_NULL(s_pool);
+    s_done = xSemaphoreCreateCounting(portNUM_PROCESSORS * 2, 0);
+    s_corrupt = false;
+
+    for (int i = 0; i < portNUM_PROCESSORS * 2; i++) {
+        xTaskCreatePinnedToCore(pool_task, "pool", 2048, (void *)(intptr_t)(i + 1), UNITY_FREERTOS_PRIORITY - 1, NULL,
+                                i % portNUM_PROCESSORS);
+    }
+    for (int i = 0; i < portNUM_PROCESSORS * 2; i++) {
+        TEST_ASSERT(xSemaphoreTake(s_done, 10000 / portTICK_PERIOD_MS));
+    }
+    vSemaphoreDelete(s_done);
+    TEST_ASSERT_FALSE(s_corrupt);
+
+    multi_heap_info_t info;
+    heap_caps_pool_get_info(s_pool, &info);
+    TEST_ASSERT_EQUAL(4, info.free_blocks);
+    heap_caps_pool_delete(s_pool);
+}
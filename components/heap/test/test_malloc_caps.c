@@ -9,6 +9,7 @@
 #include "esp_heap_caps.h"
 #include "esp_spi_flash.h"
 #include <stdlib.h>
+#include <string.h>
 #include <sys/param.h>
 
 #ifndef CONFIG_ESP32S2_MEMPROT_FEATURE
@@ -240,4 +241,41 @@ TEST_CASE("allocation with invalid capability should also trigger the alloc fail
     TEST_ASSERT(called_user_failed_hook != false);
 
     (void)ptr;
-}
\ No newline at end of file
+}
+TEST_CASE("long-lived allocations are placed above other allocations", "[heap]")
+{
+    void *low = heap_caps_malloc(128, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    void *high = heap_caps_malloc(128, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL | MALLOC_CAP_LONG_LIVED);
+    TEST_ASSERT_NOT_NULL(low);
+    TEST_ASSERT_NOT_NULL(high);
+    TEST_ASSERT((intptr_t)high > (intptr_t)low);
+    TEST_ASSERT(heap_caps_get_allocated_size(high) >= 128);
+    memset(high, 0xEE, 128);
+
+    /* the hint is not a capability, realloc and the info functions accept it */
+    high = heap_caps_realloc(high, 256, MALLOC_CAP_8BIT | MALLOC_CAP_LONG_LIVED);
+    TEST_ASSERT_NOT_NULL(high);
+    TEST_ASSERT_EQUAL_HEX8(0xEE, ((uint8_t *)high)[127]);
+    TEST_ASSERT_EQUAL(heap_caps_get_free_size(MALLOC_CAP_8BIT), heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_LONG_LIVED));
+    TEST_ASSERT(heap_caps_check_integrity_all(true));
+
+    heap_caps_free(high);
+    heap_caps_free(low);
+}
+
+TEST_CASE("heap_caps_get_frag_info histogram", "[heap]")
+{
+    multi_heap_frag_info_t frag;
+    heap_caps_get_frag_info(&frag, MALLOC_CAP_8BIT);
+
+    size_t blocks = 0;
+    for (int i = 0; i < MULTI_HEAP_FRAG_SIZE_CLASSES; i++) {
+        blocks += frag.free_blocks[i];
+        printf("free blocks from %d bytes: %d, %d bytes\n", (i == 0) ? 0 : 16 << i,
+               frag.free_blocks[i], frag.free_bytes[i]);
+    }
+    printf("fragmentation %d%%\n", frag.fragmentation);
+    TEST_ASSERT(blocks > 0);
+    TEST_ASSERT(frag.largest_free_block <= frag.total_free_bytes);
+    TEST_ASSERT(frag.fragmentation <= 100);
+}
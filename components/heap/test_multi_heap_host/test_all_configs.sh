@@ -5,9 +5,13 @@
 
 FAIL=0
 
-for FLAGS in "CONFIG_HEAP_POISONING_NONE" "CONFIG_HEAP_POISONING_LIGHT" "CONFIG_HEAP_POISONING_COMPREHENSIVE"; do
-    echo "==== Testing with config: ${FLAGS} ===="
-    CPPFLAGS="-D${FLAGS}" make clean test || FAIL=1
+for ALLOCATOR in "CONFIG_HEAP_ALLOCATOR_LIST" "CONFIG_HEAP_ALLOCATOR_TLSF"; do
+    for FLAGS in "CONFIG_HEAP_POISONING_NONE" "CONFIG_HEAP_POISONING_LIGHT" "CONFIG_HEAP_POISONING_COMPREHENSIVE"; do
+        for CACHE in "CONFIG_HEAP_CACHE_DISABLED" "CONFIG_HEAP_CACHE"; do
+            echo "==== Testing with config: ${ALLOCATOR} ${FLAGS} ${CACHE} ===="
+            CPPFLAGS="-D${ALLOCATOR} -D${FLAGS} -D${CACHE}" make clean test || FAIL=1
+        done
+    done
 done
 
 make clean
@@ -0,0 +1,217 @@
+#include "catch.hpp"
+#include "multi_heap.h"
+#include "../heap_caps_cache_internal.h"
+
+#include <string.h>
+#include <pthread.h>
+#include <atomic>
+#include <chrono>
+
+/* The heap only cooperates with the cache when it is enabled, see multi_heap_get_allocated_size() */
+#ifdef CONFIG_HEAP_CACHE
+
+static multi_heap_handle_t s_heap;
+static std::atomic<size_t> s_heap_calls;
+
+static void release_to_heap(void *ptr)
+{
+    s_heap_calls++;
+    multi_heap_free(s_heap, ptr);
+}
+
+/* Same logic as heap_caps_malloc() and heap_caps_free() with the cache enabled */
+static void *cached_malloc(size_t size)
+{
+    size_t block_size = heap_caps_cache_block_size(size);
+    if (block_size != 0) {
+        void *p = heap_caps_cache_get(block_size);
+        if (p != NULL) {
+            return p;
+        }
+        size = block_size;
+    }
+    s_heap_calls++;
+    return multi_heap_malloc(s_heap, size);
+}
+
+static void cached_free(void *p)
+{
+    if (p != NULL && heap_caps_cache_put(p, multi_heap_get_allocated_size(s_heap, p))) {
+        return;
+    }
+    release_to_heap(p);
+}
+
+static void *direct_malloc(size_t size)
+{
+    s_heap_calls++;
+    return multi_heap_malloc(s_heap, size);
+}
+
+static void direct_free(void *p)
+{
+    release_to_heap(p);
+}
+
+TEST_CASE("heap_caps_cache size classes", "[heap_caps_cache]")
+{
+    REQUIRE( heap_caps_cache_block_size(0) == 0 );
+    REQUIRE( heap_caps_cache_block_size(1) == 16 );
+    REQUIRE( heap_caps_cache_block_size(16) == 16 );
+    REQUIRE( heap_caps_cache_block_size(17) == 32 );
+    REQUIRE( heap_caps_cache_block_size(100) == 128 );
+    REQUIRE( heap_caps_cache_block_size(256) == 256 );
+    REQUIRE( heap_caps_cache_block_size(257) == 0 );
+
+    /* blocks which are not close to a class size are not cached */
+    uint32_t block;
+    REQUIRE( !heap_caps_cache_put(&block, 8) );
+    REQUIRE( !heap_caps_cache_put(&block, 50) );
+    REQUIRE( !heap_caps_cache_put(&block, 1024) );
+}
+
+TEST_CASE("heap_caps_cache keeps freed blocks until flushed", "[heap_caps_cache]")
+{
+    static uint8_t heapdata[16384];
+    s_heap = multi_heap_register(heapdata, sizeof(heapdata));
+    REQUIRE( s_heap != NULL );
+    heap_caps_cache_flush_blocks(release_to_heap);
+    const size_t initial_free = multi_heap_free_size(s_heap);
+
+    heap_caps_cache_stats_t before, after;
+    heap_caps_cache_get_stats(&before);
+
+    void *p = cached_malloc(20);
+    REQUIRE( p != NULL );
+    REQUIRE( multi_heap_get_allocated_size(s_heap, p) >= 32 );
+    cached_free(p);
+    REQUIRE( multi_heap_free_size(s_heap) < initial_free ); /* still in the cache */
+
+    void *q = cached_malloc(30);
+    REQUIRE( q == p ); /* same size class, same block */
+    REQUIRE( cached_malloc(64) != p );
+
+    /* fill the cache, the rest goes back to the heap */
+    void *blocks[64];
+    for (int i = 0; i < 64; i++) {
+        blocks[i] = cached_malloc(100);
+        REQUIRE( blocks[i] != NULL );
+    }
+    for (int i = 0; i < 64; i++) {
+        cached_free(blocks[i]);
+    }
+    cached_free(q);
+
+    heap_caps_cache_get_stats(&after);
+    REQUIRE( after.hits - before.hits == 1 );
+    REQUIRE( after.cached_frees - before.cached_frees + after.overflows - before.overflows == 66 );
+    REQUIRE( after.overflows - before.overflows > 0 );
+    REQUIRE( after.cached_blocks == after.cached_frees - before.cached_frees - 1 );
+
+    REQUIRE( heap_caps_cache_flush_blocks(release_to_heap) == after.cached_blocks );
+    heap_caps_cache_get_stats(&after);
+    REQUIRE( after.cached_blocks == 0 );
+    REQUIRE( after.cached_bytes == 0 );
+    REQUIRE( after.flushes == before.flushes + 1 );
+
+    /* the block allocated with 64 bytes was never freed */
+    REQUIRE( multi_heap_free_size(s_heap) < initial_free );
+    REQUIRE( multi_heap_check(s_heap, true) );
+}
+
+typedef struct {
+    void *(*alloc)(size_t);
+    void (*release)(void *);
+    uint32_t seed;
+    bool ok;
+} worker_args_t;
+
+static void *worker(void *arg)
+{
+    worker_args_t *args = (worker_args_t *)arg;
+    const int OPS = 200000;
+    const int WINDOW = 16;
+    void *p[WINDOW] = { 0 };
+    size_t s[WINDOW] = { 0 };
+    uint32_t x = args->seed;
+
+    args->ok = true;
+    for (int i = 0; i < OPS; i++) {
+        /* xorshift32 */
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        int n = x % WINDOW;
+        if (p[n] != NULL) {
+            if (((uint8_t *)p[n])[0] != (uint8_t)n || ((uint8_t *)p[n])[s[n] - 1] != (uint8_t)n) {
+                args->ok = false;
+            }
+            args->release(p[n]);
+        }
+        s[n] = 8 + (x >> 8) % 249; /* small buffers, up to 256 bytes */
+        p[n] = args->alloc(s[n]);
+        if (p[n] == NULL) {
+            args->ok = false;
+            continue;
+        }
+        memset(p[n], n, s[n]);
+    }
+    for (int n = 0; n < WINDOW; n++) {
+        if (p[n] != NULL) {
+            args->release(p[n]);
+        }
+    }
+    return NULL;
+}
+
+static double run_workers(int num_threads, void *(*alloc)(size_t), void (*release)(void *))
+{
+    pthread_t threads[num_threads];
+    worker_args_t args[num_threads];
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_threads; i++) {
+        args[i] = { alloc, release, 0x9E3779B9u * (i + 1), false };
+        REQUIRE( pthread_create(&threads[i], NULL, worker, &args[i]) == 0 );
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        REQUIRE( args[i].ok );
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+TEST_CASE("heap_caps_cache reduces heap lock contention", "[heap_caps_cache][perf]")
+{
+    static uint8_t heapdata[256 * 1024];
+    /* heap poisoning takes the heap lock recursively, which a portMUX on the target allows */
+    static pthread_mutex_t heap_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+    const int THREADS = 4;
+
+    s_heap = multi_heap_register(heapdata, sizeof(heapdata));
+    REQUIRE( s_heap != NULL );
+    multi_heap_set_lock(s_heap, &heap_lock);
+    heap_caps_cache_flush_blocks(release_to_heap);
+    const size_t initial_free = multi_heap_free_size(s_heap);
+
+    s_heap_calls = 0;
+    double direct_ms = run_workers(THREADS, direct_malloc, direct_free);
+    size_t direct_calls = s_heap_calls;
+    REQUIRE( multi_heap_free_size(s_heap) == initial_free );
+
+    s_heap_calls = 0;
+    double cached_ms = run_workers(THREADS, cached_malloc, cached_free);
+    heap_caps_cache_flush_blocks(release_to_heap);
+    size_t cached_calls = s_heap_calls;
+
+    printf("%d threads: heap locked %zu times in %.1f ms without cache, %zu times in %.1f ms with cache\n",
+           THREADS, direct_calls, direct_ms, cached_calls, cached_ms);
+
+    REQUIRE( multi_heap_check(s_heap, true) );
+    REQUIRE( multi_heap_free_size(s_heap) == initial_free );
+    REQUIRE( cached_calls < direct_calls / 2 );
+
+    multi_heap_set_lock(s_heap, NULL);
+}
+
+#endif // CONFIG_HEAP_CACHE
@@ -0,0 +1,229 @@
+#include "catch.hpp"
+#include "multi_heap.h"
+#include "../heap_caps_pool_internal.h"
+
+#include <string.h>
+#include <pthread.h>
+#include <set>
+#include <chrono>
+
+/* Same as heap_caps_pool_create(), with the memory from a multi_heap */
+static heap_caps_pool_handle_t create_pool(multi_heap_handle_t heap, size_t object_size, size_t num_objects)
+{
+    size_t storage_size = heap_caps_pool_storage_size(object_size, num_objects);
+    if (storage_size == 0) {
+        return NULL;
+    }
+    void *control = multi_heap_malloc(heap, heap_caps_pool_control_size());
+    void *storage = multi_heap_malloc(heap, storage_size);
+    REQUIRE( control != NULL );
+    REQUIRE( storage != NULL );
+    return heap_caps_pool_init(control, storage, object_size, num_objects);
+}
+
+static void delete_pool(multi_heap_handle_t heap, heap_caps_pool_handle_t pool)
+{
+    multi_heap_free(heap, heap_caps_pool_get_storage(pool));
+    multi_heap_free(heap, pool);
+}
+
+TEST_CASE("heap_caps_pool invalid arguments", "[heap_caps_pool]")
+{
+    REQUIRE( heap_caps_pool_storage_size(0, 10) == 0 );
+    REQUIRE( heap_caps_pool_storage_size(10, 0) == 0 );
+    REQUIRE( heap_caps_pool_storage_size(10, HEAP_CAPS_POOL_MAX_OBJECTS + 1) == 0 );
+    REQUIRE( heap_caps_pool_storage_size(SIZE_MAX, 2) == 0 );
+    REQUIRE( heap_caps_pool_storage_size(1, 3) == 12 );
+    REQUIRE( heap_caps_pool_storage_size(13, 10) == 160 );
+}
+
+TEST_CASE("heap_caps_pool allocates every object once", "[heap_caps_pool]")
+{
+    static uint8_t heapdata[8192];
+    const size_t NUM = 50;
+    multi_heap_handle_t heap = multi_heap_register(heapdata, sizeof(heapdata));
+    REQUIRE( heap != NULL );
+    const size_t initial_free = multi_heap_free_size(heap);
+
+    heap_caps_pool_handle_t pool = create_pool(heap, 21, NUM);
+    REQUIRE( heap_caps_pool_get_object_size(pool) == 24 );
+
+    multi_heap_info_t info;
+    heap_caps_pool_get_info(pool, &info);
+    REQUIRE( info.free_blocks == NUM );
+    REQUIRE( info.total_free_bytes == NUM * 24 );
+    REQUIRE( info.largest_free_block == 24 );
+    REQUIRE( info.total_blocks == NUM );
+
+    void *p[NUM];
+    std::set<void *> objects;
+    for (size_t i = 0; i < NUM; i++) {
+        p[i] = heap_caps_pool_alloc(pool);
+        REQUIRE( p[i] != NULL );
+        REQUIRE( ((intptr_t)p[i] & 3) == 0 );
+        REQUIRE( objects.insert(p[i]).second );
+        memset(p[i], 0xEE, 21);
+    }
+    REQUIRE( heap_caps_pool_alloc(pool) == NULL );
+
+    heap_caps_pool_get_info(pool, &info);
+    REQUIRE( info.free_blocks == 0 );
+    REQUIRE( info.allocated_blocks == NUM );
+    REQUIRE( info.largest_free_block == 0 );
+    REQUIRE( info.minimum_free_bytes == 0 );
+
+    /* last freed, first allocated */
+    heap_caps_pool_free(pool, p[7]);
+    heap_caps_pool_free(pool, p[3]);
+    heap_caps_pool_free(pool, NULL);
+    REQUIRE( heap_caps_pool_alloc(pool) == p[3] );
+    REQUIRE( heap_caps_pool_alloc(pool) == p[7] );
+
+    for (size_t i = 0; i < NUM; i++) {
+        heap_caps_pool_free(pool, p[i]);
+    }
+    heap_caps_pool_get_info(pool, &info);
+    REQUIRE( info.free_blocks == NUM );
+    REQUIRE( info.total_allocated_bytes == 0 );
+    REQUIRE( info.minimum_free_bytes == 0 );
+
+    /* objects are separate from the heap, which is still consistent */
+    REQUIRE( multi_heap_check(heap, true) );
+    delete_pool(heap, pool);
+    REQUIRE( multi_heap_free_size(heap) == initial_free );
+}
+
+typedef struct {
+    heap_caps_pool_handle_t pool;
+    uint8_t id;
+    bool ok;
+} pool_worker_args_t;
+
+static void *pool_worker(void *arg)
+{
+    pool_worker_args_t *args = (pool_worker_args_t *)arg;
+    const int OPS = 200000;
+    const int WINDOW = 8;
+    void *p[WINDOW] = { 0 };
+    size_t object_size = heap_caps_pool_get_object_size(args->pool);
+    uint32_t x = 0x9E3779B9u * args->id;
+
+    args->ok = true;
+    for (int i = 0; i < OPS; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        int n = x % WINDOW;
+        if (p[n] != NULL) {
+            /* nobody else got this object while this thread owned it */
+            for (size_t b = 0; b < object_size; b++) {
+                if (((uint8_t *)p[n])[b] != args->id) {
+                    args->ok = false;
+                }
+            }
+            heap_caps_pool_free(args->pool, p[n]);
+        }
+        p[n] = heap_caps_pool_alloc(args->pool);
+        if (p[n] != NULL) {
+            memset(p[n], args->id, object_size);
+        }
+    }
+    for (int n = 0; n < WINDOW; n++) {
+        heap_caps_pool_free(args->pool, p[n]);
+    }
+    return NULL;
+}
+
+TEST_CASE("heap_caps_pool is safe to use from several threads without a lock", "[heap_caps_pool]")
+{
+    static uint8_t heapdata[8192];
+    const int THREADS = 4;
+    const size_t NUM = 24; /* fewer objects than the threads want, so that the pool is often empty */
+    multi_heap_handle_t heap = multi_heap_register(heapdata, sizeof(heapdata));
+    REQUIRE( heap != NULL );
+    heap_caps_pool_handle_t pool = create_pool(heap, 16, NUM);
+
+    pthread_t threads[THREADS];
+    pool_worker_args_t args[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        args[i] = { pool, (uint8_t)(i + 1), false };
+        REQUIRE( pthread_create(&threads[i], NULL, pool_worker, &args[i]) == 0 );
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        REQUIRE( args[i].ok );
+    }
+
+    multi_heap_info_t info;
+    heap_caps_pool_get_info(pool, &info);
+    REQUIRE( info.free_blocks == NUM );
+
+    /* the free list still holds each object once */
+    std::set<void *> objects;
+    for (size_t i = 0; i < NUM; i++) {
+        void *p = heap_caps_pool_alloc(pool);
+        REQUIRE( p != NULL );
+        REQUIRE( objects.insert(p).second );
+    }
+    REQUIRE( heap_caps_pool_alloc(pool) == NULL );
+    delete_pool(heap, pool);
+}
+
+TEST_CASE("heap_caps_pool alloc/free compared to multi_heap", "[heap_caps_pool][perf]")
+{
+    static uint8_t heapdata[64 * 1024];
+    static pthread_mutex_t heap_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+    const size_t NUM = 256;
+    const size_t OBJECT_SIZE = 40;
+    const int ROUNDS = 2000;
+    void *p[NUM];
+
+    multi_heap_handle_t heap = multi_heap_register(heapdata, sizeof(heapdata));
+    REQUIRE( heap != NULL );
+    multi_heap_set_lock(heap, &heap_lock); /* like the heaps on the target */
+    const size_t initial_free = multi_heap_free_size(heap);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < NUM; i++) {
+            p[i] = multi_heap_malloc(heap, OBJECT_SIZE);
+        }
+        for (size_t i = 0; i < NUM; i++) {
+            multi_heap_free(heap, p[(i * 7) % NUM]);
+        }
+    }
+    double heap_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    size_t heap_used = initial_free - multi_heap_free_size(heap);
+    REQUIRE( heap_used == 0 );
+
+    for (size_t i = 0; i < NUM; i++) {
+        p[i] = multi_heap_malloc(heap, OBJECT_SIZE);
+    }
+    heap_used = initial_free - multi_heap_free_size(heap);
+    for (size_t i = 0; i < NUM; i++) {
+        multi_heap_free(heap, p[i]);
+    }
+
+    heap_caps_pool_handle_t pool = create_pool(heap, OBJECT_SIZE, NUM);
+    size_t pool_used = initial_free - multi_heap_free_size(heap);
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < NUM; i++) {
+            p[i] = heap_caps_pool_alloc(pool);
+        }
+        for (size_t i = 0; i < NUM; i++) {
+            heap_caps_pool_free(pool, p[(i * 7) % NUM]);
+        }
+    }
+    double pool_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    delete_pool(heap, pool);
+
+    const double ops = 2.0 * ROUNDS * NUM;
+    printf("%zu objects of %zu bytes: multi_heap %zu bytes, %.1f ns per alloc or free; pool %zu bytes, %.1f ns\n",
+           NUM, OBJECT_SIZE, heap_used, heap_ns / ops, pool_used, pool_ns / ops);
+
+    /* no per-object header */
+    REQUIRE( pool_used < heap_used );
+    REQUIRE( multi_heap_free_size(heap) == initial_free );
+    multi_heap_set_lock(heap, NULL);
+}
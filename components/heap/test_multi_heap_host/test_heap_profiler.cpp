@@ -0,0 +1,216 @@
+#include "catch.hpp"
+#include "../heap_profiler_internal.h"
+
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+/* The profiler only sees pointers, sizes and call stacks. These tests replay allocations without a heap, from call
+   sites with different allocation sizes and lifetimes, and compare the estimates with the exact numbers. */
+
+static uint32_t trace_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+struct call_site_t {
+    const char *name;
+    size_t min_size;
+    size_t max_size;
+    size_t live_slots;   /* allocations kept alive, a new one replaces a random slot. 0 = never freed */
+    int per_1000;        /* how often this site allocates */
+    void *callers[HEAP_PROFILER_MAX_STACK_DEPTH];
+    size_t exact_live;
+    size_t exact_total;
+};
+
+struct allocation_t {
+    void *ptr;
+    size_t size;
+};
+
+static void start_profiler(size_t interval)
+{
+    heap_profiler_stop();
+    REQUIRE( heap_profiler_start(interval) == ESP_OK );
+}
+
+static void alloc_at(call_site_t *site, void *ptr, size_t size)
+{
+    site->exact_live += size;
+    site->exact_total += size;
+    size_t samples = heap_profiler_sample_count(size);
+    if (samples != 0) {
+        heap_profiler_record_sample(ptr, samples, site->callers);
+    }
+}
+
+static void free_at(call_site_t *site, const allocation_t &a)
+{
+    site->exact_live -= a.size;
+    heap_profiler_record_free(a.ptr);
+}
+
+static bool get_site_by_hash(const call_site_t &cs, heap_profiler_site_t *out)
+{
+    for (size_t i = 0; i < heap_profiler_get_site_count(); i++) {
+        REQUIRE( heap_profiler_get_site(i, out) == ESP_OK );
+        if (memcmp(out->callers, cs.callers, 4 * sizeof(void *)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Estimates are sums of Poisson distributed samples, each standing for 'interval' bytes */
+static void require_estimate(const char *what, size_t estimate, size_t exact, size_t interval)
+{
+    double sigma = sqrt((double)interval * exact);
+    double error = fabs((double)estimate - (double)exact);
+    INFO( what << ": estimate " << estimate << " exact " << exact << " error " << error / sigma << " sigma" );
+    REQUIRE( error <= 4 * sigma + interval );
+}
+
+TEST_CASE("heap_profiler estimates live bytes per call site", "[heap_profiler]")
+{
+    const size_t INTERVAL = 512;
+    const int ALLOCATIONS = 500000;
+    call_site_t sites[] = {
+        { "small buffers",   16,   64,   4000, 500, { (void *)0x400d1000, (void *)0x400d2000 } },
+        { "medium buffers",  256,  1024, 400,  300, { (void *)0x400d1000, (void *)0x400d2100 } },
+        { "large buffers",   4096, 16384, 40,  20,  { (void *)0x400d1000, (void *)0x400d2200 } },
+        { "churn",           100,  100,  10,   160, { (void *)0x400d1000, (void *)0x400d2300, (void *)0x400e0000 } },
+        { "leak",            8,    128,  0,    20,  { (void *)0x400d1000, (void *)0x400d2300, (void *)0x400e0100 } },
+    };
+    const int NUM_SITES = sizeof(sites) / sizeof(sites[0]);
+    std::vector<allocation_t> live[NUM_SITES];
+    uintptr_t next_ptr = 0x3ffb0000;
+    uint32_t state = 0xC0FFEE;
+
+    start_profiler(INTERVAL);
+    for (int s = 0; s < NUM_SITES; s++) {
+        live[s].resize(sites[s].live_slots, allocation_t { NULL, 0 });
+    }
+
+    for (int i = 0; i < ALLOCATIONS; i++) {
+        int r = trace_rand(&state) % 1000;
+        int s = 0;
+        while (r >= sites[s].per_1000) {
+            r -= sites[s].per_1000;
+            s++;
+        }
+        call_site_t *site = &sites[s];
+        allocation_t a;
+        a.ptr = (void *)next_ptr;
+        a.size = site->min_size + trace_rand(&state) % (site->max_size - site->min_size + 1);
+        next_ptr += (a.size + 15) & ~15;
+
+        if (site->live_slots != 0) {
+            allocation_t &slot = live[s][trace_rand(&state) % site->live_slots];
+            if (slot.ptr != NULL) {
+                free_at(site, slot);
+            }
+            slot = a;
+        } else {
+            live[s].push_back(a);
+        }
+        alloc_at(site, a.ptr, a.size);
+    }
+
+    REQUIRE( heap_profiler_get_dropped_count() == 0 );
+    REQUIRE( heap_profiler_get_site_count() == NUM_SITES );
+    heap_profiler_dump();
+
+    size_t total_estimate = 0, total_exact = 0;
+    for (int s = 0; s < NUM_SITES; s++) {
+        heap_profiler_site_t est;
+        REQUIRE( get_site_by_hash(sites[s], &est) );
+        printf("%s: %zu bytes live, estimated %u; %zu bytes allocated, estimated %u\n", sites[s].name,
+               sites[s].exact_live, est.live_bytes, sites[s].exact_total, est.total_bytes);
+        require_estimate(sites[s].name, est.live_bytes, sites[s].exact_live, INTERVAL);
+        require_estimate(sites[s].name, est.total_bytes, sites[s].exact_total, INTERVAL);
+        total_estimate += est.live_bytes;
+        total_exact += sites[s].exact_live;
+    }
+    require_estimate("all sites", total_estimate, total_exact, INTERVAL);
+
+    /* once everything is freed, nothing is live */
+    for (int s = 0; s < NUM_SITES; s++) {
+        for (auto &a : live[s]) {
+            if (a.ptr != NULL) {
+                free_at(&sites[s], a);
+            }
+        }
+        heap_profiler_site_t est;
+        REQUIRE( get_site_by_hash(sites[s], &est) );
+        REQUIRE( est.live_bytes == 0 );
+        REQUIRE( est.live_samples == 0 );
+    }
+
+    REQUIRE( heap_profiler_stop() == ESP_OK );
+}
+
+TEST_CASE("heap_profiler API and full tables", "[heap_profiler]")
+{
+    heap_profiler_stop();
+    REQUIRE( heap_profiler_stop() == ESP_ERR_INVALID_STATE );
+    REQUIRE( heap_profiler_start(0) == ESP_ERR_INVALID_ARG );
+    start_profiler(64);
+    REQUIRE( heap_profiler_get_sample_interval() == 64 );
+    REQUIRE( heap_profiler_start(64) == ESP_ERR_INVALID_STATE );
+    REQUIRE( heap_profiler_get_site_count() == 0 );
+
+    heap_profiler_site_t site;
+    REQUIRE( heap_profiler_get_site(0, &site) == ESP_ERR_INVALID_ARG );
+
+    /* more call sites than the table holds, every allocation is sampled */
+    void *callers[HEAP_PROFILER_MAX_STACK_DEPTH] = { 0 };
+    for (uintptr_t i = 0; i < 100; i++) {
+        callers[0] = (void *)(0x400d0000 + i * 4);
+        size_t samples = heap_profiler_sample_count(64 * 64);
+        REQUIRE( samples > 0 );
+        heap_profiler_record_sample((void *)(0x3ffb0000 + i * 64 * 64), samples, callers);
+    }
+    REQUIRE( heap_profiler_get_site_count() == 64 );
+    REQUIRE( heap_profiler_get_dropped_count() > 0 );
+    REQUIRE( heap_profiler_get_site(63, &site) == ESP_OK );
+    REQUIRE( heap_profiler_get_site(64, &site) == ESP_ERR_INVALID_ARG );
+
+    /* a stopped profile stays as it is */
+    REQUIRE( heap_profiler_stop() == ESP_OK );
+    REQUIRE( heap_profiler_sample_count(1024 * 1024) == 0 );
+    heap_profiler_record_free((void *)0x3ffb0000);
+    REQUIRE( heap_profiler_get_site_count() == 64 );
+}
+
+TEST_CASE("heap_profiler cost per allocation", "[heap_profiler][perf]")
+{
+    const int ALLOCATIONS = 2000000;
+    void *callers[HEAP_PROFILER_MAX_STACK_DEPTH] = { (void *)0x400d1000 };
+    uint32_t state = 1;
+    size_t sampled = 0;
+
+    start_profiler(32 * 1024);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ALLOCATIONS; i++) {
+        void *ptr = (void *)(uintptr_t)(0x3ffb0000 + (i % 4096) * 256);
+        size_t size = 8 + trace_rand(&state) % 248;
+        heap_profiler_record_free(ptr);
+        size_t samples = heap_profiler_sample_count(size);
+        if (samples != 0) {
+            heap_profiler_record_sample(ptr, samples, callers);
+            sampled++;
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("heap profiler, 1 sample per 32 KB: %.1f ns per allocation and free, %zu of %d allocations sampled\n",
+           ns / ALLOCATIONS, sampled, ALLOCATIONS);
+    REQUIRE( sampled < ALLOCATIONS / 100 );
+    REQUIRE( heap_profiler_stop() == ESP_OK );
+}
@@ -5,6 +5,8 @@
 
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
+#include <chrono>
 
 /* Insurance against accidentally using libc heap functions in tests */
 #undef free
@@ -16,9 +18,17 @@
 #undef realloc
 #define realloc #error
 
+#ifdef CONFIG_HEAP_ALLOCATOR_TLSF
+/* The TLSF allocator keeps the heads of its free lists at the start of each heap,
+   add room for them to the small heaps used by these tests */
+#define HEAP_LISTS_SIZE 512
+#else
+#define HEAP_LISTS_SIZE 0
+#endif
+
 TEST_CASE("multi_heap simple allocations", "[multi_heap]")
 {
-    uint8_t small_heap[128];
+    uint8_t small_heap[128 + HEAP_LISTS_SIZE];
 
     multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
 
@@ -59,7 +69,7 @@ TEST_CASE("multi_heap simple allocations", "[multi_heap]")
 
 TEST_CASE("multi_heap fragmentation", "[multi_heap]")
 {
-    uint8_t small_heap[256];
+    uint8_t small_heap[256 + HEAP_LISTS_SIZE];
     multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
 
     const size_t alloc_size = 24;
@@ -76,7 +86,15 @@ TEST_CASE("multi_heap fragmentation", "[multi_heap]")
 
     printf("allocated %p %p %p %p\n", p[0], p[1], p[2], p[3]);
 
+#ifndef CONFIG_HEAP_ALLOCATOR_TLSF
     REQUIRE( multi_heap_malloc(heap, alloc_size * 5) == NULL ); /* no room to allocate 5*alloc_size now */
+#else
+    /* the extra room given to the TLSF heap may be enough for 5*alloc_size, but not for more than the largest free block */
+    multi_heap_info_t info;
+    multi_heap_get_info(heap, &info);
+    REQUIRE( info.largest_free_block < alloc_size * 5 + HEAP_LISTS_SIZE );
+    REQUIRE( multi_heap_malloc(heap, info.largest_free_block + 1) == NULL );
+#endif
 
     printf("4 allocations:\n");
     multi_heap_dump(heap);
@@ -109,7 +127,7 @@ TEST_CASE("multi_heap fragmentation", "[multi_heap]")
 TEST_CASE("multi_heap defrag", "[multi_heap]")
 {
     void *p[4];
-    uint8_t small_heap[512];
+    uint8_t small_heap[512 + HEAP_LISTS_SIZE];
     multi_heap_info_t info, info2;
     multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
 
@@ -159,7 +177,7 @@ TEST_CASE("multi_heap defrag", "[multi_heap]")
 TEST_CASE("multi_heap defrag realloc", "[multi_heap]")
 {
     void *p[4];
-    uint8_t small_heap[512];
+    uint8_t small_heap[512 + HEAP_LISTS_SIZE];
     multi_heap_info_t info, info2;
     multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
 
@@ -296,7 +314,7 @@ TEST_CASE("multi_heap many random allocations", "[multi_heap]")
 
 TEST_CASE("multi_heap_get_info() function", "[multi_heap]")
 {
-    uint8_t heapdata[256];
+    uint8_t heapdata[256 + HEAP_LISTS_SIZE];
     multi_heap_handle_t heap = multi_heap_register(heapdata, sizeof(heapdata));
     multi_heap_info_t before, after, freed;
 
@@ -391,7 +409,7 @@ TEST_CASE("multi_heap minimum-size allocations", "[multi_heap]")
 TEST_CASE("multi_heap_realloc()", "[multi_heap]")
 {
     const uint32_t PATTERN = 0xABABDADA;
-    uint8_t small_heap[300];
+    uint8_t small_heap[300 + HEAP_LISTS_SIZE];
     multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
 
     uint32_t *a = (uint32_t *)multi_heap_malloc(heap, 64);
@@ -432,7 +450,7 @@ TEST_CASE("multi_heap_realloc()", "[multi_heap]")
 #define TOO_MUCH 128 + 1
 #endif
     /* not enough contiguous space left in the heap */
-    uint32_t *g = (uint32_t *)multi_heap_realloc(heap, e, TOO_MUCH);
+    uint32_t *g = (uint32_t *)multi_heap_realloc(heap, e, TOO_MUCH + HEAP_LISTS_SIZE);
     REQUIRE( g == NULL );
 
     multi_heap_free(heap, f);
@@ -445,7 +463,7 @@ TEST_CASE("multi_heap_realloc()", "[multi_heap]")
 
 TEST_CASE("corrupt heap block", "[multi_heap]")
 {
-    uint8_t small_heap[256];
+    uint8_t small_heap[256 + HEAP_LISTS_SIZE];
     multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
 
     void *a = multi_heap_malloc(heap, 32);
@@ -456,7 +474,7 @@ TEST_CASE("corrupt heap block", "[multi_heap]")
 
 TEST_CASE("unaligned heaps", "[multi_heap]")
 {
-    const size_t CHUNK_LEN = 256;
+    const size_t CHUNK_LEN = 256 + HEAP_LISTS_SIZE;
     const size_t CANARY_LEN = 16;
     const uint8_t CANARY_BYTE = 0x3E;
     uint8_t heap_chunk[CHUNK_LEN + CANARY_LEN * 2];
@@ -475,8 +493,8 @@ TEST_CASE("unaligned heaps", "[multi_heap]")
 
         multi_heap_get_info(heap, &info);
 
-        REQUIRE( info.total_free_bytes > CHUNK_LEN - 64 - i );
-        REQUIRE( info.largest_free_block > CHUNK_LEN - 64 - i );
+        REQUIRE( info.total_free_bytes > CHUNK_LEN - HEAP_LISTS_SIZE - 64 - i );
+        REQUIRE( info.largest_free_block > CHUNK_LEN - HEAP_LISTS_SIZE - 64 - i );
 
         void *a = multi_heap_malloc(heap, info.largest_free_block);
         REQUIRE( a != NULL );
@@ -544,4 +562,279 @@ TEST_CASE("multi_heap aligned allocations", "[multi_heap]")
 
     printf("[ALIGNED_ALLOC] heap_size after: %d \n", multi_heap_free_size(heap));
     REQUIRE((old_size - multi_heap_free_size(heap)) <= leakage);
-}
\ No newline at end of file
+}
+/* Trace of allocations with different lifetimes, as seen in applications: a few long lived buffers (connection
+   contexts, caches), many short lived small buffers (strings, messages) and medium ones, and an occasional large
+   buffer (a file or network transfer). */
+static uint32_t trace_rand(uint32_t *state)
+{
+    /* xorshift32, so that the trace is the same on every run and with each allocator */
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void print_latency(const char *what, uint32_t *ns, size_t count)
+{
+    std::sort(ns, ns + count);
+    printf("%s: %zu calls, p50 %u ns p99 %u ns p99.9 %u ns max %u ns\n", what, count,
+           ns[count / 2], ns[count * 99 / 100], ns[count * 999 / 1000], ns[count - 1]);
+}
+
+TEST_CASE("multi_heap alloc/free latency with a fragmenting trace", "[multi_heap][perf]")
+{
+    static uint8_t heapdata[256 * 1024];
+    const int SLOTS = 256;
+    const int ITERATIONS = 200000;
+    static void *p[SLOTS];
+    static int expires[SLOTS];
+    static uint32_t malloc_ns[ITERATIONS];
+    static uint32_t free_ns[ITERATIONS];
+    size_t mallocs = 0, frees = 0, failed = 0;
+    uint32_t state = 0x12345678;
+
+    multi_heap_handle_t heap = multi_heap_register(heapdata, sizeof(heapdata));
+    REQUIRE( heap != NULL );
+    const size_t initial_free = multi_heap_free_size(heap);
+    memset(p, 0, sizeof(p));
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        int n = trace_rand(&state) % SLOTS;
+        if (p[n] != NULL) {
+            if (expires[n] > i) {
+                continue; /* still alive */
+            }
+            auto start = std::chrono::steady_clock::now();
+            multi_heap_free(heap, p[n]);
+            free_ns[frees++] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            p[n] = NULL;
+        }
+
+        size_t size;
+        int lifetime;
+        uint32_t kind = trace_rand(&state) % 100;
+        if (kind < 2) {
+            size = 256 + trace_rand(&state) % 1024;     /* long lived contexts */
+            lifetime = 5000 + trace_rand(&state) % 15000;
+        } else if (kind < 75) {
+            size = 8 + trace_rand(&state) % 120;        /* short lived small buffers */
+            lifetime = trace_rand(&state) % 500;
+        } else if (kind < 99) {
+            size = 128 + trace_rand(&state) % 1920;     /* medium buffers */
+            lifetime = trace_rand(&state) % 5000;
+        } else {
+            size = 4096 + trace_rand(&state) % 12288;   /* occasional large buffers */
+            lifetime = trace_rand(&state) % 200;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        p[n] = multi_heap_malloc(heap, size);
+        malloc_ns[mallocs++] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if (p[n] == NULL) {
+            failed++;
+        } else {
+            memset(p[n], n, size);
+            expires[n] = i + lifetime;
+        }
+    }
+
+    multi_heap_info_t info;
+    multi_heap_get_info(heap, &info);
+    printf("free blocks %zu, largest free block %zu of %zu free bytes, %zu failed allocations\n",
+           info.free_blocks, info.largest_free_block, info.total_free_bytes, failed);
+    print_latency("multi_heap_malloc", malloc_ns, mallocs);
+    print_latency("multi_heap_free", free_ns, frees);
+
+    REQUIRE( multi_heap_check(heap, true) );
+    for (int i = 0; i < SLOTS; i++) {
+        multi_heap_free(heap, p[i]);
+    }
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( initial_free == multi_heap_free_size(heap) );
+}
+
+TEST_CASE("multi_heap_get_frag_info() function", "[multi_heap]")
+{
+    uint8_t heapdata[4096 + HEAP_LISTS_SIZE];
+    multi_heap_handle_t heap = multi_heap_register(heapdata, sizeof(heapdata));
+    multi_heap_frag_info_t frag;
+    multi_heap_info_t info;
+
+    multi_heap_get_frag_info(heap, &frag);
+    multi_heap_get_info(heap, &info);
+    REQUIRE( frag.fragmentation == 0 );
+    REQUIRE( frag.total_free_bytes == info.total_free_bytes );
+    REQUIRE( frag.largest_free_block == info.largest_free_block );
+    REQUIRE( frag.free_blocks[7] == 1 ); /* 2048..4095 bytes */
+
+    /* leave free holes of 100 bytes between allocations */
+    void *p[16];
+    for (int i = 0; i < 16; i++) {
+        p[i] = multi_heap_malloc(heap, 100);
+        REQUIRE( p[i] != NULL );
+    }
+    for (int i = 0; i < 16; i += 2) {
+        multi_heap_free(heap, p[i]);
+    }
+
+    multi_heap_get_frag_info(heap, &frag);
+    multi_heap_get_info(heap, &info);
+    size_t blocks = 0, bytes = 0;
+    for (int i = 0; i < MULTI_HEAP_FRAG_SIZE_CLASSES; i++) {
+        blocks += frag.free_blocks[i];
+        bytes += frag.free_bytes[i];
+    }
+    REQUIRE( blocks == info.free_blocks );
+    REQUIRE( frag.free_blocks[2] == 8 ); /* 64..127 bytes */
+    REQUIRE( frag.total_free_bytes == info.total_free_bytes );
+    REQUIRE( frag.largest_free_block == info.largest_free_block );
+#ifndef MULTI_HEAP_POISONING
+    REQUIRE( bytes == info.total_free_bytes );
+#endif
+    REQUIRE( frag.fragmentation > 0 );
+    REQUIRE( frag.fragmentation == (info.total_free_bytes - info.largest_free_block) * 100 / info.total_free_bytes );
+
+    for (int i = 1; i < 16; i += 2) {
+        multi_heap_free(heap, p[i]);
+    }
+    multi_heap_get_frag_info(heap, &frag);
+    REQUIRE( frag.fragmentation == 0 );
+}
+
+TEST_CASE("multi_heap_malloc_high() allocates from the top", "[multi_heap]")
+{
+    uint8_t heapdata[4096 + HEAP_LISTS_SIZE];
+    multi_heap_handle_t heap = multi_heap_register(heapdata, sizeof(heapdata));
+    const size_t initial_free = multi_heap_free_size(heap);
+
+    void *low = multi_heap_malloc(heap, 200);
+    void *high = multi_heap_malloc_high(heap, 200);
+    void *high2 = multi_heap_malloc_high(heap, 300);
+    REQUIRE( low != NULL );
+    REQUIRE( high != NULL );
+    REQUIRE( high2 != NULL );
+    REQUIRE( (uint8_t *)high > (uint8_t *)low );
+    REQUIRE( (uint8_t *)high2 < (uint8_t *)high );
+    REQUIRE( (uint8_t *)high + 200 > heapdata + sizeof(heapdata) - 64 );
+    REQUIRE( multi_heap_get_allocated_size(heap, high) >= 200 );
+    memset(high, 0xEE, 200);
+    memset(high2, 0xEE, 300);
+    REQUIRE( multi_heap_check(heap, true) );
+
+    /* the free space between the allocations is one block */
+    multi_heap_info_t info;
+    multi_heap_get_info(heap, &info);
+    REQUIRE( info.free_blocks == 1 );
+
+    multi_heap_free(heap, high);
+    REQUIRE( multi_heap_check(heap, true) );
+    multi_heap_free(heap, low);
+    multi_heap_free(heap, high2);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( multi_heap_free_size(heap) == initial_free );
+
+    /* fill the heap from the top, including allocations which take whole blocks */
+    void *p[64];
+    int count = 0;
+    while (count < 64 && (p[count] = multi_heap_malloc_high(heap, 50 + count)) != NULL) {
+        memset(p[count], 0xAA, 50 + count);
+        count++;
+    }
+    REQUIRE( count > 20 );
+    REQUIRE( multi_heap_check(heap, true) );
+    for (int i = 0; i < count; i += 2) {
+        multi_heap_free(heap, p[i]);
+    }
+    for (int i = 0; i < count; i += 2) {
+        p[i] = multi_heap_malloc_high(heap, 50 + i);
+        REQUIRE( p[i] != NULL );
+    }
+    REQUIRE( multi_heap_check(heap, true) );
+    for (int i = 0; i < count; i++) {
+        multi_heap_free(heap, p[i]);
+    }
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( multi_heap_free_size(heap) == initial_free );
+}
+
+typedef struct {
+    size_t peak_fragmentation;
+    size_t min_largest_free_block;
+    size_t failed;
+} frag_trace_result_t;
+
+/* Replay an allocation trace as a protocol handler makes it: each request allocates a burst of short-lived buffers
+   and sometimes a connection context which stays allocated for many requests, then frees the buffers. The
+   fragmentation is measured once the buffers are freed. With 'hints', the contexts come from the top of the heap. */
+static void replay_frag_trace(bool hints, frag_trace_result_t *result)
+{
+    static uint8_t heapdata[128 * 1024];
+    const int REQUESTS = 2000;
+    const int BUFFERS = 100;
+    const int CONTEXTS = 160;
+    void *buffers[BUFFERS];
+    void *contexts[CONTEXTS];
+    int expires[CONTEXTS];
+    uint32_t state = 0x12345678;
+
+    multi_heap_handle_t heap = multi_heap_register(heapdata, sizeof(heapdata));
+    REQUIRE( heap != NULL );
+    const size_t initial_free = multi_heap_free_size(heap);
+    memset(contexts, 0, sizeof(contexts));
+    memset(result, 0, sizeof(frag_trace_result_t));
+    result->min_largest_free_block = SIZE_MAX;
+
+    for (int r = 0; r < REQUESTS; r++) {
+        for (int i = 0; i < BUFFERS; i++) {
+            buffers[i] = multi_heap_malloc(heap, 16 + trace_rand(&state) % 600);
+            if (buffers[i] == NULL) {
+                result->failed++;
+            }
+            if (trace_rand(&state) % 20 == 0) {
+                int n = trace_rand(&state) % CONTEXTS;
+                if (contexts[n] == NULL || expires[n] <= r) {
+                    multi_heap_free(heap, contexts[n]);
+                    size_t size = 64 + trace_rand(&state) % 448;
+                    contexts[n] = hints ? multi_heap_malloc_high(heap, size) : multi_heap_malloc(heap, size);
+                    expires[n] = r + 10 + trace_rand(&state) % 50;
+                    if (contexts[n] == NULL) {
+                        result->failed++;
+                    }
+                }
+            }
+        }
+        for (int i = 0; i < BUFFERS; i++) {
+            multi_heap_free(heap, buffers[i]);
+        }
+
+        if (r >= 100) {
+            multi_heap_frag_info_t frag;
+            multi_heap_get_frag_info(heap, &frag);
+            result->peak_fragmentation = std::max(result->peak_fragmentation, frag.fragmentation);
+            result->min_largest_free_block = std::min(result->min_largest_free_block, frag.largest_free_block);
+        }
+    }
+
+    REQUIRE( multi_heap_check(heap, true) );
+    for (int i = 0; i < CONTEXTS; i++) {
+        multi_heap_free(heap, contexts[i]);
+    }
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( initial_free == multi_heap_free_size(heap) );
+}
+
+TEST_CASE("multi_heap_malloc_high() reduces fragmentation of a trace", "[multi_heap]")
+{
+    frag_trace_result_t plain, hinted;
+    replay_frag_trace(false, &plain);
+    replay_frag_trace(true, &hinted);
+    printf("without hints: peak fragmentation %zu%%, smallest largest free block %zu bytes, %zu failed allocations\n",
+           plain.peak_fragmentation, plain.min_largest_free_block, plain.failed);
+    printf("with hints:    peak fragmentation %zu%%, smallest largest free block %zu bytes, %zu failed allocations\n",
+           hinted.peak_fragmentation, hinted.min_largest_free_block, hinted.failed);
+    REQUIRE( hinted.peak_fragmentation < plain.peak_fragmentation );
+    REQUIRE( hinted.min_largest_free_block > plain.min_largest_free_block );
+}
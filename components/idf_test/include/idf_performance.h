@@ -38,6 +38,12 @@
 #ifndef IDF_PERFORMANCE_MAX_VFS_OPEN_WRITE_CLOSE_TIME_PSRAM
 #define IDF_PERFORMANCE_MAX_VFS_OPEN_WRITE_CLOSE_TIME_PSRAM                     25000
 #endif
+#ifndef IDF_PERFORMANCE_MAX_VFS_WRITE_TIME
+#define IDF_PERFORMANCE_MAX_VFS_WRITE_TIME                                      3000
+#endif
+#ifndef IDF_PERFORMANCE_MAX_VFS_WRITE_TIME_PSRAM
+#define IDF_PERFORMANCE_MAX_VFS_WRITE_TIME_PSRAM                                4000
+#endif
 
 // throughput performance by iperf
 #ifndef IDF_PERFORMANCE_MIN_TCP_RX_THROUGHPUT
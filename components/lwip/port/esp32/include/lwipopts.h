@@ -40,6 +40,7 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #include "esp_task.h"
 #include "esp_system.h"
 #include "sdkconfig.h"
@@ -19,6 +19,7 @@
 #include <sys/lock.h>
 #include <sys/fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include "sdkconfig.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
@@ -49,6 +50,44 @@ ssize_t _read_r(struct _reent *r, int fd, void * dst, size_t size)
     return lwip_read(fd, dst, size);
 }
 
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    if (fd < LWIP_SOCKET_OFFSET) {
+        ssize_t total = 0;
+        for (int i = 0; i < iovcnt; ++i) {
+            ssize_t ret = _write_r_console(__getreent(), fd, iov[i].iov_base, iov[i].iov_len);
+            if (ret < 0) {
+                return (total > 0) ? total : -1;
+            }
+            total += ret;
+            if ((size_t) ret < iov[i].iov_len) {
+                break;
+            }
+        }
+        return total;
+    }
+    return lwip_writev(fd, iov, iovcnt);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    if (fd < LWIP_SOCKET_OFFSET) {
+        ssize_t total = 0;
+        for (int i = 0; i < iovcnt; ++i) {
+            ssize_t ret = _read_r_console(__getreent(), fd, iov[i].iov_base, iov[i].iov_len);
+            if (ret < 0) {
+                return (total > 0) ? total : -1;
+            }
+            total += ret;
+            if ((size_t) ret < iov[i].iov_len) {
+                break;
+            }
+        }
+        return total;
+    }
+    return lwip_readv(fd, iov, iovcnt);
+}
+
 int _close_r(struct _reent *r, int fd)
 {
     if (fd < LWIP_SOCKET_OFFSET) {
@@ -79,6 +79,8 @@ void esp_vfs_lwip_sockets_register(void)
         .fstat = NULL,
         .close = &lwip_close,
         .read = &lwip_read,
+        .readv = &lwip_readv,
+        .writev = &lwip_writev,
         .fcntl = &lwip_fcntl_r_wrapper,
         .ioctl = &lwip_ioctl_r_wrapper,
 #ifdef CONFIG_VFS_SUPPORT_SELECT
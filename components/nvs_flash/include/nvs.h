@@ -61,6 +61,7 @@ typedef nvs_handle_t nvs_handle IDF_DEPRECATED("Replace with nvs_handle_t");
 #define ESP_ERR_NVS_CORRUPT_KEY_PART        (ESP_ERR_NVS_BASE + 0x17)  /*!< NVS key partition is corrupt */
 
 #define ESP_ERR_NVS_CONTENT_DIFFERS         (ESP_ERR_NVS_BASE + 0x18)  /*!< Internal error; never returned by nvs API functions.  NVS key is different in comparison */
+#define ESP_ERR_NVS_BLOB_STREAM_OPEN        (ESP_ERR_NVS_BASE + 0x19)  /*!< The key is being written by a blob stream which hasn't been closed yet */
 
 #define NVS_DEFAULT_PART_NAME               "nvs"   /*!< Default partition name of the NVS partition in the partition table */
 
@@ -71,7 +72,8 @@ typedef nvs_handle_t nvs_handle IDF_DEPRECATED("Replace with nvs_handle_t");
  */
 typedef enum {
 	NVS_READONLY,  /*!< Read only */
-	NVS_READWRITE  /*!< Read and write */
+	NVS_READWRITE, /*!< Read and write */
+	NVS_READWRITE_BATCH /*!< Read and write, changes are buffered and written together by nvs_commit */
 } nvs_open_mode_t;
 
 /*
@@ -112,6 +114,11 @@ typedef struct {
  */
 typedef struct nvs_opaque_iterator_t *nvs_iterator_t;
 
+/**
+ * Opaque pointer type representing a blob opened for reading or writing in parts
+ */
+typedef struct nvs_opaque_blob_stream_t *nvs_blob_stream_t;
+
 /**
  * @brief      Open non-volatile storage with a given namespace from the default NVS partition
  *
@@ -124,9 +131,11 @@ typedef struct nvs_opaque_iterator_t *nvs_iterator_t;
  * @param[in]  name        Namespace name. Maximal length is determined by the
  *                         underlying implementation, but is guaranteed to be
  *                         at least 15 characters. Shouldn't be empty.
- * @param[in]  open_mode   NVS_READWRITE or NVS_READONLY. If NVS_READONLY, will
- *                         open a handle for reading only. All write requests will
- *             be rejected for this handle.
+ * @param[in]  open_mode   NVS_READWRITE, NVS_READWRITE_BATCH or NVS_READONLY.
+ *                         If NVS_READONLY, will open a handle for reading only.
+ *                         All write requests will be rejected for this handle.
+ *                         If NVS_READWRITE_BATCH, set and erase requests are
+ *                         buffered in RAM and only written by nvs_commit.
  * @param[out] out_handle  If successful (return code is zero), handle will be
  *                         returned in this argument.
  *
@@ -152,9 +161,11 @@ esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t *ou
  * @param[in]  name        Namespace name. Maximal length is determined by the
  *                         underlying implementation, but is guaranteed to be
  *                         at least 15 characters. Shouldn't be empty.
- * @param[in]  open_mode   NVS_READWRITE or NVS_READONLY. If NVS_READONLY, will
- *                         open a handle for reading only. All write requests will
- *             be rejected for this handle.
+ * @param[in]  open_mode   NVS_READWRITE, NVS_READWRITE_BATCH or NVS_READONLY.
+ *                         If NVS_READONLY, will open a handle for reading only.
+ *                         All write requests will be rejected for this handle.
+ *                         If NVS_READWRITE_BATCH, set and erase requests are
+ *                         buffered in RAM and only written by nvs_commit.
  * @param[out] out_handle  If successful (return code is zero), handle will be
  *                         returned in this argument.
  *
@@ -347,6 +358,134 @@ esp_err_t nvs_get_str (nvs_handle_t handle, const char* key, char* out_value, si
 esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length);
 /**@}*/
 
+/**
+ * @brief      Open a blob for reading in parts
+ *
+ * Blobs are stored in flash as a sequence of chunks. A blob stream reads
+ * the chunks overlapping the requested range directly, so a blob of any
+ * size can be processed using a small buffer instead of one large enough
+ * for the whole value, as nvs_get_blob requires.
+ *
+ * The stream has to be closed with nvs_blob_stream_close before the handle
+ * is closed or the partition is deinitialized. Writing to the key while
+ * the stream is open makes further reads fail with ESP_ERR_NVS_NOT_FOUND.
+ *
+ * @param[in]  handle      Handle obtained from nvs_open function.
+ * @param[in]  key         Key name. Maximal length is 15 characters. Shouldn't be empty.
+ * @param[out] out_stream  If successful, set to the opened stream.
+ * @param[out] out_size    If not NULL, set to the size of the blob.
+ *
+ * @return
+ *             - ESP_OK if the stream was opened successfully
+ *             - ESP_ERR_NVS_NOT_FOUND if the requested key doesn't exist or is not a blob
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NO_MEM if memory for the stream can't be allocated
+ *             - ESP_ERR_INVALID_ARG if out_stream is NULL
+ */
+esp_err_t nvs_blob_stream_open_read(nvs_handle_t handle, const char* key, nvs_blob_stream_t* out_stream, size_t* out_size);
+
+/**
+ * @brief      Read a part of a blob opened with nvs_blob_stream_open_read
+ *
+ * Reads at increasing offsets only visit each chunk once. Moving backwards
+ * restarts the lookup from the first chunk.
+ *
+ * @param[in]  stream     Stream obtained from nvs_blob_stream_open_read.
+ * @param[in]  offset     Offset of the first byte to read within the blob.
+ * @param[out] out_value  Buffer of at least length bytes.
+ * @param[in]  length     Number of bytes to read.
+ *
+ * @return
+ *             - ESP_OK if the data was read successfully
+ *             - ESP_ERR_NVS_INVALID_LENGTH if the range exceeds the size of the blob
+ *             - ESP_ERR_NVS_NOT_FOUND if a chunk of the blob is missing or corrupted
+ *             - ESP_ERR_INVALID_ARG if stream is NULL or was opened for writing
+ *             - ESP_ERR_NVS_INVALID_HANDLE if the partition was deinitialized since the stream was opened
+ */
+esp_err_t nvs_blob_stream_read(nvs_blob_stream_t stream, size_t offset, void* out_value, size_t length);
+
+/**
+ * @brief      Start writing a new value of a blob in parts
+ *
+ * Data passed to nvs_blob_stream_write is collected in a buffer of
+ * CONFIG_NVS_BLOB_STREAM_BUFFER_SIZE bytes and written to flash whenever
+ * the buffer fills up. The previous value of the key stays valid until
+ * nvs_blob_stream_close writes the index of the new one, so a power loss
+ * in between keeps the old value.
+ *
+ * Data is written directly, even if the handle was opened in
+ * NVS_READWRITE_BATCH mode. Only one writer may be open for a key at a
+ * time. Until the stream is closed or aborted, functions which would set or
+ * erase the key, including nvs_erase_all and nvs_commit of a batch which
+ * contains the key, fail with ESP_ERR_NVS_BLOB_STREAM_OPEN.
+ *
+ * @param[in]  handle      Handle obtained from nvs_open function. Must not be read-only.
+ * @param[in]  key         Key name. Maximal length is 15 characters. Shouldn't be empty.
+ * @param[out] out_stream  If successful, set to the opened stream.
+ *
+ * @return
+ *             - ESP_OK if the stream was opened successfully
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY if storage handle was opened as read only
+ *             - ESP_ERR_NVS_KEY_TOO_LONG if key name is too long
+ *             - ESP_ERR_NO_MEM if memory for the stream can't be allocated
+ *             - ESP_ERR_INVALID_ARG if out_stream is NULL
+ *             - ESP_ERR_NVS_BLOB_STREAM_OPEN if another stream is writing the key
+ */
+esp_err_t nvs_blob_stream_open_write(nvs_handle_t handle, const char* key, nvs_blob_stream_t* out_stream);
+
+/**
+ * @brief      Append data to a blob opened with nvs_blob_stream_open_write
+ *
+ * If an error is returned, the stream should be aborted using
+ * nvs_blob_stream_abort.
+ *
+ * @param[in]  stream  Stream obtained from nvs_blob_stream_open_write.
+ * @param[in]  value   Data to append.
+ * @param[in]  length  Length of the data in bytes.
+ *
+ * @return
+ *             - ESP_OK if the data was written or buffered successfully
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space for the data
+ *             - ESP_ERR_NVS_VALUE_TOO_LONG if the blob exceeds the maximal number of chunks
+ *             - ESP_ERR_INVALID_ARG if stream is NULL or was opened for reading
+ *             - ESP_ERR_NVS_INVALID_HANDLE if the partition was deinitialized since the stream was opened
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_blob_stream_write(nvs_blob_stream_t stream, const void* value, size_t length);
+
+/**
+ * @brief      Close a blob stream and release its memory
+ *
+ * For a stream opened with nvs_blob_stream_open_write, the remaining data
+ * and the blob index are written, after which the new value replaces the
+ * previous one. If this fails, the data written by the stream is erased.
+ * Streams which are still open when the partition is deinitialized are
+ * aborted; they still have to be closed to release their memory.
+ *
+ * @param[in]  stream  Stream to close. May be NULL.
+ *
+ * @return
+ *             - ESP_OK if the stream was closed and, for writers, the blob was stored successfully
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space for the remaining data
+ *             - ESP_ERR_NVS_REMOVE_FAILED if the new value was written but the previous one
+ *               couldn't be erased, as for nvs_set_blob
+ *             - ESP_ERR_NVS_INVALID_HANDLE if the partition was deinitialized since the stream was opened,
+ *               the data written by the stream was erased
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_blob_stream_close(nvs_blob_stream_t stream);
+
+/**
+ * @brief      Discard a blob stream and release its memory
+ *
+ * For a stream opened with nvs_blob_stream_open_write, the data written so
+ * far is erased and the key keeps its previous value.
+ *
+ * @param[in]  stream  Stream to abort. May be NULL.
+ */
+void nvs_blob_stream_abort(nvs_blob_stream_t stream);
+
 /**
  * @brief      Erase key-value pair with given key name.
  *
@@ -364,6 +503,7 @@ esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, si
  *              - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
  *              - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
  *              - ESP_ERR_NVS_NOT_FOUND if the requested key doesn't exist
+ *                (not reported for handles opened with NVS_READWRITE_BATCH)
  *              - other error codes from the underlying storage driver
  */
 esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key);
@@ -372,6 +512,8 @@ esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key);
  * @brief      Erase all key-value pairs in a namespace
  *
  * Note that actual storage may not be updated until nvs_commit function is called.
+ * For handles opened with NVS_READWRITE_BATCH, the namespace is erased immediately
+ * and changes which haven't been committed yet are discarded.
  *
  * @param[in]  handle  Storage handle obtained with nvs_open.
  *                     Handles that were opened read only cannot be used.
@@ -384,6 +526,28 @@ esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key);
  */
 esp_err_t nvs_erase_all(nvs_handle_t handle);
 
+/**
+ * @brief      Erase all key-value pairs in a namespace whose keys start with a prefix
+ *
+ * Each page of the partition is scanned once, and matching items are marked as erased
+ * with a single update of the entry state table of each page.
+ * For handles opened with NVS_READWRITE_BATCH, the keys are erased immediately, and
+ * changes to matching keys which haven't been committed yet are discarded.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ *                     Handles that were opened read only cannot be used.
+ * @param[in]  prefix  Prefix of the keys to erase. Maximal length is 15 characters.
+ *                     An empty prefix erases all keys of the namespace.
+ *
+ * @return
+ *              - ESP_OK if erase operation was successful, including if no key matched
+ *              - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *              - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
+ *              - ESP_ERR_NVS_KEY_TOO_LONG if the prefix is too long
+ *              - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_erase_prefix(nvs_handle_t handle, const char* prefix);
+
 /**
  * @brief      Write any pending changes to non-volatile storage
  *
@@ -391,12 +555,18 @@ esp_err_t nvs_erase_all(nvs_handle_t handle);
  * to non-volatile storage. Individual implementations may write to storage at other times,
  * but this is not guaranteed.
  *
+ * For handles opened with NVS_READWRITE_BATCH, all values set since the previous commit
+ * and all keys erased since the previous commit are written to one page in a single batch.
+ * If power is lost during nvs_commit, either all or none of these changes are applied after
+ * re-initialization. If the commit fails, pending changes are kept and nvs_commit may be retried.
+ *
  * @param[in]  handle  Storage handle obtained with nvs_open.
  *                     Handles that were opened read only cannot be used.
  *
  * @return
  *             - ESP_OK if the changes have been written successfully
  *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space for the batch
  *             - other error codes from the underlying storage driver
  */
 esp_err_t nvs_commit(nvs_handle_t handle);
@@ -422,6 +592,9 @@ typedef struct {
     size_t free_entries;      /**< Amount of free entries. */
     size_t total_entries;     /**< Amount all available entries. */
     size_t namespace_count;   /**< Amount name space. */
+    size_t max_write_time_us; /**< Longest time taken by one write or erase operation since the partition was initialized, in microseconds. */
+    size_t value_cache_hits;  /**< Number of integer reads served from the value cache, see CONFIG_NVS_VALUE_CACHE_ENTRIES. */
+    size_t value_cache_misses; /**< Number of integer reads which had to read the value from flash while the value cache was enabled. */
 } nvs_stats_t;
 
 /**
@@ -530,6 +703,31 @@ esp_err_t nvs_get_used_entry_count(nvs_handle_t handle, size_t* used_entries);
  */
 nvs_iterator_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type);
 
+/**
+ * @brief       Create an iterator to enumerate NVS entries whose keys start with a prefix
+ *
+ * Works like nvs_entry_find, and the iterator is advanced with nvs_entry_next.
+ * Entries are read from flash in blocks rather than one by one, and only those
+ * with a matching key are returned.
+ *
+ * @param[in]   part_name       Partition name
+ *
+ * @param[in]   namespace_name  Set this value if looking for entries with
+ *                              a specific namespace. Pass NULL otherwise.
+ *
+ * @param[in]   type            One of nvs_type_t values.
+ *
+ * @param[in]   prefix          Prefix of the keys to enumerate. Maximal length is 15 characters.
+ *                              An empty prefix matches all keys.
+ *
+ * @return
+ *          Iterator used to enumerate all the entries found,
+ *          or NULL if no entry satisfying criteria was found.
+ *          Iterator obtained through this function has to be released
+ *          using nvs_release_iterator when not used any more.
+ */
+nvs_iterator_t nvs_entry_find_prefix(const char *part_name, const char *namespace_name, nvs_type_t type, const char *prefix);
+
 /**
  * @brief       Returns next item matching the iterator criteria, NULL if no such item exists.
  *
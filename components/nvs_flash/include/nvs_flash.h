@@ -152,6 +152,77 @@ esp_err_t nvs_flash_erase_partition(const char *part_name);
  */
 esp_err_t nvs_flash_erase_partition_ptr(const esp_partition_t *partition);
 
+/**
+ * @brief Reclaim space of erased entries in the default NVS partition, in small steps
+ *
+ * When a write needs a new page and the partition is down to its last free page, NVS
+ * moves all items off the page with most erased entries and erases it, which stalls
+ * that write. Each call of this function does a bounded part of this work ahead of
+ * time: it moves at most max_entries entries (rounded up to whole items), or erases
+ * one page from which all items have been moved. It does nothing while the partition
+ * has more than two free pages.
+ *
+ * Call it repeatedly, e.g. from an idle task, until it returns ESP_ERR_NOT_FOUND.
+ * Writes can do the same work automatically, see CONFIG_NVS_INCREMENTAL_GC_ENTRIES.
+ *
+ * @param[in]  max_entries  Maximal number of entries to move in one call, at least 1.
+ *
+ * @return
+ *      - ESP_OK if entries were moved or a page was freed
+ *      - ESP_ERR_NOT_FOUND if there is nothing to reclaim
+ *      - ESP_ERR_NVS_NOT_ENOUGH_SPACE if items can only be moved by the next write
+ *        which needs a new page
+ *      - ESP_ERR_NVS_NOT_INITIALIZED if the storage was not initialized
+ *      - ESP_ERR_INVALID_ARG if max_entries is 0
+ *      - one of the error codes from the underlying flash storage driver
+ */
+esp_err_t nvs_flash_reclaim(size_t max_entries);
+
+/**
+ * @brief Reclaim space of erased entries in the given NVS partition, in small steps
+ *
+ * See nvs_flash_reclaim.
+ *
+ * @param[in]  partition_label  Label of the partition
+ * @param[in]  max_entries      Maximal number of entries to move in one call, at least 1.
+ *
+ * @return
+ *      - the same values as nvs_flash_reclaim
+ */
+esp_err_t nvs_flash_reclaim_partition(const char *partition_label, size_t max_entries);
+
+/**
+ * @brief Write a mount summary of the default NVS partition
+ *
+ * Mounting a partition reads and checks every item on every page. This function
+ * writes a summary of all full pages to a free page of the partition, which lets
+ * the next mount skip reading the items of full pages which haven't changed since.
+ * Pages which were changed, or didn't fit into the summary, are loaded as usual.
+ *
+ * The summary takes no space from items: the free page holding it is erased when
+ * it is needed for items, at the cost of one more sector erase. Call this function
+ * when the partition is not expected to change until the next boot, for example
+ * before a restart or deep sleep. See also CONFIG_NVS_WRITE_SUMMARY_ON_DEINIT.
+ *
+ * @return
+ *      - ESP_OK if the summary was written, or there are no full pages to summarize
+ *      - ESP_ERR_NVS_NOT_INITIALIZED if the storage was not initialized
+ *      - one of the error codes from the underlying flash storage driver
+ */
+esp_err_t nvs_flash_write_summary(void);
+
+/**
+ * @brief Write a mount summary of the given NVS partition
+ *
+ * See nvs_flash_write_summary.
+ *
+ * @param[in]  partition_label  Label of the partition
+ *
+ * @return
+ *      - the same values as nvs_flash_write_summary
+ */
+esp_err_t nvs_flash_write_summary_partition(const char *partition_label);
+
 /**
  * @brief Initialize the default NVS partition.
  *
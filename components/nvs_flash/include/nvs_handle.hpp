@@ -25,6 +25,8 @@ enum class ItemType : uint8_t {
     BLOB = 0x41,
     BLOB_DATA = NVS_TYPE_BLOB,
     BLOB_IDX  = 0x48,
+    BATCH = 0x50,       /*!< Marker of a committed batch, only present until it is finished */
+    BATCH_ERASE = 0x51, /*!< Key erased by a committed batch, follows the batch marker */
     ANY  = NVS_TYPE_ANY
 };
 
@@ -235,11 +235,57 @@ extern "C" esp_err_t nvs_flash_erase(void)
 }
 #endif // ESP_PLATFORM
 
+extern "C" esp_err_t nvs_flash_reclaim_partition(const char *part_name, size_t max_entries)
+{
+    Lock lock;
+
+    if (max_entries == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs::Storage* pStorage = lookup_storage_from_name(part_name);
+    if (pStorage == NULL) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    return pStorage->reclaimStep(max_entries);
+}
+
+extern "C" esp_err_t nvs_flash_reclaim(size_t max_entries)
+{
+    return nvs_flash_reclaim_partition(NVS_DEFAULT_PART_NAME, max_entries);
+}
+
+extern "C" esp_err_t nvs_flash_write_summary_partition(const char *part_name)
+{
+    Lock lock;
+
+    nvs::Storage* pStorage = lookup_storage_from_name(part_name);
+    if (pStorage == NULL) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    return pStorage->writeSummary();
+}
+
+extern "C" esp_err_t nvs_flash_write_summary(void)
+{
+    return nvs_flash_write_summary_partition(NVS_DEFAULT_PART_NAME);
+}
+
 extern "C" esp_err_t nvs_flash_deinit_partition(const char* partition_name)
 {
     Lock::init();
     Lock lock;
 
+#ifdef CONFIG_NVS_WRITE_SUMMARY_ON_DEINIT
+    nvs::Storage* pStorage = lookup_storage_from_name(partition_name);
+    if (pStorage != NULL) {
+        // summary only speeds up the next mount, so deinit goes on if it can't be written
+        pStorage->writeSummary();
+    }
+#endif
+
     return close_handles_and_deinit(partition_name);
 }
 
@@ -326,6 +372,19 @@ extern "C" esp_err_t nvs_erase_all(nvs_handle_t c_handle)
     return handle->erase_all();
 }
 
+extern "C" esp_err_t nvs_erase_prefix(nvs_handle_t c_handle, const char* prefix)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %s\r\n", __func__, prefix);
+    NVSHandleSimple *handle;
+    auto err = nvs_find_ns_handle(c_handle, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    return handle->erase_prefix(prefix);
+}
+
 template<typename T>
 static esp_err_t nvs_set(nvs_handle_t c_handle, const char* key, T value)
 {
@@ -510,6 +569,127 @@ extern "C" esp_err_t nvs_get_blob(nvs_handle_t c_handle, const char* key, void*
     return nvs_get_str_or_blob(c_handle, nvs::ItemType::BLOB, key, out_value, length);
 }
 
+extern "C" esp_err_t nvs_blob_stream_open_read(nvs_handle_t c_handle, const char* key, nvs_blob_stream_t* out_stream, size_t* out_size)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %s", __func__, key);
+    if (out_stream == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    NVSHandleSimple *handle;
+    auto err = nvs_find_ns_handle(c_handle, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    nvs_blob_stream_t stream = new (std::nothrow) nvs_opaque_blob_stream_t;
+    if (stream == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    err = handle->openBlobReader(key, stream);
+    if (err != ESP_OK) {
+        delete stream;
+        return err;
+    }
+
+    if (out_size != nullptr) {
+        *out_size = stream->size;
+    }
+    *out_stream = stream;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_blob_stream_read(nvs_blob_stream_t stream, size_t offset, void* out_value, size_t length)
+{
+    Lock lock;
+    if (stream == nullptr || stream->write) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (stream->storage == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    return stream->storage->readBlobStream(stream, offset, out_value, length);
+}
+
+extern "C" esp_err_t nvs_blob_stream_open_write(nvs_handle_t c_handle, const char* key, nvs_blob_stream_t* out_stream)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %s", __func__, key);
+    if (out_stream == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    NVSHandleSimple *handle;
+    auto err = nvs_find_ns_handle(c_handle, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    nvs_blob_stream_t stream = new (std::nothrow) nvs_opaque_blob_stream_t;
+    if (stream == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    err = handle->openBlobWriter(key, stream);
+    if (err != ESP_OK) {
+        delete stream;
+        return err;
+    }
+
+    *out_stream = stream;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_blob_stream_write(nvs_blob_stream_t stream, const void* value, size_t length)
+{
+    Lock lock;
+    if (stream == nullptr || !stream->write) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (stream->storage == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    return stream->storage->writeBlobStream(stream, value, length);
+}
+
+extern "C" esp_err_t nvs_blob_stream_close(nvs_blob_stream_t stream)
+{
+    Lock lock;
+    if (stream == nullptr) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (stream->storage == nullptr) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (stream->write) {
+        err = stream->storage->closeBlobWriter(stream);
+    } else {
+        stream->storage->closeBlobReader(stream);
+    }
+    delete stream;
+    return err;
+}
+
+extern "C" void nvs_blob_stream_abort(nvs_blob_stream_t stream)
+{
+    Lock lock;
+    if (stream == nullptr) {
+        return;
+    }
+
+    if (stream->storage == nullptr) {
+        // the storage was deinitialized, which has aborted the stream already
+    } else if (stream->write) {
+        stream->storage->abortBlobWriter(stream);
+    } else {
+        stream->storage->closeBlobReader(stream);
+    }
+    delete stream;
+}
+
 extern "C" esp_err_t nvs_get_stats(const char* part_name, nvs_stats_t* nvs_stats)
 {
     Lock lock;
@@ -522,6 +702,9 @@ extern "C" esp_err_t nvs_get_stats(const char* part_name, nvs_stats_t* nvs_stats
     nvs_stats->free_entries     = 0;
     nvs_stats->total_entries    = 0;
     nvs_stats->namespace_count  = 0;
+    nvs_stats->max_write_time_us = 0;
+    nvs_stats->value_cache_hits = 0;
+    nvs_stats->value_cache_misses = 0;
 
     pStorage = lookup_storage_from_name((part_name == NULL) ? NVS_DEFAULT_PART_NAME : part_name);
     if (pStorage == NULL) {
@@ -690,10 +873,19 @@ static nvs_iterator_t create_iterator(nvs::Storage *storage, nvs_type_t type)
 }
 
 extern "C" nvs_iterator_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type)
+{
+    return nvs_entry_find_prefix(part_name, namespace_name, type, "");
+}
+
+extern "C" nvs_iterator_t nvs_entry_find_prefix(const char *part_name, const char *namespace_name, nvs_type_t type, const char *prefix)
 {
     Lock lock;
     nvs::Storage *pStorage;
 
+    if (prefix == NULL || strlen(prefix) > nvs::Item::MAX_KEY_LENGTH) {
+        return NULL;
+    }
+
     pStorage = lookup_storage_from_name(part_name);
     if (pStorage == NULL) {
         return NULL;
@@ -704,7 +896,7 @@ extern "C" nvs_iterator_t nvs_entry_find(const char *part_name, const char *name
         return NULL;
     }
 
-    bool entryFound = pStorage->findEntry(it, namespace_name);
+    bool entryFound = pStorage->findEntry(it, namespace_name, prefix);
     if (!entryFound) {
         free(it);
         return NULL;
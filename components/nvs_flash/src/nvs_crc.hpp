@@ -0,0 +1,51 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef nvs_crc_hpp
+#define nvs_crc_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include "sdkconfig.h"
+#if defined(ESP_PLATFORM)
+#include <esp32/rom/crc.h>
+#else
+#include "crc.h"
+#endif
+
+namespace nvs
+{
+
+/**
+ * CRC32 computed eight bytes at a time, using 8 kB of lookup tables.
+ * Gives the same result as crc32_le from ROM, which processes one byte at a time.
+ */
+uint32_t nvs_crc32_le_slicing_by_8(uint32_t crc, const uint8_t* buf, size_t len);
+
+/**
+ * CRC32 used for all NVS entries, page headers and data. Defaults to crc32_le from ROM,
+ * or to the slicing-by-8 implementation if CONFIG_NVS_CRC32_SLICING_BY_8 is enabled.
+ */
+inline uint32_t nvs_crc32_le(uint32_t crc, const uint8_t* buf, size_t len)
+{
+#if CONFIG_NVS_CRC32_SLICING_BY_8
+    return nvs_crc32_le_slicing_by_8(crc, buf, len);
+#else
+    return crc32_le(crc, buf, len);
+#endif
+}
+
+} // namespace nvs
+
+#endif /* nvs_crc_hpp */
@@ -18,6 +18,8 @@
 namespace nvs {
 
 NVSHandleSimple::~NVSHandleSimple() {
+    // changes which weren't committed are discarded
+    mPendingOps.clearAndFreeNodes();
     NVSPartitionManager::get_instance()->close_handle(this);
 }
 
@@ -25,6 +27,7 @@ esp_err_t NVSHandleSimple::set_typed_item(ItemType datatype, const char *key, co
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
     if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
+    if (mBatched) return addPendingOp(datatype, key, data, dataSize);
 
     return mStoragePtr->writeItem(mNsIndex, datatype, key, data, dataSize);
 }
@@ -33,6 +36,11 @@ esp_err_t NVSHandleSimple::get_typed_item(ItemType datatype, const char *key, vo
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
 
+    if (mBatched) {
+        Storage::BatchOp *op = findPendingOp(datatype, key);
+        if (op) return readPendingOp(*op, data, dataSize);
+    }
+
     return mStoragePtr->readItem(mNsIndex, datatype, key, data, dataSize);
 }
 
@@ -40,6 +48,7 @@ esp_err_t NVSHandleSimple::set_string(const char *key, const char* str)
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
     if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
+    if (mBatched) return addPendingOp(nvs::ItemType::SZ, key, str, strlen(str) + 1);
 
     return mStoragePtr->writeItem(mNsIndex, nvs::ItemType::SZ, key, str, strlen(str) + 1);
 }
@@ -48,6 +57,7 @@ esp_err_t NVSHandleSimple::set_blob(const char *key, const void* blob, size_t le
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
     if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
+    if (mBatched) return addPendingOp(nvs::ItemType::BLOB, key, blob, len);
 
     return mStoragePtr->writeItem(mNsIndex, nvs::ItemType::BLOB, key, blob, len);
 }
@@ -56,6 +66,11 @@ esp_err_t NVSHandleSimple::get_string(const char *key, char* out_str, size_t len
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
 
+    if (mBatched) {
+        Storage::BatchOp *op = findPendingOp(nvs::ItemType::SZ, key);
+        if (op) return readPendingOp(*op, out_str, len);
+    }
+
     return mStoragePtr->readItem(mNsIndex, nvs::ItemType::SZ, key, out_str, len);
 }
 
@@ -63,6 +78,11 @@ esp_err_t NVSHandleSimple::get_blob(const char *key, void* out_blob, size_t len)
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
 
+    if (mBatched) {
+        Storage::BatchOp *op = findPendingOp(nvs::ItemType::BLOB, key);
+        if (op) return readPendingOp(*op, out_blob, len);
+    }
+
     return mStoragePtr->readItem(mNsIndex, nvs::ItemType::BLOB, key, out_blob, len);
 }
 
@@ -70,6 +90,15 @@ esp_err_t NVSHandleSimple::get_item_size(ItemType datatype, const char *key, siz
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
 
+    if (mBatched) {
+        Storage::BatchOp *op = findPendingOp(datatype, key);
+        if (op) {
+            if (op->mDatatype == ItemType::ANY) return ESP_ERR_NVS_NOT_FOUND;
+            size = op->mDataSize;
+            return ESP_OK;
+        }
+    }
+
     return mStoragePtr->getItemDataSize(mNsIndex, datatype, key, size);
 }
 
@@ -77,6 +106,7 @@ esp_err_t NVSHandleSimple::erase_item(const char* key)
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
     if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
+    if (mBatched) return addPendingOp(nvs::ItemType::ANY, key, nullptr, 0);
 
     return mStoragePtr->eraseItem(mNsIndex, key);
 }
@@ -86,14 +116,42 @@ esp_err_t NVSHandleSimple::erase_all()
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
     if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
 
+    // not buffered, pending changes are discarded and the namespace is erased immediately
+    mPendingOps.clearAndFreeNodes();
     return mStoragePtr->eraseNamespace(mNsIndex);
 }
 
+esp_err_t NVSHandleSimple::erase_prefix(const char* prefix)
+{
+    if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
+    if (strlen(prefix) > Item::MAX_KEY_LENGTH) return ESP_ERR_NVS_KEY_TOO_LONG;
+
+    size_t prefixLen = strlen(prefix);
+    for (auto it = mPendingOps.begin(); it != mPendingOps.end(); ) {
+        auto tmp = it;
+        ++it;
+        if (strncmp(tmp->mKey, prefix, prefixLen) == 0) {
+            mPendingOps.erase(tmp);
+            delete static_cast<Storage::BatchOp*>(tmp);
+        }
+    }
+    return mStoragePtr->eraseItemsWithPrefix(mNsIndex, prefix);
+}
+
 esp_err_t NVSHandleSimple::commit()
 {
     if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
 
-    return ESP_OK;
+    if (!mBatched || mPendingOps.empty()) return ESP_OK;
+
+    // if writing fails, operations are kept so that commit can be retried;
+    // values which have been stored already are not written again
+    esp_err_t err = mStoragePtr->writeBatch(mNsIndex, mPendingOps);
+    if (err == ESP_OK) {
+        mPendingOps.clearAndFreeNodes();
+    }
+    return err;
 }
 
 esp_err_t NVSHandleSimple::get_used_entry_count(size_t& used_entries)
@@ -110,6 +168,87 @@ esp_err_t NVSHandleSimple::get_used_entry_count(size_t& used_entries)
     return err;
 }
 
+esp_err_t NVSHandleSimple::addPendingOp(ItemType datatype, const char *key, const void *data, size_t dataSize)
+{
+    if (strlen(key) > Item::MAX_KEY_LENGTH) return ESP_ERR_NVS_KEY_TOO_LONG;
+
+    Storage::BatchOp *op = new (std::nothrow) Storage::BatchOp;
+    if (!op) return ESP_ERR_NO_MEM;
+
+    op->mDatatype = datatype;
+    strncpy(op->mKey, key, sizeof(op->mKey) - 1);
+    op->mKey[sizeof(op->mKey) - 1] = 0;
+    op->mDataSize = dataSize;
+    if (dataSize > 0) {
+        op->mData = new (std::nothrow) uint8_t[dataSize];
+        if (!op->mData) {
+            delete op;
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(op->mData, data, dataSize);
+    }
+
+    // the whole batch is written to a single page on commit, starting with one entry for the batch marker
+    size_t entryCount = 1 + Storage::getBatchOpEntryCount(*op);
+    if (entryCount > Page::ENTRY_COUNT) {
+        delete op;
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    // an erase supersedes all operations on the key, a set supersedes an erase or a set of the same type
+    auto supersedes = [=](const Storage::BatchOp &other) -> bool {
+        return strncmp(other.mKey, key, Item::MAX_KEY_LENGTH) == 0 &&
+                (datatype == ItemType::ANY || other.mDatatype == ItemType::ANY || other.mDatatype == datatype);
+    };
+
+    for (auto it = mPendingOps.begin(); it != mPendingOps.end(); ++it) {
+        if (!supersedes(*it)) {
+            entryCount += Storage::getBatchOpEntryCount(*it);
+        }
+    }
+    if (entryCount > Page::ENTRY_COUNT) {
+        delete op;
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    for (auto it = mPendingOps.begin(); it != mPendingOps.end(); ) {
+        auto tmp = it;
+        ++it;
+        if (supersedes(*tmp)) {
+            mPendingOps.erase(tmp);
+            delete static_cast<Storage::BatchOp*>(tmp);
+        }
+    }
+    mPendingOps.push_back(op);
+    return ESP_OK;
+}
+
+Storage::BatchOp *NVSHandleSimple::findPendingOp(ItemType datatype, const char *key)
+{
+    for (auto it = mPendingOps.begin(); it != mPendingOps.end(); ++it) {
+        if (strncmp(it->mKey, key, Item::MAX_KEY_LENGTH) == 0 &&
+                (it->mDatatype == ItemType::ANY || it->mDatatype == datatype)) {
+            return it;
+        }
+    }
+    return nullptr;
+}
+
+esp_err_t NVSHandleSimple::readPendingOp(const Storage::BatchOp &op, void *data, size_t dataSize)
+{
+    if (op.mDatatype == ItemType::ANY) return ESP_ERR_NVS_NOT_FOUND;
+
+    // same checks as in Page::readItem
+    if (!isVariableLengthType(op.mDatatype)) {
+        if (dataSize != op.mDataSize) return ESP_ERR_NVS_TYPE_MISMATCH;
+    } else if (dataSize < op.mDataSize) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    memcpy(data, op.mData, op.mDataSize);
+    return ESP_OK;
+}
+
 void NVSHandleSimple::debugDump() {
     return mStoragePtr->debugDump();
 }
@@ -130,4 +269,20 @@ bool NVSHandleSimple::nextEntry(nvs_opaque_iterator_t* it) {
     return mStoragePtr->nextEntry(it);
 }
 
+esp_err_t NVSHandleSimple::openBlobReader(const char *key, nvs_opaque_blob_stream_t* stream)
+{
+    if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
+
+    return mStoragePtr->openBlobReader(stream, mNsIndex, key);
+}
+
+esp_err_t NVSHandleSimple::openBlobWriter(const char *key, nvs_opaque_blob_stream_t* stream)
+{
+    if (!valid) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (mReadOnly) return ESP_ERR_NVS_READ_ONLY;
+    if (strlen(key) > Item::MAX_KEY_LENGTH) return ESP_ERR_NVS_KEY_TOO_LONG;
+
+    return mStoragePtr->openBlobWriter(stream, mNsIndex, key);
+}
+
 }
@@ -33,10 +33,11 @@ namespace nvs {
 class NVSHandleSimple : public intrusive_list_node<NVSHandleSimple>, public NVSHandle {
     friend class NVSPartitionManager;
 public:
-    NVSHandleSimple(bool readOnly, uint8_t nsIndex, Storage *StoragePtr) :
+    NVSHandleSimple(bool readOnly, uint8_t nsIndex, Storage *StoragePtr, bool batched = false) :
         mStoragePtr(StoragePtr),
         mNsIndex(nsIndex),
         mReadOnly(readOnly),
+        mBatched(batched),
         valid(1)
     { }
 
@@ -60,6 +61,12 @@ public:
 
     esp_err_t erase_all() override;
 
+    /**
+     * Erase all keys of the namespace which start with prefix. Not buffered in batch mode: pending
+     * operations on matching keys are discarded, and the items are erased immediately.
+     */
+    esp_err_t erase_prefix(const char *prefix);
+
     esp_err_t commit() override;
 
     esp_err_t get_used_entry_count(size_t &usedEntries) override;
@@ -76,7 +83,23 @@ public:
 
     bool nextEntry(nvs_opaque_iterator_t *it);
 
+    esp_err_t openBlobReader(const char *key, nvs_opaque_blob_stream_t *stream);
+
+    esp_err_t openBlobWriter(const char *key, nvs_opaque_blob_stream_t *stream);
+
 private:
+    /**
+     * Buffer a set or erase operation until commit() is called, replacing earlier operations on the same item.
+     */
+    esp_err_t addPendingOp(ItemType datatype, const char *key, const void *data, size_t dataSize);
+
+    /**
+     * Find a buffered operation which determines the value of the given item, if any.
+     */
+    Storage::BatchOp *findPendingOp(ItemType datatype, const char *key);
+
+    esp_err_t readPendingOp(const Storage::BatchOp &op, void *data, size_t dataSize);
+
     /**
      * The underlying storage's object.
      */
@@ -93,6 +116,14 @@ private:
      */
     uint8_t mReadOnly;
 
+    /**
+     * Whether this handle was opened in NVS_READWRITE_BATCH mode.
+     * If so, set and erase operations are buffered in mPendingOps and written by commit().
+     */
+    uint8_t mBatched;
+
+    Storage::TBatchList mPendingOps;
+
     /**
      * Indicates the validity of this handle.
      * Upon opening, a handle is valid. It becomes invalid if the underlying storage is de-initialized.
@@ -21,14 +21,25 @@ HashList::HashList()
 {
 }
 
+void HashList::setItemIndex(ItemIndex* index, Page* owner)
+{
+    mItemIndex = index;
+    mOwner = owner;
+}
+
 void HashList::clear()
 {
-    for (auto it = mBlockList.begin(); it != mBlockList.end();) {
-        auto tmp = it;
-        ++it;
-        mBlockList.erase(tmp);
-        delete static_cast<HashListBlock*>(tmp);
+    if (mItemIndex) {
+        for (size_t i = 0; i < mCapacity; ++i) {
+            if (!mNodes[i].isEmpty()) {
+                mItemIndex->erase(mNodes[i].mHash, mOwner, mNodes[i].mIndex);
+            }
+        }
     }
+    delete[] mNodes;
+    mNodes = nullptr;
+    mCapacity = 0;
+    mCount = 0;
 }
 
 HashList::~HashList()
@@ -36,65 +47,111 @@ HashList::~HashList()
     clear();
 }
 
-HashList::HashListBlock::HashListBlock()
+void HashList::place(const HashListNode& node)
 {
-    static_assert(sizeof(HashListBlock) == HashListBlock::BYTE_SIZE,
-                  "cache block size calculation incorrect");
+    size_t slot = home(node.mHash);
+    while (!mNodes[slot].isEmpty()) {
+        slot = (slot + 1) & (mCapacity - 1);
+    }
+    mNodes[slot] = node;
 }
 
-esp_err_t HashList::insert(const Item& item, size_t index)
+esp_err_t HashList::resize(size_t capacity)
 {
-    const uint32_t hash_24 = item.calculateCrc32WithoutValue() & 0xffffff;
-    // add entry to the end of last block if possible
-    if (mBlockList.size()) {
-        auto& block = mBlockList.back();
-        if (block.mCount < HashListBlock::ENTRY_COUNT) {
-            block.mNodes[block.mCount++] = HashListNode(hash_24, index);
-            return ESP_OK;
+    assert(capacity <= MAX_CAPACITY);
+
+    HashListNode* newNodes = new (std::nothrow) HashListNode[capacity];
+    if (!newNodes) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    HashListNode* oldNodes = mNodes;
+    size_t oldCapacity = mCapacity;
+    mNodes = newNodes;
+    mCapacity = capacity;
+    for (size_t i = 0; i < oldCapacity; ++i) {
+        if (!oldNodes[i].isEmpty()) {
+            place(oldNodes[i]);
         }
     }
-    // if the above failed, create a new block and add entry to it
-    HashListBlock* newBlock = new (std::nothrow) HashListBlock;
+    delete[] oldNodes;
+    return ESP_OK;
+}
 
-    if (!newBlock) return ESP_ERR_NO_MEM;
+esp_err_t HashList::reserve(size_t count)
+{
+    // keep at least a quarter of the table empty, so that probe sequences stay short
+    size_t capacity = MIN_CAPACITY;
+    while (count * 4 > capacity * 3) {
+        capacity *= 2;
+    }
+    if (capacity <= mCapacity) {
+        return ESP_OK;
+    }
+    return resize(capacity);
+}
 
-    mBlockList.push_back(newBlock);
-    newBlock->mNodes[0] = HashListNode(hash_24, index);
-    newBlock->mCount++;
+esp_err_t HashList::insert(const Item& item, size_t index)
+{
+    return insert(item.calculateCrc32WithoutValue() & 0xffffff, index);
+}
+
+esp_err_t HashList::insert(uint32_t hash_24, size_t index)
+{
+    if ((mCount + 1) * 4 > mCapacity * 3) {
+        esp_err_t err = reserve(mCount + 1);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    place(HashListNode(hash_24, index));
+    ++mCount;
+    if (mItemIndex) {
+        mItemIndex->insert(hash_24, mOwner, index);
+    }
 
     return ESP_OK;
 }
 
-void HashList::erase(size_t index, bool itemShouldExist)
+void HashList::removeAt(size_t slot)
 {
-    for (auto it = mBlockList.begin(); it != mBlockList.end();) {
-        bool haveEntries = false;
-        bool foundIndex = false;
-        for (size_t i = 0; i < it->mCount; ++i) {
-            if (it->mNodes[i].mIndex == index) {
-                it->mNodes[i].mIndex = 0xff;
-                foundIndex = true;
-                /* found the item and removed it */
-            }
-            if (it->mNodes[i].mIndex != 0xff) {
-                haveEntries = true;
-            }
-            if (haveEntries && foundIndex) {
-                /* item was found, and HashListBlock still has some items */
-                return;
-            }
-        }
-        /* no items left in HashListBlock, can remove */
-        if (!haveEntries) {
-            auto tmp = it;
-            ++it;
-            mBlockList.erase(tmp);
-            delete static_cast<HashListBlock*>(tmp);
-        } else {
-            ++it;
+    const size_t mask = mCapacity - 1;
+    mNodes[slot] = HashListNode();
+    --mCount;
+
+    // shift following nodes of the same probe sequence back, so that lookups don't need tombstones
+    size_t hole = slot;
+    for (size_t i = (slot + 1) & mask; !mNodes[i].isEmpty(); i = (i + 1) & mask) {
+        size_t distance = (i - home(mNodes[i].mHash)) & mask;
+        size_t distanceToHole = (i - hole) & mask;
+        if (distance >= distanceToHole) {
+            mNodes[hole] = mNodes[i];
+            mNodes[i] = HashListNode();
+            hole = i;
         }
-        if (foundIndex) {
-            /* item was found and empty HashListBlock was removed */
+    }
+
+    if (mCount == 0) {
+        delete[] mNodes;
+        mNodes = nullptr;
+        mCapacity = 0;
+    }
+}
+
+void HashList::eraseAt(size_t slot)
+{
+    if (mItemIndex) {
+        mItemIndex->erase(mNodes[slot].mHash, mOwner, mNodes[slot].mIndex);
+    }
+    removeAt(slot);
+}
+
+void HashList::erase(size_t index, bool itemShouldExist)
+{
+    for (size_t i = 0; i < mCapacity; ++i) {
+        if (mNodes[i].mIndex == index) {
+            eraseAt(i);
             return;
         }
     }
@@ -103,20 +160,37 @@ void HashList::erase(size_t index, bool itemShouldExist)
     }
 }
 
+void HashList::erase(size_t index, const Item& item)
+{
+    if (mCount != 0) {
+        const uint32_t hash_24 = item.calculateCrc32WithoutValue() & 0xffffff;
+        for (size_t i = home(hash_24); !mNodes[i].isEmpty(); i = (i + 1) & (mCapacity - 1)) {
+            if (mNodes[i].mIndex == index) {
+                eraseAt(i);
+                return;
+            }
+        }
+    }
+    // the node was inserted with another hash than the one of the item, fall back to a full scan
+    erase(index);
+}
+
 size_t HashList::find(size_t start, const Item& item)
 {
+    if (mCount == 0) {
+        return SIZE_MAX;
+    }
+
     const uint32_t hash_24 = item.calculateCrc32WithoutValue() & 0xffffff;
-    for (auto it = mBlockList.begin(); it != mBlockList.end(); ++it) {
-        for (size_t index = 0; index < it->mCount; ++index) {
-            HashListNode& e = it->mNodes[index];
-            if (e.mIndex >= start &&
-                    e.mHash == hash_24 &&
-                    e.mIndex != 0xff) {
-                return e.mIndex;
-            }
+    // several items may share the hash, return the first one at or after start
+    size_t result = SIZE_MAX;
+    for (size_t i = home(hash_24); !mNodes[i].isEmpty(); i = (i + 1) & (mCapacity - 1)) {
+        const HashListNode& e = mNodes[i];
+        if (e.mHash == hash_24 && e.mIndex >= start && e.mIndex < result) {
+            result = e.mIndex;
         }
     }
-    return SIZE_MAX;
+    return result;
 }
 
 
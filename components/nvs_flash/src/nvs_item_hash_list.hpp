@@ -17,11 +17,18 @@
 
 #include "nvs.h"
 #include "nvs_types.hpp"
-#include "intrusive_list.h"
+#include "nvs_item_index.hpp"
 
 namespace nvs
 {
 
+/**
+ * Maps 24-bit item hashes to entry indices within one page.
+ *
+ * Implemented as an open-addressed table with linear probing, stored in a single allocation.
+ * The table grows in powers of two as items are added, up to the size required by Page::ENTRY_COUNT,
+ * and is released once the last item is erased.
+ */
 class HashList
 {
 public:
@@ -29,10 +36,31 @@ public:
     ~HashList();
 
     esp_err_t insert(const Item& item, size_t index);
+
+    /**
+     * Insert an item by its 24-bit hash, as computed by insert(const Item&, size_t).
+     */
+    esp_err_t insert(uint32_t hash_24, size_t index);
+
+    /**
+     * Make room for count items, so that inserting them doesn't grow the table step by step.
+     */
+    esp_err_t reserve(size_t count);
+
     void erase(const size_t index, bool itemShouldExist=true);
+
+    /**
+     * Erase the item at index, looking it up by the hash of the item instead of scanning the whole table.
+     */
+    void erase(const size_t index, const Item& item);
     size_t find(size_t start, const Item& item);
     void clear();
 
+    /**
+     * Report all insertions and removals to a partition-wide index, on behalf of the given page.
+     */
+    void setItemIndex(ItemIndex* index, Page* owner);
+
 private:
     HashList(const HashList& other);
     const HashList& operator= (const HashList& rhs);
@@ -50,22 +78,37 @@ protected:
         {
         }
 
+        bool isEmpty() const
+        {
+            return mIndex == 0xff;
+        }
+
         uint32_t mIndex : 8;
         uint32_t mHash  : 24;
     };
 
-    struct HashListBlock : public intrusive_list_node<HashList::HashListBlock> {
-        HashListBlock();
+    static const size_t MIN_CAPACITY = 16;
+    // table is kept at most 3/4 full, which is enough for every entry of a page
+    static const size_t MAX_CAPACITY = 256;
 
-        static const size_t BYTE_SIZE = 128;
-        static const size_t ENTRY_COUNT = (BYTE_SIZE - sizeof(intrusive_list_node<HashListBlock>) - sizeof(size_t)) / 4;
+    size_t home(uint32_t hash) const
+    {
+        return hash & (mCapacity - 1);
+    }
 
-        size_t mCount = 0;
-        HashListNode mNodes[ENTRY_COUNT];
-    };
+    esp_err_t resize(size_t capacity);
+
+    void place(const HashListNode& node);
+
+    void removeAt(size_t slot);
+
+    void eraseAt(size_t slot);
 
-    typedef intrusive_list<HashListBlock> TBlockList;
-    TBlockList mBlockList;
+    HashListNode* mNodes = nullptr;
+    size_t mCapacity = 0;
+    size_t mCount = 0;
+    ItemIndex* mItemIndex = nullptr;
+    Page* mOwner = nullptr;
 }; // class HashList
 
 } // namespace nvs
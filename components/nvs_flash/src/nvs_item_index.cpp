@@ -0,0 +1,158 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nvs_item_index.hpp"
+#include <new>
+#include <cassert>
+#include <algorithm>
+
+namespace nvs
+{
+
+ItemIndex::ItemIndex()
+{
+}
+
+ItemIndex::~ItemIndex()
+{
+    clear();
+}
+
+esp_err_t ItemIndex::init(size_t pageCount)
+{
+    clear();
+
+    size_t wanted = pageCount * NVS_ITEM_INDEX_BUCKETS_PER_PAGE;
+    if (wanted == 0) {
+        return ESP_OK;
+    }
+
+    // bucket is selected by masking the hash, so round up to a power of two
+    size_t bucketCount = 1;
+    while (bucketCount < wanted) {
+        bucketCount <<= 1;
+    }
+
+    mBuckets = new (std::nothrow) Node*[bucketCount];
+    if (!mBuckets) {
+        return ESP_ERR_NO_MEM;
+    }
+    std::fill_n(mBuckets, bucketCount, nullptr);
+    mBucketCount = bucketCount;
+    mValid = true;
+    return ESP_OK;
+}
+
+void ItemIndex::clear()
+{
+    while (mBlocks) {
+        NodeBlock* next = mBlocks->mNext;
+        delete mBlocks;
+        mBlocks = next;
+    }
+    delete[] mBuckets;
+    mBuckets = nullptr;
+    mBucketCount = 0;
+    mFreeNodes = nullptr;
+    mNodeCount = 0;
+    mValid = false;
+}
+
+void ItemIndex::insert(uint32_t hash, Page* page, size_t index)
+{
+    if (!mValid) {
+        return;
+    }
+
+    if (!mFreeNodes) {
+        NodeBlock* block = new (std::nothrow) NodeBlock;
+        if (!block) {
+            // an incomplete index would report false misses, drop it altogether
+            clear();
+            return;
+        }
+        block->mNext = mBlocks;
+        mBlocks = block;
+        for (size_t i = 0; i < NodeBlock::NODE_COUNT; ++i) {
+            block->mNodes[i].mNext = mFreeNodes;
+            mFreeNodes = &block->mNodes[i];
+        }
+    }
+
+    Node* node = mFreeNodes;
+    mFreeNodes = node->mNext;
+
+    node->mPage = page;
+    node->mIndex = static_cast<uint32_t>(index);
+    node->mHash = hash;
+    Node*& head = bucket(hash);
+    node->mNext = head;
+    head = node;
+    ++mNodeCount;
+}
+
+void ItemIndex::erase(uint32_t hash, Page* page, size_t index)
+{
+    if (!mValid) {
+        return;
+    }
+
+    for (Node** link = &bucket(hash); *link != nullptr; link = &(*link)->mNext) {
+        Node* node = *link;
+        if (node->mPage == page && node->mIndex == index) {
+            *link = node->mNext;
+            node->mNext = mFreeNodes;
+            mFreeNodes = node;
+            --mNodeCount;
+            return;
+        }
+    }
+    assert(false && "item should have been present in index");
+}
+
+bool ItemIndex::contains(uint32_t hash, const Page* page, size_t index) const
+{
+    if (!mValid) {
+        return false;
+    }
+
+    for (const Node* node = bucket(hash); node != nullptr; node = node->mNext) {
+        if (node->mPage == page && node->mIndex == index && node->mHash == hash) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t ItemIndex::find(uint32_t hash, Candidate* candidates, size_t maxCount) const
+{
+    if (!mValid) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (const Node* node = bucket(hash); node != nullptr; node = node->mNext) {
+        if (node->mHash != hash) {
+            continue;
+        }
+        if (count < maxCount) {
+            candidates[count].mPage = node->mPage;
+            candidates[count].mIndex = node->mIndex;
+        }
+        ++count;
+    }
+    return count;
+}
+
+} // namespace nvs
@@ -0,0 +1,117 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef nvs_item_index_hpp
+#define nvs_item_index_hpp
+
+#include "nvs.h"
+#include "sdkconfig.h"
+#include <cstddef>
+#include <cstdint>
+
+#ifdef CONFIG_NVS_ITEM_INDEX
+#define NVS_ITEM_INDEX_BUCKETS_PER_PAGE CONFIG_NVS_ITEM_INDEX_BUCKETS_PER_PAGE
+#else
+#define NVS_ITEM_INDEX_BUCKETS_PER_PAGE 0
+#endif
+
+namespace nvs
+{
+
+class Page;
+
+/**
+ * Partition-wide index of all items stored in the pages of one PageManager.
+ *
+ * Maps the 24-bit item hash used by HashList (namespace, key and chunk index) to the page and entry index
+ * holding the item, so that a lookup does not have to visit the hash list of every page.
+ * The index is kept up to date by the per-page HashList instances, which report every insertion and removal.
+ *
+ * If the index can't allocate memory for a new node, it invalidates itself and lookups fall back to
+ * iterating over pages until the partition is loaded again.
+ */
+class ItemIndex
+{
+public:
+    static const size_t MAX_CANDIDATES = 8;
+
+    struct Candidate {
+        Page* mPage;
+        size_t mIndex;
+    };
+
+    ItemIndex();
+    ~ItemIndex();
+
+    esp_err_t init(size_t pageCount);
+
+    void clear();
+
+    bool isValid() const
+    {
+        return mValid;
+    }
+
+    void insert(uint32_t hash, Page* page, size_t index);
+
+    void erase(uint32_t hash, Page* page, size_t index);
+
+    bool contains(uint32_t hash, const Page* page, size_t index) const;
+
+    /**
+     * Copies up to maxCount locations of items with the given hash to candidates.
+     * Returns the total number of such items, which may be larger than maxCount.
+     */
+    size_t find(uint32_t hash, Candidate* candidates, size_t maxCount) const;
+
+    size_t getNodeCount() const
+    {
+        return mNodeCount;
+    }
+
+private:
+    ItemIndex(const ItemIndex& other);
+    const ItemIndex& operator= (const ItemIndex& rhs);
+
+protected:
+    struct Node {
+        Node* mNext;
+        Page* mPage;
+        uint32_t mIndex : 8;
+        uint32_t mHash  : 24;
+    };
+
+    struct NodeBlock {
+        static const size_t NODE_COUNT = 32;
+
+        NodeBlock* mNext;
+        Node mNodes[NODE_COUNT];
+    };
+
+    Node*& bucket(uint32_t hash) const
+    {
+        return mBuckets[hash & (mBucketCount - 1)];
+    }
+
+    Node** mBuckets = nullptr;
+    size_t mBucketCount = 0;
+    NodeBlock* mBlocks = nullptr;
+    Node* mFreeNodes = nullptr;
+    size_t mNodeCount = 0;
+    bool mValid = false;
+}; // class ItemIndex
+
+} // namespace nvs
+
+#endif /* nvs_item_index_hpp */
@@ -33,13 +33,15 @@ esp_err_t nvs_flash_write(size_t destAddr, const void *srcAddr, size_t size) {
 
         if(xtsCtxt) {
             uint8_t* buf = static_cast<uint8_t*>(malloc(size));
+            if (!buf) {
+                return ESP_ERR_NO_MEM;
+            }
             memcpy(buf, srcAddr, size);
             auto err = encrMgr->encryptNvsData(buf, destAddr, size, xtsCtxt);
-            if( err != ESP_OK) {
-                return err;
+            if( err == ESP_OK) {
+                err = spi_flash_write(destAddr, buf, size);
             }
-            err = spi_flash_write(destAddr, buf, size);
-            delete buf;
+            free(buf);
             return err;
         }
     }
@@ -12,13 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "nvs_page.hpp"
-#if defined(ESP_PLATFORM)
-#include <esp32/rom/crc.h>
-#else
-#include "crc.h"
-#endif
+#include "nvs_crc.hpp"
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
 
 #include "nvs_ops.hpp"
 
@@ -27,12 +24,22 @@ namespace nvs
 
 uint32_t Page::Header::calculateCrc32()
 {
-    return crc32_le(0xffffffff,
-                    reinterpret_cast<uint8_t*>(this) + offsetof(Header, mSeqNumber),
-                    offsetof(Header, mCrc32) - offsetof(Header, mSeqNumber));
+    return nvs_crc32_le(0xffffffff,
+                        reinterpret_cast<uint8_t*>(this) + offsetof(Header, mSeqNumber),
+                        offsetof(Header, mCrc32) - offsetof(Header, mSeqNumber));
 }
 
 esp_err_t Page::load(uint32_t sectorNumber)
+{
+    auto err = loadHeader(sectorNumber);
+    if (err != ESP_OK) {
+        return err;
+    }
+    bool fromSummary;
+    return loadEntries(nullptr, fromSummary);
+}
+
+esp_err_t Page::loadHeader(uint32_t sectorNumber)
 {
     mBaseAddress = sectorNumber * SEC_SIZE;
     mUsedEntryCount = 0;
@@ -81,16 +88,30 @@ esp_err_t Page::load(uint32_t sectorNumber)
 
     switch (mState) {
     case PageState::UNINITIALIZED:
+    case PageState::FULL:
+    case PageState::ACTIVE:
+    case PageState::FREEING:
         break;
 
+    default:
+        mState = PageState::CORRUPT;
+        break;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t Page::loadEntries(const PageSummary::Record* record, bool& fromSummary)
+{
+    fromSummary = false;
+    switch (mState) {
     case PageState::FULL:
     case PageState::ACTIVE:
     case PageState::FREEING:
-        mLoadEntryTable();
+        mLoadEntryTable(record, fromSummary);
         break;
 
     default:
-        mState = PageState::CORRUPT;
         break;
     }
 
@@ -108,9 +129,12 @@ esp_err_t Page::writeEntry(const Item& item)
         return err;
     }
 
-    err = alterEntryState(mNextFreeEntry, EntryState::WRITTEN);
-    if (err != ESP_OK) {
-        return err;
+    // within a batch, entry states are updated all at once by commitBatch
+    if (mBatchStart == INVALID_ENTRY) {
+        err = alterEntryState(mNextFreeEntry, EntryState::WRITTEN);
+        if (err != ESP_OK) {
+            return err;
+        }
     }
 
     if (mFirstUsedEntry == INVALID_ENTRY) {
@@ -160,9 +184,11 @@ esp_err_t Page::writeEntryData(const uint8_t* data, size_t size)
         mState = PageState::INVALID;
         return rc;
     }
-    auto err = alterEntryRangeState(mNextFreeEntry, mNextFreeEntry + count, EntryState::WRITTEN);
-    if (err != ESP_OK) {
-        return err;
+    if (mBatchStart == INVALID_ENTRY) {
+        auto err = alterEntryRangeState(mNextFreeEntry, mNextFreeEntry + count, EntryState::WRITTEN);
+        if (err != ESP_OK) {
+            return err;
+        }
     }
     mUsedEntryCount += count;
     mNextFreeEntry += count;
@@ -264,6 +290,104 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
     return ESP_OK;
 }
 
+esp_err_t Page::beginBatch()
+{
+    assert(mBatchStart == INVALID_ENTRY);
+
+    if (mState == PageState::INVALID) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    if (mState == PageState::UNINITIALIZED) {
+        esp_err_t err = initialize();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (mState == PageState::FULL || mNextFreeEntry >= ENTRY_COUNT) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    mBatchStart = mNextFreeEntry;
+    return ESP_OK;
+}
+
+esp_err_t Page::commitBatch()
+{
+    assert(mBatchStart != INVALID_ENTRY);
+    size_t begin = mBatchStart;
+    mBatchStart = INVALID_ENTRY;
+
+    if (mNextFreeEntry == begin) {
+        return ESP_OK;
+    }
+
+    // Entry states are altered starting from the end of the range. Until the state of the first entry
+    // is written, mLoadEntryTable will find written entries after an empty one, and discard all of them.
+    auto err = alterEntryRangeState(begin, mNextFreeEntry, EntryState::WRITTEN);
+    if (err != ESP_OK) {
+        mState = PageState::INVALID;
+        return err;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::abortBatch()
+{
+    assert(mBatchStart != INVALID_ENTRY);
+    size_t begin = mBatchStart;
+    mBatchStart = INVALID_ENTRY;
+
+    // writeItem adds the item to the hash list before writing it, so clean up one entry past the end
+    for (size_t i = begin; i <= mNextFreeEntry && i < ENTRY_COUNT; ++i) {
+        mHashList.erase(i, false);
+    }
+
+    if (mNextFreeEntry == begin || mState == PageState::INVALID) {
+        return ESP_OK;
+    }
+
+    size_t count = mNextFreeEntry - begin;
+    mUsedEntryCount -= count;
+    mErasedEntryCount += count;
+    if (mFirstUsedEntry >= begin) {
+        mFirstUsedEntry = INVALID_ENTRY;
+    }
+    auto err = alterEntryRangeState(begin, mNextFreeEntry, EntryState::ERASED);
+    if (err != ESP_OK) {
+        mState = PageState::INVALID;
+        return err;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::eraseBatchItems(size_t markerIndex)
+{
+    Item marker;
+    auto err = readEntry(markerIndex, marker);
+    if (err != ESP_OK) {
+        return err;
+    }
+    assert(marker.datatype == ItemType::BATCH);
+
+    deferEntryStateWrites();
+    for (size_t i = markerIndex + 1; i < markerIndex + 1 + marker.batch.eraseCount && err == ESP_OK; ++i) {
+        // some of them may be erased already, if power went out while the marker was being erased
+        if (mEntryTable.get(i) == EntryState::WRITTEN) {
+            err = eraseEntryAndSpan(i);
+        }
+    }
+    esp_err_t flushErr = flushEntryStates();
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (flushErr != ESP_OK) {
+        return flushErr;
+    }
+    return eraseEntryAndSpan(markerIndex);
+}
+
 esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize, uint8_t chunkIdx, VerOffset chunkStart)
 {
     size_t index = 0;
@@ -315,6 +439,62 @@ esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, vo
     return ESP_OK;
 }
 
+esp_err_t Page::readItemPart(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t dataSize, bool verifyCrc, uint8_t chunkIdx)
+{
+    size_t index = 0;
+    Item item;
+
+    if (mState == PageState::INVALID) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    if (!isVariableLengthType(datatype)) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+
+    esp_err_t rc = findItem(nsIndex, datatype, key, index, item, chunkIdx);
+    if (rc != ESP_OK) {
+        return rc;
+    }
+
+    size_t itemSize = item.varLength.dataSize;
+    if (offset > itemSize || dataSize > itemSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    // without CRC check only the entries overlapping the requested range have to be read
+    size_t first = verifyCrc ? 0 : offset / ENTRY_SIZE;
+    size_t last = verifyCrc ? item.span - 1 : (offset + dataSize + ENTRY_SIZE - 1) / ENTRY_SIZE;
+    uint8_t* dst = reinterpret_cast<uint8_t*>(data);
+    uint32_t crc = 0xffffffff;
+    for (size_t i = first; i < last; ++i) {
+        Item ditem;
+        rc = readEntry(index + 1 + i, ditem);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        size_t entryStart = i * ENTRY_SIZE;
+        size_t entrySize = itemSize - entryStart;
+        entrySize = (entrySize < ENTRY_SIZE) ? entrySize : ENTRY_SIZE;
+        if (verifyCrc) {
+            crc = Item::calculateCrc32(crc, ditem.rawData, entrySize);
+        }
+        size_t copyStart = std::max(entryStart, offset);
+        size_t copyEnd = std::min(entryStart + entrySize, offset + dataSize);
+        if (copyStart < copyEnd) {
+            memcpy(dst + copyStart - offset, ditem.rawData + copyStart - entryStart, copyEnd - copyStart);
+        }
+    }
+    if (verifyCrc && crc != item.varLength.dataCrc32) {
+        rc = eraseEntryAndSpan(index);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
 esp_err_t Page::cmpItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t chunkIdx, VerOffset chunkStart)
 {
     size_t index = 0;
@@ -406,7 +586,7 @@ esp_err_t Page::eraseEntryAndSpan(size_t index)
                 return rc;
             }
         } else {
-            mHashList.erase(index);
+            mHashList.erase(index, item);
             span = item.span;
             for (ptrdiff_t i = index + span - 1; i >= static_cast<ptrdiff_t>(index); --i) {
                 if (mEntryTable.get(i) == EntryState::WRITTEN) {
@@ -485,6 +665,11 @@ esp_err_t Page::copyItems(Page& other)
             return err;
         }
 
+        if (isBatchItem(entry)) {
+            readEntryIndex++;
+            continue;
+        }
+
         err = other.mHashList.insert(entry, other.mNextFreeEntry);
         if (err != ESP_OK) {
             return err;
@@ -512,7 +697,67 @@ esp_err_t Page::copyItems(Page& other)
     return ESP_OK;
 }
 
-esp_err_t Page::mLoadEntryTable()
+esp_err_t Page::moveItems(Page& other, size_t maxEntries, size_t& movedEntries)
+{
+    movedEntries = 0;
+
+    while (mFirstUsedEntry != INVALID_ENTRY && movedEntries < maxEntries) {
+        size_t index = mFirstUsedEntry;
+        Item entry;
+        auto err = readEntry(index, entry);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        if (entry.calculateCrc32() != entry.crc32 || isBatchItem(entry)) {
+            // not an item anymore, or a leftover of a batch, nothing to move
+            err = eraseEntryAndSpan(index);
+            if (err != ESP_OK) {
+                return err;
+            }
+            ++movedEntries;
+            continue;
+        }
+
+        size_t span = entry.span;
+        if (other.getFreeEntryCount() < span) {
+            return ESP_ERR_NVS_PAGE_FULL;
+        }
+
+        err = other.beginBatch();
+        if (err != ESP_OK) {
+            return err;
+        }
+        err = other.mHashList.insert(entry, other.mNextFreeEntry);
+        if (err == ESP_OK) {
+            err = other.writeEntry(entry);
+        }
+        for (size_t i = index + 1; i < index + span && err == ESP_OK; ++i) {
+            err = readEntry(i, entry);
+            if (err == ESP_OK) {
+                err = other.writeEntry(entry);
+            }
+        }
+        if (err != ESP_OK) {
+            other.abortBatch();
+            return err;
+        }
+        err = other.commitBatch();
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        // until the original is erased, the item is present twice; PageManager::load keeps the copy
+        err = eraseEntryAndSpan(index);
+        if (err != ESP_OK) {
+            return err;
+        }
+        movedEntries += span;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Page::mLoadEntryTable(const PageSummary::Record* record, bool& fromSummary)
 {
     // for states where we actually care about data in the page, read entry state table
     if (mState == PageState::ACTIVE ||
@@ -550,6 +795,35 @@ esp_err_t Page::mLoadEntryTable()
             }
         }
 
+        // entries of a batch are marked as written starting from the last one (see commitBatch),
+        // so written entries which follow an empty one belong to a batch which wasn't committed
+        size_t lastNonEmpty = INVALID_ENTRY;
+        for (size_t i = mNextFreeEntry; i < ENTRY_COUNT; ++i) {
+            if (mEntryTable.get(i) != EntryState::EMPTY) {
+                lastNonEmpty = i;
+            }
+        }
+        if (lastNonEmpty != INVALID_ENTRY) {
+            for (size_t i = mNextFreeEntry; i <= lastNonEmpty; ++i) {
+                auto s = mEntryTable.get(i);
+                if (s == EntryState::WRITTEN) {
+                    --mUsedEntryCount;
+                }
+                if (s != EntryState::ERASED) {
+                    ++mErasedEntryCount;
+                }
+            }
+            if (mFirstUsedEntry != INVALID_ENTRY && mFirstUsedEntry >= mNextFreeEntry) {
+                mFirstUsedEntry = INVALID_ENTRY;
+            }
+            auto err = alterEntryRangeState(mNextFreeEntry, lastNonEmpty + 1, EntryState::ERASED);
+            if (err != ESP_OK) {
+                mState = PageState::INVALID;
+                return err;
+            }
+            mNextFreeEntry = lastNonEmpty + 1;
+        }
+
         // however, if power failed after some data was written into the entry.
         // but before the entry state table was altered, the entry locacted via
         // entry state table may actually be half-written.
@@ -661,6 +935,11 @@ esp_err_t Page::mLoadEntryTable()
             }
         }
     } else if (mState == PageState::FULL || mState == PageState::FREEING) {
+        if (record != nullptr && mLoadFromSummary(*record) == ESP_OK) {
+            fromSummary = true;
+            return ESP_OK;
+        }
+
         // We have already filled mHashList for page in active state.
         // Do the same for the case when page is in full or freeing state.
         Item item;
@@ -711,6 +990,40 @@ esp_err_t Page::mLoadEntryTable()
     return ESP_OK;
 }
 
+esp_err_t Page::mLoadFromSummary(const PageSummary::Record& record)
+{
+    // items of a full page are only erased afterwards, which changes the entry state table
+    if (mState != PageState::FULL
+            || record.mSeqNumber != mSeqNumber
+            || record.mEntryTableCrc32 != getEntryTableCrc32()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    // the item count is known, so the hash list is allocated once instead of growing while it is filled
+    auto err = mHashList.reserve(record.mItemCount);
+    if (err != ESP_OK) {
+        return err;
+    }
+    const uint32_t* items = record.items();
+    for (size_t i = 0; i < record.mItemCount; ++i) {
+        size_t index = PageSummary::getItemIndex(items[i]);
+        if (index >= ENTRY_COUNT || mEntryTable.get(index) != EntryState::WRITTEN) {
+            mHashList.clear();
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        err = mHashList.insert(PageSummary::getItemHash(items[i]), index);
+        if (err != ESP_OK) {
+            mHashList.clear();
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+uint32_t Page::getEntryTableCrc32() const
+{
+    return nvs_crc32_le(0xffffffff, reinterpret_cast<const uint8_t*>(mEntryTable.data()), mEntryTable.byteSize());
+}
 
 esp_err_t Page::initialize()
 {
@@ -738,6 +1051,10 @@ esp_err_t Page::alterEntryState(size_t index, EntryState state)
     assert(index < ENTRY_COUNT);
     mEntryTable.set(index, state);
     size_t wordToWrite = mEntryTable.getWordIndex(index);
+    if (mDeferStateWrites) {
+        mDirtyStateWords |= 1 << wordToWrite;
+        return ESP_OK;
+    }
     uint32_t word = mEntryTable.data()[wordToWrite];
     auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(wordToWrite) * 4,
             &word, sizeof(word));
@@ -761,7 +1078,9 @@ esp_err_t Page::alterEntryRangeState(size_t begin, size_t end, EntryState state)
         } else {
             nextWordIndex = mEntryTable.getWordIndex(i - 1);
         }
-        if (nextWordIndex != wordIndex) {
+        if (nextWordIndex != wordIndex && mDeferStateWrites) {
+            mDirtyStateWords |= 1 << wordIndex;
+        } else if (nextWordIndex != wordIndex) {
             uint32_t word = mEntryTable.data()[wordIndex];
             auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(wordIndex) * 4,
                     &word, 4);
@@ -774,6 +1093,26 @@ esp_err_t Page::alterEntryRangeState(size_t begin, size_t end, EntryState state)
     return ESP_OK;
 }
 
+esp_err_t Page::flushEntryStates()
+{
+    mDeferStateWrites = false;
+    for (size_t i = 0; mDirtyStateWords != 0; ++i) {
+        if ((mDirtyStateWords & (1 << i)) == 0) {
+            continue;
+        }
+        mDirtyStateWords &= ~(1 << i);
+        uint32_t word = mEntryTable.data()[i];
+        auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(i) * 4,
+                &word, sizeof(word));
+        if (rc != ESP_OK) {
+            mDirtyStateWords = 0;
+            mState = PageState::INVALID;
+            return rc;
+        }
+    }
+    return ESP_OK;
+}
+
 esp_err_t Page::alterPageState(PageState state)
 {
     uint32_t state_val = static_cast<uint32_t>(state);
@@ -895,6 +1234,100 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
     return ESP_ERR_NVS_NOT_FOUND;
 }
 
+esp_err_t Page::findItem(const PageSummary::Record& record, size_t &itemIndex, Item& item)
+{
+    const uint32_t* items = record.items();
+    for (size_t i = 0; i < record.mItemCount; ++i) {
+        size_t index = PageSummary::getItemIndex(items[i]);
+        if (index < itemIndex
+                || !PageSummary::isMountScanItem(items[i])
+                || mEntryTable.get(index) != EntryState::WRITTEN) {
+            continue;
+        }
+
+        auto rc = readEntry(index, item);
+        if (rc != ESP_OK) {
+            mState = PageState::INVALID;
+            return rc;
+        }
+
+        if (item.crc32 != item.calculateCrc32()) {
+            rc = eraseEntryAndSpan(index);
+            if (rc != ESP_OK) {
+                mState = PageState::INVALID;
+                return rc;
+            }
+            continue;
+        }
+
+        itemIndex = index;
+        return ESP_OK;
+    }
+
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t Page::findItemWithPrefix(uint8_t nsIndex, ItemType datatype, const char* prefix, size_t &itemIndex, Item& item)
+{
+    if (mState == PageState::CORRUPT || mState == PageState::INVALID || mState == PageState::UNINITIALIZED) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    size_t start = std::max(itemIndex, mFirstUsedEntry);
+    size_t end = mNextFreeEntry;
+    if (end > ENTRY_COUNT) {
+        end = ENTRY_COUNT;
+    }
+    size_t prefixLen = strnlen(prefix, Item::MAX_KEY_LENGTH);
+
+    Item block[PREFIX_SCAN_ENTRIES];
+    size_t blockStart = 0;
+    size_t blockEnd = 0;
+    size_t next;
+    for (size_t i = start; i < end; i = next) {
+        next = i + 1;
+        if (mEntryTable.get(i) != EntryState::WRITTEN) {
+            continue;
+        }
+
+        if (i >= blockEnd) {
+            blockStart = i;
+            blockEnd = std::min(i + PREFIX_SCAN_ENTRIES, end);
+            auto rc = nvs_flash_read(getEntryAddress(i), block, (blockEnd - blockStart) * ENTRY_SIZE);
+            if (rc != ESP_OK) {
+                mState = PageState::INVALID;
+                return rc;
+            }
+        }
+        const Item& entry = block[i - blockStart];
+
+        if (entry.crc32 != entry.calculateCrc32()) {
+            auto rc = eraseEntryAndSpan(i);
+            if (rc != ESP_OK) {
+                mState = PageState::INVALID;
+                return rc;
+            }
+            continue;
+        }
+
+        if (isVariableLengthType(entry.datatype)) {
+            next = i + entry.span;
+        }
+
+        if ((nsIndex != NS_ANY && entry.nsIndex != nsIndex)
+                || (datatype != ItemType::ANY && entry.datatype != datatype)
+                || strncmp(prefix, entry.key, prefixLen) != 0) {
+            continue;
+        }
+
+        item = entry;
+        itemIndex = i;
+        return ESP_OK;
+    }
+
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
 esp_err_t Page::getSeqNumber(uint32_t& seqNumber) const
 {
     if (mState != PageState::UNINITIALIZED && mState != PageState::INVALID && mState != PageState::CORRUPT) {
@@ -967,6 +1400,16 @@ size_t Page::getVarDataTailroom() const
     return ((mNextFreeEntry < (ENTRY_COUNT-1)) ? ((ENTRY_COUNT - mNextFreeEntry - 1) * ENTRY_SIZE): 0);
 }
 
+size_t Page::getFreeEntryCount() const
+{
+    if (mState == PageState::UNINITIALIZED) {
+        return ENTRY_COUNT;
+    } else if (mState != PageState::ACTIVE || mNextFreeEntry >= ENTRY_COUNT) {
+        return 0;
+    }
+    return ENTRY_COUNT - mNextFreeEntry;
+}
+
 const char* Page::pageStateToName(PageState ps)
 {
     switch (ps) {
@@ -24,6 +24,7 @@
 #include "compressed_enum_table.hpp"
 #include "intrusive_list.h"
 #include "nvs_item_hash_list.hpp"
+#include "nvs_page_summary.hpp"
 
 namespace nvs
 {
@@ -55,6 +56,8 @@ public:
 
     static const uint8_t NVS_VERSION = 0xfe; // Decrement to upgrade
 
+    static const size_t PREFIX_SCAN_ENTRIES = 8;
+
     enum class PageState : uint32_t {
         // All bits set, default state after flash erase. Page has not been initialized yet.
         UNINITIALIZED = 0xffffffff,
@@ -84,6 +87,16 @@ public:
 
     esp_err_t load(uint32_t sectorNumber);
 
+    /**
+     * Load the page in two steps, as done by load: loadHeader reads the page header, and loadEntries reads
+     * the entry state table and the items. This lets PageManager find the summary page before loading items.
+     * If the page is full and matches the given summary record, the hash list is filled from the record instead
+     * of reading every item, and fromSummary is set.
+     */
+    esp_err_t loadHeader(uint32_t sectorNumber);
+
+    esp_err_t loadEntries(const PageSummary::Record* record, bool& fromSummary);
+
     esp_err_t getSeqNumber(uint32_t& seqNumber) const;
 
     esp_err_t setSeqNumber(uint32_t seqNumber);
@@ -94,6 +107,12 @@ public:
 
     esp_err_t readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize, uint8_t chunkIdx = CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
 
+    /**
+     * Read dataSize bytes of a variable length item, starting at offset within its data.
+     * If verifyCrc is set, the whole item is read to check its CRC, which is done once per item by streaming readers.
+     */
+    esp_err_t readItemPart(uint8_t nsIndex, ItemType datatype, const char* key, size_t offset, void* data, size_t dataSize, bool verifyCrc, uint8_t chunkIdx = CHUNK_ANY);
+
     esp_err_t cmpItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t chunkIdx = CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
 
     esp_err_t eraseItem(uint8_t nsIndex, ItemType datatype, const char* key, uint8_t chunkIdx = CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
@@ -102,6 +121,26 @@ public:
 
     esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item, uint8_t chunkIdx = CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
 
+    /**
+     * Find the next item at or after itemIndex which is flagged in the summary record this page was loaded from.
+     */
+    esp_err_t findItem(const PageSummary::Record& record, size_t &itemIndex, Item& item);
+
+    /**
+     * Find the next item at or after itemIndex whose key starts with prefix. nsIndex and datatype may be
+     * NS_ANY and ItemType::ANY, and an empty prefix matches all keys. Hashes only identify whole keys, so
+     * entries are read in blocks of PREFIX_SCAN_ENTRIES, instead of one flash read for each item.
+     */
+    esp_err_t findItemWithPrefix(uint8_t nsIndex, ItemType datatype, const char* prefix, size_t &itemIndex, Item& item);
+
+    /**
+     * Erase the item at the index returned by findItem or findItemWithPrefix, including its data entries.
+     */
+    esp_err_t eraseItemAt(size_t itemIndex)
+    {
+        return eraseEntryAndSpan(itemIndex);
+    }
+
     template<typename T>
     esp_err_t writeItem(uint8_t nsIndex, const char* key, const T& value)
     {
@@ -135,6 +174,8 @@ public:
     {
         return mErasedEntryCount;
     }
+
+    uint32_t getEntryTableCrc32() const;
     size_t getVarDataTailroom() const ;
 
     esp_err_t markFull();
@@ -143,12 +184,71 @@ public:
 
     esp_err_t copyItems(Page& other);
 
+    /**
+     * Move items to the other page, starting from the first used entry, until at least maxEntries entries
+     * are moved or no items are left. Each item is written to the other page as a batch, so that it
+     * becomes valid atomically, and then erased from this page.
+     * Returns ESP_ERR_NVS_PAGE_FULL if the next item doesn't fit into the other page.
+     */
+    esp_err_t moveItems(Page& other, size_t maxEntries, size_t& movedEntries);
+
+    /**
+     * Start a batch of writes. Entries of items written until commitBatch is called are stored in flash,
+     * but are only marked as written by commitBatch, with a single update of the entry state table.
+     * If power goes off before the batch is committed, none of its items are loaded afterwards.
+     */
+    esp_err_t beginBatch();
+
+    esp_err_t commitBatch();
+
+    /**
+     * Discard items written since beginBatch. Their entries are marked as erased.
+     */
+    esp_err_t abortBatch();
+
+    size_t getFreeEntryCount() const;
+
+    size_t getNextFreeEntry() const
+    {
+        return mNextFreeEntry;
+    }
+
+    /**
+     * Erase the marker of a batch written by Storage::writeBatch at markerIndex, and the BATCH_ERASE items
+     * which follow it. The marker is erased last, once the state of the other items is written to flash.
+     */
+    esp_err_t eraseBatchItems(size_t markerIndex);
+
+    /**
+     * Whether the item is a marker or an erased key of a batch, which are not moved to other pages.
+     */
+    static bool isBatchItem(const Item& item)
+    {
+        return item.nsIndex == NS_ANY && (item.datatype == ItemType::BATCH || item.datatype == ItemType::BATCH_ERASE);
+    }
+
+    /**
+     * Until flushEntryStates is called, changes of entry states are only applied to the entry state table in RAM.
+     * This way, erasing several items writes each modified word of the table to flash only once.
+     */
+    void deferEntryStateWrites()
+    {
+        mDeferStateWrites = true;
+    }
+
+    esp_err_t flushEntryStates();
+
     esp_err_t erase();
 
     void debugDump() const;
 
     esp_err_t calcEntries(nvs_stats_t &nvsStats);
 
+    void setItemIndex(ItemIndex* index)
+    {
+        mHashList.setItemIndex(index, this);
+    }
+
 protected:
 
     class Header
@@ -175,7 +275,9 @@ protected:
         INVALID = 0x4 // entry is in inconsistent state (write started but ESB_WRITTEN has not been set yet)
     };
 
-    esp_err_t mLoadEntryTable();
+    esp_err_t mLoadEntryTable(const PageSummary::Record* record, bool& fromSummary);
+
+    esp_err_t mLoadFromSummary(const PageSummary::Record& record);
 
     esp_err_t initialize();
 
@@ -220,6 +322,9 @@ protected:
     size_t mFirstUsedEntry = INVALID_ENTRY;
     uint16_t mUsedEntryCount = 0;
     uint16_t mErasedEntryCount = 0;
+    size_t mBatchStart = INVALID_ENTRY;
+    bool mDeferStateWrites = false;
+    uint32_t mDirtyStateWords = 0;
 
     HashList mHashList;
 
@@ -230,6 +335,7 @@ protected:
     static_assert(sizeof(Header) == 32, "header size must be 32 bytes");
     static_assert(ENTRY_TABLE_OFFSET % 32 == 0, "entry table offset should be aligned");
     static_assert(ENTRY_DATA_OFFSET % 32 == 0, "entry data offset should be aligned");
+    static_assert(TEntryTable::byteSize() / 4 <= 32, "mDirtyStateWords should have a bit for each word of entry table");
 
 }; // class Page
 
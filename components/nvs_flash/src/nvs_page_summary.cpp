@@ -0,0 +1,226 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nvs_page_summary.hpp"
+#include "nvs_page.hpp"
+#include "nvs_ops.hpp"
+#include "nvs_crc.hpp"
+#include <new>
+#include <cstddef>
+#include <algorithm>
+
+namespace nvs
+{
+
+static const size_t DATA_CAPACITY = Page::SEC_SIZE - Page::ENTRY_SIZE;
+
+uint32_t PageSummary::Header::calculateCrc32() const
+{
+    return nvs_crc32_le(0xffffffff,
+                        reinterpret_cast<const uint8_t*>(this) + offsetof(Header, mGeneration),
+                        offsetof(Header, mCrc32) - offsetof(Header, mGeneration));
+}
+
+esp_err_t PageSummary::load(uint32_t sectorNumber, size_t pageCount)
+{
+    const uint32_t address = sectorNumber * Page::SEC_SIZE;
+    Header header;
+    auto err = spi_flash_read(address, &header, sizeof(header));
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (header.mMarker != MARKER
+            || header.mCrc32 != header.calculateCrc32()
+            || header.mVersion != VERSION
+            || header.mDataSize > DATA_CAPACITY
+            || header.mDataSize % Page::ENTRY_SIZE != 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (isValid() && header.mGeneration <= mGeneration) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    std::unique_ptr<uint32_t[]> data(new (std::nothrow) uint32_t[header.mDataSize / sizeof(uint32_t)]);
+    std::unique_ptr<const Record*[]> records(new (std::nothrow) const Record*[pageCount]);
+    if (!data || !records) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    err = nvs_flash_read(address + sizeof(Header), data.get(), header.mDataSize);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (nvs_crc32_le(0xffffffff, reinterpret_cast<uint8_t*>(data.get()), header.mDataSize) != header.mDataCrc32) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    std::fill_n(records.get(), pageCount, nullptr);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.get());
+    size_t offset = 0;
+    for (size_t i = 0; i < header.mRecordCount; ++i) {
+        if (offset + sizeof(Record) > header.mDataSize) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        const Record* record = reinterpret_cast<const Record*>(bytes + offset);
+        offset += sizeof(Record) + record->mItemCount * sizeof(uint32_t);
+        if (offset > header.mDataSize || record->mPageIndex >= pageCount) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        records[record->mPageIndex] = record;
+    }
+
+    mData = std::move(data);
+    mDataSize = header.mDataSize;
+    mRecordCount = header.mRecordCount;
+    mRecords = std::move(records);
+    mPageCount = pageCount;
+    mSectorNumber = sectorNumber;
+    mGeneration = header.mGeneration;
+    return ESP_OK;
+}
+
+const PageSummary::Record* PageSummary::find(size_t pageIndex) const
+{
+    if (!mRecords || pageIndex >= mPageCount) {
+        return nullptr;
+    }
+    return mRecords[pageIndex];
+}
+
+void PageSummary::reject(size_t pageIndex)
+{
+    if (mRecords && pageIndex < mPageCount) {
+        mRecords[pageIndex] = nullptr;
+    }
+}
+
+esp_err_t PageSummary::allocate()
+{
+    mData.reset(new (std::nothrow) uint32_t[DATA_CAPACITY / sizeof(uint32_t)]);
+    if (!mData) {
+        return ESP_ERR_NO_MEM;
+    }
+    mDataSize = 0;
+    mRecordCount = 0;
+    return ESP_OK;
+}
+
+esp_err_t PageSummary::addPage(size_t pageIndex, Page& page)
+{
+    if (!mData) {
+        auto err = allocate();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    uint32_t seqNumber;
+    auto err = page.getSeqNumber(seqNumber);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (mDataSize + sizeof(Record) > DATA_CAPACITY) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(mData.get());
+    Record* record = reinterpret_cast<Record*>(bytes + mDataSize);
+    uint32_t* items = reinterpret_cast<uint32_t*>(record + 1);
+
+    size_t count = 0;
+    size_t itemIndex = 0;
+    Item item;
+    while ((err = page.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item)) == ESP_OK) {
+        if (mDataSize + sizeof(Record) + (count + 1) * sizeof(uint32_t) > DATA_CAPACITY) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        bool mountScan = item.nsIndex == Page::NS_INDEX
+                || item.datatype == ItemType::BLOB_IDX
+                || item.datatype == ItemType::BLOB_DATA;
+        items[count++] = makeItem(itemIndex, item.calculateCrc32WithoutValue() & 0xffffff, mountScan);
+        itemIndex += item.span;
+    }
+    if (err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+    if (count == 0) {
+        // nothing to skip when loading this page
+        return ESP_OK;
+    }
+
+    // findItem may have erased corrupted items, so the entry state table is only checked now
+    record->mPageIndex = static_cast<uint16_t>(pageIndex);
+    record->mItemCount = static_cast<uint8_t>(count);
+    record->mReserved = 0xff;
+    record->mSeqNumber = seqNumber;
+    record->mEntryTableCrc32 = page.getEntryTableCrc32();
+    mDataSize += sizeof(Record) + count * sizeof(uint32_t);
+    ++mRecordCount;
+    return ESP_OK;
+}
+
+esp_err_t PageSummary::write(uint32_t sectorNumber, uint32_t generation)
+{
+    if (!mData) {
+        auto err = allocate();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    size_t paddedSize = (mDataSize + Page::ENTRY_SIZE - 1) / Page::ENTRY_SIZE * Page::ENTRY_SIZE;
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(mData.get());
+    std::fill(bytes + mDataSize, bytes + paddedSize, 0xff);
+
+    Header header;
+    header.mMarker = MARKER;
+    header.mGeneration = generation;
+    header.mRecordCount = static_cast<uint32_t>(mRecordCount);
+    header.mDataSize = static_cast<uint32_t>(paddedSize);
+    header.mDataCrc32 = nvs_crc32_le(0xffffffff, bytes, paddedSize);
+    header.mPageVersion = 0xff;
+    header.mVersion = VERSION;
+    std::fill_n(header.mReserved, sizeof(header.mReserved), 0xff);
+    header.mReserved2 = 0xffffffff;
+    header.mCrc32 = header.calculateCrc32();
+
+    const uint32_t address = sectorNumber * Page::SEC_SIZE;
+    if (paddedSize > 0) {
+        auto err = nvs_flash_write(address + sizeof(Header), bytes, paddedSize);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    // header goes last, so that a summary which wasn't written completely is never loaded
+    auto err = spi_flash_write(address, &header, sizeof(header));
+    if (err != ESP_OK) {
+        return err;
+    }
+    mSectorNumber = sectorNumber;
+    mGeneration = generation;
+    return ESP_OK;
+}
+
+void PageSummary::clear()
+{
+    mData.reset();
+    mDataSize = 0;
+    mRecordCount = 0;
+    mRecords.reset();
+    mPageCount = 0;
+    mSectorNumber = 0;
+    mGeneration = 0;
+}
+
+} // namespace nvs
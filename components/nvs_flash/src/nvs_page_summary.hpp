@@ -0,0 +1,166 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef nvs_page_summary_hpp
+#define nvs_page_summary_hpp
+
+#include "nvs.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace nvs
+{
+
+class Page;
+
+/**
+ * Summary of the full pages of a partition, which lets mounting skip reading and checking every item of pages
+ * which have not changed since the summary was written.
+ *
+ * The summary is written to a free page. It starts with a header which has a marker in place of the page state,
+ * so it is treated as a corrupt page by the rest of NVS, and erased when that page is activated.
+ * For every full page, the summary holds its sequence number, the CRC of its entry state table and, for each item,
+ * the entry index and 24-bit hash which go into the hash list. A page is only loaded from its record if both its
+ * sequence number and entry state table are unchanged.
+ *
+ * Items which Storage looks at while mounting (namespace entries and blob items) are flagged, so that only those
+ * have to be read from flash.
+ */
+class PageSummary
+{
+public:
+    static const uint32_t MARKER = 0x59524d53; // "SMRY"
+    static const uint8_t VERSION = 1;
+
+    static const uint32_t ITEM_INDEX_MASK = 0x7f;
+    static const uint32_t ITEM_MOUNT_SCAN = 0x80;
+
+    struct Record {
+        uint16_t mPageIndex;        // index of the page within the partition
+        uint8_t mItemCount;         // number of item words following the record
+        uint8_t mReserved;
+        uint32_t mSeqNumber;        // sequence number of the page
+        uint32_t mEntryTableCrc32;  // crc of the entry state table of the page
+
+        const uint32_t* items() const
+        {
+            return reinterpret_cast<const uint32_t*>(this + 1);
+        }
+    };
+
+    static uint32_t makeItem(size_t index, uint32_t hash, bool mountScan)
+    {
+        return (hash << 8) | (mountScan ? ITEM_MOUNT_SCAN : 0) | static_cast<uint32_t>(index);
+    }
+
+    static size_t getItemIndex(uint32_t item)
+    {
+        return item & ITEM_INDEX_MASK;
+    }
+
+    static uint32_t getItemHash(uint32_t item)
+    {
+        return item >> 8;
+    }
+
+    static bool isMountScanItem(uint32_t item)
+    {
+        return (item & ITEM_MOUNT_SCAN) != 0;
+    }
+
+    PageSummary() {}
+
+    /**
+     * Read the summary stored in the given sector, if the sector holds a valid summary which is newer than
+     * the one loaded already. Returns ESP_ERR_NVS_NOT_FOUND otherwise.
+     */
+    esp_err_t load(uint32_t sectorNumber, size_t pageCount);
+
+    bool isValid() const
+    {
+        return mRecords != nullptr;
+    }
+
+    uint32_t getSectorNumber() const
+    {
+        return mSectorNumber;
+    }
+
+    uint32_t getGeneration() const
+    {
+        return mGeneration;
+    }
+
+    /**
+     * Returns the record of the page with the given index, or nullptr if there is none.
+     */
+    const Record* find(size_t pageIndex) const;
+
+    /**
+     * Forget the record of a page which couldn't be loaded from it.
+     */
+    void reject(size_t pageIndex);
+
+    /**
+     * Add a record for a full page. Reads the items of the page from flash.
+     * Returns ESP_ERR_NVS_NOT_ENOUGH_SPACE if the record doesn't fit into the summary.
+     */
+    esp_err_t addPage(size_t pageIndex, Page& page);
+
+    /**
+     * Write the records added so far to the given erased sector.
+     */
+    esp_err_t write(uint32_t sectorNumber, uint32_t generation);
+
+    void clear();
+
+    size_t getRecordCount() const
+    {
+        return mRecordCount;
+    }
+
+protected:
+    // laid out like Page::Header where it matters, so that the page is taken for a corrupt one, not a newer format
+    struct Header {
+        uint32_t mMarker;       // MARKER, in place of the page state
+        uint32_t mGeneration;   // incremented with every summary written to the partition
+        uint8_t mPageVersion;   // 0xff, in place of the nvs format version
+        uint8_t mVersion;       // summary format version
+        uint8_t mReserved[2];   // unused, must be 0xff
+        uint32_t mRecordCount;  // number of records
+        uint32_t mDataSize;     // size of the records which follow the header, padded to a multiple of the entry size
+        uint32_t mDataCrc32;    // crc of the records
+        uint32_t mReserved2;    // unused, must be 0xffffffff
+        uint32_t mCrc32;        // crc of everything except mMarker
+
+        uint32_t calculateCrc32() const;
+    };
+
+    static_assert(sizeof(Header) == 32, "summary header should take one entry");
+
+    esp_err_t allocate();
+
+    std::unique_ptr<uint32_t[]> mData;
+    size_t mDataSize = 0;
+    size_t mRecordCount = 0;
+    std::unique_ptr<const Record*[]> mRecords;
+    size_t mPageCount = 0;
+    uint32_t mSectorNumber = 0;
+    uint32_t mGeneration = 0;
+}; // class PageSummary
+
+} // namespace nvs
+
+#endif /* nvs_page_summary_hpp */
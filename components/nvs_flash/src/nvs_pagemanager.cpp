@@ -21,15 +21,40 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
     mPageCount = sectorCount;
     mPageList.clear();
     mFreePageList.clear();
+    mPages.reset();
+    mSummary.clear();
+    mSummaryGeneration = 0;
+
+    // if the index can't be allocated, lookups fall back to iterating over pages
+    mItemIndex.init(sectorCount);
+
     mPages.reset(new (nothrow) Page[sectorCount]);
 
     if (!mPages) return ESP_ERR_NO_MEM;
 
+    // page headers are loaded first, so that items of full pages can be loaded from a summary
     for (uint32_t i = 0; i < sectorCount; ++i) {
-        auto err = mPages[i].load(baseSector + i);
+        mPages[i].setItemIndex(&mItemIndex);
+        auto err = mPages[i].loadHeader(baseSector + i);
         if (err != ESP_OK) {
             return err;
         }
+        if (mPages[i].state() == Page::PageState::CORRUPT) {
+            // summary is optional, pages are loaded by reading all items if it can't be loaded
+            mSummary.load(baseSector + i, sectorCount);
+        }
+    }
+    mSummaryGeneration = mSummary.getGeneration();
+
+    for (uint32_t i = 0; i < sectorCount; ++i) {
+        bool fromSummary;
+        auto err = mPages[i].loadEntries(mSummary.find(i), fromSummary);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (!fromSummary) {
+            mSummary.reject(i);
+        }
         uint32_t seqNumber;
         if (mPages[i].getSeqNumber(seqNumber) != ESP_OK) {
             mFreePageList.push_back(&mPages[i]);
@@ -46,6 +71,13 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
         }
     }
 
+    if (mSummary.isValid()) {
+        // keep the summary page until all other free pages are used
+        Page* summaryPage = &mPages[mSummary.getSectorNumber() - baseSector];
+        mFreePageList.erase(summaryPage);
+        mFreePageList.push_back(summaryPage);
+    }
+
     if (mPageList.empty()) {
         mSeqNumber = 0;
         return activatePage();
@@ -59,34 +91,29 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
     // but before the old one was erased, we end up with a duplicate item
     Page& lastPage = back();
     size_t lastItemIndex = SIZE_MAX;
+    size_t markerIndex = SIZE_MAX;
     Item item;
+    Item lastItem;
+    Item marker;
     size_t itemIndex = 0;
     while (lastPage.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+        if (item.datatype == ItemType::BATCH && Page::isBatchItem(item)) {
+            markerIndex = itemIndex;
+            marker = item;
+        }
+        lastItem = item;
         itemIndex += item.span;
         lastItemIndex = itemIndex;
     }
 
-    if (lastItemIndex != SIZE_MAX) {
-        auto last = PageManager::TPageListIterator(&lastPage);
-        TPageListIterator it;
-
-        for (it = begin(); it != last; ++it) {
-
-            if ((it->state() != Page::PageState::FREEING) &&
-                    (it->eraseItem(item.nsIndex, item.datatype, item.key, item.chunkIndex) == ESP_OK)) {
-                break;
-            }
-        }
-        if ((it == last) && (item.datatype == ItemType::BLOB_IDX)) {
-            /* Rare case in which the blob was stored using old format, but power went just after writing
-             * blob index during modification. Loop again and delete the old version blob*/
-            for (it = begin(); it != last; ++it) {
+    if (lastItemIndex != SIZE_MAX && !Page::isBatchItem(lastItem)) {
+        eraseDuplicates(lastItem);
+    }
 
-                if ((it->state() != Page::PageState::FREEING) &&
-                        (it->eraseItem(item.nsIndex, ItemType::BLOB, item.key, item.chunkIndex) == ESP_OK)) {
-                    break;
-                }
-            }
+    if (markerIndex != SIZE_MAX) {
+        auto err = finishBatch(markerIndex, marker);
+        if (err != ESP_OK) {
+            return err;
         }
     }
 
@@ -133,6 +160,136 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
     return ESP_OK;
 }
 
+esp_err_t PageManager::findMountItem(Page& page, size_t& itemIndex, Item& item)
+{
+    const PageSummary::Record* record = mSummary.find(&page - mPages.get());
+    if (record != nullptr) {
+        return page.findItem(*record, itemIndex, item);
+    }
+    return page.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item);
+}
+
+void PageManager::releaseSummary()
+{
+    mSummary.clear();
+}
+
+esp_err_t PageManager::writeSummary()
+{
+    if (mFreePageList.empty()) {
+        return ESP_ERR_NVS_NO_FREE_PAGES;
+    }
+
+    PageSummary summary;
+    for (auto it = begin(); it != end(); ++it) {
+        if (it->state() != Page::PageState::FULL) {
+            continue;
+        }
+        Page* page = it;
+        auto err = summary.addPage(page - mPages.get(), *page);
+        // pages which don't fit are loaded by reading all items
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
+            return err;
+        }
+    }
+    if (summary.getRecordCount() == 0) {
+        return ESP_OK;
+    }
+
+    // use the free page which will be activated last, erasing it if it isn't blank
+    Page* target = nullptr;
+    for (auto it = mFreePageList.begin(); it != mFreePageList.end(); ++it) {
+        if (it->state() == Page::PageState::UNINITIALIZED) {
+            target = it;
+        }
+    }
+    if (target == nullptr) {
+        target = &mFreePageList.back();
+        auto err = target->erase();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    const uint32_t sectorNumber = mBaseSector + static_cast<uint32_t>(target - mPages.get());
+    auto err = summary.write(sectorNumber, mSummaryGeneration + 1);
+    // loading the page again marks it as corrupt, so it gets erased before it is activated,
+    // also if the summary wasn't written completely
+    auto loadErr = target->load(sectorNumber);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (loadErr != ESP_OK) {
+        return loadErr;
+    }
+    ++mSummaryGeneration;
+    mFreePageList.erase(target);
+    mFreePageList.push_back(target);
+    return ESP_OK;
+}
+
+void PageManager::eraseDuplicates(const Item& item)
+{
+    auto last = PageManager::TPageListIterator(&back());
+    TPageListIterator it;
+
+    for (it = begin(); it != last; ++it) {
+
+        if ((it->state() != Page::PageState::FREEING) &&
+                (it->eraseItem(item.nsIndex, item.datatype, item.key, item.chunkIndex) == ESP_OK)) {
+            break;
+        }
+    }
+    if ((it == last) && (item.datatype == ItemType::BLOB_IDX)) {
+        /* Rare case in which the blob was stored using old format, but power went just after writing
+         * blob index during modification. Loop again and delete the old version blob*/
+        for (it = begin(); it != last; ++it) {
+
+            if ((it->state() != Page::PageState::FREEING) &&
+                    (it->eraseItem(item.nsIndex, ItemType::BLOB, item.key, item.chunkIndex) == ESP_OK)) {
+                break;
+            }
+        }
+    }
+}
+
+esp_err_t PageManager::finishBatch(size_t markerIndex, const Item& marker)
+{
+    Page& lastPage = back();
+    const size_t end = markerIndex + 1 + marker.batch.eraseCount + marker.batch.setEntries;
+    size_t itemIndex = markerIndex + 1;
+    Item item;
+    while (lastPage.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK && itemIndex < end) {
+        if (item.datatype != ItemType::BATCH_ERASE) {
+            eraseDuplicates(item);
+            itemIndex += item.span;
+            continue;
+        }
+
+        // erase all items of the key which were written before the batch
+        for (auto it = begin(); it != this->end(); ++it) {
+            if (it->state() == Page::PageState::FREEING) {
+                continue;
+            }
+            size_t index = 0;
+            Item found;
+            while (it->findItem(marker.batch.nsIndex, ItemType::ANY, item.key, index, found) == ESP_OK) {
+                if (&*it == &lastPage && index > markerIndex) {
+                    break;
+                }
+                auto err = it->eraseItemAt(index);
+                if (err != ESP_OK) {
+                    return err;
+                }
+                index += found.span;
+            }
+        }
+        itemIndex += item.span;
+    }
+
+    return lastPage.eraseBatchItems(markerIndex);
+}
+
 esp_err_t PageManager::requestNewPage()
 {
     if (mFreePageList.empty()) {
@@ -196,6 +353,60 @@ esp_err_t PageManager::requestNewPage()
     return ESP_OK;
 }
 
+esp_err_t PageManager::reclaimStep(size_t maxEntries)
+{
+    if (mFreePageList.size() > RECLAIM_FREE_PAGES) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // find the page with the highest number of erased items, other than the active one
+    Page* reclaimedPage = nullptr;
+    size_t maxUnusedItems = 0;
+    for (auto it = begin(); it != end(); ++it) {
+        if (&(*it) == &back() || it->state() != Page::PageState::FULL) {
+            continue;
+        }
+        auto unused = Page::ENTRY_COUNT - it->getUsedEntryCount();
+        if (unused > maxUnusedItems) {
+            reclaimedPage = it;
+            maxUnusedItems = unused;
+        }
+    }
+
+    if (reclaimedPage == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // erasing takes as long as moving a few dozen entries, so it is a step of its own
+    if (reclaimedPage->getUsedEntryCount() == 0) {
+        auto err = reclaimedPage->erase();
+        if (err != ESP_OK) {
+            return err;
+        }
+        mPageList.erase(reclaimedPage);
+        mFreePageList.push_back(reclaimedPage);
+        return ESP_OK;
+    }
+
+    size_t movedEntries;
+    auto err = reclaimedPage->moveItems(back(), maxEntries, movedEntries);
+    if (err == ESP_ERR_NVS_PAGE_FULL) {
+        // continue on a new page, but leave the last free page to requestNewPage
+        if (mFreePageList.size() < 2) {
+            return (movedEntries > 0) ? ESP_OK : ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        Page& page = back();
+        if (page.state() != Page::PageState::FULL) {
+            err = page.markFull();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        err = activatePage();
+    }
+    return err;
+}
+
 esp_err_t PageManager::activatePage()
 {
     if (mFreePageList.empty()) {
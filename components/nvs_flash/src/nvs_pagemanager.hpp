@@ -19,6 +19,8 @@
 #include "nvs_types.hpp"
 #include "nvs_page.hpp"
 #include "nvs_pagemanager.hpp"
+#include "nvs_item_index.hpp"
+#include "nvs_page_summary.hpp"
 #include "intrusive_list.h"
 
 namespace nvs
@@ -28,6 +30,7 @@ class PageManager
     using TPageList = intrusive_list<Page>;
     using TPageListIterator = TPageList::iterator;
 public:
+    static const size_t RECLAIM_FREE_PAGES = 2;
 
     PageManager() {}
 
@@ -54,6 +57,29 @@ public:
 
     esp_err_t requestNewPage();
 
+    /**
+     * Do the work of requestNewPage in small steps, ahead of time: once the partition is down to
+     * RECLAIM_FREE_PAGES free pages, move up to maxEntries entries of items from the page with most erased
+     * entries to the active page, or erase that page if no items are left on it.
+     * Returns ESP_ERR_NOT_FOUND if there is nothing to reclaim.
+     */
+    esp_err_t reclaimStep(size_t maxEntries);
+
+    /**
+     * Write a summary of all full pages to a free page, so that the next load doesn't have to read
+     * the items of full pages which are unchanged by then. See PageSummary.
+     */
+    esp_err_t writeSummary();
+
+    /**
+     * Find the next item at or after itemIndex which Storage has to look at while mounting the partition.
+     * For pages loaded from a summary, these are namespace entries and blob items, otherwise all items.
+     * Only valid after load and until releaseSummary is called.
+     */
+    esp_err_t findMountItem(Page& page, size_t& itemIndex, Item& item);
+
+    void releaseSummary();
+
     esp_err_t fillStats(nvs_stats_t& nvsStats);
 
     uint32_t getBaseSector()
@@ -61,14 +87,34 @@ public:
         return mBaseSector;
     }
 
+    const ItemIndex& getItemIndex() const
+    {
+        return mItemIndex;
+    }
+
 protected:
     friend class Iterator;
 
     esp_err_t activatePage();
 
+    /**
+     * Erase the previous version of an item on the last page, if power went out before it was erased.
+     */
+    void eraseDuplicates(const Item& item);
+
+    /**
+     * Remove previous values and erased keys of a batch committed to the last page (see Storage::writeBatch),
+     * if power went out before its marker was erased. Only the items of the batch are checked.
+     */
+    esp_err_t finishBatch(size_t markerIndex, const Item& marker);
+
     TPageList mPageList;
     TPageList mFreePageList;
+    // pages report to the index when their hash lists change, so it has to outlive them
+    ItemIndex mItemIndex;
     std::unique_ptr<Page[]> mPages;
+    PageSummary mSummary;
+    uint32_t mSummaryGeneration = 0;
     uint32_t mBaseSector;
     uint32_t mPageCount;
     uint32_t mSeqNumber;
@@ -157,12 +157,12 @@ esp_err_t NVSPartitionManager::open_handle(const char *part_name,
         return ESP_ERR_NVS_PART_NOT_FOUND;
     }
 
-    esp_err_t err = sHandle->createOrOpenNamespace(ns_name, open_mode == NVS_READWRITE, nsIndex);
+    esp_err_t err = sHandle->createOrOpenNamespace(ns_name, open_mode != NVS_READONLY, nsIndex);
     if (err != ESP_OK) {
         return err;
     }
 
-    *handle = new (std::nothrow) NVSHandleSimple(open_mode==NVS_READONLY, nsIndex, sHandle);
+    *handle = new (std::nothrow) NVSHandleSimple(open_mode==NVS_READONLY, nsIndex, sHandle, open_mode==NVS_READWRITE_BATCH);
 
     if (!handle) return ESP_ERR_NO_MEM;
 
@@ -18,6 +18,7 @@
 #ifdef ESP_PLATFORM
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "esp_timer.h"
 
 namespace nvs
 {
@@ -64,6 +65,11 @@ public:
 } // namespace nvs
 
 #else // ESP_PLATFORM
+#include <cstdint>
+
+// provided by the host test environment, which reports the time spent in emulated flash operations
+extern "C" int64_t esp_timer_get_time(void);
+
 namespace nvs
 {
 class Lock
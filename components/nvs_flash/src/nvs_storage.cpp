@@ -23,6 +23,7 @@ namespace nvs
 
 Storage::~Storage()
 {
+    detachBlobStreams();
     clearNamespaces();
 }
 
@@ -31,8 +32,10 @@ void Storage::clearNamespaces()
     mNamespaces.clearAndFreeNodes();
 }
 
-esp_err_t Storage::populateBlobIndices(TBlobIndexList& blobIdxList)
+esp_err_t Storage::loadNamespacesAndBlobIndices(TBlobIndexList& blobIdxList)
 {
+    clearNamespaces();
+    std::fill_n(mNamespaceUsage.data(), mNamespaceUsage.byteSize() / 4, 0);
     for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
         Page& p = *it;
         size_t itemIndex = 0;
@@ -42,20 +45,33 @@ esp_err_t Storage::populateBlobIndices(TBlobIndexList& blobIdxList)
          * logic in pagemanager will remove the earlier index. So we should never find a
          * duplicate index at this point */
 
-        while (p.findItem(Page::NS_ANY, ItemType::BLOB_IDX, nullptr, itemIndex, item) == ESP_OK) {
-            BlobIndexNode* entry = new (std::nothrow) BlobIndexNode;
+        while (mPageManager.findMountItem(p, itemIndex, item) == ESP_OK) {
+            if (item.nsIndex == Page::NS_INDEX && item.datatype == ItemType::U8) {
+                NamespaceEntry* entry = new (std::nothrow) NamespaceEntry;
+
+                if (!entry) return ESP_ERR_NO_MEM;
+
+                item.getKey(entry->mName, sizeof(entry->mName));
+                item.getValue(entry->mIndex);
+                mNamespaces.push_back(entry);
+                mNamespaceUsage.set(entry->mIndex, true);
+            } else if (item.datatype == ItemType::BLOB_IDX && item.chunkIndex == Page::CHUNK_ANY) {
+                BlobIndexNode* entry = new (std::nothrow) BlobIndexNode;
 
-            if (!entry) return ESP_ERR_NO_MEM;
+                if (!entry) return ESP_ERR_NO_MEM;
 
-            item.getKey(entry->key, sizeof(entry->key));
-            entry->nsIndex = item.nsIndex;
-            entry->chunkStart = item.blobIndex.chunkStart;
-            entry->chunkCount = item.blobIndex.chunkCount;
+                item.getKey(entry->key, sizeof(entry->key));
+                entry->nsIndex = item.nsIndex;
+                entry->chunkStart = item.blobIndex.chunkStart;
+                entry->chunkCount = item.blobIndex.chunkCount;
 
-            blobIdxList.push_back(entry);
+                blobIdxList.push_back(entry);
+            }
             itemIndex += item.span;
         }
     }
+    mNamespaceUsage.set(0, true);
+    mNamespaceUsage.set(255, true);
 
     return ESP_OK;
 }
@@ -71,7 +87,11 @@ void Storage::eraseOrphanDataBlobs(TBlobIndexList& blobIdxList)
          * 1) VER_0_OFFSET <= chunkIndex < VER_1_OFFSET-1 => Version0 chunks
          * 2) VER_1_OFFSET <= chunkIndex < VER_ANY => Version1 chunks
          */
-        while (p.findItem(Page::NS_ANY, ItemType::BLOB_DATA, nullptr, itemIndex, item) == ESP_OK) {
+        while (mPageManager.findMountItem(p, itemIndex, item) == ESP_OK) {
+            if (item.datatype != ItemType::BLOB_DATA) {
+                itemIndex += item.span;
+                continue;
+            }
 
             auto iter = std::find_if(blobIdxList.begin(),
                     blobIdxList.end(),
@@ -90,51 +110,32 @@ void Storage::eraseOrphanDataBlobs(TBlobIndexList& blobIdxList)
 
 esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
 {
+    mMaxWriteTime = 0;
+    // without memory for the value cache, values are always read from flash
+    mValueCache.resize(mValueCacheEntries);
     auto err = mPageManager.load(baseSector, sectorCount);
     if (err != ESP_OK) {
         mState = StorageState::INVALID;
         return err;
     }
 
-    // load namespaces list
-    clearNamespaces();
-    std::fill_n(mNamespaceUsage.data(), mNamespaceUsage.byteSize() / 4, 0);
-    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
-        Page& p = *it;
-        size_t itemIndex = 0;
-        Item item;
-        while (p.findItem(Page::NS_INDEX, ItemType::U8, nullptr, itemIndex, item) == ESP_OK) {
-            NamespaceEntry* entry = new (std::nothrow) NamespaceEntry;
-
-            if (!entry) {
-                mState = StorageState::INVALID;
-                return ESP_ERR_NO_MEM;
-            }
-
-            item.getKey(entry->mName, sizeof(entry->mName));
-            item.getValue(entry->mIndex);
-            mNamespaces.push_back(entry);
-            mNamespaceUsage.set(entry->mIndex, true);
-            itemIndex += item.span;
-        }
-    }
-    mNamespaceUsage.set(0, true);
-    mNamespaceUsage.set(255, true);
-    mState = StorageState::ACTIVE;
-
-    // Populate list of multi-page index entries.
+    // Load namespaces and the list of multi-page index entries in one pass over the items.
     TBlobIndexList blobIdxList;
-    err = populateBlobIndices(blobIdxList);
+    err = loadNamespacesAndBlobIndices(blobIdxList);
     if (err != ESP_OK) {
+        blobIdxList.clearAndFreeNodes();
+        mPageManager.releaseSummary();
         mState = StorageState::INVALID;
         return ESP_ERR_NO_MEM;
     }
+    mState = StorageState::ACTIVE;
 
     // Remove the entries for which there is no parent multi-page index.
     eraseOrphanDataBlobs(blobIdxList);
 
     // Purge the blob index list
     blobIdxList.clearAndFreeNodes();
+    mPageManager.releaseSummary();
 
 #ifndef ESP_PLATFORM
     debugCheck();
@@ -142,6 +143,15 @@ esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
     return ESP_OK;
 }
 
+esp_err_t Storage::writeSummary()
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    return mPageManager.writeSummary();
+}
+
 bool Storage::isValid() const
 {
     return mState == StorageState::ACTIVE;
@@ -149,6 +159,43 @@ bool Storage::isValid() const
 
 esp_err_t Storage::findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, uint8_t chunkIdx, VerOffset chunkStart)
 {
+    const ItemIndex& index = mPageManager.getItemIndex();
+    if (index.isValid()) {
+        const uint32_t hash = Item(nsIndex, datatype, 0, key, chunkIdx).calculateCrc32WithoutValue() & 0xffffff;
+        ItemIndex::Candidate candidates[ItemIndex::MAX_CANDIDATES];
+        // candidates are copied out first, as Page::findItem may erase corrupted entries from the index
+        size_t count = index.find(hash, candidates, ItemIndex::MAX_CANDIDATES);
+        if (count == 0) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        if (count <= ItemIndex::MAX_CANDIDATES) {
+            Page* foundPage = nullptr;
+            uint32_t foundSeqNumber = 0;
+            for (size_t i = 0; i < count; ++i) {
+                Page* candidatePage = candidates[i].mPage;
+                uint32_t seqNumber;
+                if (candidatePage->getSeqNumber(seqNumber) != ESP_OK ||
+                        (foundPage != nullptr && seqNumber >= foundSeqNumber)) {
+                    continue;
+                }
+                // in transient states an item may be present on several pages, prefer the oldest one
+                size_t itemIndex = candidates[i].mIndex;
+                Item candidateItem;
+                if (candidatePage->findItem(nsIndex, datatype, key, itemIndex, candidateItem, chunkIdx, chunkStart) == ESP_OK) {
+                    foundPage = candidatePage;
+                    foundSeqNumber = seqNumber;
+                    item = candidateItem;
+                }
+            }
+            if (foundPage == nullptr) {
+                return ESP_ERR_NVS_NOT_FOUND;
+            }
+            page = foundPage;
+            return ESP_OK;
+        }
+        // too many items share the hash, fall back to iterating over pages
+    }
+
     for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
         size_t itemIndex = 0;
         auto err = it->findItem(nsIndex, datatype, key, itemIndex, item, chunkIdx, chunkStart);
@@ -269,6 +316,14 @@ esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    if (hasBlobWriter(nsIndex, key, true)) {
+        return ESP_ERR_NVS_BLOB_STREAM_OPEN;
+    }
+
+    WriteTimer timer(mMaxWriteTime);
+    autoReclaim();
+    mValueCache.erase(nsIndex, key);
+
     Page* findPage = nullptr;
     Item item;
 
@@ -527,6 +582,11 @@ esp_err_t Storage::readItem(uint8_t nsIndex, ItemType datatype, const char* key,
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    const bool cacheable = mValueCache.isEnabled() && ValueCache::isCacheable(datatype, dataSize);
+    if (cacheable && mValueCache.find(nsIndex, datatype, key, data, dataSize)) {
+        return ESP_OK;
+    }
+
     Item item;
     Page* findPage = nullptr;
     if (datatype == ItemType::BLOB) {
@@ -540,8 +600,11 @@ esp_err_t Storage::readItem(uint8_t nsIndex, ItemType datatype, const char* key,
     if (err != ESP_OK) {
         return err;
     }
-    return findPage->readItem(nsIndex, datatype, key, data, dataSize);
-
+    err = findPage->readItem(nsIndex, datatype, key, data, dataSize);
+    if (err == ESP_OK && cacheable) {
+        mValueCache.insert(nsIndex, datatype, key, data, dataSize);
+    }
+    return err;
 }
 
 esp_err_t Storage::eraseMultiPageBlob(uint8_t nsIndex, const char* key, VerOffset chunkStart)
@@ -589,12 +652,365 @@ esp_err_t Storage::eraseMultiPageBlob(uint8_t nsIndex, const char* key, VerOffse
     return ESP_OK;
 }
 
+esp_err_t Storage::openBlobReader(nvs_opaque_blob_stream_t* stream, uint8_t nsIndex, const char* key)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    Item item;
+    Page* findPage = nullptr;
+
+    stream->storage = this;
+    stream->nsIndex = nsIndex;
+    strncpy(stream->key, key, sizeof(stream->key) - 1);
+    stream->key[sizeof(stream->key) - 1] = 0;
+    stream->write = false;
+    stream->chunkNum = 0;
+    stream->chunkOffset = 0;
+    stream->chunkVerified = false;
+    stream->buffer = nullptr;
+    stream->bufferUsed = 0;
+
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item);
+    if (err == ESP_OK) {
+        stream->datatype = ItemType::BLOB_DATA;
+        stream->chunkStart = item.blobIndex.chunkStart;
+        stream->chunkCount = item.blobIndex.chunkCount;
+        stream->size = item.blobIndex.dataSize;
+        mBlobStreams.push_back(stream);
+        return ESP_OK;
+    }
+    if (err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+
+    /* Support for earlier versions where BLOBS were stored without index */
+    err = findItem(nsIndex, ItemType::BLOB, key, findPage, item);
+    if (err != ESP_OK) {
+        return err;
+    }
+    stream->datatype = ItemType::BLOB;
+    stream->chunkStart = VerOffset::VER_ANY;
+    stream->chunkCount = 1;
+    stream->size = item.varLength.dataSize;
+    mBlobStreams.push_back(stream);
+    return ESP_OK;
+}
+
+void Storage::closeBlobReader(nvs_opaque_blob_stream_t* stream)
+{
+    mBlobStreams.erase(stream);
+}
+
+esp_err_t Storage::readBlobStream(nvs_opaque_blob_stream_t* stream, size_t offset, void* data, size_t dataSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    if (offset > stream->size || dataSize > stream->size - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    while (dataSize > 0) {
+        if (offset < stream->chunkOffset) {
+            /* Chunk sizes are only known from the chunks themselves, so seeking backwards starts over */
+            stream->chunkNum = 0;
+            stream->chunkOffset = 0;
+            stream->chunkVerified = false;
+        }
+        if (stream->chunkNum >= stream->chunkCount) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        uint8_t chunkIdx = (stream->datatype == ItemType::BLOB) ? Page::CHUNK_ANY
+                : static_cast<uint8_t> (stream->chunkStart) + stream->chunkNum;
+        Item item;
+        Page* findPage = nullptr;
+        auto err = findItem(stream->nsIndex, stream->datatype, stream->key, findPage, item, chunkIdx);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        size_t chunkSize = item.varLength.dataSize;
+        if (offset >= stream->chunkOffset + chunkSize) {
+            stream->chunkOffset += chunkSize;
+            stream->chunkNum++;
+            stream->chunkVerified = false;
+            continue;
+        }
+
+        size_t chunkPos = offset - stream->chunkOffset;
+        size_t readSize = (dataSize < chunkSize - chunkPos) ? dataSize : chunkSize - chunkPos;
+        err = findPage->readItemPart(stream->nsIndex, stream->datatype, stream->key, chunkPos, dst, readSize,
+                !stream->chunkVerified, chunkIdx);
+        if (err != ESP_OK) {
+            return err;
+        }
+        stream->chunkVerified = true;
+        dst += readSize;
+        offset += readSize;
+        dataSize -= readSize;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::openBlobWriter(nvs_opaque_blob_stream_t* stream, uint8_t nsIndex, const char* key)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    /* Both writers would use the version which isn't referenced by the current index */
+    if (hasBlobWriter(nsIndex, key, true)) {
+        return ESP_ERR_NVS_BLOB_STREAM_OPEN;
+    }
+
+    Item item;
+    Page* findPage = nullptr;
+
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+
+    stream->storage = this;
+    stream->nsIndex = nsIndex;
+    strncpy(stream->key, key, sizeof(stream->key) - 1);
+    stream->key[sizeof(stream->key) - 1] = 0;
+    stream->write = true;
+    stream->datatype = ItemType::BLOB_DATA;
+    /* Toggle the version, the previous one stays valid until the stream is closed */
+    stream->chunkStart = (err == ESP_OK && item.blobIndex.chunkStart == VerOffset::VER_0_OFFSET)
+            ? VerOffset::VER_1_OFFSET : VerOffset::VER_0_OFFSET;
+    stream->chunkCount = 0;
+    stream->size = 0;
+    stream->bufferUsed = 0;
+    stream->buffer = new (std::nothrow) uint8_t[NVS_BLOB_STREAM_BUFFER_SIZE];
+    if (!stream->buffer) {
+        return ESP_ERR_NO_MEM;
+    }
+    mBlobStreams.push_back(stream);
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeBlobStreamChunk(nvs_opaque_blob_stream_t* stream, const uint8_t* data, size_t dataSize, size_t& written)
+{
+    if (stream->chunkCount >= (Page::CHUNK_ANY - 1) / 2) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    while (true) {
+        Page& page = getCurrentPage();
+        size_t tailroom = page.getVarDataTailroom();
+        if (tailroom >= dataSize || tailroom >= Page::CHUNK_MAX_SIZE / 10) {
+            size_t chunkSize = (dataSize > tailroom) ? tailroom : dataSize;
+            auto err = page.writeItem(stream->nsIndex, ItemType::BLOB_DATA, stream->key, data, chunkSize,
+                    static_cast<uint8_t> (stream->chunkStart) + stream->chunkCount);
+            assert(err != ESP_ERR_NVS_PAGE_FULL);
+            if (err != ESP_OK) {
+                return err;
+            }
+            stream->chunkCount++;
+            stream->size += chunkSize;
+            written = chunkSize;
+            return ESP_OK;
+        }
+
+        /* Tailroom is too small to start a chunk, continue on a new page */
+        if (page.state() != Page::PageState::FULL) {
+            auto err = page.markFull();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        auto err = mPageManager.requestNewPage();
+        if (err != ESP_OK) {
+            return err;
+        } else if (getCurrentPage().getVarDataTailroom() == tailroom) {
+            /* We got the same page or we are not improving.*/
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+    }
+}
+
+esp_err_t Storage::flushBlobStream(nvs_opaque_blob_stream_t* stream)
+{
+    while (stream->bufferUsed > 0) {
+        size_t written = 0;
+        auto err = writeBlobStreamChunk(stream, stream->buffer, stream->bufferUsed, written);
+        if (err != ESP_OK) {
+            return err;
+        }
+        memmove(stream->buffer, stream->buffer + written, stream->bufferUsed - written);
+        stream->bufferUsed -= written;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeBlobStream(nvs_opaque_blob_stream_t* stream, const void* data, size_t dataSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    WriteTimer timer(mMaxWriteTime);
+    autoReclaim();
+
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    while (dataSize > 0) {
+        if (stream->bufferUsed == 0 && dataSize >= NVS_BLOB_STREAM_BUFFER_SIZE) {
+            /* Nothing is buffered, so large writes go to flash straight from the caller's memory */
+            size_t written = 0;
+            auto err = writeBlobStreamChunk(stream, src, dataSize, written);
+            if (err != ESP_OK) {
+                return err;
+            }
+            src += written;
+            dataSize -= written;
+            continue;
+        }
+
+        size_t copySize = NVS_BLOB_STREAM_BUFFER_SIZE - stream->bufferUsed;
+        copySize = (dataSize < copySize) ? dataSize : copySize;
+        memcpy(stream->buffer + stream->bufferUsed, src, copySize);
+        stream->bufferUsed += copySize;
+        src += copySize;
+        dataSize -= copySize;
+        if (stream->bufferUsed == NVS_BLOB_STREAM_BUFFER_SIZE) {
+            auto err = flushBlobStream(stream);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::closeBlobWriter(nvs_opaque_blob_stream_t* stream)
+{
+    if (mState != StorageState::ACTIVE) {
+        abortBlobWriter(stream);
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    WriteTimer timer(mMaxWriteTime);
+
+    auto err = flushBlobStream(stream);
+    if (err == ESP_OK) {
+        /* All chunks are stored. Now store the index, which makes the new version valid.*/
+        Item item;
+        std::fill_n(item.data, sizeof(item.data), 0xff);
+        item.blobIndex.dataSize = stream->size;
+        item.blobIndex.chunkCount = stream->chunkCount;
+        item.blobIndex.chunkStart = stream->chunkStart;
+
+        Page& page = getCurrentPage();
+        err = page.writeItem(stream->nsIndex, ItemType::BLOB_IDX, stream->key, item.data, sizeof(item.data));
+        if (err == ESP_ERR_NVS_PAGE_FULL) {
+            if (page.state() != Page::PageState::FULL) {
+                err = page.markFull();
+            }
+            if (err == ESP_OK) {
+                err = mPageManager.requestNewPage();
+            }
+            if (err == ESP_OK) {
+                err = getCurrentPage().writeItem(stream->nsIndex, ItemType::BLOB_IDX, stream->key, item.data, sizeof(item.data));
+                if (err == ESP_ERR_NVS_PAGE_FULL) {
+                    err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+                }
+            }
+        }
+    }
+    if (err != ESP_OK) {
+        abortBlobWriter(stream);
+        return err;
+    }
+
+    delete[] stream->buffer;
+    stream->buffer = nullptr;
+    mBlobStreams.erase(stream);
+
+    /* Erase the blob with earlier version*/
+    VerOffset prevStart = (stream->chunkStart == VerOffset::VER_0_OFFSET) ? VerOffset::VER_1_OFFSET : VerOffset::VER_0_OFFSET;
+    err = eraseMultiPageBlob(stream->nsIndex, stream->key, prevStart);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        /* Support for earlier versions where BLOBS were stored without index */
+        Item item;
+        Page* findPage = nullptr;
+        err = findItem(stream->nsIndex, ItemType::BLOB, stream->key, findPage, item);
+        if (err == ESP_OK) {
+            err = findPage->eraseItem(stream->nsIndex, ItemType::BLOB, stream->key);
+        } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    }
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        return ESP_ERR_NVS_REMOVE_FAILED;
+    }
+    return err;
+}
+
+void Storage::abortBlobWriter(nvs_opaque_blob_stream_t* stream)
+{
+    /* Chunks which can't be erased now are orphans without index and get erased on the next init */
+    if (mState == StorageState::ACTIVE) {
+        for (uint8_t chunkNum = 0; chunkNum < stream->chunkCount; chunkNum++) {
+            uint8_t chunkIdx = static_cast<uint8_t> (stream->chunkStart) + chunkNum;
+            Item item;
+            Page* findPage = nullptr;
+            if (findItem(stream->nsIndex, ItemType::BLOB_DATA, stream->key, findPage, item, chunkIdx) == ESP_OK) {
+                findPage->eraseItem(stream->nsIndex, ItemType::BLOB_DATA, stream->key, chunkIdx);
+            }
+        }
+    }
+    stream->chunkCount = 0;
+    stream->size = 0;
+    stream->bufferUsed = 0;
+    delete[] stream->buffer;
+    stream->buffer = nullptr;
+    mBlobStreams.erase(stream);
+}
+
+bool Storage::hasBlobWriter(uint8_t nsIndex, const char* prefix, bool exactMatch)
+{
+    const size_t prefixLength = exactMatch ? Item::MAX_KEY_LENGTH + 1 : strlen(prefix);
+    for (auto it = mBlobStreams.begin(); it != mBlobStreams.end(); ++it) {
+        if (it->write && it->nsIndex == nsIndex && strncmp(it->key, prefix, prefixLength) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Storage::detachBlobStreams()
+{
+    while (!mBlobStreams.empty()) {
+        nvs_opaque_blob_stream_t* stream = &mBlobStreams.front();
+        if (stream->write) {
+            abortBlobWriter(stream);
+        } else {
+            closeBlobReader(stream);
+        }
+        stream->storage = nullptr;
+    }
+}
+
 esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key)
 {
     if (mState != StorageState::ACTIVE) {
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    if (hasBlobWriter(nsIndex, key, true)) {
+        return ESP_ERR_NVS_BLOB_STREAM_OPEN;
+    }
+
+    WriteTimer timer(mMaxWriteTime);
+    mValueCache.erase(nsIndex, key);
+
     if (datatype == ItemType::BLOB) {
         return eraseMultiPageBlob(nsIndex, key);
     }
@@ -619,6 +1035,13 @@ esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    if (hasBlobWriter(nsIndex, "", false)) {
+        return ESP_ERR_NVS_BLOB_STREAM_OPEN;
+    }
+
+    WriteTimer timer(mMaxWriteTime);
+    mValueCache.eraseNamespace(nsIndex);
+
     for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
         while (true) {
             auto err = it->eraseItem(nsIndex, ItemType::ANY, nullptr);
@@ -634,6 +1057,328 @@ esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
 
 }
 
+esp_err_t Storage::eraseItemsWithPrefix(uint8_t nsIndex, const char* prefix)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    if (hasBlobWriter(nsIndex, prefix, false)) {
+        return ESP_ERR_NVS_BLOB_STREAM_OPEN;
+    }
+
+    WriteTimer timer(mMaxWriteTime);
+    mValueCache.erasePrefix(nsIndex, prefix);
+
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        it->deferEntryStateWrites();
+    }
+
+    // blob chunks may be stored on other pages than their index, so blobs are erased after the scan
+    TBlobIndexList blobs;
+    esp_err_t err = ESP_OK;
+    for (auto it = mPageManager.begin(); it != mPageManager.end() && err == ESP_OK; ++it) {
+        size_t itemIndex = 0;
+        Item item;
+        while ((err = it->findItemWithPrefix(nsIndex, ItemType::ANY, prefix, itemIndex, item)) == ESP_OK) {
+            if (item.datatype == ItemType::BLOB_IDX) {
+                auto entry = new (std::nothrow) BlobIndexNode;
+                if (!entry) {
+                    err = ESP_ERR_NO_MEM;
+                    break;
+                }
+                item.getKey(entry->key, sizeof(entry->key));
+                entry->nsIndex = item.nsIndex;
+                entry->chunkStart = item.blobIndex.chunkStart;
+                blobs.push_back(entry);
+            } else if (item.datatype != ItemType::BLOB_DATA) {
+                err = it->eraseItemAt(itemIndex);
+                if (err != ESP_OK) {
+                    break;
+                }
+            }
+            itemIndex += item.span;
+        }
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    }
+
+    for (auto it = blobs.begin(); it != blobs.end() && err == ESP_OK; ++it) {
+        err = eraseMultiPageBlob(nsIndex, it->key, it->chunkStart);
+    }
+    blobs.clearAndFreeNodes();
+
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        esp_err_t flushErr = it->flushEntryStates();
+        if (err == ESP_OK) {
+            err = flushErr;
+        }
+    }
+    return err;
+}
+
+size_t Storage::getBatchOpEntryCount(const BatchOp& op)
+{
+    if (op.mDatatype == ItemType::ANY) {
+        // erase operations are recorded with a BATCH_ERASE item
+        return 1;
+    }
+    size_t count = 1;
+    if (isVariableLengthType(op.mDatatype)) {
+        count += (op.mDataSize + Page::ENTRY_SIZE - 1) / Page::ENTRY_SIZE;
+    }
+    if (op.mDatatype == ItemType::BLOB) {
+        // blob is stored as a single data chunk followed by blob index
+        ++count;
+    }
+    return count;
+}
+
+size_t Storage::getBatchEntryCount(TBatchList& ops)
+{
+    size_t count = 0;
+    for (auto it = ops.begin(); it != ops.end(); ++it) {
+        count += getBatchOpEntryCount(*it);
+    }
+    return count;
+}
+
+esp_err_t Storage::writeBatch(uint8_t nsIndex, TBatchList& ops)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    WriteTimer timer(mMaxWriteTime);
+    autoReclaim();
+
+    if (ops.empty()) {
+        return ESP_OK;
+    }
+
+    // checked before anything is written, so that the batch is either applied as a whole or kept pending
+    for (auto it = ops.begin(); it != ops.end(); ++it) {
+        if (hasBlobWriter(nsIndex, it->mKey, true)) {
+            return ESP_ERR_NVS_BLOB_STREAM_OPEN;
+        }
+    }
+
+    for (auto it = ops.begin(); it != ops.end(); ++it) {
+        mValueCache.erase(nsIndex, it->mKey);
+    }
+
+    std::unique_ptr<BatchOpState[]> states(new (std::nothrow) BatchOpState[ops.size()]);
+    if (!states) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err;
+    Item item;
+    Page* findPage;
+
+    // Same as in writeItem, values which are already stored are not written again,
+    // and keys which don't exist are not erased
+    size_t entryCount = 0;
+    size_t eraseCount = 0;
+    size_t i = 0;
+    for (auto it = ops.begin(); it != ops.end(); ++it, ++i) {
+        BatchOpState& state = states[i];
+        state.mSkip = true;
+        state.mOldPage = nullptr;
+        if (it->mDatatype == ItemType::ANY) {
+            findPage = nullptr;
+            err = findItem(nsIndex, ItemType::ANY, it->mKey, findPage, item);
+            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+                return err;
+            }
+            if (err == ESP_OK) {
+                state.mSkip = false;
+                ++eraseCount;
+            }
+            continue;
+        }
+        if (it->mDatatype == ItemType::BLOB) {
+            err = cmpMultiPageBlob(nsIndex, it->mKey, it->mData, it->mDataSize);
+        } else {
+            findPage = nullptr;
+            err = findItem(nsIndex, it->mDatatype, it->mKey, findPage, item);
+            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+                return err;
+            }
+            if (findPage != nullptr) {
+                err = findPage->cmpItem(nsIndex, it->mDatatype, it->mKey, it->mData, it->mDataSize);
+            }
+        }
+        if (err != ESP_OK) {
+            state.mSkip = false;
+            entryCount += getBatchOpEntryCount(*it);
+        }
+    }
+
+    if (entryCount == 0 && eraseCount == 0) {
+        return ESP_OK;
+    }
+
+    // The batch starts with a marker, followed by one BATCH_ERASE item for each erased key and the new values.
+    // The marker stays until the previous values and the erased keys are removed, so that PageManager::load
+    // can finish the batch if power goes off before that.
+    const size_t batchEntryCount = 1 + eraseCount + entryCount;
+
+    // all items of the batch have to be on the current page, so that they can be committed together
+    if (getCurrentPage().getFreeEntryCount() < batchEntryCount) {
+        Page& page = getCurrentPage();
+        if (page.state() != Page::PageState::FULL) {
+            err = page.markFull();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        err = mPageManager.requestNewPage();
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (getCurrentPage().getFreeEntryCount() < batchEntryCount) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+    }
+
+    // look up previous values only now, as requesting a new page may have moved them
+    i = 0;
+    for (auto it = ops.begin(); it != ops.end(); ++it, ++i) {
+        BatchOpState& state = states[i];
+        if (state.mSkip || it->mDatatype == ItemType::ANY) {
+            continue;
+        }
+        if (it->mDatatype == ItemType::BLOB) {
+            state.mOldDatatype = ItemType::BLOB_IDX;
+            state.mChunkStart = VerOffset::VER_0_OFFSET;
+            err = findItem(nsIndex, ItemType::BLOB_IDX, it->mKey, state.mOldPage, item);
+            if (err == ESP_OK) {
+                /* Toggle the version by changing the offset */
+                state.mChunkStart = (item.blobIndex.chunkStart == VerOffset::VER_1_OFFSET)
+                        ? VerOffset::VER_0_OFFSET : VerOffset::VER_1_OFFSET;
+            } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+                /* Support for earlier versions where BLOBS were stored without index */
+                state.mOldDatatype = ItemType::BLOB;
+                err = findItem(nsIndex, ItemType::BLOB, it->mKey, state.mOldPage, item);
+            }
+        } else {
+            state.mOldDatatype = it->mDatatype;
+            err = findItem(nsIndex, it->mDatatype, it->mKey, state.mOldPage, item);
+        }
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+
+    Page& page = getCurrentPage();
+    err = page.beginBatch();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    Item marker(Page::NS_ANY, ItemType::BATCH, 1, nullptr);
+    marker.batch.nsIndex = nsIndex;
+    marker.batch.eraseCount = eraseCount;
+    marker.batch.setEntries = entryCount;
+    const size_t markerIndex = page.getNextFreeEntry();
+    err = page.writeItem(Page::NS_ANY, ItemType::BATCH, "", marker.data, sizeof(marker.data));
+
+    i = 0;
+    for (auto it = ops.begin(); it != ops.end() && err == ESP_OK; ++it, ++i) {
+        if (!states[i].mSkip && it->mDatatype == ItemType::ANY) {
+            err = page.writeItem(Page::NS_ANY, ItemType::BATCH_ERASE, it->mKey, marker.data, sizeof(marker.data));
+        }
+    }
+    if (err != ESP_OK) {
+        page.abortBatch();
+        return err;
+    }
+
+    i = 0;
+    for (auto it = ops.begin(); it != ops.end(); ++it, ++i) {
+        const BatchOpState& state = states[i];
+        if (state.mSkip || it->mDatatype == ItemType::ANY) {
+            continue;
+        }
+        if (it->mDatatype == ItemType::BLOB) {
+            err = page.writeItem(nsIndex, ItemType::BLOB_DATA, it->mKey, it->mData, it->mDataSize,
+                    static_cast<uint8_t> (state.mChunkStart));
+            if (err == ESP_OK) {
+                Item index;
+                std::fill_n(index.data, sizeof(index.data), 0xff);
+                index.blobIndex.dataSize = it->mDataSize;
+                index.blobIndex.chunkCount = 1;
+                index.blobIndex.chunkStart = state.mChunkStart;
+                err = page.writeItem(nsIndex, ItemType::BLOB_IDX, it->mKey, index.data, sizeof(index.data));
+            }
+        } else {
+            err = page.writeItem(nsIndex, it->mDatatype, it->mKey, it->mData, it->mDataSize);
+        }
+        assert(err != ESP_ERR_NVS_PAGE_FULL);
+        if (err != ESP_OK) {
+            page.abortBatch();
+            return err;
+        }
+    }
+
+    err = page.commitBatch();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // New values and erased keys are committed, now remove the old values.
+    // If power goes off before this is finished, PageManager::load does it, using the batch marker.
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        it->deferEntryStateWrites();
+    }
+
+    i = 0;
+    err = ESP_OK;
+    for (auto it = ops.begin(); it != ops.end() && err == ESP_OK; ++it, ++i) {
+        const BatchOpState& state = states[i];
+        if (state.mSkip) {
+            continue;
+        }
+        if (it->mDatatype == ItemType::ANY) {
+            err = eraseItem(nsIndex, ItemType::ANY, it->mKey);
+            if (err == ESP_ERR_NVS_NOT_FOUND) {
+                err = ESP_OK;
+            }
+        } else if (state.mOldPage != nullptr) {
+            if (state.mOldDatatype == ItemType::BLOB_IDX) {
+                VerOffset prevStart = (state.mChunkStart == VerOffset::VER_1_OFFSET)
+                        ? VerOffset::VER_0_OFFSET : VerOffset::VER_1_OFFSET;
+                err = eraseMultiPageBlob(nsIndex, it->mKey, prevStart);
+            } else {
+                err = state.mOldPage->eraseItem(nsIndex, state.mOldDatatype, it->mKey);
+            }
+        }
+    }
+
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        esp_err_t flushErr = it->flushEntryStates();
+        if (err == ESP_OK) {
+            err = flushErr;
+        }
+    }
+    // the marker is erased only after the removal of old values is written to flash
+    if (err == ESP_OK) {
+        err = page.eraseBatchItems(markerIndex);
+    }
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        return ESP_ERR_NVS_REMOVE_FAILED;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
 esp_err_t Storage::getItemDataSize(uint8_t nsIndex, ItemType datatype, const char* key, size_t& dataSize)
 {
     if (mState != StorageState::ACTIVE) {
@@ -685,6 +1430,9 @@ void Storage::debugCheck()
                 assert(0);
             }
             keys.insert(std::make_pair(keystr, static_cast<Page*>(p)));
+            if (mPageManager.getItemIndex().isValid()) {
+                assert(mPageManager.getItemIndex().contains(item.calculateCrc32WithoutValue() & 0xffffff, static_cast<Page*>(p), itemIndex));
+            }
             itemIndex += item.span;
             usedCount += item.span;
         }
@@ -696,9 +1444,27 @@ void Storage::debugCheck()
 esp_err_t Storage::fillStats(nvs_stats_t& nvsStats)
 {
     nvsStats.namespace_count = mNamespaces.size();
+    nvsStats.max_write_time_us = mMaxWriteTime;
+    nvsStats.value_cache_hits = mValueCache.getHits();
+    nvsStats.value_cache_misses = mValueCache.getMisses();
     return mPageManager.fillStats(nvsStats);
 }
 
+esp_err_t Storage::setValueCacheEntries(size_t entries)
+{
+    mValueCacheEntries = entries;
+    return mValueCache.resize(entries);
+}
+
+esp_err_t Storage::reclaimStep(size_t maxEntries)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    return mPageManager.reclaimStep(maxEntries);
+}
+
 esp_err_t Storage::calcEntriesInNamespace(uint8_t nsIndex, size_t& usedEntries)
 {
     usedEntries = 0;
@@ -739,11 +1505,13 @@ void Storage::fillEntryInfo(Item &item, nvs_entry_info_t &info)
     }
 }
 
-bool Storage::findEntry(nvs_opaque_iterator_t* it, const char* namespace_name)
+bool Storage::findEntry(nvs_opaque_iterator_t* it, const char* namespace_name, const char* prefix)
 {
     it->entryIndex = 0;
     it->nsIndex = Page::NS_ANY;
     it->page = mPageManager.begin();
+    strncpy(it->prefix, prefix, sizeof(it->prefix) - 1);
+    it->prefix[sizeof(it->prefix) - 1] = 0;
 
     if (namespace_name != nullptr) {
         if(createOrOpenNamespace(namespace_name, false, it->nsIndex) != ESP_OK) {
@@ -758,7 +1526,8 @@ inline bool isIterableItem(Item& item)
 {
     return (item.nsIndex != 0 &&
             item.datatype != ItemType::BLOB &&
-            item.datatype != ItemType::BLOB_IDX);
+            item.datatype != ItemType::BLOB_IDX &&
+            !Page::isBatchItem(item));
 }
 
 inline bool isMultipageBlob(Item& item)
@@ -775,7 +1544,7 @@ bool Storage::nextEntry(nvs_opaque_iterator_t* it)
 
     for (auto page = it->page; page != mPageManager.end(); ++page) {
         do {
-            err = page->findItem(it->nsIndex, (ItemType)it->type, nullptr, it->entryIndex, item);
+            err = page->findItemWithPrefix(it->nsIndex, (ItemType)it->type, it->prefix, it->entryIndex, item);
             it->entryIndex += item.span;
             if(err == ESP_OK && isIterableItem(item) && !isMultipageBlob(item)) {
                 fillEntryInfo(item, it->entry_info);
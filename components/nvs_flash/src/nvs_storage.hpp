@@ -20,9 +20,40 @@
 #include "nvs_types.hpp"
 #include "nvs_page.hpp"
 #include "nvs_pagemanager.hpp"
+#include "nvs_value_cache.hpp"
+#include "nvs_platform.hpp"
+#include "sdkconfig.h"
+
+#define NVS_BLOB_STREAM_BUFFER_SIZE CONFIG_NVS_BLOB_STREAM_BUFFER_SIZE
 
 //extern void dumpBytes(const uint8_t* data, size_t count);
 
+namespace nvs
+{
+class Storage;
+}
+
+/**
+ * Blob streams are linked into a list of the storage while they are open. If the storage is
+ * deinitialized first, pending writes are aborted and storage is set to nullptr.
+ */
+struct nvs_opaque_blob_stream_t : public intrusive_list_node<nvs_opaque_blob_stream_t>
+{
+    nvs::Storage *storage;
+    uint8_t nsIndex;
+    char key[nvs::Item::MAX_KEY_LENGTH + 1];
+    bool write;
+    nvs::ItemType datatype;         // BLOB_DATA, or BLOB for blobs stored without index
+    nvs::VerOffset chunkStart;
+    uint8_t chunkCount;
+    size_t size;                    // size of the blob when reading, bytes written to flash when writing
+    uint8_t chunkNum;               // chunk containing the last read position
+    size_t chunkOffset;             // offset of that chunk within the blob
+    bool chunkVerified;             // whether the CRC of that chunk has been checked
+    uint8_t *buffer;                // NVS_BLOB_STREAM_BUFFER_SIZE bytes of data not yet written to flash
+    size_t bufferUsed;
+};
+
 namespace nvs
 {
 
@@ -57,7 +88,39 @@ class Storage : public intrusive_list_node<Storage>
 
     typedef intrusive_list<BlobIndexNode> TBlobIndexList;
 
+    typedef intrusive_list<nvs_opaque_blob_stream_t> TBlobStreamList;
+
+    struct BatchOpState {
+        bool mSkip;             // value is already stored, nothing to write
+        Page* mOldPage;         // page holding the previous value, if any
+        ItemType mOldDatatype;  // type of the previous item (BLOB_IDX for blobs with index)
+        VerOffset mChunkStart;  // version of a blob written by the batch
+    };
+
 public:
+    /**
+     * Set or erase operation buffered by a handle opened in NVS_READWRITE_BATCH mode.
+     * Erase operations have mDatatype set to ItemType::ANY and carry no data.
+     */
+    struct BatchOp : public intrusive_list_node<BatchOp> {
+    public:
+        BatchOp() : mData(nullptr), mDataSize(0)
+        {
+        }
+
+        ~BatchOp()
+        {
+            delete[] mData;
+        }
+
+        ItemType mDatatype;
+        char mKey[Item::MAX_KEY_LENGTH + 1];
+        uint8_t* mData;
+        size_t mDataSize;
+    };
+
+    typedef intrusive_list<BatchOp> TBatchList;
+
     ~Storage();
 
     Storage(const char *pName = NVS_DEFAULT_PART_NAME)
@@ -98,6 +161,28 @@ public:
 
     esp_err_t eraseNamespace(uint8_t nsIndex);
 
+    /**
+     * Erase all items of the namespace whose keys start with prefix. Pages are scanned once each, and
+     * the entry state table of each page is written once, after all matching items on it are erased.
+     */
+    esp_err_t eraseItemsWithPrefix(uint8_t nsIndex, const char* prefix);
+
+    /**
+     * Number of entries needed to store the value of a set operation.
+     */
+    static size_t getBatchOpEntryCount(const BatchOp& op);
+
+    /**
+     * Number of entries needed to store all set operations in the list.
+     */
+    static size_t getBatchEntryCount(TBatchList& ops);
+
+    /**
+     * Write all set operations of the list to the current page as one batch, which becomes valid atomically,
+     * then erase previous values of these keys and apply erase operations.
+     */
+    esp_err_t writeBatch(uint8_t nsIndex, TBatchList& ops);
+
     const char *getPartName() const
     {
         return mPartitionName;
@@ -115,15 +200,81 @@ public:
 
     esp_err_t eraseMultiPageBlob(uint8_t nsIndex, const char* key, VerOffset chunkStart = VerOffset::VER_ANY);
 
+    /**
+     * Open a blob for reading in parts. Fills in the stream, including the size of the blob.
+     */
+    esp_err_t openBlobReader(nvs_opaque_blob_stream_t* stream, uint8_t nsIndex, const char* key);
+
+    /**
+     * Read dataSize bytes of a blob opened by openBlobReader, starting at offset.
+     * Only the chunks overlapping the requested range are read; the CRC of a chunk is checked on its first access.
+     */
+    esp_err_t readBlobStream(nvs_opaque_blob_stream_t* stream, size_t offset, void* data, size_t dataSize);
+
+    /**
+     * Forget a stream opened by openBlobReader.
+     */
+    void closeBlobReader(nvs_opaque_blob_stream_t* stream);
+
+    /**
+     * Start writing a new version of a blob in parts. The previous value of the key stays valid until
+     * closeBlobWriter writes the blob index. Until then, other changes of the key fail with
+     * ESP_ERR_NVS_BLOB_STREAM_OPEN, as they would use the same version of the chunks.
+     */
+    esp_err_t openBlobWriter(nvs_opaque_blob_stream_t* stream, uint8_t nsIndex, const char* key);
+
+    /**
+     * Append data to a blob opened by openBlobWriter. Data is collected in the stream buffer and written
+     * as BLOB_DATA chunks whenever the buffer fills up.
+     */
+    esp_err_t writeBlobStream(nvs_opaque_blob_stream_t* stream, const void* data, size_t dataSize);
+
+    /**
+     * Write the remaining data and the blob index, then erase the previous version of the blob.
+     * If anything fails, the stream is aborted.
+     */
+    esp_err_t closeBlobWriter(nvs_opaque_blob_stream_t* stream);
+
+    /**
+     * Erase the chunks written by the stream so far and release its buffer.
+     */
+    void abortBlobWriter(nvs_opaque_blob_stream_t* stream);
+
     void debugDump();
 
     void debugCheck();
 
     esp_err_t fillStats(nvs_stats_t& nvsStats);
 
+    /**
+     * Move up to maxEntries entries of items to reclaim the space of erased entries ahead of time,
+     * see PageManager::reclaimStep.
+     */
+    esp_err_t reclaimStep(size_t maxEntries);
+
+    /**
+     * Number of integer values kept in RAM after they are read, 0 to always read values from flash.
+     * Resets the cache and its hit and miss counters. Defaults to CONFIG_NVS_VALUE_CACHE_ENTRIES.
+     */
+    esp_err_t setValueCacheEntries(size_t entries);
+
+    /**
+     * Write a summary of full pages which lets the next init skip reading their items, see PageManager::writeSummary.
+     */
+    esp_err_t writeSummary();
+
+    /**
+     * Number of entries moved by reclaimStep before each write operation, 0 to reclaim space only
+     * when a new page is needed. Defaults to CONFIG_NVS_INCREMENTAL_GC_ENTRIES.
+     */
+    void setAutoReclaimEntries(size_t entries)
+    {
+        mAutoReclaimEntries = entries;
+    }
+
     esp_err_t calcEntriesInNamespace(uint8_t nsIndex, size_t& usedEntries);
 
-    bool findEntry(nvs_opaque_iterator_t*, const char* name);
+    bool findEntry(nvs_opaque_iterator_t*, const char* name, const char* prefix = "");
 
     bool nextEntry(nvs_opaque_iterator_t* it);
 
@@ -136,7 +287,7 @@ protected:
 
     void clearNamespaces();
 
-    esp_err_t populateBlobIndices(TBlobIndexList&);
+    esp_err_t loadNamespacesAndBlobIndices(TBlobIndexList&);
 
     void eraseOrphanDataBlobs(TBlobIndexList&);
 
@@ -144,6 +295,52 @@ protected:
 
     esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, uint8_t chunkIdx = Page::CHUNK_ANY, VerOffset chunkStart = VerOffset::VER_ANY);
 
+    esp_err_t writeBlobStreamChunk(nvs_opaque_blob_stream_t* stream, const uint8_t* data, size_t dataSize, size_t& written);
+
+    esp_err_t flushBlobStream(nvs_opaque_blob_stream_t* stream);
+
+    /**
+     * Whether a blob stream opened by openBlobWriter for a key of the namespace which starts with prefix
+     * is still open. With exactMatch set, the key has to be equal to prefix.
+     */
+    bool hasBlobWriter(uint8_t nsIndex, const char* prefix, bool exactMatch);
+
+    /**
+     * Abort the writers which are still open and detach all streams from the storage.
+     */
+    void detachBlobStreams();
+
+    void autoReclaim()
+    {
+        if (mAutoReclaimEntries > 0) {
+            // errors are reported by the write operation itself
+            mPageManager.reclaimStep(mAutoReclaimEntries);
+        }
+    }
+
+    /**
+     * Records the time between its construction and destruction in mMaxWriteTime, if it is the longest so far.
+     */
+    class WriteTimer
+    {
+    public:
+        WriteTimer(uint32_t& maxTime) : mMaxTime(maxTime), mStart(esp_timer_get_time())
+        {
+        }
+
+        ~WriteTimer()
+        {
+            uint32_t elapsed = static_cast<uint32_t>(esp_timer_get_time() - mStart);
+            if (elapsed > mMaxTime) {
+                mMaxTime = elapsed;
+            }
+        }
+
+    protected:
+        uint32_t& mMaxTime;
+        int64_t mStart;
+    };
+
 protected:
     char mPartitionName [NVS_PART_NAME_MAX_SIZE + 1];
     size_t mPageCount;
@@ -151,6 +348,11 @@ protected:
     TNamespaces mNamespaces;
     CompressedEnumTable<bool, 1, 256> mNamespaceUsage;
     StorageState mState = StorageState::INVALID;
+    size_t mAutoReclaimEntries = CONFIG_NVS_INCREMENTAL_GC_ENTRIES;
+    uint32_t mMaxWriteTime = 0;
+    ValueCache mValueCache;
+    size_t mValueCacheEntries = CONFIG_NVS_VALUE_CACHE_ENTRIES;
+    TBlobStreamList mBlobStreams;
 };
 
 } // namespace nvs
@@ -163,6 +365,7 @@ struct nvs_opaque_iterator_t
     nvs::Storage *storage;
     intrusive_list<nvs::Page>::iterator page;
     nvs_entry_info_t entry_info;
+    char prefix[nvs::Item::MAX_KEY_LENGTH + 1];
 };
 
 #endif /* nvs_storage_hpp */
@@ -12,42 +12,36 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "nvs_types.hpp"
-
-#if defined(ESP_PLATFORM)
-#include <esp32/rom/crc.h>
-#else
-#include "crc.h"
-#endif
+#include "nvs_crc.hpp"
 
 namespace nvs
 {
 uint32_t Item::calculateCrc32() const
 {
-    uint32_t result = 0xffffffff;
-    const uint8_t* p = reinterpret_cast<const uint8_t*>(this);
-    result = crc32_le(result, p + offsetof(Item, nsIndex),
-                      offsetof(Item, crc32) - offsetof(Item, nsIndex));
-    result = crc32_le(result, p + offsetof(Item, key), sizeof(key));
-    result = crc32_le(result, p + offsetof(Item, data), sizeof(data));
-    return result;
+    // gather the covered fields, so that the CRC is computed in one pass over 28 bytes
+    uint8_t buf[offsetof(Item, crc32) + sizeof(key) + sizeof(data)];
+    memcpy(buf, rawData, offsetof(Item, crc32));
+    memcpy(buf + offsetof(Item, crc32), rawData + offsetof(Item, key), sizeof(key) + sizeof(data));
+    return nvs_crc32_le(0xffffffff, buf, sizeof(buf));
 }
 
 uint32_t Item::calculateCrc32WithoutValue() const
 {
-    uint32_t result = 0xffffffff;
-    const uint8_t* p = reinterpret_cast<const uint8_t*>(this);
-    result = crc32_le(result, p + offsetof(Item, nsIndex),
-                      offsetof(Item, datatype) - offsetof(Item, nsIndex));
-    result = crc32_le(result, p + offsetof(Item, key), sizeof(key));
-    result = crc32_le(result, p + offsetof(Item, chunkIndex), sizeof(chunkIndex));
-    return result;
+    uint8_t buf[sizeof(nsIndex) + sizeof(key) + sizeof(chunkIndex)];
+    buf[0] = nsIndex;
+    memcpy(buf + sizeof(nsIndex), key, sizeof(key));
+    buf[sizeof(nsIndex) + sizeof(key)] = chunkIndex;
+    return nvs_crc32_le(0xffffffff, buf, sizeof(buf));
 }
 
 uint32_t Item::calculateCrc32(const uint8_t* data, size_t size)
 {
-    uint32_t result = 0xffffffff;
-    result = crc32_le(result, data, size);
-    return result;
+    return nvs_crc32_le(0xffffffff, data, size);
+}
+
+uint32_t Item::calculateCrc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+    return nvs_crc32_le(crc, data, size);
 }
 
 } // namespace nvs
@@ -70,6 +70,12 @@ public:
                     VerOffset  chunkStart; // Offset from which the chunkIndex for children blobs starts
                     uint16_t   reserved;
                 } blobIndex;
+                struct {
+                    uint8_t  nsIndex;    // namespace of the batch
+                    uint8_t  eraseCount; // number of BATCH_ERASE items following the marker
+                    uint16_t setEntries; // number of entries of new values following the erase items
+                    uint32_t reserved;
+                } batch;
                 uint8_t data[8];
             };
         };
@@ -102,6 +108,7 @@ public:
     uint32_t calculateCrc32() const;
     uint32_t calculateCrc32WithoutValue() const;
     static uint32_t calculateCrc32(const uint8_t* data, size_t size);
+    static uint32_t calculateCrc32(uint32_t crc, const uint8_t* data, size_t size);
 
     void getKey(char* dst, size_t dstSize)
     {
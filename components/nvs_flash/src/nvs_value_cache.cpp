@@ -0,0 +1,187 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "nvs_value_cache.hpp"
+#include <new>
+#include <cstring>
+#include <algorithm>
+
+namespace nvs
+{
+
+ValueCache::ValueCache()
+{
+}
+
+ValueCache::~ValueCache()
+{
+    resize(0);
+}
+
+esp_err_t ValueCache::resize(size_t entries)
+{
+    mUsed.clear();
+    mFree.clear();
+    delete[] mNodes;
+    delete[] mBuckets;
+    mNodes = nullptr;
+    mBuckets = nullptr;
+    mEntryCount = 0;
+    mBucketCount = 0;
+    mHits = 0;
+    mMisses = 0;
+
+    if (entries == 0) {
+        return ESP_OK;
+    }
+
+    size_t bucketCount = 1;
+    while (bucketCount < entries) {
+        bucketCount <<= 1;
+    }
+
+    mNodes = new (std::nothrow) Node[entries];
+    mBuckets = new (std::nothrow) Node*[bucketCount];
+    if (!mNodes || !mBuckets) {
+        delete[] mNodes;
+        delete[] mBuckets;
+        mNodes = nullptr;
+        mBuckets = nullptr;
+        return ESP_ERR_NO_MEM;
+    }
+    std::fill_n(mBuckets, bucketCount, nullptr);
+    for (size_t i = 0; i < entries; ++i) {
+        mFree.push_back(&mNodes[i]);
+    }
+    mEntryCount = entries;
+    mBucketCount = bucketCount;
+    return ESP_OK;
+}
+
+uint32_t ValueCache::hash(uint8_t nsIndex, const char* key)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u ^ nsIndex;
+    h *= 16777619u;
+    for (size_t i = 0; i < Item::MAX_KEY_LENGTH && key[i] != 0; ++i) {
+        h ^= static_cast<uint8_t>(key[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool ValueCache::find(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize)
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    for (Node* node = bucket(nsIndex, key); node != nullptr; node = node->mNextInBucket) {
+        if (node->mNsIndex == nsIndex && node->mDatatype == datatype && node->mDataSize == dataSize
+                && strncmp(node->mKey, key, Item::MAX_KEY_LENGTH) == 0) {
+            memcpy(data, node->mData, dataSize);
+            mUsed.erase(node);
+            mUsed.push_front(node);
+            ++mHits;
+            return true;
+        }
+    }
+    ++mMisses;
+    return false;
+}
+
+void ValueCache::insert(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    if (!isEnabled() || !isCacheable(datatype, dataSize)) {
+        return;
+    }
+
+    erase(nsIndex, key);
+    if (mFree.empty()) {
+        remove(&mUsed.back());
+    }
+
+    Node* node = &mFree.front();
+    mFree.pop_front();
+    node->mNsIndex = nsIndex;
+    node->mDatatype = datatype;
+    node->mDataSize = static_cast<uint8_t>(dataSize);
+    strncpy(node->mKey, key, Item::MAX_KEY_LENGTH);
+    node->mKey[Item::MAX_KEY_LENGTH] = 0;
+    memcpy(node->mData, data, dataSize);
+
+    Node*& head = bucket(nsIndex, key);
+    node->mNextInBucket = head;
+    head = node;
+    mUsed.push_front(node);
+}
+
+void ValueCache::remove(Node* node)
+{
+    for (Node** link = &bucket(node->mNsIndex, node->mKey); *link != nullptr; link = &(*link)->mNextInBucket) {
+        if (*link == node) {
+            *link = node->mNextInBucket;
+            break;
+        }
+    }
+    mUsed.erase(node);
+    mFree.push_back(node);
+}
+
+void ValueCache::erase(uint8_t nsIndex, const char* key)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    Node* node = bucket(nsIndex, key);
+    while (node != nullptr) {
+        Node* next = node->mNextInBucket;
+        if (node->mNsIndex == nsIndex && strncmp(node->mKey, key, Item::MAX_KEY_LENGTH) == 0) {
+            remove(node);
+        }
+        node = next;
+    }
+}
+
+void ValueCache::eraseNamespace(uint8_t nsIndex)
+{
+    for (auto it = mUsed.begin(); it != mUsed.end(); ) {
+        Node* node = it++;
+        if (node->mNsIndex == nsIndex) {
+            remove(node);
+        }
+    }
+}
+
+void ValueCache::erasePrefix(uint8_t nsIndex, const char* prefix)
+{
+    size_t prefixLen = strnlen(prefix, Item::MAX_KEY_LENGTH);
+    for (auto it = mUsed.begin(); it != mUsed.end(); ) {
+        Node* node = it++;
+        if (node->mNsIndex == nsIndex && strncmp(node->mKey, prefix, prefixLen) == 0) {
+            remove(node);
+        }
+    }
+}
+
+void ValueCache::clear()
+{
+    while (!mUsed.empty()) {
+        remove(&mUsed.front());
+    }
+}
+
+} // namespace nvs
@@ -0,0 +1,129 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef nvs_value_cache_hpp
+#define nvs_value_cache_hpp
+
+#include "nvs.h"
+#include "nvs_types.hpp"
+#include "intrusive_list.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace nvs
+{
+
+/**
+ * Cache of recently read values of fixed size items (integers), keyed by namespace index, key and type.
+ *
+ * Holds up to a configured number of values, replacing the least recently used one when it is full.
+ * Nodes are allocated once, when the size is set. Storage removes a key from the cache before it writes or erases it.
+ */
+class ValueCache
+{
+public:
+    static const size_t MAX_VALUE_SIZE = 8;
+
+    ValueCache();
+    ~ValueCache();
+
+    /**
+     * Drop all values and allocate room for the given number of values, 0 to disable the cache.
+     */
+    esp_err_t resize(size_t entries);
+
+    size_t size() const
+    {
+        return mEntryCount;
+    }
+
+    bool isEnabled() const
+    {
+        return mEntryCount > 0;
+    }
+
+    static bool isCacheable(ItemType datatype, size_t dataSize)
+    {
+        return !isVariableLengthType(datatype) && datatype != ItemType::ANY && dataSize <= MAX_VALUE_SIZE;
+    }
+
+    /**
+     * Copy the cached value to data. Returns false if the value is not cached.
+     */
+    bool find(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize);
+
+    void insert(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize);
+
+    /**
+     * Remove the key from the cache, whatever its type.
+     */
+    void erase(uint8_t nsIndex, const char* key);
+
+    void eraseNamespace(uint8_t nsIndex);
+
+    /**
+     * Remove all keys of the namespace which start with prefix.
+     */
+    void erasePrefix(uint8_t nsIndex, const char* prefix);
+
+    void clear();
+
+    uint32_t getHits() const
+    {
+        return mHits;
+    }
+
+    uint32_t getMisses() const
+    {
+        return mMisses;
+    }
+
+private:
+    ValueCache(const ValueCache& other);
+    const ValueCache& operator= (const ValueCache& rhs);
+
+protected:
+    struct Node : public intrusive_list_node<Node> {
+        Node* mNextInBucket;
+        uint8_t mNsIndex;
+        ItemType mDatatype;
+        uint8_t mDataSize;
+        char mKey[Item::MAX_KEY_LENGTH + 1];
+        uint8_t mData[MAX_VALUE_SIZE];
+    };
+
+    typedef intrusive_list<Node> TNodeList;
+
+    static uint32_t hash(uint8_t nsIndex, const char* key);
+
+    Node*& bucket(uint8_t nsIndex, const char* key) const
+    {
+        return mBuckets[hash(nsIndex, key) & (mBucketCount - 1)];
+    }
+
+    void remove(Node* node);
+
+    Node* mNodes = nullptr;
+    Node** mBuckets = nullptr;
+    size_t mEntryCount = 0;
+    size_t mBucketCount = 0;
+    TNodeList mUsed;  // most recently used first
+    TNodeList mFree;
+    uint32_t mHits = 0;
+    uint32_t mMisses = 0;
+}; // class ValueCache
+
+} // namespace nvs
+
+#endif /* nvs_value_cache_hpp */
@@ -0,0 +1,127 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "heap_tracker.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// every block starts with a header holding its size, padded to keep the payload aligned
+union BlockHeader {
+    size_t size;
+    std::max_align_t align;
+};
+
+size_t s_current_bytes = 0;
+size_t s_peak_bytes = 0;
+size_t s_current_blocks = 0;
+size_t s_alloc_count = 0;
+
+void* tracked_alloc(size_t size)
+{
+    BlockHeader* header = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + size));
+    if (header == nullptr) {
+        return nullptr;
+    }
+    header->size = size;
+    s_current_bytes += size;
+    ++s_current_blocks;
+    ++s_alloc_count;
+    if (s_current_bytes > s_peak_bytes) {
+        s_peak_bytes = s_current_bytes;
+    }
+    return header + 1;
+}
+
+void tracked_free(void* ptr)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+    BlockHeader* header = static_cast<BlockHeader*>(ptr) - 1;
+    s_current_bytes -= header->size;
+    --s_current_blocks;
+    free(header);
+}
+
+} // namespace
+
+size_t heap_tracker_current_bytes()
+{
+    return s_current_bytes;
+}
+
+size_t heap_tracker_peak_bytes()
+{
+    return s_peak_bytes;
+}
+
+size_t heap_tracker_current_blocks()
+{
+    return s_current_blocks;
+}
+
+size_t heap_tracker_alloc_count()
+{
+    return s_alloc_count;
+}
+
+void heap_tracker_reset_peak()
+{
+    s_peak_bytes = s_current_bytes;
+}
+
+void* operator new(size_t size)
+{
+    void* ptr = tracked_alloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return tracked_alloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return tracked_alloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    tracked_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    tracked_free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    tracked_free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    tracked_free(ptr);
+}
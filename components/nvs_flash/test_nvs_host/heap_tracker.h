@@ -0,0 +1,40 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef heap_tracker_h
+#define heap_tracker_h
+
+#include <cstddef>
+
+/**
+ * Host tests replace the global operator new and delete to keep track of
+ * memory allocated through them, so that the heap usage of NVS operations
+ * can be measured. Allocations made with malloc are not counted.
+ */
+
+/** Number of bytes currently allocated */
+size_t heap_tracker_current_bytes();
+
+/** Highest number of bytes allocated at once since the last reset */
+size_t heap_tracker_peak_bytes();
+
+/** Number of blocks currently allocated */
+size_t heap_tracker_current_blocks();
+
+/** Number of allocations made since start */
+size_t heap_tracker_alloc_count();
+
+/** Restart peak tracking from the current usage */
+void heap_tracker_reset_peak();
+
+#endif /* heap_tracker_h */
@@ -0,0 +1,457 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "nvs_workload.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "nvs_test_api.h"
+#include "spi_flash_emulation.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <random>
+
+namespace
+{
+
+const char* PARTITION_NAME = "workload";
+const char* NAMESPACE_NAME = "workload";
+
+enum class KeyKind {
+    INTEGER,
+    STRING,
+    BLOB,
+};
+
+struct KeyState {
+    char key[16];
+    KeyKind kind;
+    size_t size;                // integer width, string length including the terminator, or blob size
+    std::vector<uint8_t> value; // last value written
+};
+
+bool parse_size(const char* value, size_t& out)
+{
+    char* end;
+    unsigned long result = strtoul(value, &end, 10);
+    if (end == value || *end != 0) {
+        return false;
+    }
+    out = result;
+    return true;
+}
+
+bool parse_range(const char* value, size_t& min, size_t& max)
+{
+    const char* dash = strchr(value, '-');
+    if (dash == nullptr) {
+        if (!parse_size(value, min)) {
+            return false;
+        }
+        max = min;
+        return true;
+    }
+    std::string first(value, dash);
+    return parse_size(first.c_str(), min) && parse_size(dash + 1, max) && min <= max;
+}
+
+bool parse_double(const char* value, double& out)
+{
+    char* end;
+    double result = strtod(value, &end);
+    if (end == value || *end != 0 || result < 0) {
+        return false;
+    }
+    out = result;
+    return true;
+}
+
+bool parse_percent(const char* value, unsigned& out)
+{
+    size_t result;
+    if (!parse_size(value, result) || result > 100) {
+        return false;
+    }
+    out = static_cast<unsigned>(result);
+    return true;
+}
+
+size_t integer_width(size_t size)
+{
+    if (size <= 1) {
+        return 1;
+    } else if (size <= 2) {
+        return 2;
+    } else if (size <= 4) {
+        return 4;
+    }
+    return 8;
+}
+
+void fill_value(KeyState& state, std::mt19937& gen)
+{
+    state.value.resize(state.size);
+    for (auto& byte : state.value) {
+        byte = static_cast<uint8_t>(gen());
+    }
+    if (state.kind == KeyKind::STRING) {
+        for (auto& byte : state.value) {
+            byte = 'a' + byte % 26;
+        }
+        state.value.back() = 0;
+    }
+}
+
+esp_err_t write_value(nvs_handle_t handle, const KeyState& state)
+{
+    switch (state.kind) {
+    case KeyKind::INTEGER: {
+        uint64_t value = 0;
+        memcpy(&value, state.value.data(), state.size);
+        switch (state.size) {
+        case 1:
+            return nvs_set_u8(handle, state.key, static_cast<uint8_t>(value));
+        case 2:
+            return nvs_set_u16(handle, state.key, static_cast<uint16_t>(value));
+        case 4:
+            return nvs_set_u32(handle, state.key, static_cast<uint32_t>(value));
+        default:
+            return nvs_set_u64(handle, state.key, value);
+        }
+    }
+    case KeyKind::STRING:
+        return nvs_set_str(handle, state.key, reinterpret_cast<const char*>(state.value.data()));
+    case KeyKind::BLOB:
+        return nvs_set_blob(handle, state.key, state.value.data(), state.size);
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t read_value(nvs_handle_t handle, const KeyState& state, std::vector<uint8_t>& out)
+{
+    out.resize(state.size);
+    size_t size = state.size;
+    esp_err_t err;
+    switch (state.kind) {
+    case KeyKind::INTEGER: {
+        uint64_t value = 0;
+        switch (state.size) {
+        case 1:
+            err = nvs_get_u8(handle, state.key, reinterpret_cast<uint8_t*>(&value));
+            break;
+        case 2:
+            err = nvs_get_u16(handle, state.key, reinterpret_cast<uint16_t*>(&value));
+            break;
+        case 4:
+            err = nvs_get_u32(handle, state.key, reinterpret_cast<uint32_t*>(&value));
+            break;
+        default:
+            err = nvs_get_u64(handle, state.key, &value);
+            break;
+        }
+        memcpy(out.data(), &value, state.size);
+        return err;
+    }
+    case KeyKind::STRING:
+        err = nvs_get_str(handle, state.key, reinterpret_cast<char*>(out.data()), &size);
+        break;
+    case KeyKind::BLOB:
+        err = nvs_get_blob(handle, state.key, out.data(), &size);
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (err == ESP_OK && size != state.size) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    return err;
+}
+
+/* Cumulative probabilities of picking the key with each popularity rank */
+std::vector<double> zipf_distribution(size_t count, double skew)
+{
+    std::vector<double> cdf(count);
+    double sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += 1.0 / pow(static_cast<double>(i + 1), skew);
+        cdf[i] = sum;
+    }
+    for (auto& p : cdf) {
+        p /= sum;
+    }
+    return cdf;
+}
+
+esp_err_t verify_values(const std::vector<KeyState>& keys)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open_from_partition(PARTITION_NAME, NAMESPACE_NAME, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    std::vector<uint8_t> value;
+    for (const auto& state : keys) {
+        err = read_value(handle, state, value);
+        if (err == ESP_OK && value != state.value) {
+            err = ESP_ERR_INVALID_STATE;
+        }
+        if (err != ESP_OK) {
+            break;
+        }
+    }
+    nvs_close(handle);
+    return err;
+}
+
+} // namespace
+
+esp_err_t WorkloadConfig::parse(const char* spec)
+{
+    std::string list(spec);
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t next = list.find(',', pos);
+        if (next == std::string::npos) {
+            next = list.size();
+        }
+        std::string setting = list.substr(pos, next - pos);
+        pos = next + 1;
+        if (setting.empty()) {
+            continue;
+        }
+        size_t eq = setting.find('=');
+        if (eq == std::string::npos) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        std::string name = setting.substr(0, eq);
+        const char* value = setting.c_str() + eq + 1;
+        size_t number;
+        bool ok;
+        if (name == "name") {
+            this->name = value;
+            ok = true;
+        } else if (name == "sectors") {
+            ok = parse_size(value, sectors) && sectors >= 3;
+        } else if (name == "keys") {
+            ok = parse_size(value, keyCount) && keyCount > 0;
+        } else if (name == "value_size") {
+            ok = parse_range(value, minValueSize, maxValueSize) && minValueSize > 0;
+        } else if (name == "blob_percent") {
+            ok = parse_percent(value, blobPercent);
+        } else if (name == "blob_size") {
+            ok = parse_range(value, minBlobSize, maxBlobSize) && minBlobSize > 0;
+        } else if (name == "skew") {
+            ok = parse_double(value, skew);
+        } else if (name == "read_percent") {
+            ok = parse_percent(value, readPercent);
+        } else if (name == "ops") {
+            ok = parse_size(value, operations);
+        } else if (name == "seed") {
+            ok = parse_size(value, number);
+            seed = static_cast<uint32_t>(number);
+        } else if (name == "endurance") {
+            ok = parse_size(value, enduranceCycles) && enduranceCycles > 0;
+        } else if (name == "writes_per_hour") {
+            ok = parse_double(value, writesPerHour) && writesPerHour > 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return ESP_OK;
+}
+
+double WorkloadResult::getOpsPerSecond() const
+{
+    return flashTime ? operations * 1e6 / flashTime : 0;
+}
+
+double WorkloadResult::getHostOpsPerSecond() const
+{
+    return hostTime > 0 ? operations / hostTime : 0;
+}
+
+double WorkloadResult::getWriteAmplification() const
+{
+    return logicalBytes ? static_cast<double>(flashBytesWritten) / logicalBytes : 0;
+}
+
+size_t WorkloadResult::getMinSectorErases() const
+{
+    return sectorErases.empty() ? 0 : *std::min_element(sectorErases.begin(), sectorErases.end());
+}
+
+size_t WorkloadResult::getMaxSectorErases() const
+{
+    return sectorErases.empty() ? 0 : *std::max_element(sectorErases.begin(), sectorErases.end());
+}
+
+double WorkloadResult::getMeanSectorErases() const
+{
+    if (sectorErases.empty()) {
+        return 0;
+    }
+    size_t sum = 0;
+    for (auto count : sectorErases) {
+        sum += count;
+    }
+    return static_cast<double>(sum) / sectorErases.size();
+}
+
+double WorkloadResult::getProjectedWrites(const WorkloadConfig& config) const
+{
+    size_t maxErases = getMaxSectorErases();
+    if (maxErases == 0) {
+        return 0;
+    }
+    return static_cast<double>(config.enduranceCycles) * writes / maxErases;
+}
+
+double WorkloadResult::getProjectedYears(const WorkloadConfig& config) const
+{
+    return getProjectedWrites(config) / config.writesPerHour / (24 * 365);
+}
+
+void WorkloadResult::print(const WorkloadConfig& config, std::ostream& out) const
+{
+    out << "Workload \"" << config.name << "\": " << config.sectors << " sectors, " << config.keyCount << " keys, "
+        << "values " << config.minValueSize << "-" << config.maxValueSize << " B, "
+        << config.blobPercent << "% blobs of " << config.minBlobSize << "-" << config.maxBlobSize << " B, "
+        << "skew " << config.skew << ", " << config.readPercent << "% reads" << std::endl;
+    out << "  " << operations << " ops (" << writes << " writes): "
+        << std::fixed << std::setprecision(0) << getOpsPerSecond() << " ops/s of flash time, "
+        << getHostOpsPerSecond() << " ops/s on host" << std::endl;
+    out << "  " << flashBytesWritten << " bytes written to flash for " << logicalBytes << " bytes of values ("
+        << std::setprecision(2) << getWriteAmplification() << " per logical byte), "
+        << flashWriteOps << " writes, " << flashReadOps << " reads, " << eraseOps << " erases" << std::endl;
+    out << "  erases per sector: min " << getMinSectorErases() << ", max " << getMaxSectorErases()
+        << ", mean " << getMeanSectorErases() << " [";
+    for (size_t i = 0; i < sectorErases.size(); ++i) {
+        out << (i ? " " : "") << sectorErases[i];
+    }
+    out << "]" << std::endl;
+    if (getMaxSectorErases() == 0) {
+        out << "  projected lifetime: no sector was erased" << std::endl;
+    } else {
+        out << "  projected lifetime at " << config.enduranceCycles << " erase cycles: "
+            << std::setprecision(3) << std::scientific << getProjectedWrites(config) << " writes, "
+            << std::fixed << std::setprecision(1) << getProjectedYears(config) << " years at "
+            << config.writesPerHour << " writes per hour" << std::endl;
+    }
+    out << std::defaultfloat << std::setprecision(6);
+}
+
+esp_err_t workload_run(SpiFlashEmulator& emu, const WorkloadConfig& config, WorkloadResult& result)
+{
+    if (emu.size() < config.sectors * SPI_FLASH_SEC_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    result = WorkloadResult();
+
+    std::mt19937 gen(config.seed);
+    std::vector<KeyState> keys(config.keyCount);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto& state = keys[i];
+        snprintf(state.key, sizeof(state.key), "key%u", static_cast<unsigned>(i));
+        if (gen() % 100 < config.blobPercent) {
+            state.kind = KeyKind::BLOB;
+            state.size = config.minBlobSize + gen() % (config.maxBlobSize - config.minBlobSize + 1);
+        } else {
+            size_t size = config.minValueSize + gen() % (config.maxValueSize - config.minValueSize + 1);
+            state.kind = (size > sizeof(uint64_t)) ? KeyKind::STRING : KeyKind::INTEGER;
+            state.size = (size > sizeof(uint64_t)) ? size : integer_width(size);
+        }
+    }
+    // popularity ranks are shuffled, so that hot keys are spread over the partition
+    std::vector<size_t> ranks(keys.size());
+    for (size_t i = 0; i < ranks.size(); ++i) {
+        ranks[i] = i;
+    }
+    std::shuffle(ranks.begin(), ranks.end(), gen);
+    auto cdf = zipf_distribution(keys.size(), config.skew);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    esp_err_t err = nvs_flash_init_custom(PARTITION_NAME, 0, config.sectors);
+    if (err != ESP_OK) {
+        return err;
+    }
+    nvs_handle_t handle;
+    err = nvs_open_from_partition(PARTITION_NAME, NAMESPACE_NAME, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        nvs_flash_deinit_partition(PARTITION_NAME);
+        return err;
+    }
+    for (auto& state : keys) {
+        fill_value(state, gen);
+        err = write_value(handle, state);
+        if (err != ESP_OK) {
+            break;
+        }
+    }
+
+    std::vector<size_t> erasesBefore(config.sectors);
+    for (size_t i = 0; i < config.sectors; ++i) {
+        erasesBefore[i] = emu.getSectorEraseCount(i);
+    }
+    emu.clearStats();
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<uint8_t> value;
+    for (size_t i = 0; i < config.operations && err == ESP_OK; ++i) {
+        size_t rank = std::lower_bound(cdf.begin(), cdf.end(), uniform(gen)) - cdf.begin();
+        auto& state = keys[ranks[std::min(rank, ranks.size() - 1)]];
+        if (gen() % 100 < config.readPercent) {
+            err = read_value(handle, state, value);
+        } else {
+            fill_value(state, gen);
+            err = write_value(handle, state);
+            ++result.writes;
+            result.logicalBytes += state.size;
+        }
+        ++result.operations;
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+
+    result.hostTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.flashBytesWritten = emu.getWriteBytes();
+    result.flashReadOps = emu.getReadOps();
+    result.flashWriteOps = emu.getWriteOps();
+    result.eraseOps = emu.getEraseOps();
+    result.flashTime = emu.getTotalTime();
+    result.sectorErases.resize(config.sectors);
+    for (size_t i = 0; i < config.sectors; ++i) {
+        result.sectorErases[i] = emu.getSectorEraseCount(i) - erasesBefore[i];
+    }
+
+    nvs_close(handle);
+    nvs_flash_deinit_partition(PARTITION_NAME);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_flash_init_custom(PARTITION_NAME, 0, config.sectors);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = verify_values(keys);
+    nvs_flash_deinit_partition(PARTITION_NAME);
+    return err;
+}
@@ -0,0 +1,94 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef nvs_workload_h
+#define nvs_workload_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "esp_err.h"
+
+class SpiFlashEmulator;
+
+/**
+ * Replays a synthetic workload against an NVS partition on the flash emulator and
+ * measures what it costs in flash operations and wear.
+ *
+ * Every key gets a fixed type and size when the partition is populated: integers for
+ * value sizes up to 8 bytes, strings for larger ones, and blobs for the given share
+ * of keys. Each operation then reads or rewrites one key, picked with a Zipf
+ * distribution, so that a skew of 0 spreads updates evenly over all keys and larger
+ * values concentrate them on a few.
+ */
+struct WorkloadConfig {
+    std::string name = "custom";
+    size_t sectors = 8;             // size of the partition
+    size_t keyCount = 100;          // number of keys written
+    size_t minValueSize = 1;        // integer and string values, in bytes
+    size_t maxValueSize = 8;
+    unsigned blobPercent = 0;       // share of keys which hold blobs
+    size_t minBlobSize = 32;
+    size_t maxBlobSize = 512;
+    double skew = 0;                // Zipf exponent of the key popularity
+    unsigned readPercent = 0;       // share of operations which read instead of write
+    size_t operations = 10000;      // number of operations replayed after populating the partition
+    uint32_t seed = 42;
+    size_t enduranceCycles = 100000;    // erase cycles a sector is rated for
+    double writesPerHour = 60;      // write rate used to convert lifetime into time
+
+    /**
+     * Override settings from a comma separated list of name=value pairs, for example
+     * "keys=200,value_size=1-32,blob_percent=10,blob_size=100-4000,skew=0.9".
+     * Returns ESP_ERR_INVALID_ARG if a name or value isn't recognized.
+     */
+    esp_err_t parse(const char* spec);
+};
+
+struct WorkloadResult {
+    size_t operations = 0;
+    size_t writes = 0;
+    size_t logicalBytes = 0;        // value bytes passed to the set functions
+    size_t flashBytesWritten = 0;
+    size_t flashReadOps = 0;
+    size_t flashWriteOps = 0;
+    size_t eraseOps = 0;
+    size_t flashTime = 0;           // emulated flash time, in microseconds
+    double hostTime = 0;            // time spent on the host, in seconds
+    std::vector<size_t> sectorErases;   // erases of each sector of the partition
+
+    double getOpsPerSecond() const;
+    double getHostOpsPerSecond() const;
+    double getWriteAmplification() const;
+    size_t getMinSectorErases() const;
+    size_t getMaxSectorErases() const;
+    double getMeanSectorErases() const;
+
+    /** Writes until the most erased sector reaches its rated endurance, or 0 if nothing was erased */
+    double getProjectedWrites(const WorkloadConfig& config) const;
+
+    /** Same as getProjectedWrites, in years at WorkloadConfig::writesPerHour */
+    double getProjectedYears(const WorkloadConfig& config) const;
+
+    void print(const WorkloadConfig& config, std::ostream& out) const;
+};
+
+/**
+ * Populate a partition at the start of the emulated flash, replay the workload and check afterwards
+ * that all keys read back with their last values after mounting the partition again.
+ */
+esp_err_t workload_run(SpiFlashEmulator& emu, const WorkloadConfig& config, WorkloadResult& result);
+
+#endif /* nvs_workload_h */
@@ -1,3 +1,9 @@
 #define CONFIG_NVS_ENCRYPTION 1
+#define CONFIG_NVS_ITEM_INDEX 1
+#define CONFIG_NVS_ITEM_INDEX_BUCKETS_PER_PAGE 8
+#define CONFIG_NVS_BLOB_STREAM_BUFFER_SIZE 1024
+#define CONFIG_NVS_INCREMENTAL_GC_ENTRIES 0
+#define CONFIG_NVS_VALUE_CACHE_ENTRIES 0
+#define CONFIG_NVS_CRC32_SLICING_BY_8 1
 //currently use the legacy implementation, since the stubs for new HAL are not done yet
 #define CONFIG_SPI_FLASH_USE_LEGACY_IMPL 1
@@ -61,6 +61,16 @@ esp_err_t spi_flash_read(size_t src_addr, void *des_addr, size_t size)
     return ESP_OK;
 }
 
+// NVS measures the duration of its operations with this function,
+// report the time spent in emulated flash operations instead of real time
+extern "C" int64_t esp_timer_get_time(void)
+{
+    if (!s_emulator) {
+        return 0;
+    }
+    return static_cast<int64_t>(s_emulator->getTotalTime());
+}
+
 // timing data for ESP8266, 160MHz CPU frequency, 80MHz flash requency
 // all values in microseconds
 // values are for block sizes starting at 4 bytes and going up to 4096 bytes
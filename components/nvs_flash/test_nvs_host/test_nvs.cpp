@@ -14,11 +14,14 @@
 #include "catch.hpp"
 #include "nvs.hpp"
 #include "nvs_test_api.h"
+#include "nvs_crc.hpp"
+#include "crc.h"
 #include "sdkconfig.h"
 #ifdef CONFIG_NVS_ENCRYPTION
 #include "nvs_encr.hpp"
 #endif
 #include "spi_flash_emulation.h"
+#include "heap_tracker.h"
 #include <sstream>
 #include <iostream>
 #include <fstream>
@@ -27,6 +30,7 @@
 #include <sys/wait.h>
 #include <string.h>
 #include <string>
+#include <chrono>
 
 #define TEST_ESP_ERR(rc, res) CHECK((rc) == (res))
 #define TEST_ESP_OK(rc) CHECK((rc) == ESP_OK)
@@ -291,9 +295,9 @@ TEST_CASE("Page handles invalid CRC of variable length items", "[nvs][cur]")
 class HashListTestHelper : public HashList
 {
     public:
-        size_t getBlockCount()
+        size_t getCapacity()
         {
-            return mBlockList.size();
+            return mCapacity;
         }
 };
 
@@ -308,12 +312,12 @@ TEST_CASE("HashList is cleaned up as soon as items are erased", "[nvs]")
         Item item(1, ItemType::U32, 1, key);
         hashlist.insert(item, i);
     }
-    INFO("Added " << count << " items, " << hashlist.getBlockCount() << " blocks");
+    INFO("Added " << count << " items, capacity " << hashlist.getCapacity());
     // Remove them in reverse order
     for (size_t i = count; i > 0; --i) {
         hashlist.erase(i - 1, true);
     }
-    CHECK(hashlist.getBlockCount() == 0);
+    CHECK(hashlist.getCapacity() == 0);
     // Add again
     for (size_t i = 0; i < count; ++i) {
         char key[16];
@@ -321,12 +325,118 @@ TEST_CASE("HashList is cleaned up as soon as items are erased", "[nvs]")
         Item item(1, ItemType::U32, 1, key);
         hashlist.insert(item, i);
     }
-    INFO("Added " << count << " items, " << hashlist.getBlockCount() << " blocks");
+    INFO("Added " << count << " items, capacity " << hashlist.getCapacity());
     // Remove them in the same order
     for (size_t i = 0; i < count; ++i) {
         hashlist.erase(i, true);
     }
-    CHECK(hashlist.getBlockCount() == 0);
+    CHECK(hashlist.getCapacity() == 0);
+}
+
+TEST_CASE("HashList finds the first matching item at or after start index", "[nvs]")
+{
+    HashList hashlist;
+    Item item(1, ItemType::U32, 1, "foo");
+    CHECK(hashlist.find(0, item) == SIZE_MAX);
+    REQUIRE(hashlist.insert(item, 10) == ESP_OK);
+    REQUIRE(hashlist.insert(item, 3) == ESP_OK);
+    CHECK(hashlist.find(0, item) == 3);
+    CHECK(hashlist.find(4, item) == 10);
+    CHECK(hashlist.find(11, item) == SIZE_MAX);
+    hashlist.erase(3);
+    CHECK(hashlist.find(0, item) == 10);
+    CHECK(hashlist.find(0, Item(1, ItemType::U32, 1, "bar")) == SIZE_MAX);
+}
+
+TEST_CASE("HashList stays consistent after random inserts and erases", "[nvs]")
+{
+    HashListTestHelper hashlist;
+    Item items[Page::ENTRY_COUNT];
+    bool present[Page::ENTRY_COUNT] = {false};
+    for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+        char key[16];
+        // few distinct keys, so that probe sequences of different hashes overlap
+        snprintf(key, sizeof(key), "k%d", (int) (i % 40));
+        items[i] = Item(1, ItemType::U32, 1, key);
+    }
+
+    srand(42);
+    for (size_t op = 0; op < 20000; ++op) {
+        size_t index = rand() % Page::ENTRY_COUNT;
+        if (present[index]) {
+            hashlist.erase(index);
+            present[index] = false;
+        } else {
+            REQUIRE(hashlist.insert(items[index], index) == ESP_OK);
+            present[index] = true;
+        }
+
+        size_t probe = rand() % Page::ENTRY_COUNT;
+        size_t start = rand() % Page::ENTRY_COUNT;
+        size_t expected = SIZE_MAX;
+        for (size_t i = start; i < Page::ENTRY_COUNT; ++i) {
+            if (present[i] && strcmp(items[i].key, items[probe].key) == 0) {
+                expected = i;
+                break;
+            }
+        }
+        REQUIRE(hashlist.find(start, items[probe]) == expected);
+    }
+    CHECK(hashlist.getCapacity() <= 256);
+}
+
+#ifdef CONFIG_NVS_ITEM_INDEX
+TEST_CASE("ItemIndex keeps track of items on all pages", "[nvs]")
+{
+    ItemIndex index;
+    REQUIRE(index.init(4) == ESP_OK);
+    REQUIRE(index.isValid());
+
+    Page pages[2];
+    ItemIndex::Candidate candidates[ItemIndex::MAX_CANDIDATES];
+    const uint32_t hash = Item(1, ItemType::U32, 1, "foo").calculateCrc32WithoutValue() & 0xffffff;
+    const uint32_t otherHash = Item(1, ItemType::U32, 1, "bar").calculateCrc32WithoutValue() & 0xffffff;
+
+    CHECK(index.find(hash, candidates, ItemIndex::MAX_CANDIDATES) == 0);
+
+    index.insert(hash, &pages[0], 3);
+    index.insert(hash, &pages[1], 7);
+    index.insert(otherHash, &pages[1], 8);
+    CHECK(index.getNodeCount() == 3);
+    CHECK(index.contains(hash, &pages[0], 3));
+    CHECK(index.contains(hash, &pages[1], 7));
+    CHECK_FALSE(index.contains(hash, &pages[1], 8));
+
+    REQUIRE(index.find(hash, candidates, ItemIndex::MAX_CANDIDATES) == 2);
+    CHECK(index.find(hash, candidates, 1) == 2);
+
+    index.erase(hash, &pages[0], 3);
+    REQUIRE(index.find(hash, candidates, ItemIndex::MAX_CANDIDATES) == 1);
+    CHECK(candidates[0].mPage == &pages[1]);
+    CHECK(candidates[0].mIndex == 7);
+    CHECK(index.getNodeCount() == 2);
+
+    index.clear();
+    CHECK_FALSE(index.isValid());
+    CHECK(index.find(hash, candidates, ItemIndex::MAX_CANDIDATES) == 0);
+}
+#endif // CONFIG_NVS_ITEM_INDEX
+
+TEST_CASE("ItemIndex is updated when page is reclaimed", "[nvs]")
+{
+    SpiFlashEmulator emu(3);
+    Storage storage;
+    CHECK(storage.init(0, 3) == ESP_OK);
+    // keep rewriting one item so that the first pages are freed and erased
+    for (size_t i = 0; i < Page::ENTRY_COUNT * 4; ++i) {
+        REQUIRE(storage.writeItem(1, "foo", static_cast<uint32_t>(i)) == ESP_OK);
+        REQUIRE(storage.writeItem(1, "bar", static_cast<uint32_t>(i)) == ESP_OK);
+    }
+    CHECK(emu.getEraseOps() > 0);
+    uint32_t value;
+    CHECK(storage.readItem(1, "foo", value) == ESP_OK);
+    CHECK(value == Page::ENTRY_COUNT * 4 - 1);
+    CHECK(storage.readItem(1, "baz", value) == ESP_ERR_NVS_NOT_FOUND);
 }
 
 TEST_CASE("can init PageManager in empty flash", "[nvs]")
@@ -793,6 +903,29 @@ TEST_CASE("nvs iterators tests", "[nvs]")
         CHECK(entry_count(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_U64) == 1);
    }
 
+    SECTION("Entries are filtered by key prefix")
+    {
+        auto prefix_count = [](const char *name, nvs_type_t type, const char *prefix)-> int {
+            int count;
+            nvs_iterator_t it = nvs_entry_find_prefix(NVS_DEFAULT_PART_NAME, name, type, prefix);
+            for (count = 0; it != nullptr; count++) {
+                nvs_entry_info_t info;
+                nvs_entry_info(it, &info);
+                CHECK(strncmp(info.key, prefix, strlen(prefix)) == 0);
+                it = nvs_entry_next(it);
+            }
+            return count;
+        };
+        CHECK(prefix_count(name_1, NVS_TYPE_ANY, "value1") == 3);
+        CHECK(prefix_count(NULL, NVS_TYPE_ANY, "value1") == 4);
+        CHECK(prefix_count(NULL, NVS_TYPE_I32, "value1") == 1);
+        CHECK(prefix_count(name_1, NVS_TYPE_BLOB, "value1") == 1);
+        CHECK(prefix_count(NULL, NVS_TYPE_ANY, "") == 15);
+        CHECK(prefix_count(NULL, NVS_TYPE_ANY, "value10") == 1);
+        CHECK(nvs_entry_find_prefix(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_ANY, "x") == NULL);
+        CHECK(nvs_entry_find_prefix(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_ANY, "0123456789abcdef") == NULL);
+    }
+
    SECTION("New entry is not created when existing key-value pair is set")
    {
         CHECK(entry_count(NVS_DEFAULT_PART_NAME, name_2, NVS_TYPE_ANY) == 4);
@@ -3381,6 +3514,1586 @@ TEST_CASE("check and read data from partition generated via manufacturing utilit
 }
 #endif
 
+TEST_CASE("benchmark item lookup for different partition sizes", "[nvs]")
+{
+    const size_t pageCounts[] = {4, 16, 64};
+    const size_t lookupCount = 20000;
+    for (size_t pageCount : pageCounts) {
+        SpiFlashEmulator emu(pageCount);
+        // fill all pages except the last one directly, to avoid consistency checks after each write
+        for (size_t i = 0; i < pageCount - 1; ++i) {
+            Page p;
+            p.load(i);
+            p.setSeqNumber(i);
+            for (size_t j = 0; j < Page::ENTRY_COUNT; ++j) {
+                char key[16];
+                snprintf(key, sizeof(key), "k%d_%d", (int) i, (int) j);
+                REQUIRE(p.writeItem(1, key, static_cast<uint32_t>(j)) == ESP_OK);
+            }
+            REQUIRE(p.markFull() == ESP_OK);
+        }
+
+        Storage storage;
+        REQUIRE(storage.init(0, pageCount) == ESP_OK);
+
+        char lastKey[32];
+        snprintf(lastKey, sizeof(lastKey), "k%d_%d", (int) pageCount - 2, (int) Page::ENTRY_COUNT - 1);
+        uint32_t value;
+        REQUIRE(storage.readItem(1, lastKey, value) == ESP_OK);
+        CHECK(value == Page::ENTRY_COUNT - 1);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < lookupCount; ++i) {
+            storage.readItem(1, lastKey, value);
+        }
+        auto hitTime = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < lookupCount; ++i) {
+            storage.readItem(1, "missing", value);
+        }
+        auto missTime = std::chrono::steady_clock::now() - start;
+
+        s_perf << "Item lookup with " << pageCount << " pages: hit on last page "
+               << std::chrono::duration_cast<std::chrono::nanoseconds>(hitTime).count() / lookupCount << " ns, miss "
+               << std::chrono::duration_cast<std::chrono::nanoseconds>(missTime).count() / lookupCount << " ns"
+               << " (item index " << (NVS_ITEM_INDEX_BUCKETS_PER_PAGE ? "enabled" : "disabled") << ")" << std::endl;
+    }
+}
+
+// HashList as it was before it became an open-addressed table: 24-bit hash / 8-bit index pairs in a
+// list of 128-byte blocks. Kept to compare both in the benchmark below.
+class BlockHashList
+{
+public:
+    ~BlockHashList()
+    {
+        clear();
+    }
+
+    esp_err_t reserve(size_t)
+    {
+        return ESP_OK;
+    }
+
+    esp_err_t insert(const Item& item, size_t index)
+    {
+        const uint32_t hash_24 = item.calculateCrc32WithoutValue() & 0xffffff;
+        if (mBlockList.size() == 0 || mBlockList.back().mCount == Block::ENTRY_COUNT) {
+            Block* block = new (std::nothrow) Block;
+            if (!block) {
+                return ESP_ERR_NO_MEM;
+            }
+            mBlockList.push_back(block);
+        }
+        Block& block = mBlockList.back();
+        block.mNodes[block.mCount].mIndex = index;
+        block.mNodes[block.mCount].mHash = hash_24;
+        ++block.mCount;
+        return ESP_OK;
+    }
+
+    void erase(size_t index, bool itemShouldExist = true)
+    {
+        for (auto it = mBlockList.begin(); it != mBlockList.end();) {
+            bool haveEntries = false;
+            bool foundIndex = false;
+            for (size_t i = 0; i < it->mCount; ++i) {
+                if (it->mNodes[i].mIndex == index) {
+                    it->mNodes[i].mIndex = 0xff;
+                    foundIndex = true;
+                }
+                if (it->mNodes[i].mIndex != 0xff) {
+                    haveEntries = true;
+                }
+                if (haveEntries && foundIndex) {
+                    return;
+                }
+            }
+            if (!haveEntries) {
+                auto tmp = it;
+                ++it;
+                mBlockList.erase(tmp);
+                delete static_cast<Block*>(tmp);
+            } else {
+                ++it;
+            }
+            if (foundIndex) {
+                return;
+            }
+        }
+        CHECK_FALSE(itemShouldExist);
+    }
+
+    void erase(size_t index, const Item&)
+    {
+        erase(index);
+    }
+
+    size_t find(size_t start, const Item& item)
+    {
+        const uint32_t hash_24 = item.calculateCrc32WithoutValue() & 0xffffff;
+        for (auto it = mBlockList.begin(); it != mBlockList.end(); ++it) {
+            for (size_t i = 0; i < it->mCount; ++i) {
+                if (it->mNodes[i].mIndex >= start && it->mNodes[i].mHash == hash_24 && it->mNodes[i].mIndex != 0xff) {
+                    return it->mNodes[i].mIndex;
+                }
+            }
+        }
+        return SIZE_MAX;
+    }
+
+    void clear()
+    {
+        while (mBlockList.size()) {
+            Block* block = &mBlockList.front();
+            mBlockList.erase(block);
+            delete block;
+        }
+    }
+
+protected:
+    struct Node {
+        uint32_t mIndex : 8;
+        uint32_t mHash  : 24;
+    };
+
+    struct Block : public intrusive_list_node<Block> {
+        static const size_t BYTE_SIZE = 128;
+        static const size_t ENTRY_COUNT = (BYTE_SIZE - sizeof(intrusive_list_node<Block>) - sizeof(size_t)) / 4;
+
+        size_t mCount = 0;
+        Node mNodes[ENTRY_COUNT];
+    };
+
+    intrusive_list<Block> mBlockList;
+};
+
+struct HashListBenchmark {
+    std::chrono::steady_clock::duration load{0};
+    std::chrono::steady_clock::duration hit{0};
+    std::chrono::steady_clock::duration miss{0};
+    std::chrono::steady_clock::duration erase{0};
+    size_t loadAllocs = 0;
+    size_t liveBlocks = 0;
+    size_t liveBytes = 0;
+};
+
+// Fill the list as Page::load does for a full page, look up every item and a missing key for each of them,
+// then erase the items in random order as they are overwritten
+template<typename TList>
+static void benchmark_hash_list(TList& list, bool reserve, bool eraseByItem, const Item* items, const Item* missing,
+                                const size_t* eraseOrder, size_t rounds, HashListBenchmark& result)
+{
+    for (size_t round = 0; round < rounds; ++round) {
+        size_t allocs = heap_tracker_alloc_count();
+        size_t blocks = heap_tracker_current_blocks();
+        size_t bytes = heap_tracker_current_bytes();
+        bool inserted = true;
+        auto start = std::chrono::steady_clock::now();
+        if (reserve) {
+            inserted = list.reserve(Page::ENTRY_COUNT) == ESP_OK;
+        }
+        for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+            inserted &= list.insert(items[i], i) == ESP_OK;
+        }
+        result.load += std::chrono::steady_clock::now() - start;
+        result.loadAllocs = heap_tracker_alloc_count() - allocs;
+        result.liveBlocks = heap_tracker_current_blocks() - blocks;
+        result.liveBytes = heap_tracker_current_bytes() - bytes;
+
+        size_t found = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+            found += list.find(0, items[i]) == i;
+        }
+        result.hit += std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+            found += list.find(0, missing[i]) != SIZE_MAX;
+        }
+        result.miss += std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+            if (eraseByItem) {
+                list.erase(eraseOrder[i], items[eraseOrder[i]]);
+            } else {
+                list.erase(eraseOrder[i]);
+            }
+        }
+        result.erase += std::chrono::steady_clock::now() - start;
+        // checked only now, as the test framework allocates memory as well
+        size_t leftBlocks = heap_tracker_current_blocks() - blocks;
+        REQUIRE(inserted);
+        REQUIRE(found == (size_t) Page::ENTRY_COUNT);
+        REQUIRE(leftBlocks == 0);
+    }
+}
+
+TEST_CASE("benchmark HashList for a full page", "[nvs]")
+{
+    const size_t rounds = 1000;
+    std::unique_ptr<Item[]> items(new Item[Page::ENTRY_COUNT]);
+    std::unique_ptr<Item[]> missing(new Item[Page::ENTRY_COUNT]);
+    std::unique_ptr<size_t[]> eraseOrder(new size_t[Page::ENTRY_COUNT]);
+    for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+        char key[32];
+        snprintf(key, sizeof(key), "key%d", (int) i);
+        items[i] = Item(1, ItemType::U32, 1, key);
+        snprintf(key, sizeof(key), "missing%d", (int) i);
+        missing[i] = Item(1, ItemType::U32, 1, key);
+        eraseOrder[i] = i;
+    }
+    srand(1);
+    for (size_t i = Page::ENTRY_COUNT - 1; i > 0; --i) {
+        std::swap(eraseOrder[i], eraseOrder[rand() % (i + 1)]);
+    }
+
+    HashListBenchmark blockList, table, reservedTable;
+    {
+        BlockHashList list;
+        benchmark_hash_list(list, false, false, items.get(), missing.get(), eraseOrder.get(), rounds, blockList);
+    }
+    {
+        HashList list;
+        benchmark_hash_list(list, false, false, items.get(), missing.get(), eraseOrder.get(), rounds, table);
+    }
+    {
+        HashList list;
+        benchmark_hash_list(list, true, true, items.get(), missing.get(), eraseOrder.get(), rounds, reservedTable);
+    }
+
+    // Growing the table on the way rehashes 180 nodes and allocates 5 times, which makes filling it slower
+    // than filling the block list. Page::load reserves the table when the item count is known.
+    CHECK(reservedTable.loadAllocs == 1);
+    CHECK(reservedTable.liveBlocks == 1);
+
+    const size_t ops = rounds * Page::ENTRY_COUNT;
+    auto ns = [ops](std::chrono::steady_clock::duration d) {
+        return (long) (std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / ops);
+    };
+    auto report = [&](const char* name, const HashListBenchmark& b) {
+        char line[160];
+        snprintf(line, sizeof(line), "%-34s | %6ld | %6ld | %6ld | %6ld | %6d | %6d | %6d",
+                 name, ns(b.load), ns(b.hit), ns(b.miss), ns(b.erase),
+                 (int) b.loadAllocs, (int) b.liveBlocks, (int) b.liveBytes);
+        s_perf << line << std::endl;
+    };
+    s_perf << "HashList with " << Page::ENTRY_COUNT << " items, ns per item, heap blocks and bytes of a full page" << std::endl;
+    s_perf << "list                               | insert |    hit |   miss |  erase | allocs | blocks |  bytes" << std::endl;
+    report("block list", blockList);
+    report("table", table);
+    report("table, reserved, erase by item", reservedTable);
+
+    // Loading a whole page, which reads the items from flash and computes their CRCs as well
+    SpiFlashEmulator emu(1);
+    {
+        Page page;
+        REQUIRE(page.load(0) == ESP_OK);
+        for (size_t i = 0; i < Page::ENTRY_COUNT; ++i) {
+            uint32_t value = i;
+            REQUIRE(page.writeItem(1, items[i].key, value) == ESP_OK);
+        }
+    }
+    const size_t loadRounds = 100;
+    std::chrono::steady_clock::duration loadTime(0);
+    size_t loadAllocs = 0;
+    for (size_t round = 0; round < loadRounds; ++round) {
+        Page page;
+        size_t allocs = heap_tracker_alloc_count();
+        auto start = std::chrono::steady_clock::now();
+        esp_err_t err = page.load(0);
+        loadTime += std::chrono::steady_clock::now() - start;
+        loadAllocs += heap_tracker_alloc_count() - allocs;
+        REQUIRE(err == ESP_OK);
+        REQUIRE(page.getUsedEntryCount() == (size_t) Page::ENTRY_COUNT);
+    }
+    s_perf << "Page::load of a full page: "
+           << std::chrono::duration_cast<std::chrono::microseconds>(loadTime).count() / loadRounds << " us, "
+           << loadAllocs / loadRounds << " allocations" << std::endl;
+}
+
+TEST_CASE("handle opened in batch mode writes changes on commit", "[nvs]")
+{
+    SpiFlashEmulator emu(3);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 3));
+
+    nvs_handle_t handle, batch;
+    TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_u32(handle, "a", 1));
+    TEST_ESP_OK(nvs_set_u32(handle, "gone", 5));
+    TEST_ESP_OK(nvs_open("ns", NVS_READWRITE_BATCH, &batch));
+
+    TEST_ESP_OK(nvs_set_u32(batch, "a", 2));
+    TEST_ESP_OK(nvs_set_str(batch, "s", "hello"));
+    TEST_ESP_OK(nvs_set_blob(batch, "b", "blob", 4));
+    TEST_ESP_OK(nvs_erase_key(batch, "gone"));
+
+    // other handles don't see pending changes
+    uint32_t val;
+    char str[16];
+    size_t len = sizeof(str);
+    TEST_ESP_OK(nvs_get_u32(handle, "a", &val));
+    CHECK(val == 1);
+    TEST_ESP_ERR(nvs_get_str(handle, "s", str, &len), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_get_u32(handle, "gone", &val));
+    CHECK(val == 5);
+
+    // the batch handle does
+    TEST_ESP_OK(nvs_get_u32(batch, "a", &val));
+    CHECK(val == 2);
+    len = sizeof(str);
+    TEST_ESP_OK(nvs_get_str(batch, "s", str, &len));
+    CHECK(strcmp(str, "hello") == 0);
+    TEST_ESP_ERR(nvs_get_u32(batch, "gone", &val), ESP_ERR_NVS_NOT_FOUND);
+
+    TEST_ESP_OK(nvs_commit(batch));
+
+    TEST_ESP_OK(nvs_get_u32(handle, "a", &val));
+    CHECK(val == 2);
+    len = sizeof(str);
+    TEST_ESP_OK(nvs_get_str(handle, "s", str, &len));
+    CHECK(strcmp(str, "hello") == 0);
+    len = sizeof(str);
+    TEST_ESP_OK(nvs_get_blob(handle, "b", str, &len));
+    CHECK(len == 4);
+    CHECK(memcmp(str, "blob", 4) == 0);
+    TEST_ESP_ERR(nvs_get_u32(handle, "gone", &val), ESP_ERR_NVS_NOT_FOUND);
+
+    // blob can be updated in batch mode, replacing the earlier version
+    TEST_ESP_OK(nvs_set_blob(batch, "b", "BLOB", 4));
+    TEST_ESP_OK(nvs_commit(batch));
+    len = sizeof(str);
+    TEST_ESP_OK(nvs_get_blob(handle, "b", str, &len));
+    CHECK(memcmp(str, "BLOB", 4) == 0);
+
+    // the whole batch has to fit into one page
+    TEST_ESP_ERR(nvs_set_u32(batch, "key_is_too_long_", 0), ESP_ERR_NVS_KEY_TOO_LONG);
+    std::unique_ptr<uint8_t[]> blob(new uint8_t[Page::CHUNK_MAX_SIZE]);
+    TEST_ESP_ERR(nvs_set_blob(batch, "big", blob.get(), Page::CHUNK_MAX_SIZE), ESP_ERR_NVS_VALUE_TOO_LONG);
+    TEST_ESP_OK(nvs_set_blob(batch, "big", blob.get(), Page::CHUNK_MAX_SIZE / 2));
+    TEST_ESP_ERR(nvs_set_blob(batch, "big2", blob.get(), Page::CHUNK_MAX_SIZE / 2), ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+
+    // changes which are not committed are discarded
+    TEST_ESP_OK(nvs_set_u32(batch, "a", 3));
+    nvs_close(batch);
+    TEST_ESP_OK(nvs_get_u32(handle, "a", &val));
+    CHECK(val == 2);
+    len = 0;
+    TEST_ESP_ERR(nvs_get_blob(handle, "big", NULL, &len), ESP_ERR_NVS_NOT_FOUND);
+
+    nvs_close(handle);
+    nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME);
+}
+
+static void addBatchOp(Storage::TBatchList& ops, ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    Storage::BatchOp* op = new Storage::BatchOp;
+    op->mDatatype = datatype;
+    strncpy(op->mKey, key, sizeof(op->mKey) - 1);
+    op->mKey[sizeof(op->mKey) - 1] = 0;
+    op->mDataSize = dataSize;
+    op->mData = new uint8_t[dataSize];
+    memcpy(op->mData, data, dataSize);
+    ops.push_back(op);
+}
+
+TEST_CASE("batch is committed atomically if power is lost", "[nvs]")
+{
+    const size_t keyCount = 20;
+    const size_t fillerCount = 80;
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(4);
+        {
+            Storage storage;
+            TEST_ESP_OK(storage.init(0, 4));
+            // leave too little space on the first page, so that the batch goes to a new page
+            for (size_t i = 0; i < fillerCount; ++i) {
+                char key[16];
+                snprintf(key, sizeof(key), "filler%d", (int) i);
+                TEST_ESP_OK(storage.writeItem(2, key, static_cast<uint8_t>(i)));
+            }
+            for (size_t i = 0; i < keyCount; ++i) {
+                char key[16];
+                snprintf(key, sizeof(key), "key%d", (int) i);
+                TEST_ESP_OK(storage.writeItem(1, key, static_cast<uint32_t>(1)));
+            }
+            TEST_ESP_OK(storage.writeItem(1, ItemType::SZ, "str", "old", 4));
+            TEST_ESP_OK(storage.writeItem(1, ItemType::BLOB, "blob", "old", 3));
+            TEST_ESP_OK(storage.writeItem(1, "erased", static_cast<uint8_t>(0)));
+        }
+
+        bool committed;
+        {
+            Storage storage;
+            TEST_ESP_OK(storage.init(0, 4));
+            Storage::TBatchList ops;
+            const uint32_t newValue = 2;
+            for (size_t i = 0; i < keyCount; ++i) {
+                char key[16];
+                snprintf(key, sizeof(key), "key%d", (int) i);
+                addBatchOp(ops, ItemType::U32, key, &newValue, sizeof(newValue));
+            }
+            addBatchOp(ops, ItemType::SZ, "str", "new value", 10);
+            addBatchOp(ops, ItemType::BLOB, "blob", "new value", 9);
+            addBatchOp(ops, ItemType::ANY, "erased", nullptr, 0);
+
+            emu.failAfter(errDelay);
+            committed = storage.writeBatch(1, ops) == ESP_OK;
+            emu.failAfter(UINT32_MAX);
+            ops.clearAndFreeNodes();
+        }
+
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, 4));
+        uint32_t expected;
+        TEST_ESP_OK(storage.readItem(1, "key0", expected));
+        REQUIRE((expected == 1 || expected == 2));
+        for (size_t i = 1; i < keyCount; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%d", (int) i);
+            uint32_t val;
+            TEST_ESP_OK(storage.readItem(1, key, val));
+            REQUIRE(val == expected);
+        }
+        char str[16];
+        TEST_ESP_OK(storage.readItem(1, ItemType::SZ, "str", str, sizeof(str)));
+        CHECK(strcmp(str, (expected == 2) ? "new value" : "old") == 0);
+        size_t blobSize;
+        TEST_ESP_OK(storage.getItemDataSize(1, ItemType::BLOB, "blob", blobSize));
+        CHECK(blobSize == ((expected == 2) ? 9 : 3));
+        // erased keys are part of the batch as well
+        uint8_t erased;
+        CHECK(storage.readItem(1, "erased", erased) == ((expected == 2) ? ESP_ERR_NVS_NOT_FOUND : ESP_OK));
+        if (committed) {
+            CHECK(expected == 2);
+            break;
+        }
+    }
+}
+
+TEST_CASE("benchmark batched commit against per-key writes", "[nvs]")
+{
+    const size_t keyCount = 30;
+    const size_t rounds = 20;
+    size_t writeOps[2], writeBytes[2], totalTime[2];
+    for (int batched = 0; batched < 2; ++batched) {
+        SpiFlashEmulator emu(8);
+        TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 8));
+        nvs_handle_t handle;
+        TEST_ESP_OK(nvs_open("settings", batched ? NVS_READWRITE_BATCH : NVS_READWRITE, &handle));
+        emu.clearStats();
+        for (size_t round = 0; round < rounds; ++round) {
+            for (size_t i = 0; i < keyCount; ++i) {
+                char key[16];
+                snprintf(key, sizeof(key), "setting%d", (int) i);
+                TEST_ESP_OK(nvs_set_u32(handle, key, round));
+            }
+            TEST_ESP_OK(nvs_commit(handle));
+        }
+        writeOps[batched] = emu.getWriteOps();
+        writeBytes[batched] = emu.getWriteBytes();
+        totalTime[batched] = emu.getTotalTime();
+        nvs_close(handle);
+        nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME);
+    }
+    CHECK(writeOps[1] < writeOps[0]);
+    s_perf << "Saving " << keyCount << " keys, per commit: per-key writes " << writeOps[0] / rounds << " write ops, "
+           << writeBytes[0] / rounds << " bytes, " << totalTime[0] / rounds << " us; batched "
+           << writeOps[1] / rounds << " write ops, " << writeBytes[1] / rounds << " bytes, "
+           << totalTime[1] / rounds << " us" << std::endl;
+}
+
+TEST_CASE("blob stream reads and writes blobs in parts", "[nvs]")
+{
+    SpiFlashEmulator emu(16);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 16));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("stream", NVS_READWRITE, &handle));
+    nvs_stats_t emptyStats;
+    TEST_ESP_OK(nvs_get_stats(NULL, &emptyStats));
+
+    const size_t blobSize = 3 * Page::CHUNK_MAX_SIZE + 123;
+    std::unique_ptr<uint8_t[]> blob(new uint8_t[blobSize]);
+    srand(42);
+    for (size_t i = 0; i < blobSize; ++i) {
+        blob[i] = static_cast<uint8_t>(rand());
+    }
+
+    // write in parts of varying size, some of them larger than the stream buffer
+    nvs_blob_stream_t stream;
+    TEST_ESP_OK(nvs_blob_stream_open_write(handle, "blob", &stream));
+    for (size_t offset = 0; offset < blobSize; ) {
+        size_t len = std::min<size_t>(rand() % (2 * CONFIG_NVS_BLOB_STREAM_BUFFER_SIZE) + 1, blobSize - offset);
+        TEST_ESP_OK(nvs_blob_stream_write(stream, blob.get() + offset, len));
+        offset += len;
+    }
+    size_t size = 0;
+    TEST_ESP_ERR(nvs_get_blob(handle, "blob", NULL, &size), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_blob_stream_close(stream));
+
+    std::unique_ptr<uint8_t[]> readBack(new uint8_t[blobSize]);
+    size = blobSize;
+    TEST_ESP_OK(nvs_get_blob(handle, "blob", readBack.get(), &size));
+    CHECK(size == blobSize);
+    CHECK(memcmp(blob.get(), readBack.get(), blobSize) == 0);
+
+    // read at random offsets, moving forwards and backwards
+    uint8_t buf[300];
+    TEST_ESP_OK(nvs_blob_stream_open_read(handle, "blob", &stream, &size));
+    CHECK(size == blobSize);
+    for (int i = 0; i < 200; ++i) {
+        size_t offset = rand() % blobSize;
+        size_t len = std::min<size_t>(rand() % sizeof(buf) + 1, blobSize - offset);
+        TEST_ESP_OK(nvs_blob_stream_read(stream, offset, buf, len));
+        REQUIRE(memcmp(buf, blob.get() + offset, len) == 0);
+    }
+    TEST_ESP_ERR(nvs_blob_stream_read(stream, blobSize - 8, buf, 16), ESP_ERR_NVS_INVALID_LENGTH);
+    TEST_ESP_ERR(nvs_blob_stream_write(stream, buf, 16), ESP_ERR_INVALID_ARG);
+    TEST_ESP_OK(nvs_blob_stream_close(stream));
+
+    // blobs written by nvs_set_blob can be read in parts as well
+    TEST_ESP_OK(nvs_set_blob(handle, "blob", blob.get() + 1, blobSize - 1));
+    TEST_ESP_OK(nvs_blob_stream_open_read(handle, "blob", &stream, &size));
+    CHECK(size == blobSize - 1);
+    for (size_t offset = 0; offset < size; offset += 16) {
+        size_t len = std::min<size_t>(16, size - offset);
+        TEST_ESP_OK(nvs_blob_stream_read(stream, offset, buf, len));
+        REQUIRE(memcmp(buf, blob.get() + 1 + offset, len) == 0);
+    }
+    TEST_ESP_OK(nvs_blob_stream_close(stream));
+
+    // aborted writes keep the previous value and leave no data behind
+    nvs_stats_t stats;
+    TEST_ESP_OK(nvs_get_stats(NULL, &stats));
+    size_t usedEntries = stats.used_entries;
+    TEST_ESP_OK(nvs_blob_stream_open_write(handle, "blob", &stream));
+    TEST_ESP_OK(nvs_blob_stream_write(stream, blob.get(), blobSize));
+    nvs_blob_stream_abort(stream);
+    TEST_ESP_OK(nvs_get_stats(NULL, &stats));
+    CHECK(stats.used_entries == usedEntries);
+    size = 0;
+    TEST_ESP_OK(nvs_get_blob(handle, "blob", NULL, &size));
+    CHECK(size == blobSize - 1);
+
+    // closing a writer replaces the previous value
+    TEST_ESP_OK(nvs_blob_stream_open_write(handle, "blob", &stream));
+    TEST_ESP_OK(nvs_blob_stream_write(stream, "short", 5));
+    TEST_ESP_OK(nvs_blob_stream_close(stream));
+    TEST_ESP_OK(nvs_get_stats(NULL, &stats));
+    CHECK(stats.used_entries == emptyStats.used_entries + 3);
+    size = sizeof(buf);
+    TEST_ESP_OK(nvs_get_blob(handle, "blob", buf, &size));
+    CHECK(size == 5);
+    CHECK(memcmp(buf, "short", 5) == 0);
+
+    // empty blobs
+    TEST_ESP_OK(nvs_blob_stream_open_write(handle, "empty", &stream));
+    TEST_ESP_OK(nvs_blob_stream_close(stream));
+    TEST_ESP_OK(nvs_blob_stream_open_read(handle, "empty", &stream, &size));
+    CHECK(size == 0);
+    TEST_ESP_OK(nvs_blob_stream_read(stream, 0, buf, 0));
+    TEST_ESP_OK(nvs_blob_stream_close(stream));
+
+    TEST_ESP_ERR(nvs_blob_stream_open_read(handle, "missing", &stream, &size), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(nvs_blob_stream_open_write(handle, "key_is_too_long_", &stream), ESP_ERR_NVS_KEY_TOO_LONG);
+    nvs_handle_t readOnly;
+    TEST_ESP_OK(nvs_open("stream", NVS_READONLY, &readOnly));
+    TEST_ESP_ERR(nvs_blob_stream_open_write(readOnly, "blob", &stream), ESP_ERR_NVS_READ_ONLY);
+    nvs_close(readOnly);
+
+    nvs_close(handle);
+    nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME);
+}
+
+TEST_CASE("blob stream rejects other changes of the key while it is open", "[nvs]")
+{
+    SpiFlashEmulator emu(8);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 8));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("stream", NVS_READWRITE, &handle));
+    nvs_handle_t batch;
+    TEST_ESP_OK(nvs_open("stream", NVS_READWRITE_BATCH, &batch));
+
+    const size_t blobSize = 2 * CONFIG_NVS_BLOB_STREAM_BUFFER_SIZE + 10;
+    uint8_t streamed[blobSize];
+    uint8_t other[blobSize];
+    std::fill_n(streamed, blobSize, 0x55);
+    std::fill_n(other, blobSize, 0xaa);
+    TEST_ESP_OK(nvs_set_blob(handle, "blob", other, 16));
+
+    // the chunks of the writer already use the version which a concurrent set would pick
+    nvs_blob_stream_t stream;
+    TEST_ESP_OK(nvs_blob_stream_open_write(handle, "blob", &stream));
+    TEST_ESP_OK(nvs_blob_stream_write(stream, streamed, blobSize));
+
+    nvs_blob_stream_t second;
+    TEST_ESP_ERR(nvs_blob_stream_open_write(handle, "blob", &second), ESP_ERR_NVS_BLOB_STREAM_OPEN);
+    TEST_ESP_ERR(nvs_set_blob(handle, "blob", other, blobSize), ESP_ERR_NVS_BLOB_STREAM_OPEN);
+    TEST_ESP_ERR(nvs_set_str(handle, "blob", "text"), ESP_ERR_NVS_BLOB_STREAM_OPEN);
+    TEST_ESP_ERR(nvs_erase_key(handle, "blob"), ESP_ERR_NVS_BLOB_STREAM_OPEN);
+    TEST_ESP_ERR(nvs_erase_prefix(handle, "bl"), ESP_ERR_NVS_BLOB_STREAM_OPEN);
+    TEST_ESP_ERR(nvs_erase_all(handle), ESP_ERR_NVS_BLOB_STREAM_OPEN);
+    TEST_ESP_OK(nvs_set_blob(batch, "blob", other, blobSize));
+    TEST_ESP_ERR(nvs_commit(batch), ESP_ERR_NVS_BLOB_STREAM_OPEN);
+
+    // other keys of the namespace, and the same key in other namespaces, can still be changed
+    TEST_ESP_OK(nvs_set_blob(handle, "blob2", other, blobSize));
+    TEST_ESP_OK(nvs_erase_prefix(handle, "blob2"));
+    nvs_handle_t otherNs;
+    TEST_ESP_OK(nvs_open("other", NVS_READWRITE, &otherNs));
+    TEST_ESP_OK(nvs_set_blob(otherNs, "blob", other, blobSize));
+    nvs_close(otherNs);
+
+    TEST_ESP_OK(nvs_blob_stream_write(stream, streamed, 10));
+    TEST_ESP_OK(nvs_blob_stream_close(stream));
+
+    uint8_t readBack[blobSize + 10];
+    size_t size = sizeof(readBack);
+    TEST_ESP_OK(nvs_get_blob(handle, "blob", readBack, &size));
+    CHECK(size == blobSize + 10);
+    CHECK(std::all_of(readBack, readBack + size, [](uint8_t b) { return b == 0x55; }));
+
+    // once the stream is closed, the pending batch can be committed
+    TEST_ESP_OK(nvs_commit(batch));
+    size = sizeof(readBack);
+    TEST_ESP_OK(nvs_get_blob(handle, "blob", readBack, &size));
+    CHECK(size == blobSize);
+    CHECK(memcmp(readBack, other, blobSize) == 0);
+
+    // aborting releases the key as well
+    TEST_ESP_OK(nvs_blob_stream_open_write(handle, "blob", &stream));
+    nvs_blob_stream_abort(stream);
+    TEST_ESP_OK(nvs_erase_key(handle, "blob"));
+
+    nvs_close(batch);
+    nvs_close(handle);
+    nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME);
+}
+
+TEST_CASE("blob streams left open are aborted when the partition is deinitialized", "[nvs]")
+{
+    SpiFlashEmulator emu(8);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 8));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("stream", NVS_READWRITE, &handle));
+
+    const size_t blobSize = 2 * CONFIG_NVS_BLOB_STREAM_BUFFER_SIZE + 10;
+    uint8_t oldValue[blobSize];
+    uint8_t newValue[blobSize];
+    std::fill_n(oldValue, blobSize, 0x11);
+    std::fill_n(newValue, blobSize, 0x22);
+    TEST_ESP_OK(nvs_set_blob(handle, "blob", oldValue, blobSize));
+
+    nvs_blob_stream_t writer, reader;
+    TEST_ESP_OK(nvs_blob_stream_open_write(handle, "blob", &writer));
+    TEST_ESP_OK(nvs_blob_stream_write(writer, newValue, blobSize));
+    TEST_ESP_OK(nvs_blob_stream_open_read(handle, "blob", &reader, nullptr));
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+
+    uint8_t readBack[blobSize];
+    TEST_ESP_ERR(nvs_blob_stream_write(writer, newValue, 10), ESP_ERR_NVS_INVALID_HANDLE);
+    TEST_ESP_ERR(nvs_blob_stream_read(reader, 0, readBack, 10), ESP_ERR_NVS_INVALID_HANDLE);
+    TEST_ESP_ERR(nvs_blob_stream_close(writer), ESP_ERR_NVS_INVALID_HANDLE);
+    TEST_ESP_ERR(nvs_blob_stream_close(reader), ESP_ERR_NVS_INVALID_HANDLE);
+
+    // the chunks written by the stream were erased, the previous value is kept
+    size_t oldChunks = 0;
+    for (uint32_t sector = 0; sector < 8; ++sector) {
+        Page page;
+        TEST_ESP_OK(page.load(sector));
+        oldChunks += page.findItem(1, ItemType::BLOB_DATA, "blob", static_cast<uint8_t>(VerOffset::VER_0_OFFSET)) == ESP_OK;
+        CHECK(page.findItem(1, ItemType::BLOB_DATA, "blob", static_cast<uint8_t>(VerOffset::VER_1_OFFSET)) == ESP_ERR_NVS_NOT_FOUND);
+    }
+    CHECK(oldChunks > 0);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 8));
+    TEST_ESP_OK(nvs_open("stream", NVS_READWRITE, &handle));
+    size_t size = sizeof(readBack);
+    TEST_ESP_OK(nvs_get_blob(handle, "blob", readBack, &size));
+    CHECK(size == blobSize);
+    CHECK(memcmp(readBack, oldValue, blobSize) == 0);
+
+    nvs_close(handle);
+    nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME);
+}
+
+TEST_CASE("blob stream keeps the previous value if power is lost", "[nvs]")
+{
+    const size_t blobSize = Page::CHUNK_MAX_SIZE + 500;
+    std::unique_ptr<uint8_t[]> oldValue(new uint8_t[blobSize]);
+    std::unique_ptr<uint8_t[]> newValue(new uint8_t[blobSize]);
+    std::unique_ptr<uint8_t[]> readBack(new uint8_t[blobSize]);
+    std::fill_n(oldValue.get(), blobSize, 0x11);
+    std::fill_n(newValue.get(), blobSize, 0x22);
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(6);
+        {
+            Storage storage;
+            TEST_ESP_OK(storage.init(0, 6));
+            TEST_ESP_OK(storage.writeItem(1, ItemType::BLOB, "blob", oldValue.get(), blobSize));
+        }
+
+        bool closed = false;
+        {
+            Storage storage;
+            TEST_ESP_OK(storage.init(0, 6));
+            nvs_opaque_blob_stream_t stream;
+            TEST_ESP_OK(storage.openBlobWriter(&stream, 1, "blob"));
+            emu.failAfter(errDelay);
+            if (storage.writeBlobStream(&stream, newValue.get(), blobSize) == ESP_OK) {
+                closed = storage.closeBlobWriter(&stream) == ESP_OK;
+            } else {
+                storage.abortBlobWriter(&stream);
+            }
+            emu.failAfter(UINT32_MAX);
+        }
+
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, 6));
+        size_t size;
+        TEST_ESP_OK(storage.getItemDataSize(1, ItemType::BLOB, "blob", size));
+        REQUIRE(size == blobSize);
+        TEST_ESP_OK(storage.readItem(1, ItemType::BLOB, "blob", readBack.get(), blobSize));
+        bool isOld = memcmp(readBack.get(), oldValue.get(), blobSize) == 0;
+        bool isNew = memcmp(readBack.get(), newValue.get(), blobSize) == 0;
+        REQUIRE((isOld || isNew));
+        if (closed) {
+            CHECK(isNew);
+            break;
+        }
+    }
+}
+
+TEST_CASE("benchmark peak heap usage of blob stream against nvs_set_blob", "[nvs]")
+{
+    const size_t blobSize = 40 * 1024;
+    const size_t partSize = 256;
+    SpiFlashEmulator emu(32);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 32));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("stream", NVS_READWRITE, &handle));
+
+    // no test macros while measuring, they allocate memory themselves
+    esp_err_t err = ESP_OK;
+    bool same = true;
+    size_t base = heap_tracker_current_bytes();
+    heap_tracker_reset_peak();
+    emu.clearStats();
+    {
+        std::unique_ptr<uint8_t[]> blob(new uint8_t[blobSize]);
+        for (size_t i = 0; i < blobSize; ++i) {
+            blob[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+        }
+        err = nvs_set_blob(handle, "whole", blob.get(), blobSize);
+        size_t size = blobSize;
+        if (err == ESP_OK) {
+            err = nvs_get_blob(handle, "whole", blob.get(), &size);
+        }
+        for (size_t i = 0; i < blobSize; ++i) {
+            same = same && blob[i] == static_cast<uint8_t>(i * 7 + (i >> 8));
+        }
+    }
+    size_t wholePeak = heap_tracker_peak_bytes() - base;
+    size_t wholeTime = emu.getTotalTime();
+    TEST_ESP_OK(err);
+    CHECK(same);
+
+    base = heap_tracker_current_bytes();
+    heap_tracker_reset_peak();
+    emu.clearStats();
+    {
+        std::unique_ptr<uint8_t[]> part(new uint8_t[partSize]);
+        nvs_blob_stream_t stream;
+        err = nvs_blob_stream_open_write(handle, "streamed", &stream);
+        for (size_t offset = 0; offset < blobSize && err == ESP_OK; offset += partSize) {
+            for (size_t i = 0; i < partSize; ++i) {
+                part[i] = static_cast<uint8_t>((offset + i) * 7 + ((offset + i) >> 8));
+            }
+            err = nvs_blob_stream_write(stream, part.get(), partSize);
+        }
+        if (err == ESP_OK) {
+            err = nvs_blob_stream_close(stream);
+        }
+        size_t size = 0;
+        if (err == ESP_OK) {
+            err = nvs_blob_stream_open_read(handle, "streamed", &stream, &size);
+        }
+        for (size_t offset = 0; offset < size && err == ESP_OK; offset += partSize) {
+            err = nvs_blob_stream_read(stream, offset, part.get(), partSize);
+            for (size_t i = 0; i < partSize; ++i) {
+                same = same && part[i] == static_cast<uint8_t>((offset + i) * 7 + ((offset + i) >> 8));
+            }
+        }
+        if (size != 0) {
+            nvs_blob_stream_close(stream);
+        }
+    }
+    size_t streamPeak = heap_tracker_peak_bytes() - base;
+    size_t streamTime = emu.getTotalTime();
+    TEST_ESP_OK(err);
+    CHECK(same);
+    CHECK(streamPeak < wholePeak / 10);
+
+    s_perf << "Peak heap usage to write and read a " << blobSize << " byte blob: nvs_set_blob/nvs_get_blob "
+           << wholePeak << " bytes, " << wholeTime << " us; blob stream with " << partSize << " byte parts "
+           << streamPeak << " bytes, " << streamTime << " us" << std::endl;
+
+    nvs_close(handle);
+    nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME);
+}
+
+static void fillForReclaim(Storage& storage, size_t keyCount, size_t rounds)
+{
+    for (size_t round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i < keyCount; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%d", (int) i);
+            REQUIRE(storage.writeItem(1, key, static_cast<uint32_t>(i * 1000 + round)) == ESP_OK);
+        }
+        REQUIRE(storage.writeItem(1, ItemType::SZ, "str", "a string spanning several entries", 34) == ESP_OK);
+    }
+}
+
+static void checkReclaimed(Storage& storage, size_t keyCount, size_t rounds)
+{
+    for (size_t i = 0; i < keyCount; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", (int) i);
+        uint32_t val;
+        REQUIRE(storage.readItem(1, key, val) == ESP_OK);
+        REQUIRE(val == i * 1000 + rounds - 1);
+    }
+    char str[40];
+    REQUIRE(storage.readItem(1, ItemType::SZ, "str", str, sizeof(str)) == ESP_OK);
+    CHECK(strcmp(str, "a string spanning several entries") == 0);
+}
+
+TEST_CASE("reclaim steps free pages in bounded amounts of work", "[nvs]")
+{
+    const size_t keyCount = 100;
+    const size_t rounds = 4;
+    const size_t stepEntries = 8;
+    SpiFlashEmulator emu(5);
+    Storage storage;
+    TEST_ESP_OK(storage.init(0, 5));
+    fillForReclaim(storage, keyCount, rounds);
+
+    size_t steps = 0;
+    size_t erasedPages = 0;
+    esp_err_t err;
+    do {
+        emu.clearStats();
+        err = storage.reclaimStep(stepEntries);
+        REQUIRE((err == ESP_OK || err == ESP_ERR_NOT_FOUND));
+        // moving an entry takes one write for its data and one state update on either page
+        CHECK(emu.getWriteOps() <= 3 * (stepEntries + 1));
+        CHECK(emu.getEraseOps() <= 1);
+        erasedPages += emu.getEraseOps();
+        ++steps;
+    } while (err == ESP_OK);
+    CHECK(steps > 1);
+    CHECK(erasedPages > 0);
+    storage.debugCheck();
+    checkReclaimed(storage, keyCount, rounds);
+
+    // the partition has enough free pages now, so writes don't need to move items
+    emu.clearStats();
+    TEST_ESP_OK(storage.writeItem(1, "key0", static_cast<uint32_t>(rounds - 1)));
+    CHECK(emu.getEraseOps() == 0);
+
+    Storage reloaded;
+    TEST_ESP_OK(reloaded.init(0, 5));
+    reloaded.debugCheck();
+    checkReclaimed(reloaded, keyCount, rounds);
+}
+
+TEST_CASE("reclaim steps keep all items if power is lost", "[nvs]")
+{
+    const size_t keyCount = 100;
+    const size_t rounds = 4;
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(5);
+        {
+            Storage storage;
+            TEST_ESP_OK(storage.init(0, 5));
+            fillForReclaim(storage, keyCount, rounds);
+        }
+
+        bool finished = false;
+        {
+            Storage storage;
+            TEST_ESP_OK(storage.init(0, 5));
+            emu.failAfter(errDelay);
+            esp_err_t err;
+            do {
+                err = storage.reclaimStep(16);
+            } while (err == ESP_OK);
+            finished = err == ESP_ERR_NOT_FOUND;
+            emu.failAfter(UINT32_MAX);
+        }
+
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, 5));
+        storage.debugCheck();
+        checkReclaimed(storage, keyCount, rounds);
+        if (finished) {
+            break;
+        }
+    }
+}
+
+TEST_CASE("benchmark worst-case write time with incremental reclaim", "[nvs]")
+{
+    const size_t keyCount = 60;
+    const size_t writes = 3000;
+    const char* modes[] = {"on demand", "8 entries before each write", "16 entries between writes"};
+    size_t maxTime[3], totalTime[3], maxErase[3];
+    for (int mode = 0; mode < 3; ++mode) {
+        SpiFlashEmulator emu(6);
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, 6));
+        storage.setAutoReclaimEntries((mode == 1) ? 8 : 0);
+        // half of the items never change, so that reclaimed pages have items to move
+        for (size_t i = 0; i < keyCount; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "const%d", (int) i);
+            TEST_ESP_OK(storage.writeItem(1, key, static_cast<uint32_t>(i)));
+        }
+        emu.clearStats();
+        maxErase[mode] = 0;
+        srand(42);
+        for (size_t i = 0; i < writes; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%d", rand() % (int) keyCount);
+            size_t erases = emu.getEraseOps();
+            REQUIRE(storage.writeItem(1, key, static_cast<uint32_t>(i)) == ESP_OK);
+            maxErase[mode] = std::max(maxErase[mode], emu.getEraseOps() - erases);
+            if (mode == 2) {
+                esp_err_t err = storage.reclaimStep(16);
+                REQUIRE((err == ESP_OK || err == ESP_ERR_NOT_FOUND));
+            }
+        }
+        nvs_stats_t stats;
+        TEST_ESP_OK(storage.fillStats(stats));
+        maxTime[mode] = stats.max_write_time_us;
+        totalTime[mode] = emu.getTotalTime();
+        storage.debugCheck();
+    }
+    // a flash sector erase is the longest operation, writes which reclaim space in steps do at most one
+    CHECK(maxErase[1] <= 1);
+    CHECK(maxTime[1] <= maxTime[0]);
+    // if space is reclaimed between writes, writes don't have to erase at all
+    CHECK(maxErase[2] == 0);
+    CHECK(maxTime[2] < maxTime[0] / 10);
+    s_perf << "Worst-case time of " << writes << " writes with space reclaimed";
+    for (int mode = 0; mode < 3; ++mode) {
+        s_perf << (mode ? ", " : " ") << modes[mode] << ": " << maxTime[mode] << " us ("
+               << totalTime[mode] << " us total)";
+    }
+    s_perf << std::endl;
+}
+
+static void fillForSummary(Storage& storage, uint8_t& nsIndex, size_t keyCount, size_t blobCount)
+{
+    REQUIRE(storage.createOrOpenNamespace("summary", true, nsIndex) == ESP_OK);
+    for (size_t i = 0; i < keyCount; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", (int) i);
+        REQUIRE(storage.writeItem(nsIndex, key, static_cast<uint32_t>(i)) == ESP_OK);
+        if (i % 4 == 0) {
+            snprintf(key, sizeof(key), "str%d", (int) i);
+            REQUIRE(storage.writeItem(nsIndex, ItemType::SZ, key, "a string spanning several entries", 34) == ESP_OK);
+        }
+    }
+    uint8_t blob[3000];
+    for (size_t i = 0; i < blobCount; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "blob%d", (int) i);
+        std::fill_n(blob, sizeof(blob), static_cast<uint8_t>(i));
+        REQUIRE(storage.writeItem(nsIndex, ItemType::BLOB, key, blob, sizeof(blob)) == ESP_OK);
+    }
+}
+
+static void checkSummary(Storage& storage, size_t keyCount, size_t blobCount)
+{
+    uint8_t nsIndex;
+    REQUIRE(storage.createOrOpenNamespace("summary", false, nsIndex) == ESP_OK);
+    for (size_t i = 0; i < keyCount; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", (int) i);
+        uint32_t val;
+        REQUIRE(storage.readItem(nsIndex, key, val) == ESP_OK);
+        REQUIRE(val == i);
+        if (i % 4 == 0) {
+            char str[40];
+            snprintf(key, sizeof(key), "str%d", (int) i);
+            REQUIRE(storage.readItem(nsIndex, ItemType::SZ, key, str, sizeof(str)) == ESP_OK);
+            CHECK(strcmp(str, "a string spanning several entries") == 0);
+        }
+    }
+    uint8_t blob[3000];
+    for (size_t i = 0; i < blobCount; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "blob%d", (int) i);
+        REQUIRE(storage.readItem(nsIndex, ItemType::BLOB, key, blob, sizeof(blob)) == ESP_OK);
+        CHECK(std::all_of(blob, blob + sizeof(blob), [=](uint8_t b) { return b == static_cast<uint8_t>(i); }));
+    }
+}
+
+TEST_CASE("page summary lets mount skip reading items of unchanged pages", "[nvs]")
+{
+    const size_t sectors = 16;
+    const size_t keyCount = 200;
+    const size_t blobCount = 6;
+    SpiFlashEmulator emu(sectors);
+    {
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, sectors));
+        uint8_t nsIndex;
+        fillForSummary(storage, nsIndex, keyCount, blobCount);
+    }
+
+    emu.clearStats();
+    size_t fullScanReads;
+    {
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, sectors));
+        fullScanReads = emu.getReadOps();
+        TEST_ESP_OK(storage.writeSummary());
+    }
+
+    emu.clearStats();
+    {
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, sectors));
+        CHECK(emu.getReadOps() < fullScanReads / 2);
+        CHECK(emu.getWriteOps() == 0);
+        CHECK(emu.getEraseOps() == 0);
+        storage.debugCheck();
+        checkSummary(storage, keyCount, blobCount);
+
+        // pages on which items are erased are loaded by reading all items again
+        uint8_t nsIndex;
+        TEST_ESP_OK(storage.createOrOpenNamespace("summary", false, nsIndex));
+        TEST_ESP_OK(storage.writeItem(nsIndex, "key1", static_cast<uint32_t>(1)));
+        TEST_ESP_OK(storage.eraseItem(nsIndex, ItemType::BLOB, "blob0"));
+        TEST_ESP_OK(storage.eraseItem(nsIndex, ItemType::SZ, "str8"));
+        TEST_ESP_OK(storage.writeItem(nsIndex, ItemType::SZ, "str8", "a string spanning several entries", 34));
+        TEST_ESP_OK(storage.writeItem(nsIndex, ItemType::BLOB, "blob0", "\0", 1));
+    }
+
+    Storage storage;
+    TEST_ESP_OK(storage.init(0, sectors));
+    storage.debugCheck();
+    uint8_t nsIndex;
+    TEST_ESP_OK(storage.createOrOpenNamespace("summary", false, nsIndex));
+    uint8_t blob[4];
+    size_t blobSize;
+    TEST_ESP_OK(storage.getItemDataSize(nsIndex, ItemType::BLOB, "blob0", blobSize));
+    CHECK(blobSize == 1);
+    TEST_ESP_OK(storage.readItem(nsIndex, ItemType::BLOB, "blob0", blob, blobSize));
+    CHECK(blob[0] == 0);
+    TEST_ESP_OK(storage.writeItem(nsIndex, ItemType::BLOB, "blob0", std::vector<uint8_t>(3000, 0).data(), 3000));
+    checkSummary(storage, keyCount, blobCount);
+
+    // the free page holding the summary is erased before it is used for items
+    for (size_t i = 0; i < 1000; ++i) {
+        TEST_ESP_OK(storage.writeItem(nsIndex, "key0", static_cast<uint32_t>(i)));
+    }
+    TEST_ESP_OK(storage.writeItem(nsIndex, "key0", static_cast<uint32_t>(0)));
+    Storage reloaded;
+    TEST_ESP_OK(reloaded.init(0, sectors));
+    reloaded.debugCheck();
+    checkSummary(reloaded, keyCount, blobCount);
+}
+
+TEST_CASE("page summary is not used for pages changed before power is lost", "[nvs]")
+{
+    const size_t sectors = 12;
+    const size_t keyCount = 120;
+    const size_t blobCount = 4;
+    nvs_stats_t statsWithBlob, statsWithoutBlob;
+    {
+        SpiFlashEmulator emu(sectors);
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, sectors));
+        uint8_t nsIndex;
+        fillForSummary(storage, nsIndex, keyCount, blobCount);
+        TEST_ESP_OK(storage.fillStats(statsWithBlob));
+        TEST_ESP_OK(storage.eraseItem(nsIndex, ItemType::BLOB, "blob1"));
+        TEST_ESP_OK(storage.fillStats(statsWithoutBlob));
+    }
+
+    for (uint32_t errDelay = 0; ; ++errDelay) {
+        INFO(errDelay);
+        SpiFlashEmulator emu(sectors);
+        {
+            Storage storage;
+            TEST_ESP_OK(storage.init(0, sectors));
+            uint8_t nsIndex;
+            fillForSummary(storage, nsIndex, keyCount, blobCount);
+            TEST_ESP_OK(storage.writeSummary());
+        }
+
+        bool finished = false;
+        {
+            Storage storage;
+            TEST_ESP_OK(storage.init(0, sectors));
+            uint8_t nsIndex;
+            TEST_ESP_OK(storage.createOrOpenNamespace("summary", false, nsIndex));
+            emu.failAfter(errDelay);
+            // data chunks of an erased blob are left on unchanged pages if power is lost in between
+            finished = storage.eraseItem(nsIndex, ItemType::BLOB, "blob1") == ESP_OK
+                    && storage.writeSummary() == ESP_OK;
+            emu.failAfter(UINT32_MAX);
+        }
+
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, sectors));
+        storage.debugCheck();
+        uint8_t nsIndex;
+        TEST_ESP_OK(storage.createOrOpenNamespace("summary", false, nsIndex));
+        uint8_t blob[3000];
+        esp_err_t err = storage.readItem(nsIndex, ItemType::BLOB, "blob1", blob, sizeof(blob));
+        nvs_stats_t stats;
+        TEST_ESP_OK(storage.fillStats(stats));
+        if (err == ESP_OK) {
+            CHECK(stats.used_entries == statsWithBlob.used_entries);
+        } else {
+            TEST_ESP_ERR(err, ESP_ERR_NVS_NOT_FOUND);
+            CHECK(stats.used_entries == statsWithoutBlob.used_entries);
+        }
+        checkSummary(storage, keyCount, 1);
+        if (finished) {
+            break;
+        }
+    }
+}
+
+TEST_CASE("benchmark mount time with page summary", "[nvs]")
+{
+    // 0.5 MB partition
+    const size_t sectors = 128;
+    const size_t keyCount = 600;
+    const size_t blobCount = 30;
+    SpiFlashEmulator emu(sectors);
+    {
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, sectors));
+        uint8_t nsIndex;
+        fillForSummary(storage, nsIndex, keyCount, blobCount);
+    }
+
+    emu.clearStats();
+    size_t fullScanTime, fullScanReads;
+    {
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, sectors));
+        fullScanTime = emu.getTotalTime();
+        fullScanReads = emu.getReadOps();
+        TEST_ESP_OK(storage.writeSummary());
+    }
+
+    emu.clearStats();
+    Storage storage;
+    TEST_ESP_OK(storage.init(0, sectors));
+    size_t summaryTime = emu.getTotalTime();
+    size_t summaryReads = emu.getReadOps();
+    checkSummary(storage, keyCount, blobCount);
+    CHECK(summaryReads < fullScanReads / 2);
+    s_perf << "Mount time of a " << sectors * SPI_FLASH_SEC_SIZE / 1024 << " kB partition: "
+           << fullScanTime << " us (" << fullScanReads << " reads), with page summary: "
+           << summaryTime << " us (" << summaryReads << " reads)" << std::endl;
+}
+
+TEST_CASE("value cache serves repeated reads from RAM and drops written keys", "[nvs]")
+{
+    SpiFlashEmulator emu(4);
+    Storage storage;
+    TEST_ESP_OK(storage.init(0, 4));
+    TEST_ESP_OK(storage.setValueCacheEntries(4));
+    for (uint32_t i = 0; i < 6; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", (int) i);
+        TEST_ESP_OK(storage.writeItem(1, key, i));
+    }
+    TEST_ESP_OK(storage.writeItem(2, "key0", static_cast<uint32_t>(100)));
+
+    uint32_t val;
+    TEST_ESP_OK(storage.readItem(1, "key0", val));
+    CHECK(val == 0);
+    emu.clearStats();
+    TEST_ESP_OK(storage.readItem(1, "key0", val));
+    CHECK(val == 0);
+    CHECK(emu.getReadOps() == 0);
+    // namespace and type are part of the cache key
+    TEST_ESP_OK(storage.readItem(2, "key0", val));
+    CHECK(val == 100);
+    uint16_t val16;
+    TEST_ESP_ERR(storage.readItem(1, "key0", val16), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(storage.readItem(1, "key0", val));
+    CHECK(val == 0);
+
+    nvs_stats_t stats;
+    TEST_ESP_OK(storage.fillStats(stats));
+    CHECK(stats.value_cache_hits == 2);
+    CHECK(stats.value_cache_misses == 3);
+
+    // written and erased keys are read from flash again
+    TEST_ESP_OK(storage.writeItem(1, "key0", static_cast<uint32_t>(10)));
+    TEST_ESP_OK(storage.readItem(1, "key0", val));
+    CHECK(val == 10);
+    TEST_ESP_OK(storage.eraseItem(1, ItemType::U32, "key0"));
+    TEST_ESP_ERR(storage.readItem(1, "key0", val), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(storage.readItem(2, "key0", val));
+    TEST_ESP_OK(storage.eraseNamespace(2));
+    TEST_ESP_ERR(storage.readItem(2, "key0", val), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(storage.readItem(1, "key1", val));
+    Storage::TBatchList ops;
+    uint32_t newValue = 11;
+    addBatchOp(ops, ItemType::U32, "key1", &newValue, sizeof(newValue));
+    TEST_ESP_OK(storage.writeBatch(1, ops));
+    ops.clearAndFreeNodes();
+    TEST_ESP_OK(storage.readItem(1, "key1", val));
+    CHECK(val == 11);
+
+    // least recently read values are dropped when the cache is full
+    for (uint32_t i = 1; i < 6; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", (int) i);
+        TEST_ESP_OK(storage.readItem(1, key, val));
+    }
+    emu.clearStats();
+    TEST_ESP_OK(storage.readItem(1, "key5", val));
+    TEST_ESP_OK(storage.readItem(1, "key2", val));
+    CHECK(emu.getReadOps() == 0);
+    TEST_ESP_OK(storage.readItem(1, "key1", val));
+    CHECK(val == 11);
+    CHECK(emu.getReadOps() > 0);
+
+    TEST_ESP_OK(storage.setValueCacheEntries(0));
+    emu.clearStats();
+    TEST_ESP_OK(storage.readItem(1, "key5", val));
+    CHECK(val == 5);
+    CHECK(emu.getReadOps() > 0);
+    TEST_ESP_OK(storage.fillStats(stats));
+    CHECK(stats.value_cache_hits == 0);
+    CHECK(stats.value_cache_misses == 0);
+}
+
+TEST_CASE("benchmark polling hot keys with value cache", "[nvs]")
+{
+    const size_t keyCount = 200;
+    const size_t hotKeys = 8;
+    const size_t reads = 10000;
+    size_t flashTime[2], readOps[2];
+    for (int cached = 0; cached < 2; ++cached) {
+        SpiFlashEmulator emu(10);
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, 10));
+        TEST_ESP_OK(storage.setValueCacheEntries(cached ? 16 : 0));
+        for (size_t i = 0; i < keyCount; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%d", (int) i);
+            TEST_ESP_OK(storage.writeItem(1, key, static_cast<uint32_t>(i)));
+        }
+        emu.clearStats();
+        srand(42);
+        for (size_t i = 0; i < reads; ++i) {
+            // most reads go to a few keys, with an occasional write to one of them
+            size_t index = (rand() % 10 == 0) ? rand() % keyCount : rand() % hotKeys;
+            char key[16];
+            snprintf(key, sizeof(key), "key%d", (int) index);
+            if (i % 1000 == 999) {
+                TEST_ESP_OK(storage.writeItem(1, key, static_cast<uint32_t>(index)));
+            }
+            uint32_t val;
+            TEST_ESP_OK(storage.readItem(1, key, val));
+            REQUIRE(val == index);
+        }
+        flashTime[cached] = emu.getTotalTime();
+        readOps[cached] = emu.getReadOps();
+        if (cached) {
+            nvs_stats_t stats;
+            TEST_ESP_OK(storage.fillStats(stats));
+            CHECK(stats.value_cache_hits > reads / 2);
+            s_perf << "Polling " << hotKeys << " hot keys out of " << keyCount << ", " << reads << " reads: "
+                   << flashTime[0] << " us in " << readOps[0] << " flash reads without value cache, "
+                   << flashTime[1] << " us in " << readOps[1] << " flash reads with 16 cached values ("
+                   << stats.value_cache_hits << " hits, " << stats.value_cache_misses << " misses)" << std::endl;
+        }
+    }
+    CHECK(readOps[1] < readOps[0] / 4);
+}
+
+TEST_CASE("slicing-by-8 crc32 gives the same results as crc32_le", "[nvs]")
+{
+    srand(42);
+    uint8_t buf[256];
+    for (auto& byte : buf) {
+        byte = static_cast<uint8_t>(rand());
+    }
+    for (size_t offset = 0; offset < 8; ++offset) {
+        for (size_t len = 0; len + offset <= sizeof(buf); ++len) {
+            CHECK(nvs_crc32_le_slicing_by_8(0xffffffff, buf + offset, len) == crc32_le(0xffffffff, buf + offset, len));
+            CHECK(nvs_crc32_le_slicing_by_8(0, buf + offset, len) == crc32_le(0, buf + offset, len));
+        }
+    }
+    uint32_t crc = nvs_crc32_le_slicing_by_8(0xffffffff, buf, 13);
+    CHECK(nvs_crc32_le_slicing_by_8(crc, buf + 13, 100) == crc32_le(0xffffffff, buf, 113));
+}
+
+TEST_CASE("single pass item crc32 matches crc32 of item fields", "[nvs]")
+{
+    srand(42);
+    for (int i = 0; i < 1000; ++i) {
+        Item item;
+        for (auto& byte : item.rawData) {
+            byte = static_cast<uint8_t>(rand());
+        }
+        const uint8_t* p = item.rawData;
+        uint32_t crc = crc32_le(0xffffffff, p + offsetof(Item, nsIndex), offsetof(Item, crc32) - offsetof(Item, nsIndex));
+        crc = crc32_le(crc, p + offsetof(Item, key), sizeof(item.key));
+        crc = crc32_le(crc, p + offsetof(Item, data), sizeof(item.data));
+        CHECK(item.calculateCrc32() == crc);
+
+        crc = crc32_le(0xffffffff, p + offsetof(Item, nsIndex), offsetof(Item, datatype) - offsetof(Item, nsIndex));
+        crc = crc32_le(crc, p + offsetof(Item, key), sizeof(item.key));
+        crc = crc32_le(crc, p + offsetof(Item, chunkIndex), sizeof(item.chunkIndex));
+        CHECK(item.calculateCrc32WithoutValue() == crc);
+    }
+}
+
+TEST_CASE("benchmark entry crc32 when mounting a full partition", "[nvs]")
+{
+    const size_t sectors = 64;
+    const int rounds = 20;
+    SpiFlashEmulator emu(sectors);
+    {
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, sectors));
+        size_t i = 0;
+        esp_err_t err;
+        do {
+            char key[16];
+            snprintf(key, sizeof(key), "key%d", (int) i);
+            err = storage.writeItem(1, key, static_cast<uint32_t>(i++));
+        } while (err == ESP_OK);
+        CHECK(err == ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+    }
+
+    // mounting checks the crc of every written entry, and computes its hash for the hash list
+    const size_t entryDataOffset = 2 * Page::ENTRY_SIZE; // after page header and entry state table
+    vector<const Item*> items;
+    for (size_t sector = 0; sector < sectors; ++sector) {
+        const uint8_t* page = emu.bytes() + sector * SPI_FLASH_SEC_SIZE;
+        for (size_t entry = 0; entry < Page::ENTRY_COUNT; ++entry) {
+            const Item* item = reinterpret_cast<const Item*>(page + entryDataOffset + entry * Page::ENTRY_SIZE);
+            if (item->span != 0xff) {
+                items.push_back(item);
+            }
+        }
+    }
+    volatile uint32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (auto item : items) {
+            const uint8_t* p = item->rawData;
+            uint32_t crc = crc32_le(0xffffffff, p + offsetof(Item, nsIndex), offsetof(Item, crc32) - offsetof(Item, nsIndex));
+            crc = crc32_le(crc, p + offsetof(Item, key), sizeof(item->key));
+            sink = crc32_le(crc, p + offsetof(Item, data), sizeof(item->data));
+            crc = crc32_le(0xffffffff, p + offsetof(Item, nsIndex), offsetof(Item, datatype) - offsetof(Item, nsIndex));
+            crc = crc32_le(crc, p + offsetof(Item, key), sizeof(item->key));
+            sink = crc32_le(crc, p + offsetof(Item, chunkIndex), sizeof(item->chunkIndex));
+        }
+    }
+    auto byteWiseTime = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (auto item : items) {
+            sink = item->calculateCrc32();
+            sink = item->calculateCrc32WithoutValue();
+        }
+    }
+    auto singlePassTime = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, sectors));
+    }
+    auto mountTime = std::chrono::steady_clock::now() - start;
+    (void) sink;
+
+    auto us = [rounds](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / rounds;
+    };
+    s_perf << "Host time to mount a full " << sectors << " sector partition with " << items.size() << " entries: "
+           << us(mountTime) << " us, of which entry crc32 takes " << us(singlePassTime)
+           << " us in a single slicing-by-8 pass, compared to " << us(byteWiseTime)
+           << " us for three byte-wise crc32_le passes" << std::endl;
+}
+
+TEST_CASE("keys can be erased by prefix", "[nvs]")
+{
+    SpiFlashEmulator emu(6);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 6));
+
+    nvs_handle_t handle, other;
+    TEST_ESP_OK(nvs_open("sensors", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_open("other", NVS_READWRITE, &other));
+    vector<uint8_t> blob(5000, 0x5a);
+    for (int sensor = 1; sensor <= 3; ++sensor) {
+        char key[16];
+        snprintf(key, sizeof(key), "s%d_temp", sensor);
+        TEST_ESP_OK(nvs_set_i32(handle, key, sensor));
+        TEST_ESP_OK(nvs_set_i32(other, key, sensor));
+        snprintf(key, sizeof(key), "s%d_name", sensor);
+        TEST_ESP_OK(nvs_set_str(handle, key, "sensor name"));
+        snprintf(key, sizeof(key), "s%d_cal", sensor);
+        TEST_ESP_OK(nvs_set_blob(handle, key, blob.data(), blob.size()));
+    }
+    TEST_ESP_OK(nvs_set_u8(handle, "s2", 2));
+
+    TEST_ESP_OK(nvs_erase_prefix(handle, "s2_"));
+    int32_t value;
+    char str[16];
+    size_t size = sizeof(str);
+    TEST_ESP_ERR(nvs_get_i32(handle, "s2_temp", &value), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(nvs_get_str(handle, "s2_name", str, &size), ESP_ERR_NVS_NOT_FOUND);
+    size = 0;
+    TEST_ESP_ERR(nvs_get_blob(handle, "s2_cal", nullptr, &size), ESP_ERR_NVS_NOT_FOUND);
+    uint8_t u8;
+    TEST_ESP_OK(nvs_get_u8(handle, "s2", &u8));
+    TEST_ESP_OK(nvs_get_i32(other, "s2_temp", &value));
+    TEST_ESP_OK(nvs_get_i32(handle, "s1_temp", &value));
+    size = blob.size();
+    vector<uint8_t> read(blob.size());
+    TEST_ESP_OK(nvs_get_blob(handle, "s3_cal", read.data(), &size));
+    CHECK(read == blob);
+
+    TEST_ESP_ERR(nvs_erase_prefix(handle, "0123456789abcdef"), ESP_ERR_NVS_KEY_TOO_LONG);
+    TEST_ESP_OK(nvs_erase_prefix(handle, "nothing"));
+
+    // pending changes of matching keys are dropped in batch mode
+    nvs_handle_t batch;
+    TEST_ESP_OK(nvs_open("sensors", NVS_READWRITE_BATCH, &batch));
+    TEST_ESP_OK(nvs_set_i32(batch, "s1_temp", 100));
+    TEST_ESP_OK(nvs_set_i32(batch, "s4_temp", 4));
+    TEST_ESP_OK(nvs_erase_prefix(batch, "s1"));
+    TEST_ESP_OK(nvs_commit(batch));
+    nvs_close(batch);
+    TEST_ESP_ERR(nvs_get_i32(handle, "s1_temp", &value), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_get_i32(handle, "s4_temp", &value));
+    CHECK(value == 4);
+
+    nvs_close(handle);
+    nvs_close(other);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 6));
+    TEST_ESP_OK(nvs_open("sensors", NVS_READONLY, &handle));
+    TEST_ESP_ERR(nvs_get_i32(handle, "s2_temp", &value), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(nvs_get_i32(handle, "s1_temp", &value), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(nvs_get_i32(handle, "s3_temp", &value));
+    CHECK(value == 3);
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
+TEST_CASE("erasing by prefix drops cached values and writes entry states once per word", "[nvs]")
+{
+    SpiFlashEmulator emu(4);
+    Storage storage;
+    TEST_ESP_OK(storage.init(0, 4));
+    TEST_ESP_OK(storage.setValueCacheEntries(8));
+    for (uint32_t i = 0; i < 60; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "%s%d", (i % 2) ? "a_" : "b_", (int) i);
+        TEST_ESP_OK(storage.writeItem(1, key, i));
+    }
+    uint32_t val;
+    TEST_ESP_OK(storage.readItem(1, "a_1", val));
+    TEST_ESP_OK(storage.readItem(1, "b_0", val));
+
+    emu.clearStats();
+    TEST_ESP_OK(storage.eraseItemsWithPrefix(1, "a_"));
+    // the 60 entries are held by 4 words of the entry state table
+    CHECK(emu.getWriteOps() <= 4);
+    TEST_ESP_ERR(storage.readItem(1, "a_1", val), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(storage.readItem(1, "b_0", val));
+    CHECK(val == 0);
+    size_t used;
+    TEST_ESP_OK(storage.calcEntriesInNamespace(1, used));
+    CHECK(used == 30);
+}
+
+TEST_CASE("benchmark iterating and erasing keys by prefix", "[nvs]")
+{
+    const size_t sectors = 10;
+    const int sensors = 20;
+    const int keysPerSensor = 20;
+    SpiFlashEmulator emu(sectors);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, sectors));
+    nvs_handle_t handle;
+    TEST_ESP_OK(nvs_open("sensors", NVS_READWRITE, &handle));
+    for (int sensor = 0; sensor < sensors; ++sensor) {
+        for (int i = 0; i < keysPerSensor; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "s%02d_%d", sensor, i);
+            TEST_ESP_OK(nvs_set_u32(handle, key, i));
+        }
+    }
+
+    auto count = [](nvs_iterator_t it, const char* prefix) -> int {
+        int n = 0;
+        while (it != nullptr) {
+            nvs_entry_info_t info;
+            nvs_entry_info(it, &info);
+            if (strncmp(info.key, prefix, strlen(prefix)) == 0) {
+                ++n;
+            }
+            it = nvs_entry_next(it);
+        }
+        return n;
+    };
+    emu.clearStats();
+    CHECK(count(nvs_entry_find(NVS_DEFAULT_PART_NAME, "sensors", NVS_TYPE_ANY), "s07_") == keysPerSensor);
+    size_t scanTime = emu.getTotalTime();
+    size_t scanReads = emu.getReadOps();
+    emu.clearStats();
+    CHECK(count(nvs_entry_find_prefix(NVS_DEFAULT_PART_NAME, "sensors", NVS_TYPE_ANY, "s07_"), "s07_") == keysPerSensor);
+    size_t prefixTime = emu.getTotalTime();
+    size_t prefixReads = emu.getReadOps();
+
+    emu.clearStats();
+    for (int i = 0; i < keysPerSensor; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "s03_%d", i);
+        TEST_ESP_OK(nvs_erase_key(handle, key));
+    }
+    size_t eraseKeysTime = emu.getTotalTime();
+    size_t eraseKeysWrites = emu.getWriteOps();
+    emu.clearStats();
+    TEST_ESP_OK(nvs_erase_prefix(handle, "s04_"));
+    size_t erasePrefixTime = emu.getTotalTime();
+    size_t erasePrefixWrites = emu.getWriteOps();
+    CHECK(erasePrefixWrites < eraseKeysWrites);
+    CHECK(count(nvs_entry_find_prefix(NVS_DEFAULT_PART_NAME, "sensors", NVS_TYPE_ANY, "s0"), "s0") == 8 * keysPerSensor);
+
+    s_perf << "Listing " << keysPerSensor << " of " << sensors * keysPerSensor << " keys: iterating namespace "
+           << scanTime << " us (" << scanReads << " reads), iterating prefix " << prefixTime << " us ("
+           << prefixReads << " reads); erasing them: one by one " << eraseKeysTime << " us ("
+           << eraseKeysWrites << " writes), by prefix " << erasePrefixTime << " us ("
+           << erasePrefixWrites << " writes)" << std::endl;
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_flash_deinit_partition(NVS_DEFAULT_PART_NAME));
+}
+
 /* Add new tests above */
 /* This test has to be the final one */
 
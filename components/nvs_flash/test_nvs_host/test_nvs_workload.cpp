@@ -0,0 +1,126 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "nvs.h"
+#include "nvs_workload.h"
+#include "spi_flash_emulation.h"
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <string>
+
+using namespace std;
+
+TEST_CASE("workload settings are parsed", "[nvs_workload]")
+{
+    WorkloadConfig config;
+    CHECK(config.parse("name=test,sectors=16,keys=200,value_size=4-64,blob_percent=10,blob_size=100,"
+                       "skew=0.9,read_percent=50,ops=1000,seed=7,endurance=10000,writes_per_hour=3600") == ESP_OK);
+    CHECK(config.name == "test");
+    CHECK(config.sectors == 16);
+    CHECK(config.keyCount == 200);
+    CHECK(config.minValueSize == 4);
+    CHECK(config.maxValueSize == 64);
+    CHECK(config.blobPercent == 10);
+    CHECK(config.minBlobSize == 100);
+    CHECK(config.maxBlobSize == 100);
+    CHECK(config.skew == 0.9);
+    CHECK(config.readPercent == 50);
+    CHECK(config.operations == 1000);
+    CHECK(config.seed == 7);
+    CHECK(config.enduranceCycles == 10000);
+    CHECK(config.writesPerHour == 3600);
+
+    CHECK(config.parse("keys") == ESP_ERR_INVALID_ARG);
+    CHECK(config.parse("pages=4") == ESP_ERR_INVALID_ARG);
+    CHECK(config.parse("value_size=8-4") == ESP_ERR_INVALID_ARG);
+    CHECK(config.parse("blob_percent=101") == ESP_ERR_INVALID_ARG);
+    CHECK(config.parse("skew=high") == ESP_ERR_INVALID_ARG);
+}
+
+TEST_CASE("workload replay keeps values and accounts for flash wear", "[nvs_workload]")
+{
+    WorkloadConfig config;
+    REQUIRE(config.parse("sectors=6,keys=50,value_size=1-40,blob_percent=20,blob_size=10-300,"
+                         "skew=1.2,read_percent=25,ops=2000") == ESP_OK);
+    SpiFlashEmulator emu(config.sectors);
+    WorkloadResult result;
+    REQUIRE(workload_run(emu, config, result) == ESP_OK);
+
+    CHECK(result.operations == config.operations);
+    CHECK(result.writes > config.operations / 2);
+    CHECK(result.writes < config.operations);
+    CHECK(result.getWriteAmplification() > 1);
+    CHECK(result.getOpsPerSecond() > 0);
+    CHECK(result.sectorErases.size() == config.sectors);
+    CHECK(accumulate(result.sectorErases.begin(), result.sectorErases.end(), size_t(0)) == result.eraseOps);
+    CHECK(result.getMaxSectorErases() > 0);
+    CHECK(result.getProjectedWrites(config) > 0);
+
+    // replaying the same workload gives the same flash operations
+    WorkloadResult again;
+    SpiFlashEmulator emu2(config.sectors);
+    REQUIRE(workload_run(emu2, config, again) == ESP_OK);
+    CHECK(again.flashBytesWritten == result.flashBytesWritten);
+    CHECK(again.sectorErases == result.sectorErases);
+}
+
+TEST_CASE("workload which doesn't fit into the partition fails", "[nvs_workload]")
+{
+    WorkloadConfig config;
+    REQUIRE(config.parse("sectors=3,keys=20,blob_percent=100,blob_size=2000,ops=10") == ESP_OK);
+    SpiFlashEmulator emu(config.sectors);
+    WorkloadResult result;
+    CHECK(workload_run(emu, config, result) == ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+}
+
+/*
+ * Workloads to size partitions with. Additional workloads can be passed in the NVS_WORKLOAD
+ * environment variable, separated by semicolons, using the settings of WorkloadConfig::parse.
+ */
+TEST_CASE("benchmark workloads", "[nvs_workload][long]")
+{
+    vector<string> specs = {
+        "name=settings,sectors=6,keys=50,value_size=1-8,ops=20000",
+        "name=counters,sectors=6,keys=100,value_size=4,skew=1.5,ops=50000",
+        "name=strings,sectors=8,keys=100,value_size=8-64,skew=0.8,ops=20000",
+        "name=mixed,sectors=16,keys=200,value_size=1-32,blob_percent=10,blob_size=64-2000,skew=0.9,"
+        "read_percent=50,ops=20000",
+        "name=blobs,sectors=32,keys=20,blob_percent=100,blob_size=1000-4000,ops=5000",
+    };
+    const char* custom = getenv("NVS_WORKLOAD");
+    if (custom != nullptr) {
+        string list(custom);
+        size_t pos = 0;
+        while (pos <= list.size()) {
+            size_t next = list.find(';', pos);
+            if (next == string::npos) {
+                next = list.size();
+            }
+            if (next > pos) {
+                specs.push_back(list.substr(pos, next - pos));
+            }
+            pos = next + 1;
+        }
+    }
+
+    for (const auto& spec : specs) {
+        WorkloadConfig config;
+        REQUIRE(config.parse(spec.c_str()) == ESP_OK);
+        SpiFlashEmulator emu(config.sectors);
+        WorkloadResult result;
+        CHECK(workload_run(emu, config, result) == ESP_OK);
+        result.print(config, cout);
+    }
+}
@@ -61,6 +61,34 @@ void sdmmc_card_print_info(FILE* stream, const sdmmc_card_t* card);
 esp_err_t sdmmc_write_sectors(sdmmc_card_t* card, const void* src,
         size_t start_sector, size_t sector_count);
 
+/**
+ * Write given number of sectors to SD/MMC card, telling the card in advance
+ * how many sectors are going to be written
+ *
+ * For SD memory cards, the number of sectors is sent using ACMD23
+ * (SET_WR_BLK_ERASE_COUNT) before the multiple block write command. This lets
+ * the card pre-erase the blocks which will be written, which makes long
+ * sequential writes faster. The hint is only sent when the whole range is
+ * written using a single multiple block write, i.e. when sector_count > 1 and
+ * src is a DMA capable, word aligned buffer. In all other cases, and for MMC
+ * cards, this function behaves like sdmmc_write_sectors.
+ *
+ * @note If the write fails, contents of the sectors in the pre-erased range
+ *       which were not written are undefined.
+ *
+ * @param card  pointer to card information structure previously initialized
+ *              using sdmmc_card_init
+ * @param src   pointer to data buffer to read data from; data size must be
+ *              equal to sector_count * card->csd.sector_size
+ * @param start_sector  sector where to start writing
+ * @param sector_count  number of sectors to write
+ * @return
+ *      - ESP_OK on success
+ *      - One of the error codes from SDMMC host controller
+ */
+esp_err_t sdmmc_write_sectors_pre_erase(sdmmc_card_t* card, const void* src,
+        size_t start_sector, size_t sector_count);
+
 /**
  * Write given number of sectors to SD/MMC card
  *
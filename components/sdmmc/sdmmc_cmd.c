@@ -346,6 +346,16 @@ esp_err_t sdmmc_send_cmd_crc_on_off(sdmmc_card_t* card, bool crc_enable)
     return sdmmc_send_cmd(card, &cmd);
 }
 
+esp_err_t sdmmc_send_cmd_set_wr_blk_erase_count(sdmmc_card_t* card, size_t block_count)
+{
+    sdmmc_command_t cmd = {
+            .opcode = SD_APP_SET_WR_BLK_ERASE_COUNT,
+            .arg = block_count & 0x7fffff,
+            .flags = SCF_CMD_AC | SCF_RSP_R1
+    };
+    return sdmmc_send_app_cmd(card, &cmd);
+}
+
 esp_err_t sdmmc_send_cmd_send_status(sdmmc_card_t* card, uint32_t* out_status)
 {
     sdmmc_command_t cmd = {
@@ -394,6 +404,24 @@ esp_err_t sdmmc_write_sectors(sdmmc_card_t* card, const void* src,
     return err;
 }
 
+esp_err_t sdmmc_write_sectors_pre_erase(sdmmc_card_t* card, const void* src,
+        size_t start_block, size_t block_count)
+{
+    // ACMD23 only applies to the multiple block write which immediately
+    // follows it, so the hint is only sent if the whole range is written
+    // with a single CMD25. MMC and SDIO cards don't support it.
+    if (block_count > 1 && card->is_mem && !card->is_mmc &&
+            esp_ptr_dma_capable(src) && (intptr_t)src % 4 == 0) {
+        esp_err_t err = sdmmc_send_cmd_set_wr_blk_erase_count(card, block_count);
+        if (err != ESP_OK) {
+            // the hint is optional, the write itself is still valid
+            ESP_LOGD(TAG, "%s: ACMD23 returned 0x%x", __func__, err);
+        }
+        return sdmmc_write_sectors_dma(card, src, start_block, block_count);
+    }
+    return sdmmc_write_sectors(card, src, start_block, block_count);
+}
+
 esp_err_t sdmmc_write_sectors_dma(sdmmc_card_t* card, const void* src,
         size_t start_block, size_t block_count)
 {
@@ -63,6 +63,8 @@ void SpiFlash::init(uint32_t chip_size, uint32_t block_size, uint32_t sector_siz
 
     this->total_erase_cycles = 0;
 
+    this->reset_stats();
+
     // Load partitions table bin
     this->memory = (uint8_t *) malloc(this->chip_size);
     memset(this->memory, 0xFF, this->chip_size);
@@ -182,6 +184,9 @@ esp_rom_spiflash_result_t SpiFlash::write(uint32_t dest_addr, const void *src, u
         this->erase_states[i] = false;
     }
 
+    this->write_ops++;
+    this->write_bytes += size;
+
     // Do the write
     for(uint32_t ctr = 0; ctr < size; ctr++)
     {
@@ -218,6 +223,9 @@ esp_rom_spiflash_result_t SpiFlash::read(uint32_t src_addr, void *dest, uint32_t
         }
     }
 
+    this->read_ops++;
+    this->read_bytes += size;
+
     // Do the read
     memcpy(dest, &this->memory[src_addr], size);
     return ESP_ROM_SPIFLASH_RESULT_OK;
@@ -250,10 +258,38 @@ void SpiFlash::set_total_erase_cycles_limit(uint32_t limit)
 
 void SpiFlash::reset_erase_cycles()
 {
-    memset(this->erase_cycles, 0, sizeof(this->sectors * sizeof(uint32_t)));
+    memset(this->erase_cycles, 0, this->sectors * sizeof(uint32_t));
 }
 
 void SpiFlash::reset_total_erase_cycles()
 {
     this->total_erase_cycles = 0;
+}
+
+uint32_t SpiFlash::get_read_ops()
+{
+    return this->read_ops;
+}
+
+uint32_t SpiFlash::get_read_bytes()
+{
+    return this->read_bytes;
+}
+
+uint32_t SpiFlash::get_write_ops()
+{
+    return this->write_ops;
+}
+
+uint32_t SpiFlash::get_write_bytes()
+{
+    return this->write_bytes;
+}
+
+void SpiFlash::reset_stats()
+{
+    this->read_ops = 0;
+    this->read_bytes = 0;
+    this->write_ops = 0;
+    this->write_bytes = 0;
 }
\ No newline at end of file
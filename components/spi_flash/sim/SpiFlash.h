@@ -54,6 +54,13 @@ public:
     void reset_erase_cycles();
     void reset_total_erase_cycles();
 
+    // Number of read and write operations, and bytes transferred by them
+    uint32_t get_read_ops();
+    uint32_t get_read_bytes();
+    uint32_t get_write_ops();
+    uint32_t get_write_bytes();
+    void reset_stats();
+
     uint8_t* get_memory_ptr(uint32_t src_address);
 
 private:
@@ -75,6 +82,11 @@ private:
     uint32_t total_erase_cycles;
     uint32_t total_erase_cycles_limit;
 
+    uint32_t read_ops;
+    uint32_t read_bytes;
+    uint32_t write_ops;
+    uint32_t write_bytes;
+
     void deinit();
 };
 
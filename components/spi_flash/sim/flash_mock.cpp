@@ -75,6 +75,26 @@ extern "C" int spi_flash_get_erase_cycles(size_t sector)
     return spiflash.get_erase_cycles(sector);
 }
 
+extern "C" int spi_flash_get_read_ops(void)
+{
+    return spiflash.get_read_ops();
+}
+
+extern "C" int spi_flash_get_read_bytes(void)
+{
+    return spiflash.get_read_bytes();
+}
+
+extern "C" int spi_flash_get_write_ops(void)
+{
+    return spiflash.get_write_ops();
+}
+
+extern "C" void spi_flash_reset_stats(void)
+{
+    spiflash.reset_stats();
+}
+
 esp_rom_spiflash_result_t esp_rom_spiflash_read(uint32_t target, uint32_t *dest, int32_t len)
 {
     return spiflash.read(target, dest, len);
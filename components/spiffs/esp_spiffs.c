@@ -84,6 +84,86 @@ static time_t vfs_spiffs_get_mtime(const spiffs_stat* s);
 
 static esp_spiffs_t * _efs[CONFIG_SPIFFS_MAX_PARTITIONS];
 
+#ifdef CONFIG_SPIFFS_GC_TASK
+static void esp_spiffs_gc_task(void* arg)
+{
+    esp_spiffs_t * efs = (esp_spiffs_t *)arg;
+    const TickType_t idle_ticks = pdMS_TO_TICKS(CONFIG_SPIFFS_GC_TASK_IDLE_MS);
+    const TickType_t budget_ticks = pdMS_TO_TICKS(CONFIG_SPIFFS_GC_TASK_BUDGET_MS);
+    bool modified = false;
+    while (!efs->gc_stop) {
+        if (!modified) {
+            // sleep until the file system is modified
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        // wait until it is not modified for a while
+        while (!efs->gc_stop && ulTaskNotifyTake(pdTRUE, idle_ticks) != 0) {
+        }
+        if (efs->gc_stop) {
+            break;
+        }
+        modified = false;
+        TickType_t start = xTaskGetTickCount();
+        s32_t res;
+        do {
+            res = spiffs_api_gc_step(efs->fs, CONFIG_SPIFFS_GC_TASK_FREE_BLOCKS);
+            if (res < 0) {
+                ESP_LOGW(TAG, "garbage collection failed, %i", res);
+            }
+            if (ulTaskNotifyTake(pdTRUE, 0) != 0) {
+                // modified again, wait for the next idle period
+                modified = true;
+                break;
+            }
+        } while (res > 0 && xTaskGetTickCount() - start < budget_ticks);
+        if (res > 0) {
+            // out of time, continue after the next idle period
+            modified = true;
+        }
+    }
+    xSemaphoreGive(efs->gc_done);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t esp_spiffs_gc_task_start(esp_spiffs_t * efs)
+{
+    efs->gc_stop = false;
+    efs->gc_done = xSemaphoreCreateBinary();
+    if (efs->gc_done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(esp_spiffs_gc_task, "spiffs_gc", CONFIG_SPIFFS_GC_TASK_STACK_SIZE, efs,
+                    CONFIG_SPIFFS_GC_TASK_PRIORITY, &efs->gc_task) != pdPASS) {
+        efs->gc_task = NULL;
+        vSemaphoreDelete(efs->gc_done);
+        efs->gc_done = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static void esp_spiffs_gc_task_stop(esp_spiffs_t * efs)
+{
+    efs->gc_stop = true;
+    xTaskNotifyGive(efs->gc_task);
+    // not a task notification, one may already be pending for the calling task
+    xSemaphoreTake(efs->gc_done, portMAX_DELAY);
+    vSemaphoreDelete(efs->gc_done);
+    efs->gc_done = NULL;
+    efs->gc_task = NULL;
+}
+#endif // CONFIG_SPIFFS_GC_TASK
+
+/* Tell the garbage collection task, if any, that the file system was modified */
+static inline void esp_spiffs_modified(esp_spiffs_t * efs)
+{
+#ifdef CONFIG_SPIFFS_GC_TASK
+    if (efs->gc_task) {
+        xTaskNotifyGive(efs->gc_task);
+    }
+#endif
+}
+
 static void esp_spiffs_free(esp_spiffs_t ** efs)
 {
     esp_spiffs_t * e = *efs;
@@ -92,10 +172,17 @@ static void esp_spiffs_free(esp_spiffs_t ** efs)
     }
     *efs = NULL;
 
+#ifdef CONFIG_SPIFFS_GC_TASK
+    if (e->gc_task) {
+        esp_spiffs_gc_task_stop(e);
+    }
+#endif
+
     if (e->fs) {
         SPIFFS_unmount(e->fs);
         free(e->fs);
     }
+    spiffs_index_delete(e->index);
     vSemaphoreDelete(e->lock);
     free(e->fds);
     free(e->cache);
@@ -305,6 +392,9 @@ esp_err_t esp_spiffs_format(const char* partition_label)
     }
 
     SPIFFS_unmount(_efs[index]->fs);
+    if (_efs[index]->index) {
+        spiffs_index_clear(_efs[index]->index);
+    }
 
     s32_t res = SPIFFS_format(_efs[index]->fs);
     if (res != SPIFFS_OK) {
@@ -377,6 +467,13 @@ esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t * conf)
         return ESP_ERR_INVALID_STATE;
     }
 
+#ifdef CONFIG_SPIFFS_NAME_INDEX
+    _efs[index]->index = spiffs_index_create(_efs[index]->fs);
+    if (_efs[index]->index == NULL) {
+        ESP_LOGW(TAG, "file name index could not be created");
+    }
+#endif
+
     strlcat(_efs[index]->base_path, conf->base_path, ESP_VFS_PATH_MAX + 1);
     err = esp_vfs_register(conf->base_path, &vfs, _efs[index]);
     if (err != ESP_OK) {
@@ -384,6 +481,16 @@ esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t * conf)
         return err;
     }
 
+#ifdef CONFIG_SPIFFS_GC_TASK
+    err = esp_spiffs_gc_task_start(_efs[index]);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "garbage collection task could not be created");
+        esp_vfs_unregister(conf->base_path);
+        esp_spiffs_free(&_efs[index]);
+        return err;
+    }
+#endif
+
     return ESP_OK;
 }
 
@@ -465,7 +572,12 @@ static int vfs_spiffs_open(void* ctx, const char * path, int flags, int mode)
     assert(path);
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
     int spiffs_flags = spiffs_mode_conv(flags);
-    int fd = SPIFFS_open(efs->fs, path, spiffs_flags, mode);
+    int fd;
+    if (efs->index) {
+        fd = spiffs_index_open(efs->index, path, spiffs_flags, mode);
+    } else {
+        fd = SPIFFS_open(efs->fs, path, spiffs_flags, mode);
+    }
     if (fd < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
@@ -481,6 +593,7 @@ static ssize_t vfs_spiffs_write(void* ctx, int fd, const void * data, size_t siz
 {
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
     ssize_t res = SPIFFS_write(efs->fs, fd, (void *)data, size);
+    esp_spiffs_modified(efs);
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
@@ -504,7 +617,13 @@ static ssize_t vfs_spiffs_read(void* ctx, int fd, void * dst, size_t size)
 static int vfs_spiffs_close(void* ctx, int fd)
 {
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
-    int res = SPIFFS_close(efs->fs, fd);
+    int res;
+    if (efs->index) {
+        res = spiffs_index_close(efs->index, fd);
+    } else {
+        res = SPIFFS_close(efs->fs, fd);
+    }
+    esp_spiffs_modified(efs);
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
@@ -552,7 +671,12 @@ static int vfs_spiffs_stat(void* ctx, const char * path, struct stat * st)
     assert(st);
     spiffs_stat s;
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
-    off_t res = SPIFFS_stat(efs->fs, path, &s);
+    off_t res;
+    if (efs->index) {
+        res = spiffs_index_stat(efs->index, path, &s);
+    } else {
+        res = SPIFFS_stat(efs->fs, path, &s);
+    }
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
@@ -574,11 +698,15 @@ static int vfs_spiffs_rename(void* ctx, const char *src, const char *dst)
     assert(dst);
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
     int res = SPIFFS_rename(efs->fs, src, dst);
+    esp_spiffs_modified(efs);
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
         return -1;
     }
+    if (efs->index) {
+        spiffs_index_forget(efs->index, src);
+    }
     return res;
 }
 
@@ -587,11 +715,15 @@ static int vfs_spiffs_unlink(void* ctx, const char *path)
     assert(path);
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
     int res = SPIFFS_remove(efs->fs, path);
+    esp_spiffs_modified(efs);
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
         SPIFFS_clearerr(efs->fs);
         return -1;
     }
+    if (efs->index) {
+        spiffs_index_forget(efs->index, path);
+    }
     return res;
 }
 
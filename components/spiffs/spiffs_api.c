@@ -18,6 +18,7 @@
 #include "esp_spiffs.h"
 #include "esp_vfs.h"
 #include "spiffs_api.h"
+#include "spiffs_nucleus.h"
 
 static const char* TAG = "SPIFFS";
 
@@ -64,6 +65,51 @@ s32_t spiffs_api_erase(spiffs *fs, uint32_t addr, uint32_t size)
     return 0;
 }
 
+/* Read the counters which decide what to collect. Other tasks update them while they use the file system. */
+static void spiffs_api_gc_counters(spiffs *fs, uint32_t *free_blocks, uint32_t *deleted_pages, s32_t *free_pages)
+{
+    SPIFFS_LOCK(fs);
+    *free_blocks = fs->free_blocks;
+    *deleted_pages = fs->stats_p_deleted;
+    *free_pages = (SPIFFS_PAGES_PER_BLOCK(fs) - SPIFFS_OBJ_LOOKUP_PAGES(fs)) * (fs->block_count - 2)
+            - fs->stats_p_allocated - fs->stats_p_deleted;
+    SPIFFS_UNLOCK(fs);
+}
+
+s32_t spiffs_api_gc_step(spiffs *fs, uint32_t min_free_blocks)
+{
+    uint32_t free_blocks;
+    uint32_t deleted_pages;
+    s32_t free_pages;
+    spiffs_api_gc_counters(fs, &free_blocks, &deleted_pages, &free_pages);
+    if (free_blocks >= min_free_blocks) {
+        return 0;
+    }
+    // erasing blocks which only have deleted pages doesn't move any data, try this first
+    uint32_t prev_free_blocks = free_blocks;
+    s32_t res = SPIFFS_gc_quick(fs, 0);
+    spiffs_api_gc_counters(fs, &free_blocks, &deleted_pages, &free_pages);
+    if (res == SPIFFS_OK && free_blocks > prev_free_blocks) {
+        return 1;
+    }
+    SPIFFS_clearerr(fs);
+    if (deleted_pages == 0) {
+        return 0;
+    }
+    // SPIFFS_gc collects blocks until the requested size is free. Asking for
+    // one page more than is free makes it collect a single block (usually).
+    if (free_pages < 0) {
+        free_pages = 0;
+    }
+    res = SPIFFS_gc(fs, (free_pages + 1) * SPIFFS_DATA_PAGE_SIZE(fs));
+    if (res != SPIFFS_OK) {
+        res = SPIFFS_errno(fs);
+        SPIFFS_clearerr(fs);
+        return (res == SPIFFS_ERR_FULL) ? 0 : res;
+    }
+    return 1;
+}
+
 void spiffs_api_check(spiffs *fs, spiffs_check_type type, 
                             spiffs_check_report report, uint32_t arg1, uint32_t arg2)
 {
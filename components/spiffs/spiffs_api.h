@@ -22,6 +22,7 @@
 #include "spiffs.h"
 #include "esp_vfs.h"
 #include "esp_compiler.h"
+#include "spiffs_index.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,6 +43,10 @@ typedef struct {
     uint32_t fds_sz;                        /*!< File Descriptor Buffer Length */
     uint8_t *cache;                         /*!< Cache Buffer */
     uint32_t cache_sz;                      /*!< Cache Buffer Length */
+    spiffs_index_t *index;                  /*!< Index of file names, NULL if not used */
+    TaskHandle_t gc_task;                   /*!< Background garbage collection task, NULL if not used */
+    SemaphoreHandle_t gc_done;              /*!< Given by the garbage collection task when it exits */
+    volatile bool gc_stop;                  /*!< Set to stop the garbage collection task */
 } esp_spiffs_t;
 
 s32_t spiffs_api_read(spiffs *fs, uint32_t addr, uint32_t size, uint8_t *dst);
@@ -50,6 +55,17 @@ s32_t spiffs_api_write(spiffs *fs, uint32_t addr, uint32_t size, uint8_t *src);
 
 s32_t spiffs_api_erase(spiffs *fs, uint32_t addr, uint32_t size);
 
+/**
+ * @brief Collect one block, if the file system has less than the given number of free blocks
+ *
+ * Used to do garbage collection ahead of time, so that writes don't have to.
+ * Takes the file system lock, so it must be called without holding it.
+ *
+ * @return 1 if a block was collected, 0 if there are enough free blocks or
+ *         nothing can be collected, negative SPIFFS error code on failure
+ */
+s32_t spiffs_api_gc_step(spiffs *fs, uint32_t min_free_blocks);
+
 void spiffs_api_check(spiffs *fs, spiffs_check_type type,
                             spiffs_check_report report, uint32_t arg1, uint32_t arg2);
 
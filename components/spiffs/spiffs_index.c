@@ -0,0 +1,301 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spiffs_index.h"
+#include "spiffs_nucleus.h"
+
+#define INDEX_INITIAL_CAPACITY  64
+
+static uint32_t index_hash(const char *path)
+{
+    // FNV-1a; 0 marks an empty slot
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < SPIFFS_OBJ_NAME_LEN && path[i] != 0; i++) {
+        hash = (hash ^ (uint8_t) path[i]) * 16777619u;
+    }
+    return (hash != 0) ? hash : 1;
+}
+
+static size_t index_slot(const spiffs_index_t *index, uint32_t hash)
+{
+    return hash & (index->capacity - 1);
+}
+
+/* Remove the entry in the given slot, moving back the entries which follow it in the probe sequence */
+static void index_remove_at(spiffs_index_t *index, size_t i)
+{
+    const size_t mask = index->capacity - 1;
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (index->entries[j].hash == 0) {
+            break;
+        }
+        size_t home = index_slot(index, index->entries[j].hash);
+        // entry j can be moved to i if its home slot is not in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            index->entries[i] = index->entries[j];
+            i = j;
+        }
+    }
+    index->entries[i].hash = 0;
+    index->count--;
+}
+
+static bool index_grow(spiffs_index_t *index)
+{
+    size_t capacity = index->capacity ? index->capacity * 2 : INDEX_INITIAL_CAPACITY;
+    spiffs_index_entry_t *entries = calloc(capacity, sizeof(spiffs_index_entry_t));
+    if (entries == NULL) {
+        return false;
+    }
+    spiffs_index_entry_t *old_entries = index->entries;
+    size_t old_capacity = index->capacity;
+    index->entries = entries;
+    index->capacity = capacity;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_entries[i].hash != 0) {
+            size_t j = index_slot(index, old_entries[i].hash);
+            while (entries[j].hash != 0) {
+                j = (j + 1) & (capacity - 1);
+            }
+            entries[j] = old_entries[i];
+        }
+    }
+    free(old_entries);
+    return true;
+}
+
+static void index_update(spiffs_index_t *index, uint32_t hash, spiffs_obj_id obj_id, spiffs_page_ix pix)
+{
+    if (index->capacity == 0) {
+        return;
+    }
+    obj_id &= ~SPIFFS_OBJ_ID_IX_FLAG;
+    size_t i = index_slot(index, hash);
+    for (; index->entries[i].hash != 0; i = (i + 1) & (index->capacity - 1)) {
+        if (index->entries[i].hash == hash && index->entries[i].obj_id == obj_id) {
+            index->entries[i].pix = pix;
+            return;
+        }
+    }
+    // keep the load factor below 3/4; the index is only a hint, so a failed allocation is not an error
+    if ((index->count + 1) * 4 > index->capacity * 3) {
+        if (!index_grow(index)) {
+            return;
+        }
+        i = index_slot(index, hash);
+        while (index->entries[i].hash != 0) {
+            i = (i + 1) & (index->capacity - 1);
+        }
+    }
+    index->entries[i] = (spiffs_index_entry_t) {
+        .hash = hash,
+        .obj_id = obj_id,
+        .pix = pix
+    };
+    index->count++;
+}
+
+#define INDEX_OPEN_STALE    -1      // the page doesn't hold the object of the entry (any more)
+#define INDEX_OPEN_OTHER    -2      // the page holds another file whose name has the same hash
+#define INDEX_OPEN_FAILED   -3      // the page could not be checked
+
+/* Open the file of the entry, if its index header is still at the page of the entry and it has the given name */
+static spiffs_file index_open_page(spiffs *fs, const spiffs_index_entry_t *entry, const char *path, spiffs_flags flags, spiffs_mode mode)
+{
+    // O_TRUNC is only applied after checking that this is the right file
+    spiffs_file fh = SPIFFS_open_by_page(fs, entry->pix, flags & ~SPIFFS_O_TRUNC, mode);
+    if (fh < 0) {
+        s32_t err = SPIFFS_errno(fs);
+        SPIFFS_clearerr(fs);
+        return (err == SPIFFS_ERR_OUT_OF_FILE_DESCS) ? INDEX_OPEN_FAILED : INDEX_OPEN_STALE;
+    }
+    spiffs_stat s;
+    if (SPIFFS_fstat(fs, fh, &s) != SPIFFS_OK) {
+        SPIFFS_clearerr(fs);
+        SPIFFS_close(fs, fh);
+        return INDEX_OPEN_FAILED;
+    }
+    if ((s.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) != entry->obj_id) {
+        // the file was deleted and the page reused by another one
+        SPIFFS_close(fs, fh);
+        return INDEX_OPEN_STALE;
+    }
+    if (strncmp((const char *) s.name, path, SPIFFS_OBJ_NAME_LEN) != 0) {
+        SPIFFS_close(fs, fh);
+        return INDEX_OPEN_OTHER;
+    }
+    if (flags & SPIFFS_O_TRUNC) {
+        SPIFFS_close(fs, fh);
+        fh = SPIFFS_open_by_page(fs, entry->pix, flags, mode);
+        if (fh < 0) {
+            SPIFFS_clearerr(fs);
+            return INDEX_OPEN_FAILED;
+        }
+    }
+    return fh;
+}
+
+/* Find the file in the index and open it; stale entries found on the way are removed, entries of other files with
+   the same name hash are skipped */
+static spiffs_file index_open_existing(spiffs_index_t *index, uint32_t hash, const char *path, spiffs_flags flags, spiffs_mode mode)
+{
+    if (index->capacity == 0) {
+        return -1;
+    }
+    size_t i = index_slot(index, hash);
+    while (index->entries[i].hash != 0) {
+        if (index->entries[i].hash == hash) {
+            spiffs_file fh = index_open_page(index->fs, &index->entries[i], path, flags, mode);
+            if (fh == INDEX_OPEN_STALE) {
+                // the next entry of the probe sequence, if any, is moved into slot i
+                index_remove_at(index, i);
+                continue;
+            }
+            if (fh != INDEX_OPEN_OTHER) {
+                return fh;
+            }
+        }
+        i = (i + 1) & (index->capacity - 1);
+    }
+    return -1;
+}
+
+spiffs_index_t* spiffs_index_create(spiffs *fs)
+{
+    spiffs_index_t *index = calloc(1, sizeof(spiffs_index_t));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->fs = fs;
+    _lock_init(&index->lock);
+    if (!index_grow(index)) {
+        spiffs_index_delete(index);
+        return NULL;
+    }
+
+    spiffs_DIR d;
+    struct spiffs_dirent e;
+    if (SPIFFS_opendir(fs, "/", &d) == NULL) {
+        SPIFFS_clearerr(fs);
+        return index;
+    }
+    while (SPIFFS_readdir(&d, &e) != NULL) {
+        index_update(index, index_hash((const char *) e.name), e.obj_id, e.pix);
+    }
+    SPIFFS_closedir(&d);
+    SPIFFS_clearerr(fs);
+    return index;
+}
+
+void spiffs_index_delete(spiffs_index_t *index)
+{
+    if (index == NULL) {
+        return;
+    }
+    _lock_close(&index->lock);
+    free(index->entries);
+    free(index);
+}
+
+void spiffs_index_clear(spiffs_index_t *index)
+{
+    _lock_acquire(&index->lock);
+    if (index->entries) {
+        memset(index->entries, 0, index->capacity * sizeof(spiffs_index_entry_t));
+    }
+    index->count = 0;
+    _lock_release(&index->lock);
+}
+
+spiffs_file spiffs_index_open(spiffs_index_t *index, const char *path, spiffs_flags flags, spiffs_mode mode)
+{
+    spiffs *fs = index->fs;
+    uint32_t hash = index_hash(path);
+    spiffs_file fh = -1;
+    _lock_acquire(&index->lock);
+    if (!(flags & SPIFFS_O_EXCL)) {
+        fh = index_open_existing(index, hash, path, flags & ~SPIFFS_O_CREAT, mode);
+    }
+    if (fh < 0) {
+        fh = SPIFFS_open(fs, path, flags, mode);
+    }
+    spiffs_stat s;
+    if (fh >= 0) {
+        if (SPIFFS_fstat(fs, fh, &s) == SPIFFS_OK) {
+            index_update(index, hash, s.obj_id, s.pix);
+        } else {
+            SPIFFS_clearerr(fs);
+        }
+    }
+    _lock_release(&index->lock);
+    return fh;
+}
+
+s32_t spiffs_index_close(spiffs_index_t *index, spiffs_file fh)
+{
+    spiffs *fs = index->fs;
+    spiffs_stat s;
+    _lock_acquire(&index->lock);
+    // fstat writes back cached data, which moves the index header page if the file has changed
+    if (SPIFFS_fstat(fs, fh, &s) == SPIFFS_OK) {
+        index_update(index, index_hash((const char *) s.name), s.obj_id, s.pix);
+    } else {
+        SPIFFS_clearerr(fs);
+    }
+    s32_t res = SPIFFS_close(fs, fh);
+    _lock_release(&index->lock);
+    return res;
+}
+
+s32_t spiffs_index_stat(spiffs_index_t *index, const char *path, spiffs_stat *s)
+{
+    spiffs *fs = index->fs;
+    uint32_t hash = index_hash(path);
+    s32_t res;
+    _lock_acquire(&index->lock);
+    spiffs_file fh = index_open_existing(index, hash, path, SPIFFS_O_RDONLY, 0);
+    if (fh >= 0) {
+        res = SPIFFS_fstat(fs, fh, s);
+        SPIFFS_close(fs, fh);
+    } else {
+        res = SPIFFS_stat(fs, path, s);
+        if (res == SPIFFS_OK) {
+            index_update(index, hash, s->obj_id, s->pix);
+        }
+    }
+    _lock_release(&index->lock);
+    return res;
+}
+
+void spiffs_index_forget(spiffs_index_t *index, const char *path)
+{
+    uint32_t hash = index_hash(path);
+    _lock_acquire(&index->lock);
+    if (index->capacity > 0) {
+        size_t i = index_slot(index, hash);
+        while (index->entries[i].hash != 0) {
+            if (index->entries[i].hash == hash) {
+                index_remove_at(index, i);
+                continue;
+            }
+            i = (i + 1) & (index->capacity - 1);
+        }
+    }
+    _lock_release(&index->lock);
+}
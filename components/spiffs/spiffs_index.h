@@ -0,0 +1,95 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/lock.h>
+#include "spiffs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Entry of the file name index
+ */
+typedef struct {
+    uint32_t hash;                          /*!< Hash of the file name, 0 for an empty slot */
+    spiffs_obj_id obj_id;                   /*!< Object ID of the file, without SPIFFS_OBJ_ID_IX_FLAG */
+    spiffs_page_ix pix;                     /*!< Page of the object index header */
+} spiffs_index_entry_t;
+
+/**
+ * @brief In-RAM index which maps file names to object index header pages
+ *
+ * SPIFFS finds a file by name by scanning the object lookup pages of the
+ * whole partition and reading the index header page of each object. The
+ * index remembers the index header page of each file, so that the file can
+ * be opened with SPIFFS_open_by_page. Only name hashes are stored; each
+ * page found in the index is checked against the object ID and the name
+ * stored in flash. Entries whose page no longer holds their object are
+ * dropped, entries of other files with the same name hash are skipped.
+ * Opening a file which is not in the index falls back to SPIFFS_open.
+ */
+typedef struct {
+    spiffs *fs;                             /*!< File system the index belongs to */
+    spiffs_index_entry_t *entries;          /*!< Open addressing hash table */
+    size_t capacity;                        /*!< Number of slots, power of 2 */
+    size_t count;                           /*!< Number of used slots */
+    _lock_t lock;                           /*!< Protects the table */
+} spiffs_index_t;
+
+/**
+ * @brief Create the index of a mounted file system, adding all the files found in it
+ *
+ * @param fs  mounted file system
+ * @return pointer to the index, or NULL if memory could not be allocated
+ */
+spiffs_index_t* spiffs_index_create(spiffs *fs);
+
+/**
+ * @brief Delete the index
+ */
+void spiffs_index_delete(spiffs_index_t *index);
+
+/**
+ * @brief Remove all entries from the index, e.g. after the file system was formatted
+ */
+void spiffs_index_clear(spiffs_index_t *index);
+
+/**
+ * @brief Open a file, using the index to find it. Same semantics as SPIFFS_open.
+ */
+spiffs_file spiffs_index_open(spiffs_index_t *index, const char *path, spiffs_flags flags, spiffs_mode mode);
+
+/**
+ * @brief Close a file, recording in the index where its index header page has moved. Same semantics as SPIFFS_close.
+ */
+s32_t spiffs_index_close(spiffs_index_t *index, spiffs_file fh);
+
+/**
+ * @brief Get file status, using the index to find the file. Same semantics as SPIFFS_stat.
+ */
+s32_t spiffs_index_stat(spiffs_index_t *index, const char *path, spiffs_stat *s);
+
+/**
+ * @brief Drop the entries of a file which was removed or renamed
+ */
+void spiffs_index_forget(spiffs_index_t *index, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
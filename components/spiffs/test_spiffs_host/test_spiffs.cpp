@@ -8,6 +8,8 @@
 #include <dirent.h>
 #include <limits.h>
 #include <unistd.h>
+#include <algorithm>
+#include <chrono>
 
 #include "esp_partition.h"
 #include "spiffs.h"
@@ -17,6 +19,9 @@
 #include "catch.hpp"
 
 extern "C" void _spi_flash_init(const char* chip_size, size_t block_size, size_t sector_size, size_t page_size, const char* partition_bin);
+extern "C" int spi_flash_get_read_ops(void);
+extern "C" void spi_flash_reset_stats(void);
+extern "C" int spi_flash_get_total_erase_cycles(void);
 
 static void init_spiffs(spiffs *fs, uint32_t max_files)
 {
@@ -254,4 +259,312 @@ TEST_CASE("can read spiffs image", "[spiffs]")
     check_spiffs_files(&fs, "../spiffs", path_buf);
 
     deinit_spiffs(&fs);
-}
\ No newline at end of file
+}
+typedef struct {
+    int reads;
+    double us;
+} open_stats_t;
+
+static open_stats_t open_files(spiffs *fs, spiffs_index_t *index, int file_count, int open_count, bool stat_only)
+{
+    char name[SPIFFS_OBJ_NAME_LEN];
+    spi_flash_reset_stats();
+    auto start = std::chrono::steady_clock::now();
+    srand(1);
+    for (int i = 0; i < open_count; i++) {
+        int n = rand() % file_count;
+        snprintf(name, sizeof(name), "/file%04d", n);
+        if (stat_only) {
+            spiffs_stat s;
+            s32_t res = index ? spiffs_index_stat(index, name, &s) : SPIFFS_stat(fs, name, &s);
+            REQUIRE(res == SPIFFS_OK);
+            REQUIRE(s.size == sizeof(n));
+            continue;
+        }
+        spiffs_file fh = index ? spiffs_index_open(index, name, SPIFFS_O_RDONLY, 0) : SPIFFS_open(fs, name, SPIFFS_O_RDONLY, 0);
+        REQUIRE(fh >= 0);
+        int data;
+        REQUIRE(SPIFFS_read(fs, fh, &data, sizeof(data)) == sizeof(data));
+        REQUIRE(data == n);
+        REQUIRE((index ? spiffs_index_close(index, fh) : SPIFFS_close(fs, fh)) == SPIFFS_OK);
+    }
+    auto end = std::chrono::steady_clock::now();
+    open_stats_t stats;
+    stats.reads = spi_flash_get_read_ops();
+    stats.us = std::chrono::duration<double, std::micro>(end - start).count() / open_count;
+    return stats;
+}
+
+TEST_CASE("file name index finds files without scanning the partition", "[spiffs][index]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "storage");
+    REQUIRE(partition);
+    esp_partition_erase_range(partition, 0, partition->size);
+
+    spiffs fs;
+    init_spiffs(&fs, 5);
+
+    const int file_count = 2000;
+    char name[SPIFFS_OBJ_NAME_LEN];
+    for (int n = 0; n < file_count; n++) {
+        snprintf(name, sizeof(name), "/file%04d", n);
+        spiffs_file fh = SPIFFS_open(&fs, name, SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY, 0);
+        REQUIRE(fh >= 0);
+        REQUIRE(SPIFFS_write(&fs, fh, &n, sizeof(n)) == sizeof(n));
+        REQUIRE(SPIFFS_close(&fs, fh) == SPIFFS_OK);
+    }
+
+    spi_flash_reset_stats();
+    spiffs_index_t *index = spiffs_index_create(&fs);
+    REQUIRE(index != NULL);
+    REQUIRE(index->count == file_count);
+    printf("index of %d files built with %d flash reads\n", file_count, spi_flash_get_read_ops());
+
+    const int open_count = 200;
+    open_stats_t open_scan = open_files(&fs, NULL, file_count, open_count, false);
+    open_stats_t open_index = open_files(&fs, index, file_count, open_count, false);
+    open_stats_t stat_scan = open_files(&fs, NULL, file_count, open_count, true);
+    open_stats_t stat_index = open_files(&fs, index, file_count, open_count, true);
+    printf("open+close, %d files: %.1f reads, %.1f us without index; %.1f reads, %.1f us with index\n",
+           file_count, (double) open_scan.reads / open_count, open_scan.us,
+           (double) open_index.reads / open_count, open_index.us);
+    printf("stat, %d files: %.1f reads, %.1f us without index; %.1f reads, %.1f us with index\n",
+           file_count, (double) stat_scan.reads / open_count, stat_scan.us,
+           (double) stat_index.reads / open_count, stat_index.us);
+    CHECK(open_index.reads * 10 < open_scan.reads);
+    CHECK(stat_index.reads * 10 < stat_scan.reads);
+
+    // rewriting a file moves its index header page; the index follows it
+    snprintf(name, sizeof(name), "/file%04d", 7);
+    spiffs_file fh = spiffs_index_open(index, name, SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY, 0);
+    REQUIRE(fh >= 0);
+    int data = 7;
+    REQUIRE(SPIFFS_write(&fs, fh, &data, sizeof(data)) == sizeof(data));
+    REQUIRE(spiffs_index_close(index, fh) == SPIFFS_OK);
+    spi_flash_reset_stats();
+    spiffs_stat s;
+    REQUIRE(spiffs_index_stat(index, name, &s) == SPIFFS_OK);
+    CHECK(s.size == sizeof(data));
+    CHECK(spi_flash_get_read_ops() < 10);
+
+    // renamed and removed files are no longer found
+    REQUIRE(SPIFFS_rename(&fs, name, "/renamed") == SPIFFS_OK);
+    spiffs_index_forget(index, name);
+    CHECK(spiffs_index_stat(index, name, &s) == SPIFFS_ERR_NOT_FOUND);
+    SPIFFS_clearerr(&fs);
+    REQUIRE(spiffs_index_stat(index, "/renamed", &s) == SPIFFS_OK);
+    CHECK(s.size == sizeof(data));
+    snprintf(name, sizeof(name), "/file%04d", 8);
+    REQUIRE(SPIFFS_remove(&fs, name) == SPIFFS_OK);
+    spiffs_index_forget(index, name);
+    CHECK(spiffs_index_open(index, name, SPIFFS_O_RDONLY, 0) < 0);
+    SPIFFS_clearerr(&fs);
+
+    spiffs_index_delete(index);
+    deinit_spiffs(&fs);
+}
+
+TEST_CASE("file name index keeps files whose names have the same hash", "[spiffs][index]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "storage");
+    REQUIRE(partition);
+    esp_partition_erase_range(partition, 0, partition->size);
+
+    spiffs fs;
+    init_spiffs(&fs, 5);
+    spiffs_index_t *index = spiffs_index_create(&fs);
+    REQUIRE(index != NULL);
+
+    // FNV-1a hash of both names is 0x000139c6
+    const char *names[] = { "/sbbazj", "/cjdmkg" };
+    for (int n = 0; n < 2; n++) {
+        spiffs_file fh = spiffs_index_open(index, names[n], SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY, 0);
+        REQUIRE(fh >= 0);
+        REQUIRE(SPIFFS_write(&fs, fh, &n, sizeof(n)) == sizeof(n));
+        REQUIRE(spiffs_index_close(index, fh) == SPIFFS_OK);
+    }
+    REQUIRE(index->count == 2);
+
+    // looking up either name skips the entry of the other file instead of dropping it
+    for (int round = 0; round < 2; round++) {
+        for (int n = 1; n >= 0; n--) {
+            spiffs_stat s;
+            REQUIRE(spiffs_index_stat(index, names[n], &s) == SPIFFS_OK);
+            CHECK(strcmp((const char *) s.name, names[n]) == 0);
+            spiffs_file fh = spiffs_index_open(index, names[n], SPIFFS_O_RDONLY, 0);
+            REQUIRE(fh >= 0);
+            int data = -1;
+            REQUIRE(SPIFFS_read(&fs, fh, &data, sizeof(data)) == sizeof(data));
+            CHECK(data == n);
+            REQUIRE(spiffs_index_close(index, fh) == SPIFFS_OK);
+            CHECK(index->count == 2);
+        }
+    }
+
+    // the entry of a file removed behind the index is dropped, the other one is kept
+    REQUIRE(SPIFFS_remove(&fs, names[0]) == SPIFFS_OK);
+    spiffs_stat s;
+    CHECK(spiffs_index_stat(index, names[0], &s) == SPIFFS_ERR_NOT_FOUND);
+    SPIFFS_clearerr(&fs);
+    CHECK(index->count == 1);
+    REQUIRE(spiffs_index_stat(index, names[1], &s) == SPIFFS_OK);
+    CHECK(strcmp((const char *) s.name, names[1]) == 0);
+    CHECK(index->count == 1);
+
+    spiffs_index_delete(index);
+    deinit_spiffs(&fs);
+}
+
+typedef struct {
+    int max_erases;             // most flash sectors erased by a single write
+    double max_us;              // longest write
+    double avg_us;
+} write_latency_t;
+
+/* Rotating logs on a partition which is mostly full of static data */
+static write_latency_t log_writes(bool gc_ahead)
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "storage");
+    REQUIRE(partition);
+    esp_partition_erase_range(partition, 0, partition->size);
+
+    spiffs fs;
+    init_spiffs(&fs, 5);
+
+    const size_t chunk_size = 4096;
+    char *chunk = (char*) calloc(1, chunk_size);
+    spiffs_file fh = SPIFFS_open(&fs, "/static", SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY, 0);
+    REQUIRE(fh >= 0);
+    for (size_t i = 0; i < 1024 * 1024 / chunk_size; i++) {
+        REQUIRE(SPIFFS_write(&fs, fh, chunk, chunk_size) == chunk_size);
+    }
+    REQUIRE(SPIFFS_close(&fs, fh) == SPIFFS_OK);
+    free(chunk);
+
+    const int log_count = 8;
+    const int records_per_log = 512;
+    const int record_count = 16000;
+    const int records_per_burst = 16;
+    char record[128];
+    char name[SPIFFS_OBJ_NAME_LEN];
+    write_latency_t latency = {};
+    double total_us = 0;
+    int log = 0;
+    fh = -1;
+    for (int r = 0; r < record_count; r++) {
+        if (r % records_per_log == 0) {
+            if (fh >= 0) {
+                REQUIRE(SPIFFS_close(&fs, fh) == SPIFFS_OK);
+            }
+            snprintf(name, sizeof(name), "/log%d", log % log_count);
+            SPIFFS_remove(&fs, name);
+            SPIFFS_clearerr(&fs);
+            fh = SPIFFS_open(&fs, name, SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY, 0);
+            REQUIRE(fh >= 0);
+            log++;
+        }
+        if (gc_ahead && r % records_per_burst == 0) {
+            // idle time between bursts of records, as seen by the garbage collection task
+            for (int step = 0; step < 4 && spiffs_api_gc_step(&fs, 5) > 0; step++) {
+            }
+        }
+        memset(record, 'a' + r % 26, sizeof(record));
+        int erases = spi_flash_get_total_erase_cycles();
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE(SPIFFS_write(&fs, fh, record, sizeof(record)) == sizeof(record));
+        auto end = std::chrono::steady_clock::now();
+        double us = std::chrono::duration<double, std::micro>(end - start).count();
+        latency.max_erases = std::max(latency.max_erases, spi_flash_get_total_erase_cycles() - erases);
+        latency.max_us = std::max(latency.max_us, us);
+        total_us += us;
+    }
+    REQUIRE(SPIFFS_close(&fs, fh) == SPIFFS_OK);
+    latency.avg_us = total_us / record_count;
+
+    // the logs are intact
+    for (int i = 0; i < log_count; i++) {
+        snprintf(name, sizeof(name), "/log%d", i);
+        spiffs_stat s;
+        REQUIRE(SPIFFS_stat(&fs, name, &s) == SPIFFS_OK);
+        CHECK(s.size == records_per_log * sizeof(record));
+    }
+    CHECK(SPIFFS_check(&fs) == SPIFFS_OK);
+
+    deinit_spiffs(&fs);
+    return latency;
+}
+
+TEST_CASE("garbage collection ahead of time keeps writes short", "[spiffs][gc]")
+{
+    write_latency_t inline_gc = log_writes(false);
+    write_latency_t gc_ahead = log_writes(true);
+    printf("128 byte log writes, garbage collection while writing: worst %d erases, %.1f us, average %.2f us\n",
+           inline_gc.max_erases, inline_gc.max_us, inline_gc.avg_us);
+    printf("128 byte log writes, garbage collection ahead of time: worst %d erases, %.1f us, average %.2f us\n",
+           gc_ahead.max_erases, gc_ahead.max_us, gc_ahead.avg_us);
+    CHECK(inline_gc.max_erases > 0);
+    CHECK(gc_ahead.max_erases < inline_gc.max_erases);
+}
+
+TEST_CASE("garbage collection step collects blocks until enough are free", "[spiffs][gc]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "storage");
+    REQUIRE(partition);
+    esp_partition_erase_range(partition, 0, partition->size);
+
+    spiffs fs;
+    init_spiffs(&fs, 5);
+
+    // enough free blocks, nothing to do
+    spi_flash_reset_stats();
+    CHECK(spiffs_api_gc_step(&fs, 1) == 0);
+    CHECK(spi_flash_get_total_erase_cycles() == 0);
+
+    // blocks which are half deleted, so that the pages still in use have to be moved
+    const size_t chunk_size = 1024;
+    const int chunk_count = 256;
+    char *chunk = (char*) calloc(1, chunk_size);
+    spiffs_file keep = SPIFFS_open(&fs, "/keep", SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY, 0);
+    spiffs_file drop = SPIFFS_open(&fs, "/drop", SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY, 0);
+    REQUIRE(keep >= 0);
+    REQUIRE(drop >= 0);
+    for (int i = 0; i < chunk_count; i++) {
+        REQUIRE(SPIFFS_write(&fs, keep, chunk, chunk_size) == chunk_size);
+        REQUIRE(SPIFFS_write(&fs, drop, chunk, chunk_size) == chunk_size);
+    }
+    REQUIRE(SPIFFS_close(&fs, keep) == SPIFFS_OK);
+    REQUIRE(SPIFFS_close(&fs, drop) == SPIFFS_OK);
+    REQUIRE(SPIFFS_remove(&fs, "/drop") == SPIFFS_OK);
+    free(chunk);
+
+    const uint32_t min_free_blocks = fs.free_blocks + 4;
+    spi_flash_reset_stats();
+    s32_t res;
+    int steps = 0;
+    do {
+        uint32_t free_blocks = fs.free_blocks;
+        res = spiffs_api_gc_step(&fs, min_free_blocks);
+        REQUIRE(res >= 0);
+        if (res > 0) {
+            CHECK(fs.free_blocks > free_blocks);
+            steps++;
+        }
+    } while (res > 0 && steps < (int) fs.block_count);
+    CHECK(steps > 0);
+    CHECK(fs.free_blocks >= min_free_blocks);
+    CHECK(spi_flash_get_total_erase_cycles() > 0);
+
+    // done until more blocks are needed
+    CHECK(spiffs_api_gc_step(&fs, min_free_blocks) == 0);
+
+    spiffs_stat s;
+    REQUIRE(SPIFFS_stat(&fs, "/keep", &s) == SPIFFS_OK);
+    CHECK(s.size == chunk_count * chunk_size);
+    CHECK(SPIFFS_check(&fs) == SPIFFS_OK);
+
+    deinit_spiffs(&fs);
+}
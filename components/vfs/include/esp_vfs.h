@@ -29,6 +29,7 @@
 #include <sys/time.h>
 #include <sys/termios.h>
 #include <sys/poll.h>
+#include <sys/uio.h>
 #include <dirent.h>
 #include <string.h>
 #include "sdkconfig.h"
@@ -120,6 +121,14 @@ typedef struct
         ssize_t (*pwrite_p)(void *ctx, int fd, const void *src, size_t size, off_t offset);          /*!< pwrite with context pointer */
         ssize_t (*pwrite)(int fd, const void *src, size_t size, off_t offset);                       /*!< pwrite without context pointer */
     };
+    union {
+        ssize_t (*readv_p)(void *ctx, int fd, const struct iovec *iov, int iovcnt);                  /*!< readv with context pointer */
+        ssize_t (*readv)(int fd, const struct iovec *iov, int iovcnt);                               /*!< readv without context pointer */
+    };
+    union {
+        ssize_t (*writev_p)(void *ctx, int fd, const struct iovec *iov, int iovcnt);                 /*!< writev with context pointer */
+        ssize_t (*writev)(int fd, const struct iovec *iov, int iovcnt);                              /*!< writev without context pointer */
+    };
     union {
         int (*open_p)(void* ctx, const char * path, int flags, int mode);                            /*!< open with context pointer */
         int (*open)(const char * path, int flags, int mode);                                         /*!< open without context pointer */
@@ -439,6 +448,38 @@ ssize_t esp_vfs_pread(int fd, void *dst, size_t size, off_t offset);
  */
 ssize_t esp_vfs_pwrite(int fd, const void *src, size_t size, off_t offset);
 
+/**
+ *
+ * @brief Implements the VFS layer of POSIX readv()
+ *
+ * If the VFS driver doesn't provide readv, the buffers are filled one after
+ * the other using read. Reading stops at the first short read.
+ *
+ * @param fd         File descriptor used for read
+ * @param iov        Array of buffers where the output will be written
+ * @param iovcnt     Number of buffers in iov
+ *
+ * @return           A positive return value indicates the number of bytes read. -1 is return on failure and errno is
+ *                   set accordingly.
+ */
+ssize_t esp_vfs_readv(int fd, const struct iovec *iov, int iovcnt);
+
+/**
+ *
+ * @brief Implements the VFS layer of POSIX writev()
+ *
+ * If the VFS driver doesn't provide writev, the buffers are written one after
+ * the other using write. Writing stops at the first short write.
+ *
+ * @param fd         File descriptor used for write
+ * @param iov        Array of buffers from where the output will be read
+ * @param iovcnt     Number of buffers in iov
+ *
+ * @return           A positive return value indicates the number of bytes written. -1 is return on failure and errno is
+ *                   set accordingly.
+ */
+ssize_t esp_vfs_writev(int fd, const struct iovec *iov, int iovcnt);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -17,12 +17,14 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/fcntl.h>
+#include <sys/uio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_vfs.h"
 #include "unity.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "test_utils.h"
 #include "ccomp_timer.h"
 
@@ -266,3 +268,147 @@ TEST_CASE("Open & write & close through VFS passes performance test", "[vfs]")
 #endif
 
 }
+
+#define WRITE_TEST_TASKS        4
+#define WRITE_TEST_ITER_COUNT   20000
+
+typedef struct {
+    int fd;
+    int64_t time_us;
+    SemaphoreHandle_t start;
+    SemaphoreHandle_t done;
+} write_test_task_param_t;
+
+static void write_test_task(void *param)
+{
+    write_test_task_param_t *task_param = (write_test_task_param_t *) param;
+    xSemaphoreTake(task_param->start, portMAX_DELAY);
+
+    const int64_t start = esp_timer_get_time();
+    for (int i = 0; i < WRITE_TEST_ITER_COUNT; ++i) {
+        write(task_param->fd, "a", 1);
+    }
+    task_param->time_us = esp_timer_get_time() - start;
+
+    xSemaphoreGive(task_param->done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Concurrent write through VFS passes performance test", "[vfs]")
+{
+    esp_vfs_t desc = {
+        .flags = ESP_VFS_FLAG_DEFAULT,
+        .open = time_test_vfs_open,
+        .close = time_test_vfs_close,
+        .write = time_test_vfs_write,
+    };
+
+    TEST_ESP_OK( esp_vfs_register(VFS_PREF1, &desc, NULL) );
+
+    write_test_task_param_t param[WRITE_TEST_TASKS];
+    SemaphoreHandle_t start = xSemaphoreCreateCounting(WRITE_TEST_TASKS, 0);
+    TEST_ASSERT_NOT_NULL(start);
+    for (int i = 0; i < WRITE_TEST_TASKS; ++i) {
+        param[i].fd = open(VFS_PREF1 FILE1, 0, 0);
+        TEST_ASSERT_NOT_EQUAL(param[i].fd, -1);
+        param[i].start = start;
+        param[i].done = xSemaphoreCreateBinary();
+        TEST_ASSERT_NOT_NULL(param[i].done);
+        xTaskCreatePinnedToCore(write_test_task, "wr", CONCURRENT_TEST_STACK_SIZE, &param[i], 3, NULL,
+                                i % portNUM_PROCESSORS);
+    }
+
+    for (int i = 0; i < WRITE_TEST_TASKS; ++i) {
+        xSemaphoreGive(start);
+    }
+
+    int64_t max_time_us = 0;
+    for (int i = 0; i < WRITE_TEST_TASKS; ++i) {
+        TEST_ASSERT_EQUAL(xSemaphoreTake(param[i].done, CONCURRENT_TEST_MAX_WAIT * 10), pdTRUE);
+        vSemaphoreDelete(param[i].done);
+        TEST_ASSERT_NOT_EQUAL(close(param[i].fd), -1);
+        if (param[i].time_us > max_time_us) {
+            max_time_us = param[i].time_us;
+        }
+    }
+    vSemaphoreDelete(start);
+    TEST_ESP_OK( esp_vfs_unregister(VFS_PREF1) );
+
+    // tasks pinned to the same CPU share it, so the time measured by each task includes the calls of the others
+    const int tasks_per_cpu = (WRITE_TEST_TASKS + portNUM_PROCESSORS - 1) / portNUM_PROCESSORS;
+    const int ns_per_call = (int) (max_time_us * 1000 / tasks_per_cpu / WRITE_TEST_ITER_COUNT);
+#ifdef CONFIG_SPIRAM
+    TEST_PERFORMANCE_LESS_THAN(VFS_WRITE_TIME_PSRAM, "%dns", ns_per_call);
+#else
+    TEST_PERFORMANCE_LESS_THAN(VFS_WRITE_TIME, "%dns", ns_per_call);
+#endif
+}
+
+static char s_vectored_test_buf[32];
+static size_t s_vectored_test_len;
+static int s_vectored_test_calls;
+
+static int vectored_test_vfs_write(int fd, const void *data, size_t size)
+{
+    // accept at most 4 bytes per call, to check that partial writes stop the loop
+    size = (size > 4) ? 4 : size;
+    memcpy(s_vectored_test_buf + s_vectored_test_len, data, size);
+    s_vectored_test_len += size;
+    ++s_vectored_test_calls;
+    return size;
+}
+
+static int vectored_test_vfs_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    for (int i = 0; i < iovcnt; ++i) {
+        memcpy(s_vectored_test_buf + s_vectored_test_len, iov[i].iov_base, iov[i].iov_len);
+        s_vectored_test_len += iov[i].iov_len;
+    }
+    ++s_vectored_test_calls;
+    return s_vectored_test_len;
+}
+
+TEST_CASE("writev() calls the VFS driver or falls back to write()", "[vfs]")
+{
+    esp_vfs_t desc = {
+        .flags = ESP_VFS_FLAG_DEFAULT,
+        .open = time_test_vfs_open,
+        .close = time_test_vfs_close,
+        .write = vectored_test_vfs_write,
+    };
+    const struct iovec iov[] = {
+        { .iov_base = "abc", .iov_len = 3 },
+        { .iov_base = NULL, .iov_len = 0 },
+        { .iov_base = "defgh", .iov_len = 5 },
+        { .iov_base = "ijk", .iov_len = 3 },
+    };
+
+    TEST_ESP_OK( esp_vfs_register(VFS_PREF1, &desc, NULL) );
+    int fd = open(VFS_PREF1 FILE1, 0, 0);
+    TEST_ASSERT_NOT_EQUAL(fd, -1);
+    s_vectored_test_len = 0;
+    s_vectored_test_calls = 0;
+    // "defgh" is written partially, so "ijk" is not written
+    TEST_ASSERT_EQUAL(7, writev(fd, iov, 4));
+    TEST_ASSERT_EQUAL(2, s_vectored_test_calls);
+    TEST_ASSERT_EQUAL_MEMORY("abcdefg", s_vectored_test_buf, 7);
+    TEST_ASSERT_EQUAL(-1, writev(fd, iov, -1));
+    TEST_ASSERT_EQUAL(EINVAL, errno);
+    TEST_ASSERT_NOT_EQUAL(close(fd), -1);
+    TEST_ESP_OK( esp_vfs_unregister(VFS_PREF1) );
+
+    desc.writev = vectored_test_vfs_writev;
+    TEST_ESP_OK( esp_vfs_register(VFS_PREF1, &desc, NULL) );
+    fd = open(VFS_PREF1 FILE1, 0, 0);
+    TEST_ASSERT_NOT_EQUAL(fd, -1);
+    s_vectored_test_len = 0;
+    s_vectored_test_calls = 0;
+    TEST_ASSERT_EQUAL(11, writev(fd, iov, 4));
+    TEST_ASSERT_EQUAL(1, s_vectored_test_calls);
+    TEST_ASSERT_EQUAL_MEMORY("abcdefghijk", s_vectored_test_buf, 11);
+    TEST_ASSERT_NOT_EQUAL(close(fd), -1);
+    TEST_ESP_OK( esp_vfs_unregister(VFS_PREF1) );
+
+    TEST_ASSERT_EQUAL(-1, writev(fd, iov, 4));
+    TEST_ASSERT_EQUAL(EBADF, errno);
+}
@@ -36,7 +36,8 @@ static const char *TAG = "vfs";
 
 #define VFS_MAX_COUNT   8   /* max number of VFS entries (registered filesystems) */
 #define LEN_PATH_PREFIX_IGNORED SIZE_MAX /* special length value for VFS which is never recognised by open() */
-#define FD_TABLE_ENTRY_UNUSED   (fd_table_t) { .permanent = false, .vfs_index = -1, .local_fd = -1 }
+#define FD_TABLE_ENTRY(perm, index, fd)  (fd_table_t) { .permanent = (perm), .vfs_index = (index), .local_fd = (fd) }
+#define FD_TABLE_ENTRY_UNUSED   FD_TABLE_ENTRY(false, -1, -1)
 
 typedef uint8_t local_fd_t;
 _Static_assert((1 << (sizeof(local_fd_t)*8)) >= MAX_FDS, "file descriptor type too small");
@@ -45,11 +46,17 @@ typedef int8_t vfs_index_t;
 _Static_assert((1 << (sizeof(vfs_index_t)*8)) >= VFS_MAX_COUNT, "VFS index type too small");
 _Static_assert(((vfs_index_t) -1) < 0, "vfs_index_t must be a signed type");
 
-typedef struct {
-    bool permanent;
-    vfs_index_t vfs_index;
-    local_fd_t local_fd;
+/* FD table entries are read without locking, by every read(), write() etc. call. An entry is always read and
+ * written as a single word, so that a reader never sees the VFS index of one entry with the local FD of another. */
+typedef union {
+    struct {
+        bool permanent;
+        vfs_index_t vfs_index;
+        local_fd_t local_fd;
+    };
+    uint32_t word;
 } fd_table_t;
+_Static_assert(sizeof(fd_table_t) == sizeof(uint32_t), "FD table entry must fit in a word");
 
 typedef struct vfs_entry_ {
     esp_vfs_t vfs;          // contains pointers to VFS functions
@@ -72,6 +79,19 @@ static size_t s_vfs_count = 0;
 static fd_table_t s_fd_table[MAX_FDS] = { [0 ... MAX_FDS-1] = FD_TABLE_ENTRY_UNUSED };
 static _lock_t s_fd_table_lock;
 
+static inline fd_table_t fd_table_get(int fd)
+{
+    fd_table_t entry;
+    entry.word = *(volatile uint32_t *) &s_fd_table[fd].word;
+    return entry;
+}
+
+/* s_fd_table_lock has to be held by the caller */
+static inline void fd_table_set(int fd, fd_table_t entry)
+{
+    *(volatile uint32_t *) &s_fd_table[fd].word = entry.word;
+}
+
 static esp_err_t esp_vfs_register_common(const char* base_path, size_t len, const esp_vfs_t* vfs, void* ctx, int *vfs_index)
 {
     if (len != LEN_PATH_PREFIX_IGNORED) {
@@ -140,16 +160,14 @@ esp_err_t esp_vfs_register_fd_range(const esp_vfs_t *vfs, void *ctx, int min_fd,
                 s_vfs[i] = NULL;
                 for (int j = min_fd; j < i; ++j) {
                     if (s_fd_table[j].vfs_index == index) {
-                        s_fd_table[j] = FD_TABLE_ENTRY_UNUSED;
+                        fd_table_set(j, FD_TABLE_ENTRY_UNUSED);
                     }
                 }
                 _lock_release(&s_fd_table_lock);
                 ESP_LOGD(TAG, "esp_vfs_register_fd_range cannot set fd %d (used by other VFS)", i);
                 return ESP_ERR_INVALID_ARG;
             }
-            s_fd_table[i].permanent = true;
-            s_fd_table[i].vfs_index = index;
-            s_fd_table[i].local_fd = i;
+            fd_table_set(i, FD_TABLE_ENTRY(true, index, i));
         }
         _lock_release(&s_fd_table_lock);
     }
@@ -179,18 +197,18 @@ esp_err_t esp_vfs_unregister(const char* base_path)
         }
         if (base_path_len == vfs->path_prefix_len &&
                 memcmp(base_path, vfs->path_prefix, vfs->path_prefix_len) == 0) {
-            free(vfs);
-            s_vfs[i] = NULL;
-
             _lock_acquire(&s_fd_table_lock);
-            // Delete all references from the FD lookup-table
+            // Delete all references from the FD lookup-table before the entry is freed
             for (int j = 0; j < MAX_FDS; ++j) {
                 if (s_fd_table[j].vfs_index == i) {
-                    s_fd_table[j] = FD_TABLE_ENTRY_UNUSED;
+                    fd_table_set(j, FD_TABLE_ENTRY_UNUSED);
                 }
             }
             _lock_release(&s_fd_table_lock);
 
+            s_vfs[i] = NULL;
+            free(vfs);
+
             return ESP_OK;
         }
     }
@@ -208,9 +226,7 @@ esp_err_t esp_vfs_register_fd(esp_vfs_id_t vfs_id, int *fd)
     _lock_acquire(&s_fd_table_lock);
     for (int i = 0; i < MAX_FDS; ++i) {
         if (s_fd_table[i].vfs_index == -1) {
-            s_fd_table[i].permanent = true;
-            s_fd_table[i].vfs_index = vfs_id;
-            s_fd_table[i].local_fd = i;
+            fd_table_set(i, FD_TABLE_ENTRY(true, vfs_id, i));
             *fd = i;
             ret = ESP_OK;
             break;
@@ -233,9 +249,9 @@ esp_err_t esp_vfs_unregister_fd(esp_vfs_id_t vfs_id, int fd)
     }
 
     _lock_acquire(&s_fd_table_lock);
-    fd_table_t *item = s_fd_table + fd;
-    if (item->permanent == true && item->vfs_index == vfs_id && item->local_fd == fd) {
-        *item = FD_TABLE_ENTRY_UNUSED;
+    const fd_table_t item = s_fd_table[fd];
+    if (item.permanent == true && item.vfs_index == vfs_id && item.local_fd == fd) {
+        fd_table_set(fd, FD_TABLE_ENTRY_UNUSED);
         ret = ESP_OK;
     }
     _lock_release(&s_fd_table_lock);
@@ -256,28 +272,22 @@ static inline const vfs_entry_t *get_vfs_for_index(int index)
 
 static inline bool fd_valid(int fd)
 {
-    return (fd < MAX_FDS) && (fd >= 0);
+    return (unsigned) fd < MAX_FDS;
 }
 
-static const vfs_entry_t *get_vfs_for_fd(int fd)
+/* Lock-free lookup of the VFS and the local FD of a global FD; both are taken from a single read of the FD table */
+static inline const vfs_entry_t *get_vfs_for_fd(int fd, int *local_fd)
 {
-    const vfs_entry_t *vfs = NULL;
-    if (fd_valid(fd)) {
-        const int index = s_fd_table[fd].vfs_index; // single read -> no locking is required
-        vfs = get_vfs_for_index(index);
+    *local_fd = -1;
+    if (!fd_valid(fd)) {
+        return NULL;
     }
-    return vfs;
-}
-
-static inline int get_local_fd(const vfs_entry_t *vfs, int fd)
-{
-    int local_fd = -1;
-
-    if (vfs && fd_valid(fd)) {
-        local_fd = s_fd_table[fd].local_fd; // single read -> no locking is required
+    const fd_table_t entry = fd_table_get(fd);
+    const vfs_entry_t *vfs = get_vfs_for_index(entry.vfs_index);
+    if (vfs != NULL) {
+        *local_fd = entry.local_fd;
     }
-
-    return local_fd;
+    return vfs;
 }
 
 static const char* translate_path(const vfs_entry_t* vfs, const char* src_path)
@@ -390,9 +400,7 @@ int esp_vfs_open(struct _reent *r, const char * path, int flags, int mode)
         _lock_acquire(&s_fd_table_lock);
         for (int i = 0; i < MAX_FDS; ++i) {
             if (s_fd_table[i].vfs_index == -1) {
-                s_fd_table[i].permanent = false;
-                s_fd_table[i].vfs_index = vfs->offset;
-                s_fd_table[i].local_fd = fd_within_vfs;
+                fd_table_set(i, FD_TABLE_ENTRY(false, vfs->offset, fd_within_vfs));
                 _lock_release(&s_fd_table_lock);
                 return i;
             }
@@ -410,8 +418,8 @@ int esp_vfs_open(struct _reent *r, const char * path, int flags, int mode)
 
 ssize_t esp_vfs_write(struct _reent *r, int fd, const void * data, size_t size)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -423,8 +431,8 @@ ssize_t esp_vfs_write(struct _reent *r, int fd, const void * data, size_t size)
 
 off_t esp_vfs_lseek(struct _reent *r, int fd, off_t size, int mode)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -436,8 +444,8 @@ off_t esp_vfs_lseek(struct _reent *r, int fd, off_t size, int mode)
 
 ssize_t esp_vfs_read(struct _reent *r, int fd, void * dst, size_t size)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -450,8 +458,8 @@ ssize_t esp_vfs_read(struct _reent *r, int fd, void * dst, size_t size)
 ssize_t esp_vfs_pread(int fd, void *dst, size_t size, off_t offset)
 {
     struct _reent *r = __getreent();
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -464,8 +472,8 @@ ssize_t esp_vfs_pread(int fd, void *dst, size_t size, off_t offset)
 ssize_t esp_vfs_pwrite(int fd, const void *src, size_t size, off_t offset)
 {
     struct _reent *r = __getreent();
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -475,10 +483,98 @@ ssize_t esp_vfs_pwrite(int fd, const void *src, size_t size, off_t offset)
     return ret;
 }
 
+static bool iov_valid(const struct iovec *iov, int iovcnt)
+{
+    if (iovcnt < 0 || (iovcnt > 0 && iov == NULL)) {
+        return false;
+    }
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        // the total length has to fit in ssize_t
+        if (iov[i].iov_len > (SIZE_MAX >> 1) - total) {
+            return false;
+        }
+        total += iov[i].iov_len;
+    }
+    return true;
+}
+
+ssize_t esp_vfs_readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    struct _reent *r = __getreent();
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL || local_fd < 0) {
+        __errno_r(r) = EBADF;
+        return -1;
+    }
+    if (!iov_valid(iov, iovcnt)) {
+        __errno_r(r) = EINVAL;
+        return -1;
+    }
+    ssize_t ret;
+    if (vfs->vfs.readv != NULL) {
+        CHECK_AND_CALL(ret, r, vfs, readv, local_fd, iov, iovcnt);
+        return ret;
+    }
+    // The driver doesn't support vectored I/O, fill the buffers one by one
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        CHECK_AND_CALL(ret, r, vfs, read, local_fd, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0) {
+            return (total > 0) ? total : -1;
+        }
+        total += ret;
+        if ((size_t) ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+ssize_t esp_vfs_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    struct _reent *r = __getreent();
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
+    if (vfs == NULL || local_fd < 0) {
+        __errno_r(r) = EBADF;
+        return -1;
+    }
+    if (!iov_valid(iov, iovcnt)) {
+        __errno_r(r) = EINVAL;
+        return -1;
+    }
+    ssize_t ret;
+    if (vfs->vfs.writev != NULL) {
+        CHECK_AND_CALL(ret, r, vfs, writev, local_fd, iov, iovcnt);
+        return ret;
+    }
+    // The driver doesn't support vectored I/O, write the buffers one by one
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        CHECK_AND_CALL(ret, r, vfs, write, local_fd, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0) {
+            return (total > 0) ? total : -1;
+        }
+        total += ret;
+        if ((size_t) ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
 int esp_vfs_close(struct _reent *r, int fd)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -488,7 +584,7 @@ int esp_vfs_close(struct _reent *r, int fd)
 
     _lock_acquire(&s_fd_table_lock);
     if (!s_fd_table[fd].permanent) {
-        s_fd_table[fd] = FD_TABLE_ENTRY_UNUSED;
+        fd_table_set(fd, FD_TABLE_ENTRY_UNUSED);
     }
     _lock_release(&s_fd_table_lock);
     return ret;
@@ -496,8 +592,8 @@ int esp_vfs_close(struct _reent *r, int fd)
 
 int esp_vfs_fstat(struct _reent *r, int fd, struct stat * st)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -509,8 +605,8 @@ int esp_vfs_fstat(struct _reent *r, int fd, struct stat * st)
 
 int esp_vfs_fcntl_r(struct _reent *r, int fd, int cmd, int arg)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -522,8 +618,8 @@ int esp_vfs_fcntl_r(struct _reent *r, int fd, int cmd, int arg)
 
 int esp_vfs_ioctl(int fd, int cmd, ...)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -539,8 +635,8 @@ int esp_vfs_ioctl(int fd, int cmd, ...)
 
 int esp_vfs_fsync(int fd)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -803,7 +899,7 @@ static int set_global_fd_sets(const fds_triple_t *vfs_fds_triple, int size, fd_s
         const fds_triple_t *item = &vfs_fds_triple[i];
         if (item->isset) {
             for (int fd = 0; fd < MAX_FDS; ++fd) {
-                const int local_fd = s_fd_table[fd].local_fd; // single read -> no locking is required
+                const int local_fd = fd_table_get(fd).local_fd;
                 if (readfds && esp_vfs_safe_fd_isset(local_fd, &item->readfds)) {
                     ESP_LOGD(TAG, "FD %d in readfds was set from VFS ID %d", fd, i);
                     FD_SET(fd, readfds);
@@ -877,11 +973,10 @@ int esp_vfs_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *errorfds
 
     int (*socket_select)(int, fd_set *, fd_set *, fd_set *, struct timeval *) = NULL;
     for (int fd = 0; fd < nfds; ++fd) {
-        _lock_acquire(&s_fd_table_lock);
-        const bool is_socket_fd = s_fd_table[fd].permanent;
-        const int vfs_index = s_fd_table[fd].vfs_index;
-        const int local_fd = s_fd_table[fd].local_fd;
-        _lock_release(&s_fd_table_lock);
+        const fd_table_t entry = fd_table_get(fd);
+        const bool is_socket_fd = entry.permanent;
+        const int vfs_index = entry.vfs_index;
+        const int local_fd = entry.local_fd;
 
         if (vfs_index < 0) {
             continue;
@@ -1072,8 +1167,8 @@ void esp_vfs_select_triggered_isr(esp_vfs_select_sem_t sem, BaseType_t *woken)
 
 int tcgetattr(int fd, struct termios *p)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1086,8 +1181,8 @@ int tcgetattr(int fd, struct termios *p)
 
 int tcsetattr(int fd, int optional_actions, const struct termios *p)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1100,8 +1195,8 @@ int tcsetattr(int fd, int optional_actions, const struct termios *p)
 
 int tcdrain(int fd)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1114,8 +1209,8 @@ int tcdrain(int fd)
 
 int tcflush(int fd, int select)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1128,8 +1223,8 @@ int tcflush(int fd, int select)
 
 int tcflow(int fd, int action)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1142,8 +1237,8 @@ int tcflow(int fd, int action)
 
 pid_t tcgetsid(int fd)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1156,8 +1251,8 @@ pid_t tcgetsid(int fd)
 
 int tcsendbreak(int fd, int duration)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1189,6 +1284,10 @@ ssize_t pread(int fd, void *dst, size_t size, off_t offset)
     __attribute__((alias("esp_vfs_pread")));
 ssize_t pwrite(int fd, const void *src, size_t size, off_t offset)
     __attribute__((alias("esp_vfs_pwrite")));
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+    __attribute__((alias("esp_vfs_readv")));
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+    __attribute__((alias("esp_vfs_writev")));
 off_t _lseek_r(struct _reent *r, int fd, off_t size, int mode)
     __attribute__((alias("esp_vfs_lseek")));
 int _fcntl_r(struct _reent *r, int fd, int cmd, int arg)
@@ -13,7 +13,9 @@
 
 #include "WL_Ext_Perf.h"
 #include <stdlib.h>
+#include <string.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 
 static const char *TAG = "wl_ext_perf";
 
@@ -23,14 +25,28 @@ static const char *TAG = "wl_ext_perf";
         return (result); \
     }
 
+#ifndef WL_EXT_CACHE_FREE
+#define WL_EXT_CACHE_FREE 0xffffffff
+#endif // WL_EXT_CACHE_FREE
+
 WL_Ext_Perf::WL_Ext_Perf(): WL_Flash()
 {
     this->sector_buffer = NULL;
+    this->cache_count = 0;
+    this->flush_timeout = 0;
+    this->cache_seq = 0;
+    this->cache = NULL;
 }
 
 WL_Ext_Perf::~WL_Ext_Perf()
 {
     free(this->sector_buffer);
+    if (this->cache != NULL) {
+        for (uint32_t i = 0; i < this->cache_count; i++) {
+            free(this->cache[i].data);
+        }
+        free(this->cache);
+    }
 }
 
 esp_err_t WL_Ext_Perf::config(WL_Config_s *cfg, Flash_Access *flash_drv)
@@ -50,6 +66,22 @@ esp_err_t WL_Ext_Perf::config(WL_Config_s *cfg, Flash_Access *flash_drv)
         return ESP_ERR_INVALID_ARG;
     }
 
+    if (config->cache_sectors > 0) {
+        this->cache = (cache_entry_t *)calloc(config->cache_sectors, sizeof(cache_entry_t));
+        if (this->cache == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        this->cache_count = config->cache_sectors;
+        for (uint32_t i = 0; i < this->cache_count; i++) {
+            this->cache[i].sector = WL_EXT_CACHE_FREE;
+            this->cache[i].data = (uint32_t *)malloc(cfg->sector_size);
+            if (this->cache[i].data == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        this->flush_timeout = config->flush_timeout;
+    }
+
     return WL_Flash::config(cfg, flash_drv);
 }
 
@@ -80,6 +112,22 @@ esp_err_t WL_Ext_Perf::erase_sector_fit(uint32_t start_sector, uint32_t count)
 
     uint32_t pre_check_start = start_sector % this->size_factor;
 
+    if (this->cache_count > 0) {
+        // Erase the copy in RAM, the flash sector is erased once when the entry is written back
+        cache_entry_t *entry;
+        result = this->cache_write_back_expired();
+        WL_EXT_RESULT_CHECK(result);
+        result = this->cache_load(start_sector / this->size_factor, &entry);
+        WL_EXT_RESULT_CHECK(result);
+        memset(&entry->data[pre_check_start * this->fat_sector_size / sizeof(uint32_t)], 0xff, count * this->fat_sector_size);
+        return ESP_OK;
+    }
+
+    if (this->isDiscarded(start_sector / this->size_factor)) {
+        // Nothing in the flash sector has to be kept
+        return WL_Flash::erase_sector(start_sector / this->size_factor);
+    }
+
 
     for (int i = 0; i < this->size_factor; i++) {
         if ((i < pre_check_start) || (i >= count + pre_check_start)) {
@@ -156,6 +204,11 @@ esp_err_t WL_Ext_Perf::erase_range(size_t start_address, size_t size)
         rest_check_count = rest_check_count / this->size_factor;
         size_t start_sector = rest_check_start / this->flash_sector_size;
         for (size_t i = 0; i < rest_check_count; i++) {
+            // A cached copy of a sector which is erased completely has nothing left to write back
+            cache_entry_t *entry = this->cache_find(start_sector + i);
+            if (entry != NULL) {
+                entry->sector = WL_EXT_CACHE_FREE;
+            }
             result = WL_Flash::erase_sector(start_sector + i);
             WL_EXT_RESULT_CHECK(result);
         }
@@ -166,3 +219,205 @@ esp_err_t WL_Ext_Perf::erase_range(size_t start_address, size_t size)
     }
     return ESP_OK;
 }
+
+esp_err_t WL_Ext_Perf::write(size_t dest_addr, const void *src, size_t size)
+{
+    if (this->cache_count == 0) {
+        return WL_Flash::write(dest_addr, src, size);
+    }
+    esp_err_t result = this->cache_write_back_expired();
+    WL_EXT_RESULT_CHECK(result);
+
+    // Sectors which are not cached are written to the flash in runs, as few operations as possible
+    const uint8_t *data = (const uint8_t *)src;
+    size_t run_addr = dest_addr;
+    size_t run_len = 0;
+    while (size > 0) {
+        uint32_t offset = dest_addr % this->flash_sector_size;
+        uint32_t len = this->flash_sector_size - offset;
+        if (len > size) {
+            len = size;
+        }
+        cache_entry_t *entry = this->cache_find(dest_addr / this->flash_sector_size);
+        if (entry != NULL) {
+            if (run_len > 0) {
+                result = WL_Flash::write(run_addr, data - run_len, run_len);
+                WL_EXT_RESULT_CHECK(result);
+                run_len = 0;
+            }
+            // Programming flash can only clear bits, keep the same behaviour for the copy in RAM
+            uint8_t *dest = (uint8_t *)entry->data + offset;
+            for (uint32_t i = 0; i < len; i++) {
+                dest[i] &= data[i];
+            }
+        } else {
+            if (run_len == 0) {
+                run_addr = dest_addr;
+            }
+            run_len += len;
+        }
+        dest_addr += len;
+        data += len;
+        size -= len;
+    }
+    if (run_len > 0) {
+        result = WL_Flash::write(run_addr, data - run_len, run_len);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Ext_Perf::read(size_t src_addr, void *dest, size_t size)
+{
+    if (this->cache_count == 0) {
+        return WL_Flash::read(src_addr, dest, size);
+    }
+    esp_err_t result = this->cache_write_back_expired();
+    WL_EXT_RESULT_CHECK(result);
+
+    uint8_t *data = (uint8_t *)dest;
+    size_t run_addr = src_addr;
+    size_t run_len = 0;
+    while (size > 0) {
+        uint32_t offset = src_addr % this->flash_sector_size;
+        uint32_t len = this->flash_sector_size - offset;
+        if (len > size) {
+            len = size;
+        }
+        cache_entry_t *entry = this->cache_find(src_addr / this->flash_sector_size);
+        if (entry != NULL) {
+            if (run_len > 0) {
+                result = WL_Flash::read(run_addr, data - run_len, run_len);
+                WL_EXT_RESULT_CHECK(result);
+                run_len = 0;
+            }
+            memcpy(data, (uint8_t *)entry->data + offset, len);
+        } else {
+            if (run_len == 0) {
+                run_addr = src_addr;
+            }
+            run_len += len;
+        }
+        src_addr += len;
+        data += len;
+        size -= len;
+    }
+    if (run_len > 0) {
+        result = WL_Flash::read(run_addr, data - run_len, run_len);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Ext_Perf::trim(size_t start_address, size_t size)
+{
+    if (start_address + size > this->chip_size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // Cached copies of flash sectors which are trimmed completely don't have to be written back
+    uint32_t sector = (start_address + this->flash_sector_size - 1) / this->flash_sector_size;
+    uint32_t end = (start_address + size) / this->flash_sector_size;
+    for (; sector < end; sector++) {
+        cache_entry_t *entry = this->cache_find(sector);
+        if (entry != NULL) {
+            entry->sector = WL_EXT_CACHE_FREE;
+        }
+    }
+    return WL_Flash::trim(start_address, size);
+}
+
+esp_err_t WL_Ext_Perf::sync()
+{
+    esp_err_t result = ESP_OK;
+    for (cache_entry_t *entry = this->cache_oldest(); entry != NULL; entry = this->cache_oldest()) {
+        result = this->cache_write_back(entry);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Ext_Perf::flush()
+{
+    esp_err_t result = this->sync();
+    WL_EXT_RESULT_CHECK(result);
+    return WL_Flash::flush();
+}
+
+WL_Ext_Perf::cache_entry_t *WL_Ext_Perf::cache_find(uint32_t sector)
+{
+    for (uint32_t i = 0; i < this->cache_count; i++) {
+        if (this->cache[i].sector == sector) {
+            return &this->cache[i];
+        }
+    }
+    return NULL;
+}
+
+WL_Ext_Perf::cache_entry_t *WL_Ext_Perf::cache_oldest()
+{
+    cache_entry_t *oldest = NULL;
+    for (uint32_t i = 0; i < this->cache_count; i++) {
+        // Sequence numbers are compared as a difference, so that they may wrap around
+        if ((this->cache[i].sector != WL_EXT_CACHE_FREE) &&
+                ((oldest == NULL) || ((int32_t)(this->cache[i].seq - oldest->seq) < 0))) {
+            oldest = &this->cache[i];
+        }
+    }
+    return oldest;
+}
+
+esp_err_t WL_Ext_Perf::cache_load(uint32_t sector, cache_entry_t **out_entry)
+{
+    esp_err_t result = ESP_OK;
+    cache_entry_t *entry = this->cache_find(sector);
+    if (entry != NULL) {
+        *out_entry = entry;
+        return ESP_OK;
+    }
+    entry = this->cache_find(WL_EXT_CACHE_FREE);
+    if (entry == NULL) {
+        // Evict the entry modified first, so that sectors reach the flash in the order they were modified
+        entry = this->cache_oldest();
+        result = this->cache_write_back(entry);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    if (this->isDiscarded(sector)) {
+        // The content of a trimmed sector doesn't have to be kept
+        memset(entry->data, 0xff, this->flash_sector_size);
+    } else {
+        result = WL_Flash::read(sector * this->flash_sector_size, entry->data, this->flash_sector_size);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    entry->sector = sector;
+    entry->seq = this->cache_seq++;
+    entry->dirty_time = esp_timer_get_time();
+    *out_entry = entry;
+    return ESP_OK;
+}
+
+esp_err_t WL_Ext_Perf::cache_write_back(cache_entry_t *entry)
+{
+    ESP_LOGV(TAG, "%s sector = 0x%08x", __func__, entry->sector);
+    esp_err_t result = WL_Flash::erase_sector(entry->sector);
+    WL_EXT_RESULT_CHECK(result);
+    result = WL_Flash::write(entry->sector * this->flash_sector_size, entry->data, this->flash_sector_size);
+    WL_EXT_RESULT_CHECK(result);
+    entry->sector = WL_EXT_CACHE_FREE;
+    return ESP_OK;
+}
+
+esp_err_t WL_Ext_Perf::cache_write_back_expired()
+{
+    if (this->flush_timeout == 0) {
+        return ESP_OK;
+    }
+    int64_t now = esp_timer_get_time();
+    for (cache_entry_t *entry = this->cache_oldest(); entry != NULL; entry = this->cache_oldest()) {
+        if (now - entry->dirty_time < (int64_t)this->flush_timeout * 1000) {
+            break;
+        }
+        esp_err_t result = this->cache_write_back(entry);
+        WL_EXT_RESULT_CHECK(result);
+    }
+    return ESP_OK;
+}
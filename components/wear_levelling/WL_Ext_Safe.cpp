@@ -57,7 +57,10 @@ esp_err_t WL_Ext_Safe::config(WL_Config_s *cfg, Flash_Access *flash_drv)
 {
     esp_err_t result = ESP_OK;
 
-    result = WL_Ext_Perf::config(cfg, flash_drv);
+    // Every partial erase has to go through the transaction in erase_sector_fit, so nothing is cached
+    wl_ext_cfg_t config = *(wl_ext_cfg_t *)cfg;
+    config.cache_sectors = 0;
+    result = WL_Ext_Perf::config(&config, flash_drv);
     WL_EXT_RESULT_CHECK(result);
     this->state_addr = WL_Flash::chip_size() - 2 * WL_Flash::sector_size();
     this->dump_addr = WL_Flash::chip_size() - 1 * WL_Flash::sector_size();
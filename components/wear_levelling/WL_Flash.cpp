@@ -25,6 +25,12 @@ static const char *TAG = "wl_flash";
 #define WL_CFG_CRC_CONST UINT32_MAX
 #endif // WL_CFG_CRC_CONST 
 
+#ifndef WL_DYNAMIC_HOT
+#define WL_DYNAMIC_HOT 4    // recent erases of a block from which on it is moved to less worn blocks
+#endif // WL_DYNAMIC_HOT
+
+#define WL_DYNAMIC_FREE 0xffff
+
 #define WL_RESULT_CHECK(result) \
     if (result != ESP_OK) { \
         ESP_LOGE(TAG,"%s(%d): result = 0x%08x", __FUNCTION__, __LINE__, result); \
@@ -43,6 +49,12 @@ WL_Flash::WL_Flash()
 WL_Flash::~WL_Flash()
 {
     free(this->temp_buff);
+    free(this->block_map);
+    free(this->block_owner);
+    free(this->block_wear);
+    free(this->block_heat);
+    free(this->trim_map);
+    free(this->erased_map);
 }
 
 esp_err_t WL_Flash::config(wl_config_t *cfg, Flash_Access *flash_drv)
@@ -112,6 +124,35 @@ esp_err_t WL_Flash::config(wl_config_t *cfg, Flash_Access *flash_drv)
         result = ESP_ERR_NO_MEM;
     }
     WL_RESULT_CHECK(result);
+
+    // Trimmed and erased blocks are tracked when erase operations work on whole blocks
+    if (this->cfg.page_size == this->cfg.sector_size) {
+        size_t map_size = (this->flash_size / this->cfg.page_size + 31) / 32 * sizeof(uint32_t);
+        this->trim_map = (uint32_t *)calloc(1, map_size);
+        this->erased_map = (uint32_t *)calloc(1, map_size);
+        if ((this->trim_map == NULL) || (this->erased_map == NULL)) {
+            result = ESP_ERR_NO_MEM;
+        }
+        WL_RESULT_CHECK(result);
+    }
+
+    if (this->cfg.dynamic) {
+        this->block_count = this->flash_size / this->cfg.page_size + 1;
+        // The state area has to hold the tables and some log entries
+        if ((this->cfg.page_size != this->cfg.sector_size) || (this->block_count >= WL_DYNAMIC_FREE) ||
+                (sizeof(wl_dynamic_state_t) + this->mapSize() + this->wearSize() + 16 * sizeof(wl_dynamic_record_t) > this->state_size)) {
+            result = ESP_ERR_INVALID_ARG;
+        }
+        WL_RESULT_CHECK(result);
+        this->block_map = (uint16_t *)calloc(1, this->mapSize());
+        this->block_owner = (uint16_t *)calloc(this->block_count, sizeof(uint16_t));
+        this->block_wear = (uint32_t *)calloc(1, this->wearSize());
+        this->block_heat = (uint16_t *)calloc(this->block_count, sizeof(uint16_t));
+        if ((this->block_map == NULL) || (this->block_owner == NULL) || (this->block_wear == NULL) || (this->block_heat == NULL)) {
+            result = ESP_ERR_NO_MEM;
+        }
+        WL_RESULT_CHECK(result);
+    }
     this->configured = true;
     return ESP_OK;
 }
@@ -125,6 +166,19 @@ esp_err_t WL_Flash::init()
     }
     // If flow will be interrupted by error, then this flag will be false
     this->initialized = false;
+    // Nothing is known about the content of the blocks after mounting
+    if (this->trim_map != NULL) {
+        size_t map_size = (this->flash_size / this->cfg.page_size + 31) / 32 * sizeof(uint32_t);
+        memset(this->trim_map, 0, map_size);
+        memset(this->erased_map, 0, map_size);
+    }
+    this->dummy_erased = false;
+    if (this->cfg.dynamic) {
+        result = this->initDynamic();
+        WL_RESULT_CHECK(result);
+        this->initialized = true;
+        return ESP_OK;
+    }
     // Init states if it is first time...
     this->flash_drv->read(this->addr_state1, &this->state, sizeof(wl_state_t));
     wl_state_t sa_copy;
@@ -182,6 +236,8 @@ esp_err_t WL_Flash::init()
         ESP_LOGD(TAG, "%s: try to update version - crc1= 0x%08x, crc2 = 0x%08x, result= 0x%08x", __func__, (uint32_t)crc1, (uint32_t)crc2, (uint32_t)result);
         result = this->updateVersion();
         if (result == ESP_FAIL) {
+            result = this->checkOtherMode();
+            WL_RESULT_CHECK(result);
             ESP_LOGD(TAG, "%s: init flash sections", __func__);
             result = this->initSections();
             WL_RESULT_CHECK(result);
@@ -440,16 +496,28 @@ esp_err_t WL_Flash::updateWL()
     if (data_addr >= this->state.max_pos) {
         data_addr = 0;
     }
+    // A block without data worth keeping is not copied, the dummy block stays erased instead
+    size_t data_block = 0;
+    bool data_discarded = false;
+    bool data_erased = false;
+    if (this->trim_map != NULL) {
+        data_block = this->calcBlock(data_addr);
+        data_discarded = this->isDiscarded(data_block);
+        data_erased = this->testBlock(this->erased_map, data_block);
+    }
     data_addr = this->cfg.start_addr + data_addr * this->cfg.page_size;
     this->dummy_addr = this->cfg.start_addr + this->state.pos * this->cfg.page_size;
-    result = this->flash_drv->erase_range(this->dummy_addr, this->cfg.page_size);
-    if (result != ESP_OK) {
-        ESP_LOGE(TAG, "%s - erase wl dummy sector result= 0x%08x", __func__, result);
-        this->state.access_count = this->state.max_count - 1; // we will update next time
-        return result;
+    if (!this->dummy_erased) {
+        result = this->flash_drv->erase_range(this->dummy_addr, this->cfg.page_size);
+        if (result != ESP_OK) {
+            ESP_LOGE(TAG, "%s - erase wl dummy sector result= 0x%08x", __func__, result);
+            this->state.access_count = this->state.max_count - 1; // we will update next time
+            return result;
+        }
     }
+    this->dummy_erased = false;
 
-    size_t copy_count = this->cfg.page_size / this->cfg.temp_buff_size;
+    size_t copy_count = data_discarded ? 0 : this->cfg.page_size / this->cfg.temp_buff_size;
     for (size_t i = 0; i < copy_count; i++) {
         result = this->flash_drv->read(data_addr + i * this->cfg.temp_buff_size, this->temp_buff, this->cfg.temp_buff_size);
         if (result != ESP_OK) {
@@ -465,6 +533,11 @@ esp_err_t WL_Flash::updateWL()
         }
     }
     // done... block moved.
+    if (data_discarded) {
+        // The old place of an erased block becomes the dummy block
+        this->markBlock(this->erased_map, data_block, true);
+        this->dummy_erased = data_erased;
+    }
     // Here we will update structures...
     // Update bits and save to flash:
     uint32_t byte_pos = this->state.pos * this->cfg.wr_size;
@@ -516,6 +589,9 @@ esp_err_t WL_Flash::updateWL()
 
 size_t WL_Flash::calcAddr(size_t addr)
 {
+    if (this->cfg.dynamic) {
+        return this->block_map[addr / this->cfg.page_size] * this->cfg.page_size + addr % this->cfg.page_size;
+    }
     size_t result = (this->flash_size - this->state.move_count * this->cfg.page_size + addr) % this->flash_size;
     size_t dummy_addr = this->state.pos * this->cfg.page_size;
     if (result < dummy_addr) {
@@ -550,11 +626,21 @@ esp_err_t WL_Flash::erase_sector(size_t sector)
         return ESP_ERR_INVALID_STATE;
     }
     ESP_LOGD(TAG, "%s - sector= 0x%08x", __func__, (uint32_t) sector);
+    if ((this->trim_map != NULL) && (sector * this->cfg.sector_size < this->flash_size) && this->testBlock(this->erased_map, sector)) {
+        // Nothing was written to the block since it was erased
+        return ESP_OK;
+    }
+    if (this->cfg.dynamic) {
+        return this->eraseDynamic(sector);
+    }
     result = this->updateWL();
     WL_RESULT_CHECK(result);
     size_t virt_addr = this->calcAddr(sector * this->cfg.sector_size);
     result = this->flash_drv->erase_sector((this->cfg.start_addr + virt_addr) / this->cfg.sector_size);
     WL_RESULT_CHECK(result);
+    if ((this->trim_map != NULL) && (sector * this->cfg.sector_size < this->flash_size)) {
+        this->markBlock(this->erased_map, sector, true);
+    }
     return result;
 }
 esp_err_t WL_Flash::erase_range(size_t start_address, size_t size)
@@ -581,15 +667,21 @@ esp_err_t WL_Flash::write(size_t dest_addr, const void *src, size_t size)
         return ESP_ERR_INVALID_STATE;
     }
     ESP_LOGD(TAG, "%s - dest_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) dest_addr, (uint32_t) size);
-    uint32_t count = (size - 1) / this->cfg.page_size;
-    for (size_t i = 0; i < count; i++) {
-        size_t virt_addr = this->calcAddr(dest_addr + i * this->cfg.page_size);
-        result = this->flash_drv->write(this->cfg.start_addr + virt_addr, &((uint8_t *)src)[i * this->cfg.page_size], this->cfg.page_size);
+    // The block map only covers the partition, the rotating dummy block wraps around
+    if (this->cfg.dynamic && (dest_addr + size > this->flash_size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    this->markWritten(dest_addr, size);
+    const uint8_t *data = (const uint8_t *)src;
+    while (size > 0) {
+        size_t virt_addr = this->calcAddr(dest_addr);
+        size_t len = this->calcExtent(dest_addr, virt_addr, size);
+        result = this->flash_drv->write(this->cfg.start_addr + virt_addr, data, len);
         WL_RESULT_CHECK(result);
+        dest_addr += len;
+        data += len;
+        size -= len;
     }
-    size_t virt_addr_last = this->calcAddr(dest_addr + count * this->cfg.page_size);
-    result = this->flash_drv->write(this->cfg.start_addr + virt_addr_last, &((uint8_t *)src)[count * this->cfg.page_size], size - count * this->cfg.page_size);
-    WL_RESULT_CHECK(result);
     return result;
 }
 
@@ -600,19 +692,100 @@ esp_err_t WL_Flash::read(size_t src_addr, void *dest, size_t size)
         return ESP_ERR_INVALID_STATE;
     }
     ESP_LOGD(TAG, "%s - src_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) src_addr, (uint32_t) size);
-    uint32_t count = (size - 1) / this->cfg.page_size;
-    for (size_t i = 0; i < count; i++) {
-        size_t virt_addr = this->calcAddr(src_addr + i * this->cfg.page_size);
-        ESP_LOGV(TAG, "%s - real_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) (this->cfg.start_addr + virt_addr), (uint32_t) size);
-        result = this->flash_drv->read(this->cfg.start_addr + virt_addr, &((uint8_t *)dest)[i * this->cfg.page_size], this->cfg.page_size);
+    // The block map only covers the partition, the rotating dummy block wraps around
+    if (this->cfg.dynamic && (src_addr + size > this->flash_size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *data = (uint8_t *)dest;
+    while (size > 0) {
+        size_t virt_addr = this->calcAddr(src_addr);
+        size_t len = this->calcExtent(src_addr, virt_addr, size);
+        ESP_LOGV(TAG, "%s - real_addr= 0x%08x, size= 0x%08x", __func__, (uint32_t) (this->cfg.start_addr + virt_addr), (uint32_t) len);
+        result = this->flash_drv->read(this->cfg.start_addr + virt_addr, data, len);
         WL_RESULT_CHECK(result);
+        src_addr += len;
+        data += len;
+        size -= len;
     }
-    size_t virt_addr_last = this->calcAddr(src_addr + count * this->cfg.page_size);
-    result = this->flash_drv->read(this->cfg.start_addr + virt_addr_last, &((uint8_t *)dest)[count * this->cfg.page_size], size - count * this->cfg.page_size);
-    WL_RESULT_CHECK(result);
     return result;
 }
 
+size_t WL_Flash::calcExtent(size_t addr, size_t virt_addr, size_t size)
+{
+    // Pages which follow each other in flash as well are accessed with one operation
+    size_t len = this->cfg.page_size - addr % this->cfg.page_size;
+    while ((len < size) && (this->calcAddr(addr + len) == virt_addr + len)) {
+        len += this->cfg.page_size;
+    }
+    return (len < size) ? len : size;
+}
+
+esp_err_t WL_Flash::trim(size_t start_address, size_t size)
+{
+    if (!this->initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ESP_LOGD(TAG, "%s - start_address= 0x%08x, size= 0x%08x", __func__, (uint32_t) start_address, (uint32_t) size);
+    if (start_address + size > this->chip_size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (this->trim_map == NULL) {
+        return ESP_OK;
+    }
+    // Only blocks which are inside the range completely are trimmed
+    size_t block = (start_address + this->cfg.page_size - 1) / this->cfg.page_size;
+    size_t end = (start_address + size) / this->cfg.page_size;
+    for (; block < end; block++) {
+        this->markBlock(this->trim_map, block, true);
+    }
+    return ESP_OK;
+}
+
+size_t WL_Flash::calcBlock(size_t pos)
+{
+    // Inverse of calcAddr: the logical block held by the physical block at pos, which is not the dummy block
+    size_t blocks = this->flash_size / this->cfg.page_size;
+    size_t block = (pos < this->state.pos) ? pos : pos - 1;
+    return (block + this->state.move_count) % blocks;
+}
+
+bool WL_Flash::testBlock(const uint32_t *map, size_t block)
+{
+    return (map[block / 32] & (1 << (block % 32))) != 0;
+}
+
+void WL_Flash::markBlock(uint32_t *map, size_t block, bool value)
+{
+    if (value) {
+        map[block / 32] |= (1 << (block % 32));
+    } else {
+        map[block / 32] &= ~(1 << (block % 32));
+    }
+}
+
+bool WL_Flash::isDiscarded(size_t block)
+{
+    return (this->trim_map != NULL) && (this->testBlock(this->trim_map, block) || this->testBlock(this->erased_map, block));
+}
+
+void WL_Flash::markWritten(size_t addr, size_t size)
+{
+    if ((this->trim_map == NULL) || (size == 0)) {
+        return;
+    }
+    // Addresses past the end wrap around, the same way calcAddr maps them
+    size_t blocks = this->flash_size / this->cfg.page_size;
+    size_t first = addr / this->cfg.page_size;
+    size_t last = (addr + size - 1) / this->cfg.page_size;
+    if (last - first >= blocks) {
+        last = first + blocks - 1;
+    }
+    for (size_t block = first; block <= last; block++) {
+        this->markBlock(this->trim_map, block % blocks, false);
+        this->markBlock(this->erased_map, block % blocks, false);
+    }
+}
+
 Flash_Access *WL_Flash::get_drv()
 {
     return this->flash_drv;
@@ -625,8 +798,297 @@ wl_config_t *WL_Flash::get_cfg()
 esp_err_t WL_Flash::flush()
 {
     esp_err_t result = ESP_OK;
+    if (this->cfg.dynamic) {
+        // Only the erase counts are not in the state yet, the block map is logged when it changes
+        if (this->dynamic_dirty) {
+            result = this->writeDynamic();
+        }
+        return result;
+    }
     this->state.access_count = this->state.max_count - 1;
     result = this->updateWL();
     ESP_LOGD(TAG, "%s - result= 0x%08x, move_count= 0x%08x", __func__, result, this->state.move_count);
     return result;
 }
+
+size_t WL_Flash::mapSize()
+{
+    return (this->block_count * sizeof(uint16_t) + 15) & ~15;
+}
+
+size_t WL_Flash::wearSize()
+{
+    return (this->block_count * sizeof(uint32_t) + 15) & ~15;
+}
+
+// The static mode rotates the data through the partition and the dynamic mode scatters it
+// through the block map, so a partition formatted in one mode can't be mounted in the other one.
+// Formatting it would destroy the data, so this is left to the user.
+esp_err_t WL_Flash::checkOtherMode()
+{
+    esp_err_t result = ESP_OK;
+    size_t addrs[2] = {this->addr_state1, this->addr_state2};
+    for (int i = 0; i < 2; i++) {
+        bool found;
+        if (this->cfg.dynamic) {
+            wl_state_t other;
+            result = this->flash_drv->read(addrs[i], &other, sizeof(wl_state_t));
+            WL_RESULT_CHECK(result);
+            found = (other.crc == crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)&other, WL_STATE_CRC_LEN_V2)) ||
+                    ((other.version == 1) && (other.device_id == crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)&other, WL_STATE_CRC_LEN_V1)));
+        } else {
+            wl_dynamic_state_t other;
+            result = this->flash_drv->read(addrs[i], &other, sizeof(wl_dynamic_state_t));
+            WL_RESULT_CHECK(result);
+            found = (other.magic == WL_DYNAMIC_MAGIC) &&
+                    (other.crc == crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)&other, offsetof(wl_dynamic_state_t, crc)));
+        }
+        if (found) {
+            ESP_LOGE(TAG, "%s: partition is formatted for %s wear levelling, erase it to change the mode", __func__,
+                     this->cfg.dynamic ? "static" : "dynamic");
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Flash::initDynamic()
+{
+    esp_err_t result = ESP_OK;
+    wl_dynamic_state_t states[2];
+    size_t addrs[2] = {this->addr_state1, this->addr_state2};
+    bool valid[2];
+    for (int i = 0; i < 2; i++) {
+        result = this->flash_drv->read(addrs[i], &states[i], sizeof(wl_dynamic_state_t));
+        WL_RESULT_CHECK(result);
+        valid[i] = (states[i].magic == WL_DYNAMIC_MAGIC) && (states[i].block_count == this->block_count) &&
+                   (states[i].crc == crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)&states[i], offsetof(wl_dynamic_state_t, crc)));
+    }
+    // Use the newer state, and the older one if the tables of the newer one are damaged
+    int first = (valid[0] && (!valid[1] || ((int32_t)(states[0].seq - states[1].seq) > 0))) ? 0 : 1;
+    result = ESP_ERR_NOT_FOUND;
+    for (int n = 0; (n < 2) && (result == ESP_ERR_NOT_FOUND); n++) {
+        int i = (first + n) % 2;
+        if (valid[i]) {
+            result = this->loadDynamic(addrs[i], &states[i]);
+        }
+    }
+    if (result == ESP_ERR_NOT_FOUND) {
+        result = this->checkOtherMode();
+        WL_RESULT_CHECK(result);
+        ESP_LOGD(TAG, "%s: init dynamic block map", __func__);
+        for (size_t i = 0; i < this->block_count; i++) {
+            this->block_map[i] = i;
+        }
+        memset(this->block_wear, 0, this->wearSize());
+        this->dynamic_seq = 0;
+        this->dynamic_addr = this->addr_state2;
+        result = this->writeDynamic();
+        WL_RESULT_CHECK(result);
+        result = this->flash_drv->erase_range(this->addr_cfg, this->cfg_size);
+        WL_RESULT_CHECK(result);
+        result = this->flash_drv->write(this->addr_cfg, &this->cfg, sizeof(wl_config_t));
+    }
+    WL_RESULT_CHECK(result);
+
+    // Every physical block holds one logical block, except for the spare block
+    for (size_t i = 0; i < this->block_count; i++) {
+        this->block_owner[i] = WL_DYNAMIC_FREE;
+    }
+    for (size_t i = 0; i < this->block_count - 1; i++) {
+        if ((this->block_map[i] >= this->block_count) || (this->block_owner[this->block_map[i]] != WL_DYNAMIC_FREE)) {
+            ESP_LOGE(TAG, "%s: block map is inconsistent", __func__);
+            return ESP_ERR_INVALID_STATE;
+        }
+        this->block_owner[this->block_map[i]] = i;
+    }
+    for (size_t i = 0; i < this->block_count; i++) {
+        if (this->block_owner[i] == WL_DYNAMIC_FREE) {
+            this->spare_block = i;
+        }
+    }
+    memset(this->block_heat, 0, this->block_count * sizeof(uint16_t));
+    this->heat_erases = 0;
+    ESP_LOGD(TAG, "%s - seq= 0x%08x, spare_block= %i", __func__, this->dynamic_seq, this->spare_block);
+    return ESP_OK;
+}
+
+esp_err_t WL_Flash::loadDynamic(size_t addr, const wl_dynamic_state_t *dyn_state)
+{
+    esp_err_t result = ESP_OK;
+    size_t map_addr = addr + sizeof(wl_dynamic_state_t);
+    result = this->flash_drv->read(map_addr, this->block_map, this->mapSize());
+    WL_RESULT_CHECK(result);
+    result = this->flash_drv->read(map_addr + this->mapSize(), this->block_wear, this->wearSize());
+    WL_RESULT_CHECK(result);
+    if ((dyn_state->map_crc != crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)this->block_map, this->mapSize())) ||
+            (dyn_state->wear_crc != crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)this->block_wear, this->wearSize()))) {
+        ESP_LOGW(TAG, "%s: tables at 0x%08x are damaged", __func__, (uint32_t) addr);
+        return ESP_ERR_NOT_FOUND;
+    }
+    this->dynamic_addr = addr;
+    this->dynamic_seq = dyn_state->seq;
+
+    // Replay the moves logged after the state was written
+    size_t log_addr = map_addr + this->mapSize() + this->wearSize();
+    wl_dynamic_record_t record;
+    bool erased = true;
+    for (; log_addr + sizeof(wl_dynamic_record_t) <= addr + this->state_size; log_addr += sizeof(wl_dynamic_record_t)) {
+        result = this->flash_drv->read(log_addr, &record, sizeof(wl_dynamic_record_t));
+        WL_RESULT_CHECK(result);
+        if ((record.seq != this->dynamic_seq + 1) || (record.logical >= this->block_count - 1) || (record.physical >= this->block_count) ||
+                (record.crc != crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)&record, offsetof(wl_dynamic_record_t, crc)))) {
+            const uint32_t *words = (const uint32_t *)&record;
+            erased = (words[0] & words[1] & words[2] & words[3]) == UINT32_MAX;
+            break;
+        }
+        this->block_map[record.logical] = record.physical;
+        if (this->block_wear[record.physical] < record.wear) {
+            this->block_wear[record.physical] = record.wear;
+        }
+        this->dynamic_seq = record.seq;
+    }
+    this->dynamic_log_addr = log_addr;
+    this->dynamic_dirty = false;
+    ESP_LOGD(TAG, "%s - addr= 0x%08x, seq= 0x%08x, log entries= %i", __func__, (uint32_t) addr, this->dynamic_seq,
+             (int)((log_addr - map_addr - this->mapSize() - this->wearSize()) / sizeof(wl_dynamic_record_t)));
+    if (!erased) {
+        // A log entry was interrupted by power loss, the entry can't be written again
+        return this->writeDynamic();
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Flash::writeDynamic()
+{
+    esp_err_t result = ESP_OK;
+    // Write the state to the other area, and the header last, so that the state in use stays valid until then
+    size_t addr = (this->dynamic_addr == this->addr_state1) ? this->addr_state2 : this->addr_state1;
+    size_t map_addr = addr + sizeof(wl_dynamic_state_t);
+
+    wl_dynamic_state_t dyn_state;
+    memset(&dyn_state, 0, sizeof(wl_dynamic_state_t));
+    dyn_state.magic = WL_DYNAMIC_MAGIC;
+    dyn_state.seq = ++this->dynamic_seq;
+    dyn_state.block_count = this->block_count;
+    dyn_state.map_crc = crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)this->block_map, this->mapSize());
+    dyn_state.wear_crc = crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)this->block_wear, this->wearSize());
+    dyn_state.crc = crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)&dyn_state, offsetof(wl_dynamic_state_t, crc));
+
+    result = this->flash_drv->erase_range(addr, this->state_size);
+    WL_RESULT_CHECK(result);
+    result = this->flash_drv->write(map_addr, this->block_map, this->mapSize());
+    WL_RESULT_CHECK(result);
+    result = this->flash_drv->write(map_addr + this->mapSize(), this->block_wear, this->wearSize());
+    WL_RESULT_CHECK(result);
+    result = this->flash_drv->write(addr, &dyn_state, sizeof(wl_dynamic_state_t));
+    WL_RESULT_CHECK(result);
+
+    this->dynamic_addr = addr;
+    this->dynamic_log_addr = map_addr + this->mapSize() + this->wearSize();
+    this->dynamic_dirty = false;
+    ESP_LOGD(TAG, "%s - addr= 0x%08x, seq= 0x%08x", __func__, (uint32_t) addr, this->dynamic_seq);
+    return ESP_OK;
+}
+
+esp_err_t WL_Flash::logDynamic(uint32_t logical)
+{
+    if (this->dynamic_log_addr + sizeof(wl_dynamic_record_t) > this->dynamic_addr + this->state_size) {
+        return this->writeDynamic();
+    }
+    wl_dynamic_record_t record;
+    record.seq = this->dynamic_seq + 1;
+    record.logical = logical;
+    record.physical = this->block_map[logical];
+    record.wear = this->block_wear[record.physical];
+    record.crc = crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)&record, offsetof(wl_dynamic_record_t, crc));
+    esp_err_t result = this->flash_drv->write(this->dynamic_log_addr, &record, sizeof(wl_dynamic_record_t));
+    // Skip the entry even if writing failed, it may be partially programmed
+    this->dynamic_log_addr += sizeof(wl_dynamic_record_t);
+    WL_RESULT_CHECK(result);
+    this->dynamic_seq = record.seq;
+    return ESP_OK;
+}
+
+esp_err_t WL_Flash::copyBlock(size_t src_addr, size_t dest_addr)
+{
+    esp_err_t result = ESP_OK;
+    size_t copy_count = this->cfg.page_size / this->cfg.temp_buff_size;
+    for (size_t i = 0; i < copy_count; i++) {
+        result = this->flash_drv->read(src_addr + i * this->cfg.temp_buff_size, this->temp_buff, this->cfg.temp_buff_size);
+        WL_RESULT_CHECK(result);
+        result = this->flash_drv->write(dest_addr + i * this->cfg.temp_buff_size, this->temp_buff, this->cfg.temp_buff_size);
+        WL_RESULT_CHECK(result);
+    }
+    return ESP_OK;
+}
+
+esp_err_t WL_Flash::eraseDynamic(size_t block)
+{
+    esp_err_t result = ESP_OK;
+    if (block >= this->block_count - 1) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (this->block_heat[block] < UINT16_MAX) {
+        this->block_heat[block]++;
+    }
+    if (++this->heat_erases >= this->block_count) {
+        this->heat_erases = 0;
+        for (size_t i = 0; i < this->block_count; i++) {
+            this->block_heat[i] >>= 1;
+        }
+    }
+
+    uint32_t physical = this->block_map[block];
+    if (this->block_heat[block] >= WL_DYNAMIC_HOT) {
+        // Look for the least worn block which holds cold data, or the spare block
+        uint32_t target = WL_DYNAMIC_FREE;
+        for (uint32_t i = 0; i < this->block_count; i++) {
+            uint16_t owner = this->block_owner[i];
+            if ((i == physical) || ((owner != WL_DYNAMIC_FREE) && (this->block_heat[owner] >= WL_DYNAMIC_HOT))) {
+                continue;
+            }
+            if ((target == WL_DYNAMIC_FREE) || (this->block_wear[i] < this->block_wear[target])) {
+                target = i;
+            }
+        }
+        if ((target != WL_DYNAMIC_FREE) && (this->block_wear[target] + this->cfg.updaterate <= this->block_wear[physical])) {
+            if (target != this->spare_block) {
+                // Move the cold data to the spare block, which frees the target block
+                uint32_t cold = this->block_owner[target];
+                uint32_t spare = this->spare_block;
+                result = this->flash_drv->erase_sector((this->cfg.start_addr + spare * this->cfg.page_size) / this->cfg.sector_size);
+                WL_RESULT_CHECK(result);
+                this->block_wear[spare]++;
+                if (this->isDiscarded(cold)) {
+                    // Nothing to copy, the block stays erased in its new place
+                    this->markBlock(this->erased_map, cold, true);
+                } else {
+                    result = this->copyBlock(this->cfg.start_addr + target * this->cfg.page_size, this->cfg.start_addr + spare * this->cfg.page_size);
+                    WL_RESULT_CHECK(result);
+                }
+                this->block_map[cold] = spare;
+                this->block_owner[spare] = cold;
+                this->block_owner[target] = WL_DYNAMIC_FREE;
+                this->spare_block = target;
+                result = this->logDynamic(cold);
+                WL_RESULT_CHECK(result);
+            }
+            // The block is erased anyway, so it moves without copying
+            ESP_LOGV(TAG, "%s - block= %i moves from %i to %i", __func__, (int) block, (int) physical, (int) target);
+            this->block_map[block] = target;
+            this->block_owner[target] = block;
+            this->block_owner[physical] = WL_DYNAMIC_FREE;
+            this->spare_block = physical;
+            physical = target;
+            result = this->logDynamic(block);
+            WL_RESULT_CHECK(result);
+        }
+    }
+    result = this->flash_drv->erase_sector((this->cfg.start_addr + physical * this->cfg.page_size) / this->cfg.sector_size);
+    WL_RESULT_CHECK(result);
+    this->block_wear[physical]++;
+    this->dynamic_dirty = true;
+    this->markBlock(this->erased_map, block, true);
+    return ESP_OK;
+}
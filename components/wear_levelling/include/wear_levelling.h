@@ -53,6 +53,42 @@ esp_err_t wl_mount(const esp_partition_t *partition, wl_handle_t *out_handle);
 */
 esp_err_t wl_unmount(wl_handle_t handle);
 
+/**
+* @brief Write data held in RAM by the WL instance to the flash
+*
+* In the performance mode with 512 byte sectors, modified flash sectors are kept in a
+* write-back cache (see CONFIG_WL_PERF_CACHE_SECTORS). Data written before this call
+* is preserved after a power loss once this function returns. Does nothing for the
+* other modes, which write data to the flash right away.
+*
+* @param handle WL partition handle
+*
+* @return
+*       - ESP_OK, if the data was written successfully;
+*       - or one of error codes from lower-level flash driver.
+*/
+esp_err_t wl_sync(wl_handle_t handle);
+
+/**
+* @brief Inform the WL layer that part of the storage holds no data which has to be kept
+*
+* Wear levelling doesn't copy trimmed blocks when it moves data around, and skips erasing
+* blocks which are still erased. The content of the range is undefined until it is written
+* again. Only flash sectors which are inside the range completely are trimmed, also when
+* wl_sector_size(...) is smaller than the flash sector. The information is kept in RAM
+* until the partition is unmounted.
+*
+* @param handle WL partition handle
+* @param start_addr Address where the range starts
+* @param size Size of the range, in bytes
+*
+* @return
+*       - ESP_OK, if the range was trimmed successfully;
+*       - ESP_ERR_INVALID_SIZE, if the range goes out of bounds of the partition;
+*       - ESP_ERR_INVALID_ARG, if the handle is not valid.
+*/
+esp_err_t wl_trim(wl_handle_t handle, size_t start_addr, size_t size);
+
 /**
 * @brief Erase part of the WL storage
 *
@@ -38,6 +38,18 @@ public:
         return ESP_OK;
     };
 
+    // Write data held in RAM to the flash, without the housekeeping done by flush()
+    virtual esp_err_t sync()
+    {
+        return ESP_OK;
+    };
+
+    // The data in the range is no longer needed, its content may change until it is written again
+    virtual esp_err_t trim(size_t start_address, size_t size)
+    {
+        return ESP_OK;
+    };
+
     virtual ~Flash_Access() {};
 };
 
@@ -39,6 +39,7 @@ typedef struct ALIGNED_(16) WL_Config_s { /*!< Size of wl_config_t structure sho
     uint32_t version;       /*!< A version of current implementatioon. To erase and reallocate complete memory this ID must be different from id before.*/
     size_t   temp_buff_size;  /*!< Size of temporary allocated buffer to copy from one flash area to another. The best way, if this value will be equal to sector size.*/
     uint32_t crc;           /*!< CRC for this config*/
+    uint32_t dynamic;       /*!< Wear levelling with a block map steered by write heat instead of a rotating dummy block, if not 0. For dynamic mode, page_size must be equal to sector_size. Kept after crc, so the layout of the older fields does not change.*/
 } wl_config_t;
 
 #ifndef _MSC_VER // MSVS has different format for this define
@@ -17,6 +17,8 @@
 
 typedef struct WL_Ext_Cfg_s : public WL_Config_s {
     uint32_t fat_sector_size;   /*!< virtual sector size*/
+    uint32_t cache_sectors;     /*!< flash sectors kept in the write-back cache of the performance mode, 0 to disable it*/
+    uint32_t flush_timeout;     /*!< time after which modified sectors are written back, in milliseconds, 0 to disable*/
 } wl_ext_cfg_t;
 
 #endif // _WL_Ext_Cfg_H_
\ No newline at end of file
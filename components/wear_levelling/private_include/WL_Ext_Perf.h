@@ -33,14 +33,45 @@ public:
     esp_err_t erase_sector(size_t sector) override;
     esp_err_t erase_range(size_t start_address, size_t size) override;
 
+    esp_err_t write(size_t dest_addr, const void *src, size_t size) override;
+    esp_err_t read(size_t src_addr, void *dest, size_t size) override;
+
+    esp_err_t sync() override;
+    esp_err_t flush() override;
+    esp_err_t trim(size_t start_address, size_t size) override;
+
 protected:
     uint32_t flash_sector_size;
     uint32_t fat_sector_size;
     uint32_t size_factor;
     uint32_t *sector_buffer;
 
+    /**
+    * @brief Flash sector held in RAM by the write-back cache
+    *
+    * Partial erases and the writes which follow them are applied to the copy in RAM. The sector is
+    * erased and programmed once when it is written back, instead of once for every FAT sector.
+    */
+    typedef struct {
+        uint32_t sector;        /*!< flash sector held by the entry, WL_EXT_CACHE_FREE if the entry is unused*/
+        uint32_t seq;           /*!< order in which entries were first modified, they are written back in this order*/
+        int64_t dirty_time;     /*!< time of the first modification, in microseconds*/
+        uint32_t *data;
+    } cache_entry_t;
+
+    uint32_t cache_count;       // 0 if the cache is disabled
+    uint32_t flush_timeout;     // in milliseconds, 0 if entries are only written back on demand
+    uint32_t cache_seq;
+    cache_entry_t *cache;
+
     virtual esp_err_t erase_sector_fit(uint32_t start_sector, uint32_t count);
 
+    cache_entry_t *cache_find(uint32_t sector);
+    esp_err_t cache_load(uint32_t sector, cache_entry_t **out_entry);
+    esp_err_t cache_write_back(cache_entry_t *entry);
+    esp_err_t cache_write_back_expired();
+    cache_entry_t *cache_oldest();
+
 };
 
 #endif // _WL_Ext_Perf_H_
\ No newline at end of file
@@ -43,6 +43,7 @@ public :
     esp_err_t read(size_t src_addr, void *dest, size_t size) override;
 
     esp_err_t flush() override;
+    esp_err_t trim(size_t start_address, size_t size) override;
 
     Flash_Access *get_drv();
     wl_config_t *get_cfg();
@@ -71,11 +72,49 @@ protected:
     esp_err_t updateWL();
     esp_err_t recoverPos();
     size_t calcAddr(size_t addr);
+    size_t calcExtent(size_t addr, size_t virt_addr, size_t size);
+
+    // Blocks which hold no data worth keeping, tracked in RAM since the partition was mounted.
+    // Such blocks are not copied when the dummy block moves over them, and erasing a block
+    // which is known to be erased does nothing.
+    uint32_t *trim_map = NULL;      // bit set for blocks which were trimmed and not written since
+    uint32_t *erased_map = NULL;    // bit set for blocks which are erased
+    bool dummy_erased;              // the dummy block is erased
+
+    size_t calcBlock(size_t pos);
+    bool testBlock(const uint32_t *map, size_t block);
+    void markBlock(uint32_t *map, size_t block, bool value);
+    bool isDiscarded(size_t block);
+    void markWritten(size_t addr, size_t size);
 
     esp_err_t updateVersion();
     esp_err_t updateV1_V2();
     void fillOkBuff(int n);
     bool OkBuffSet(int n);
+
+    // Dynamic wear levelling: logical blocks are mapped to physical blocks through block_map,
+    // and blocks which are erased often are moved to the least worn physical blocks
+    uint16_t *block_map = NULL;     // physical block of each logical block
+    uint16_t *block_owner = NULL;   // logical block held by each physical block, WL_DYNAMIC_FREE for the spare block
+    uint32_t *block_wear = NULL;    // erase count of each physical block
+    uint16_t *block_heat = NULL;    // recent erases of each logical block, halved every block_count erases
+    uint32_t block_count;           // physical blocks, one of them is the spare block
+    uint32_t spare_block;
+    uint32_t heat_erases;
+    uint32_t dynamic_seq;
+    size_t dynamic_addr;            // state area in use
+    size_t dynamic_log_addr;        // next free log entry in the state area
+    bool dynamic_dirty;             // erase counts changed since the state was written
+
+    esp_err_t checkOtherMode();
+    esp_err_t initDynamic();
+    esp_err_t loadDynamic(size_t addr, const wl_dynamic_state_t *dyn_state);
+    esp_err_t writeDynamic();
+    esp_err_t logDynamic(uint32_t logical);
+    esp_err_t eraseDynamic(size_t block);
+    esp_err_t copyBlock(size_t src_addr, size_t dest_addr);
+    size_t mapSize();
+    size_t wearSize();
 };
 
 #endif // _WL_Flash_H_
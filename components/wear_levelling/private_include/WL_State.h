@@ -48,4 +48,41 @@ static_assert(sizeof(wl_state_t) % 16 == 0, "Size of wl_state_t structure should
 #define WL_STATE_CRC_LEN_V1 offsetof(wl_state_t, device_id)
 #define WL_STATE_CRC_LEN_V2 offsetof(wl_state_t, crc)
 
+/**
+* @brief State of dynamic wear levelling, stored at the start of a state area
+*
+* The header is followed by the block map (one uint16_t per logical block), the erase counts
+* (one uint32_t per physical block), each padded to 16 bytes, and a log of wl_dynamic_record_t
+* entries which were appended since the state was written.
+*/
+typedef struct ALIGNED_(32) WL_Dynamic_State_s {
+public:
+    uint32_t magic;         /*!< WL_DYNAMIC_MAGIC*/
+    uint32_t seq;           /*!< incremented each time the state is written, the area with the higher value is used*/
+    uint32_t block_count;   /*!< number of physical blocks, one more than logical blocks*/
+    uint32_t map_crc;       /*!< CRC of the block map*/
+    uint32_t wear_crc;      /*!< CRC of the erase counts*/
+    uint32_t reserved[2];   /*!< Reserved space for future use*/
+    uint32_t crc;           /*!< CRC of structure*/
+} wl_dynamic_state_t;
+
+/**
+* @brief Log entry recording that a logical block was moved to another physical block
+*/
+typedef struct ALIGNED_(16) WL_Dynamic_Record_s {
+public:
+    uint32_t seq;           /*!< sequence number of the state, incremented for each entry*/
+    uint16_t logical;       /*!< logical block*/
+    uint16_t physical;      /*!< physical block which holds it from now on*/
+    uint32_t wear;          /*!< erase count of the physical block*/
+    uint32_t crc;           /*!< CRC of structure*/
+} wl_dynamic_record_t;
+
+#ifndef _MSC_VER // MSVS has different format for this define
+static_assert(sizeof(wl_dynamic_state_t) % 32 == 0, "Size of wl_dynamic_state_t structure should be compatible with flash encryption");
+static_assert(sizeof(wl_dynamic_record_t) == 16, "Size of wl_dynamic_record_t structure should be compatible with flash encryption");
+#endif // _MSC_VER
+
+#define WL_DYNAMIC_MAGIC 0x4c57594e
+
 #endif // _WL_State_H_
@@ -1,11 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <deque>
+#include <vector>
 
 #include "esp_spi_flash.h"
 #include "esp_partition.h"
 #include "wear_levelling.h"
 #include "WL_Flash.h"
+#include "WL_Ext_Perf.h"
+#include "Partition.h"
 #include "SpiFlash.h"
 
 #include "catch.hpp"
@@ -207,4 +211,623 @@ TEST_CASE("power down test", "[wear_levelling]")
     // Unmount
     result = wl_unmount(wl_handle);
     REQUIRE(result == ESP_OK);
-}
\ No newline at end of file
+}
+
+// Counts the operations which reach the partition below the WL layer
+class CountingPartition : public Partition
+{
+public:
+    CountingPartition(const esp_partition_t *partition) : Partition(partition) {}
+
+    esp_err_t erase_sector(size_t sector) override
+    {
+        erases++;
+        return Partition::erase_sector(sector);
+    }
+
+    esp_err_t erase_range(size_t start_address, size_t size) override
+    {
+        erases += size / sector_size();
+        return Partition::erase_range(start_address, size);
+    }
+
+    esp_err_t write(size_t dest_addr, const void *src, size_t size) override
+    {
+        bytes_written += size;
+        return Partition::write(dest_addr, src, size);
+    }
+
+    esp_err_t read(size_t src_addr, void *dest, size_t size) override
+    {
+        bytes_read += size;
+        return Partition::read(src_addr, dest, size);
+    }
+
+    void reset()
+    {
+        erases = 0;
+        bytes_written = 0;
+        bytes_read = 0;
+    }
+
+    // Flash time in microseconds, using the timing of a typical SPI flash chip
+    size_t flash_time()
+    {
+        return erases * 37142 + bytes_written * 1555 / 1000 + bytes_read * 112 / 1000;
+    }
+
+    size_t erases = 0;
+    size_t bytes_written = 0;
+    size_t bytes_read = 0;
+};
+
+// Same configuration as wl_mount uses
+static wl_ext_cfg_t default_config(Partition &part)
+{
+    wl_ext_cfg_t cfg = wl_ext_cfg_t();
+    cfg.full_mem_size = part.chip_size();
+    cfg.start_addr = 0;
+    cfg.version = 2;
+    cfg.sector_size = SPI_FLASH_SEC_SIZE;
+    cfg.page_size = SPI_FLASH_SEC_SIZE;
+    cfg.updaterate = 16;
+    cfg.temp_buff_size = 32;
+    cfg.wr_size = 16;
+    cfg.fat_sector_size = 512;
+    return cfg;
+}
+
+static esp_err_t perf_mount(WL_Ext_Perf &wl, Partition &part, uint32_t cache_sectors)
+{
+    wl_ext_cfg_t cfg = default_config(part);
+    cfg.cache_sectors = cache_sectors;
+    cfg.flush_timeout = 0;
+    esp_err_t result = wl.config(&cfg, &part);
+    if (result != ESP_OK) {
+        return result;
+    }
+    return wl.init();
+}
+
+// Write one FAT sector the way the FATFS disk driver does
+static esp_err_t fat_write(WL_Ext_Perf &wl, uint32_t sector, const uint8_t *data)
+{
+    esp_err_t result = wl.erase_range(sector * 512, 512);
+    if (result != ESP_OK) {
+        return result;
+    }
+    return wl.write(sector * 512, data, 512);
+}
+
+TEST_CASE("write-back cache of the performance mode keeps data and coalesces erases", "[wear_levelling]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+
+    CountingPartition part(partition);
+    WL_Ext_Perf *wl = new WL_Ext_Perf();
+    REQUIRE(perf_mount(*wl, part, 2) == ESP_OK);
+    REQUIRE(wl->sector_size() == 512);
+
+    // Expected contents of the first 64 FAT sectors
+    const uint32_t fat_sectors = 64;
+    uint8_t *expected = new uint8_t[fat_sectors * 512];
+    uint8_t *read = new uint8_t[fat_sectors * 512];
+    for (uint32_t i = 0; i < fat_sectors * 512; i++) {
+        expected[i] = i * 7;
+    }
+    REQUIRE(wl->erase_range(0, fat_sectors * 512) == ESP_OK);
+    REQUIRE(wl->write(0, expected, fat_sectors * 512) == ESP_OK);
+
+    // Rewriting all sectors of one flash sector erases it once
+    part.reset();
+    for (uint32_t i = 8; i < 16; i++) {
+        memset(&expected[i * 512], i, 512);
+        REQUIRE(fat_write(*wl, i, &expected[i * 512]) == ESP_OK);
+    }
+    CHECK(part.erases == 0);
+    REQUIRE(wl->read(0, read, fat_sectors * 512) == ESP_OK);
+    CHECK(memcmp(read, expected, fat_sectors * 512) == 0);
+    REQUIRE(wl->sync() == ESP_OK);
+    // one erase of the flash sector, and possibly one of the sector moved by wear levelling
+    CHECK(part.erases <= 2);
+
+    // Writes to more flash sectors than the cache holds evict the oldest ones
+    srand(42);
+    for (int n = 0; n < 200; n++) {
+        uint32_t i = rand() % fat_sectors;
+        memset(&expected[i * 512], rand(), 512);
+        expected[i * 512] = n;
+        REQUIRE(fat_write(*wl, i, &expected[i * 512]) == ESP_OK);
+    }
+    // An erase which covers the whole flash sector drops its cached copy
+    REQUIRE(wl->erase_range(32 * 512, 8 * 512) == ESP_OK);
+    memset(&expected[32 * 512], 0xff, 8 * 512);
+    REQUIRE(wl->read(0, read, fat_sectors * 512) == ESP_OK);
+    CHECK(memcmp(read, expected, fat_sectors * 512) == 0);
+
+    // Unmounting writes the cache back, the data is there when mounting without cache
+    REQUIRE(wl->flush() == ESP_OK);
+    delete wl;
+    wl = new WL_Ext_Perf();
+    REQUIRE(perf_mount(*wl, part, 0) == ESP_OK);
+    REQUIRE(wl->read(0, read, fat_sectors * 512) == ESP_OK);
+    CHECK(memcmp(read, expected, fat_sectors * 512) == 0);
+    delete wl;
+
+    delete[] expected;
+    delete[] read;
+}
+
+TEST_CASE("benchmark write-back cache of the performance mode", "[wear_levelling]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+
+    const uint32_t cache_sizes[] = {0, 1, 2, 4, 8};
+    const uint32_t sequential_sectors = 1024;
+    // Random writes to a 64 KB region, like updates of the FAT, a directory and a few files
+    const uint32_t random_sectors = 128;
+    const uint32_t random_writes = 1024;
+    uint8_t data[512];
+    size_t sequential_erases = 0;
+    size_t random_erases = 0;
+
+    printf("cache sectors | sequential: erases, KB/s | random: erases, KB/s\n");
+    for (uint32_t cache_sectors : cache_sizes) {
+        CountingPartition part(partition);
+        WL_Ext_Perf wl;
+        REQUIRE(perf_mount(wl, part, cache_sectors) == ESP_OK);
+
+        part.reset();
+        for (uint32_t i = 0; i < sequential_sectors; i++) {
+            memset(data, i, sizeof(data));
+            REQUIRE(fat_write(wl, i, data) == ESP_OK);
+        }
+        REQUIRE(wl.sync() == ESP_OK);
+        size_t seq_erases = part.erases;
+        size_t seq_time = part.flash_time();
+
+        part.reset();
+        srand(42);
+        for (uint32_t n = 0; n < random_writes; n++) {
+            memset(data, n, sizeof(data));
+            REQUIRE(fat_write(wl, rand() % random_sectors, data) == ESP_OK);
+        }
+        REQUIRE(wl.sync() == ESP_OK);
+        size_t rnd_erases = part.erases;
+        size_t rnd_time = part.flash_time();
+
+        printf("%13u | %18u, %4u | %14u, %4u\n", cache_sectors,
+               (unsigned) seq_erases, (unsigned) (sequential_sectors * 512 * 1000000ULL / 1024 / seq_time),
+               (unsigned) rnd_erases, (unsigned) (random_writes * 512 * 1000000ULL / 1024 / rnd_time));
+        if (cache_sectors == 0) {
+            sequential_erases = seq_erases;
+            random_erases = rnd_erases;
+        } else {
+            CHECK(seq_erases < sequential_erases / 4);
+            CHECK(rnd_erases < random_erases);
+        }
+        REQUIRE(wl.flush() == ESP_OK);
+    }
+}
+
+static esp_err_t flash_mount(WL_Flash &wl, Partition &part, bool dynamic, uint32_t updaterate)
+{
+    wl_ext_cfg_t cfg = default_config(part);
+    cfg.dynamic = dynamic;
+    cfg.updaterate = updaterate;
+    esp_err_t result = wl.config(&cfg, &part);
+    if (result != ESP_OK) {
+        return result;
+    }
+    return wl.init();
+}
+
+static void fill_sector(uint32_t *data, size_t words, uint32_t sector, uint32_t version)
+{
+    for (size_t i = 0; i < words; i++) {
+        data[i] = (sector << 20) ^ (version << 8) ^ i;
+    }
+}
+
+// Sector picked by a workload in which a few sectors, like the FAT and a directory, get half of the writes
+static uint32_t fat_workload_sector(uint32_t sectors)
+{
+    const uint32_t hot_sectors = 4;
+    if (rand() % 2) {
+        return rand() % hot_sectors;
+    }
+    return hot_sectors + rand() % (sectors - hot_sectors);
+}
+
+TEST_CASE("dynamic wear levelling keeps data across remounts and moves hot sectors", "[wear_levelling]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+
+    Partition part(partition);
+    WL_Flash *wl = new WL_Flash();
+    REQUIRE(flash_mount(*wl, part, true, 16) == ESP_OK);
+    const size_t sector_size = wl->sector_size();
+    const uint32_t sectors = wl->chip_size() / sector_size;
+    const size_t words = sector_size / sizeof(uint32_t);
+    uint32_t *versions = new uint32_t[sectors]();
+    uint32_t *data = new uint32_t[words];
+    uint32_t *expected = new uint32_t[words];
+
+    for (uint32_t i = 0; i < sectors; i++) {
+        fill_sector(data, words, i, 0);
+        REQUIRE(wl->erase_sector(i) == ESP_OK);
+        REQUIRE(wl->write(i * sector_size, data, sector_size) == ESP_OK);
+    }
+
+    srand(42);
+    for (int round = 0; round < 4; round++) {
+        // Enough moves to wrap the log of the state area several times
+        for (int n = 0; n < 5000; n++) {
+            uint32_t sector = fat_workload_sector(sectors);
+            versions[sector]++;
+            fill_sector(data, words, sector, versions[sector]);
+            REQUIRE(wl->erase_sector(sector) == ESP_OK);
+            REQUIRE(wl->write(sector * sector_size, data, sector_size) == ESP_OK);
+        }
+        // Every other round without flush, as if power was lost
+        if (round % 2 == 0) {
+            REQUIRE(wl->flush() == ESP_OK);
+        }
+        delete wl;
+        wl = new WL_Flash();
+        REQUIRE(flash_mount(*wl, part, true, 16) == ESP_OK);
+        for (uint32_t i = 0; i < sectors; i++) {
+            fill_sector(expected, words, i, versions[i]);
+            REQUIRE(wl->read(i * sector_size, data, sector_size) == ESP_OK);
+            REQUIRE(memcmp(data, expected, sector_size) == 0);
+        }
+    }
+    delete wl;
+    delete[] versions;
+    delete[] data;
+    delete[] expected;
+}
+
+TEST_CASE("dynamic wear levelling recovers from power loss", "[wear_levelling]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+
+    Partition part(partition);
+    WL_Flash *wl = new WL_Flash();
+    REQUIRE(flash_mount(*wl, part, true, 4) == ESP_OK);
+    const size_t sector_size = wl->sector_size();
+    const uint32_t sectors = wl->chip_size() / sector_size;
+    const size_t words = sector_size / sizeof(uint32_t);
+    uint32_t *versions = new uint32_t[sectors]();
+    uint32_t *data = new uint32_t[words];
+    uint32_t *expected = new uint32_t[words];
+
+    for (uint32_t i = 0; i < sectors; i++) {
+        fill_sector(data, words, i, 0);
+        REQUIRE(wl->erase_sector(i) == ESP_OK);
+        REQUIRE(wl->write(i * sector_size, data, sector_size) == ESP_OK);
+    }
+
+    srand(42);
+    for (int k = 0; k < TEST_COUNT_MAX; k++) {
+        // Fail a flash operation at a random point of the workload
+        spiflash.reset_total_erase_cycles();
+        spiflash.set_total_erase_cycles_limit(1 + rand() % 200);
+        uint32_t err_sector = UINT32_MAX;
+        for (int n = 0; n < 1000; n++) {
+            uint32_t sector = fat_workload_sector(sectors);
+            fill_sector(data, words, sector, versions[sector] + 1);
+            if ((wl->erase_sector(sector) != ESP_OK) || (wl->write(sector * sector_size, data, sector_size) != ESP_OK)) {
+                err_sector = sector;
+                break;
+            }
+            versions[sector]++;
+        }
+        spiflash.set_total_erase_cycles_limit(0);
+
+        delete wl;
+        wl = new WL_Flash();
+        REQUIRE(flash_mount(*wl, part, true, 4) == ESP_OK);
+        for (uint32_t i = 0; i < sectors; i++) {
+            if (i == err_sector) {
+                continue;
+            }
+            fill_sector(expected, words, i, versions[i]);
+            REQUIRE(wl->read(i * sector_size, data, sector_size) == ESP_OK);
+            REQUIRE(memcmp(data, expected, sector_size) == 0);
+        }
+        if (err_sector != UINT32_MAX) {
+            fill_sector(data, words, err_sector, versions[err_sector]);
+            REQUIRE(wl->erase_sector(err_sector) == ESP_OK);
+            REQUIRE(wl->write(err_sector * sector_size, data, sector_size) == ESP_OK);
+        }
+    }
+    spiflash.reset_total_erase_cycles();
+    delete wl;
+    delete[] versions;
+    delete[] data;
+    delete[] expected;
+}
+
+TEST_CASE("partition formatted in one wear levelling mode is not mounted in the other one", "[wear_levelling]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+
+    Partition part(partition);
+    for (int dynamic = 0; dynamic < 2; dynamic++) {
+        REQUIRE(part.erase_range(0, part.chip_size()) == ESP_OK);
+        WL_Flash *wl = new WL_Flash();
+        REQUIRE(flash_mount(*wl, part, dynamic, 4) == ESP_OK);
+        const size_t sector_size = wl->sector_size();
+        const uint32_t sectors = wl->chip_size() / sector_size;
+        const size_t words = sector_size / sizeof(uint32_t);
+        uint32_t *data = new uint32_t[words];
+        uint32_t *expected = new uint32_t[words];
+        // Enough writes to move the data away from where the other mode would look for it
+        for (uint32_t n = 0; n < sectors * 8; n++) {
+            uint32_t sector = n % sectors;
+            fill_sector(data, words, sector, n / sectors);
+            REQUIRE(wl->erase_sector(sector) == ESP_OK);
+            REQUIRE(wl->write(sector * sector_size, data, sector_size) == ESP_OK);
+        }
+        REQUIRE(wl->flush() == ESP_OK);
+        delete wl;
+
+        wl = new WL_Flash();
+        CHECK(flash_mount(*wl, part, !dynamic, 4) == ESP_ERR_INVALID_STATE);
+        delete wl;
+
+        wl = new WL_Flash();
+        REQUIRE(flash_mount(*wl, part, dynamic, 4) == ESP_OK);
+        for (uint32_t i = 0; i < sectors; i++) {
+            fill_sector(expected, words, i, 7);
+            REQUIRE(wl->read(i * sector_size, data, sector_size) == ESP_OK);
+            REQUIRE(memcmp(data, expected, sector_size) == 0);
+        }
+        delete wl;
+        delete[] data;
+        delete[] expected;
+    }
+}
+
+TEST_CASE("benchmark dynamic wear levelling", "[wear_levelling]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    const uint32_t first_sector = partition->address / SPI_FLASH_SEC_SIZE;
+    const uint32_t partition_sectors = partition->size / SPI_FLASH_SEC_SIZE;
+    const int writes = 50000;
+
+    struct {
+        const char *name;
+        bool dynamic;
+        uint32_t updaterate;
+    } modes[] = {
+        {"rotating dummy sector, update rate 16", false, 16},
+        {"dynamic, wear gap 16", true, 16},
+        {"dynamic, wear gap 64", true, 64},
+    };
+    uint32_t data[SPI_FLASH_SEC_SIZE / sizeof(uint32_t)];
+    memset(data, 0x5a, sizeof(data));
+    size_t static_total = 0;
+    size_t static_max = 0;
+
+    printf("%-40s | %12s | %10s | %10s\n", "mode", "total erases", "max/sector", "mean");
+    for (auto &mode : modes) {
+        // Start every mode from an erased partition
+        REQUIRE(esp_partition_erase_range(partition, 0, partition->size) == ESP_OK);
+        Partition part(partition);
+        WL_Flash wl;
+        REQUIRE(flash_mount(wl, part, mode.dynamic, mode.updaterate) == ESP_OK);
+        const uint32_t sectors = wl.chip_size() / wl.sector_size();
+
+        spiflash.reset_erase_cycles();
+        spiflash.reset_total_erase_cycles();
+        srand(42);
+        for (int n = 0; n < writes; n++) {
+            uint32_t sector = fat_workload_sector(sectors);
+            REQUIRE(wl.erase_sector(sector) == ESP_OK);
+            REQUIRE(wl.write(sector * SPI_FLASH_SEC_SIZE, data, sizeof(data)) == ESP_OK);
+        }
+        REQUIRE(wl.flush() == ESP_OK);
+
+        size_t total = spiflash.get_total_erase_cycles();
+        size_t max = 0;
+        for (uint32_t i = 0; i < partition_sectors; i++) {
+            size_t cycles = spiflash.get_erase_cycles(first_sector + i);
+            max = cycles > max ? cycles : max;
+        }
+        printf("%-40s | %12u | %10u | %10.1f\n", mode.name, (unsigned) total, (unsigned) max, (double) total / partition_sectors);
+        if (!mode.dynamic) {
+            static_total = total;
+            static_max = max;
+        } else {
+            CHECK(total < static_total);
+            CHECK(max < static_max);
+        }
+    }
+    spiflash.reset_erase_cycles();
+    spiflash.reset_total_erase_cycles();
+}
+
+TEST_CASE("trimmed sectors are not copied when wear levelling moves data", "[wear_levelling]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+
+    for (int dynamic = 0; dynamic < 2; dynamic++) {
+        size_t bytes_written[2];
+        size_t erases[2];
+        for (int trim = 0; trim < 2; trim++) {
+            REQUIRE(esp_partition_erase_range(partition, 0, partition->size) == ESP_OK);
+            CountingPartition part(partition);
+            WL_Flash wl;
+            REQUIRE(flash_mount(wl, part, dynamic, 16) == ESP_OK);
+            const size_t sector_size = wl.sector_size();
+            const uint32_t sectors = wl.chip_size() / sector_size;
+            const size_t words = sector_size / sizeof(uint32_t);
+            uint32_t *versions = new uint32_t[sectors]();
+            uint32_t *data = new uint32_t[words];
+            uint32_t *expected = new uint32_t[words];
+
+            for (uint32_t i = 0; i < sectors; i++) {
+                fill_sector(data, words, i, 0);
+                REQUIRE(wl.erase_sector(i) == ESP_OK);
+                REQUIRE(wl.write(i * sector_size, data, sector_size) == ESP_OK);
+            }
+            // Odd sectors hold no data any more
+            if (trim) {
+                CHECK(wl.trim(0, wl.chip_size() + sector_size) == ESP_ERR_INVALID_SIZE);
+                for (uint32_t i = 1; i < sectors; i += 2) {
+                    REQUIRE(wl.trim(i * sector_size, sector_size) == ESP_OK);
+                }
+            }
+            part.reset();
+            srand(42);
+            for (int n = 0; n < 2000; n++) {
+                uint32_t sector = (rand() % (sectors / 2)) * 2;
+                versions[sector]++;
+                fill_sector(data, words, sector, versions[sector]);
+                REQUIRE(wl.erase_sector(sector) == ESP_OK);
+                REQUIRE(wl.write(sector * sector_size, data, sector_size) == ESP_OK);
+            }
+            bytes_written[trim] = part.bytes_written;
+            erases[trim] = part.erases;
+
+            for (uint32_t i = 0; i < sectors; i += 2) {
+                fill_sector(expected, words, i, versions[i]);
+                REQUIRE(wl.read(i * sector_size, data, sector_size) == ESP_OK);
+                REQUIRE(memcmp(data, expected, sector_size) == 0);
+            }
+            // A trimmed sector keeps data written to it again
+            fill_sector(data, words, 1, 1);
+            REQUIRE(wl.erase_sector(1) == ESP_OK);
+            REQUIRE(wl.write(sector_size, data, sector_size) == ESP_OK);
+            fill_sector(expected, words, 1, 1);
+            REQUIRE(wl.read(sector_size, data, sector_size) == ESP_OK);
+            CHECK(memcmp(data, expected, sector_size) == 0);
+
+            delete[] versions;
+            delete[] data;
+            delete[] expected;
+        }
+        CHECK(bytes_written[1] < bytes_written[0]);
+        CHECK(erases[1] <= erases[0]);
+    }
+}
+
+TEST_CASE("trimmed flash sectors in the performance mode keep the data written afterwards", "[wear_levelling]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+
+    for (uint32_t cache_sectors = 0; cache_sectors <= 2; cache_sectors += 2) {
+        CountingPartition part(partition);
+        WL_Ext_Perf wl;
+        REQUIRE(perf_mount(wl, part, cache_sectors) == ESP_OK);
+        uint8_t data[512];
+        uint8_t read[512];
+        for (uint32_t sector = 0; sector < 24; sector++) {
+            memset(data, sector, sizeof(data));
+            REQUIRE(fat_write(wl, sector, data) == ESP_OK);
+        }
+        // Trim the second flash sector and a part of the third one, which is kept
+        REQUIRE(wl.trim(8 * 512, 12 * 512) == ESP_OK);
+        part.reset();
+        memset(data, 0xa5, sizeof(data));
+        REQUIRE(fat_write(wl, 9, data) == ESP_OK);
+        REQUIRE(wl.sync() == ESP_OK);
+        // Nothing had to be read back from the trimmed flash sector
+        CHECK(part.bytes_read == 0);
+
+        REQUIRE(wl.read(9 * 512, read, sizeof(read)) == ESP_OK);
+        CHECK(memcmp(read, data, sizeof(data)) == 0);
+        for (uint32_t sector = 0; sector < 24; sector++) {
+            if (sector >= 8 && sector < 16) {
+                continue;
+            }
+            memset(data, sector, sizeof(data));
+            REQUIRE(wl.read(sector * 512, read, sizeof(read)) == ESP_OK);
+            CHECK(memcmp(read, data, sizeof(data)) == 0);
+        }
+        REQUIRE(wl.flush() == ESP_OK);
+    }
+}
+
+// Write log files of a few sectors each to the free sectors following the last file, and delete the oldest
+// file once the given share of the partition is in use. Deleted files are trimmed if requested.
+static void log_rotation(WL_Flash &wl, bool trim, int files, uint32_t percent_used)
+{
+    const size_t sector_size = wl.sector_size();
+    const uint32_t sectors = wl.chip_size() / sector_size;
+    const uint32_t file_sectors = 8;
+    const size_t kept = sectors * percent_used / 100 / file_sectors;
+    std::vector<bool> used(sectors);
+    std::deque<std::vector<uint32_t> > logs;
+    std::vector<uint8_t> data(sector_size, 0x5a);
+    uint32_t next = 0;
+
+    for (int f = 0; f < files; f++) {
+        std::vector<uint32_t> log;
+        for (uint32_t i = 0; i < file_sectors; i++) {
+            while (used[next]) {
+                next = (next + 1) % sectors;
+            }
+            used[next] = true;
+            log.push_back(next);
+            REQUIRE(wl.erase_sector(next) == ESP_OK);
+            REQUIRE(wl.write(next * sector_size, data.data(), sector_size) == ESP_OK);
+        }
+        logs.push_back(log);
+        if (logs.size() > kept) {
+            for (uint32_t sector : logs.front()) {
+                used[sector] = false;
+                if (trim) {
+                    REQUIRE(wl.trim(sector * sector_size, sector_size) == ESP_OK);
+                }
+            }
+            logs.pop_front();
+        }
+    }
+}
+
+TEST_CASE("benchmark trim with log rotation", "[wear_levelling]")
+{
+    _spi_flash_init(CONFIG_ESPTOOLPY_FLASHSIZE, CONFIG_WL_SECTOR_SIZE * 16, CONFIG_WL_SECTOR_SIZE, CONFIG_WL_SECTOR_SIZE, "partition_table.bin");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    const int files = 2000;
+
+    printf("%-32s | %10s | %14s | %12s\n", "mode", "erases", "bytes written", "flash time");
+    for (int dynamic = 0; dynamic < 2; dynamic++) {
+        for (uint32_t percent_used = 25; percent_used <= 75; percent_used += 50) {
+            size_t erases[2];
+            for (int trim = 0; trim < 2; trim++) {
+                REQUIRE(esp_partition_erase_range(partition, 0, partition->size) == ESP_OK);
+                CountingPartition part(partition);
+                WL_Flash wl;
+                REQUIRE(flash_mount(wl, part, dynamic, 16) == ESP_OK);
+                part.reset();
+                log_rotation(wl, trim, files, percent_used);
+                REQUIRE(wl.flush() == ESP_OK);
+                erases[trim] = part.erases;
+
+                char name[64];
+                snprintf(name, sizeof(name), "%s, %u%% used, %s", dynamic ? "dynamic" : "static", (unsigned) percent_used,
+                         trim ? "trim" : "no trim");
+                printf("%-32s | %10u | %14u | %10.1f s\n", name, (unsigned) part.erases, (unsigned) part.bytes_written,
+                       part.flash_time() / 1000000.0);
+            }
+            if (dynamic) {
+                // Writes spread evenly over the partition never make dynamic wear levelling copy data
+                CHECK(erases[1] <= erases[0]);
+            } else {
+                CHECK(erases[1] < erases[0]);
+            }
+        }
+    }
+}
@@ -48,6 +48,25 @@
 #define WL_CURRENT_VERSION  2
 #endif //WL_CURRENT_VERSION
 
+#ifndef WL_DEFAULT_DYNAMIC
+#if CONFIG_WL_DYNAMIC
+#define WL_DEFAULT_DYNAMIC  1
+#else
+#define WL_DEFAULT_DYNAMIC  0
+#endif
+#endif //WL_DEFAULT_DYNAMIC
+
+// Only the performance mode keeps modified sectors in RAM
+#ifndef WL_DEFAULT_CACHE_SECTORS
+#if CONFIG_WL_SECTOR_SIZE == 512 && CONFIG_WL_SECTOR_MODE == 0
+#define WL_DEFAULT_CACHE_SECTORS    CONFIG_WL_PERF_CACHE_SECTORS
+#define WL_DEFAULT_FLUSH_TIMEOUT    CONFIG_WL_PERF_CACHE_FLUSH_TIMEOUT
+#else
+#define WL_DEFAULT_CACHE_SECTORS    0
+#define WL_DEFAULT_FLUSH_TIMEOUT    0
+#endif
+#endif //WL_DEFAULT_CACHE_SECTORS
+
 typedef struct {
     WL_Flash *instance;
     _lock_t lock;
@@ -83,11 +102,19 @@ esp_err_t wl_mount(const esp_partition_t *partition, wl_handle_t *out_handle)
     cfg.version = WL_CURRENT_VERSION;
     cfg.sector_size = SPI_FLASH_SEC_SIZE;
     cfg.page_size = SPI_FLASH_SEC_SIZE;
+#if WL_DEFAULT_DYNAMIC
+    // In dynamic mode, the difference of erase counts at which a frequently erased sector is moved
+    cfg.updaterate = CONFIG_WL_DYNAMIC_WEAR_GAP;
+#else
     cfg.updaterate = WL_DEFAULT_UPDATERATE;
+#endif
     cfg.temp_buff_size = WL_DEFAULT_TEMP_BUFF_SIZE;
     cfg.wr_size = WL_DEFAULT_WRITE_SIZE;
     // FAT sector size by default will be 512
     cfg.fat_sector_size = CONFIG_WL_SECTOR_SIZE;
+    cfg.dynamic = WL_DEFAULT_DYNAMIC;
+    cfg.cache_sectors = WL_DEFAULT_CACHE_SECTORS;
+    cfg.flush_timeout = WL_DEFAULT_FLUSH_TIMEOUT;
 
     if (*out_handle == WL_INVALID_HANDLE) {
         ESP_LOGE(TAG, "MAX_WL_HANDLES=%d instances already allocated", MAX_WL_HANDLES);
@@ -189,6 +216,30 @@ esp_err_t wl_unmount(wl_handle_t handle)
     return result;
 }
 
+esp_err_t wl_sync(wl_handle_t handle)
+{
+    esp_err_t result = check_handle(handle, __func__);
+    if (result != ESP_OK) {
+        return result;
+    }
+    _lock_acquire(&s_instances[handle].lock);
+    result = s_instances[handle].instance->sync();
+    _lock_release(&s_instances[handle].lock);
+    return result;
+}
+
+esp_err_t wl_trim(wl_handle_t handle, size_t start_addr, size_t size)
+{
+    esp_err_t result = check_handle(handle, __func__);
+    if (result != ESP_OK) {
+        return result;
+    }
+    _lock_acquire(&s_instances[handle].lock);
+    result = s_instances[handle].instance->trim(start_addr, size);
+    _lock_release(&s_instances[handle].lock);
+    return result;
+}
+
 esp_err_t wl_erase_range(wl_handle_t handle, size_t start_addr, size_t size)
 {
     esp_err_t result = check_handle(handle, __func__);